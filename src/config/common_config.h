@@ -20,5 +20,6 @@
 #define _COMMON_CONFIG_HEADER_
 
 #define CONFIG_VALUE_STRING_LENGHT 16
+#define CONFIG_MAX_ZONE_BOUNDS 7 /* lower bounds of the zones above the first one */
 
 #endif //_COMMON_CONFIG_HEADER_
@@ -20,10 +20,28 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "system.h"
 #include "log.h"
+#include "io_policy.h"
 #include "libconfig_helper.h"
 
+/* The whole file is written again for one setting, synced with the ride log while recording */
+static void _account_write(const char *file)
+{
+	struct stat st;
+
+	if(stat(file, &st) == 0)
+	{
+		io_policy_account(E_IO_POLICY_CONFIG, st.st_size, st.st_size, 0);
+	}
+
+	if(io_policy_sync(E_IO_POLICY_CONFIG, file) < 0)
+	{
+		log_error("io_policy_sync %s failed\n", file);
+	}
+}
+
 int libconfig_helper_get_int(const char *file, const char *conf, int *value)
 {
 	fail_if_null(file, -1, "file is null\n");
@@ -90,6 +108,49 @@ int libconfig_helper_get_string(const char *file, const char *conf, char *buff,
 	return 0;
 }
 
+int libconfig_helper_get_int_array(const char *file, const char *conf, int *values, int size)
+{
+	fail_if_null(file, -1, "file is null\n");
+	fail_if_null(conf, -2, "conf is null\n");
+	fail_if_null(values, -3, "values is null\n");
+	fail_if_negative_or_zero(size, -4, "size is not valid\n");
+
+	int length = 0;
+	config_t cfg;
+	config_init(&cfg);
+
+	/* Read the file. If there is an error, report it and exit. */
+	if(!config_read_file(&cfg, file))
+	{
+		config_destroy(&cfg);
+		fail(-5, "read configuration file %s fail\n", file);
+	}
+
+	config_setting_t *setting = config_lookup(&cfg, conf);
+	if(setting == NULL || !config_setting_is_array(setting))
+	{
+		config_destroy(&cfg);
+		fail(-6, "array %s not found in configuration file %s\n", conf, file);
+	}
+
+	length = config_setting_length(setting);
+	if(length > size)
+	{
+		config_destroy(&cfg);
+		fail(-7, "array %s has %d elements, %d maximum\n", conf, length, size);
+	}
+
+	for(int i = 0; i < length; i++)
+	{
+		values[i] = config_setting_get_int_elem(setting, i);
+	}
+
+	/* Cleanup before exiting*/
+	config_destroy(&cfg);
+
+	return length;
+}
+
 int libconfig_helper_set_int(const char *file, const char *conf, const int value)
 {
 	fail_if_null(file, -1, "file is null\n");
@@ -128,6 +189,8 @@ int libconfig_helper_set_int(const char *file, const char *conf, const int value
 		fail(-6, "write file failed\n");
 	}
 
+	_account_write(file);
+
 	/* Cleanup before exiting*/
 	return 0;
 }
@@ -171,6 +234,8 @@ int libconfig_helper_set_string(const char *file, const char *conf, const char *
 		fail(-7, "write file failed\n");
 	}
 
+	_account_write(file);
+
 	/* Cleanup before exiting*/
 	return 0;
 }
@@ -21,6 +21,8 @@
 
 int libconfig_helper_get_int(const char *file, const char *conf, int *value);
 int libconfig_helper_get_string(const char *file, const char *conf, char *buff, int size);
+/* Read an array of integers, return the number of elements read */
+int libconfig_helper_get_int_array(const char *file, const char *conf, int *values, int size);
 
 int libconfig_helper_set_int(const char *file, const char *conf, const int value);
 int libconfig_helper_set_string(const char *file, const char *conf, const char *value);
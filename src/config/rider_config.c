@@ -30,6 +30,10 @@ static struct {
 	int age;
 	int weight;
 	int height;
+	int hr_zones[CONFIG_MAX_ZONE_BOUNDS]; /* bpm */
+	int nb_hr_zones;
+	int power_zones[CONFIG_MAX_ZONE_BOUNDS]; /* W */
+	int nb_power_zones;
 } rider_conf = {
 	.is_initialized = false,
 };
@@ -50,6 +54,12 @@ int rider_config_init(void)
 	fail_if_negative(ret, -5, "getting rider age conf failed\n");
 	ret = libconfig_helper_get_int(RIDER_CONF_FILE_PATH, "height", &rider_conf.height);
 	fail_if_negative(ret, -6, "getting rider height conf failed\n");
+	ret = libconfig_helper_get_int_array(RIDER_CONF_FILE_PATH, "hr_zones", rider_conf.hr_zones, CONFIG_MAX_ZONE_BOUNDS);
+	fail_if_negative(ret, -7, "getting rider hr_zones conf failed\n");
+	rider_conf.nb_hr_zones = ret;
+	ret = libconfig_helper_get_int_array(RIDER_CONF_FILE_PATH, "power_zones", rider_conf.power_zones, CONFIG_MAX_ZONE_BOUNDS);
+	fail_if_negative(ret, -8, "getting rider power_zones conf failed\n");
+	rider_conf.nb_power_zones = ret;
 
 	rider_conf.is_initialized = true;
 	return 0;
@@ -110,6 +120,30 @@ int rider_config_get_height(void)
 	return rider_conf.height;
 }
 
+static int _get_zones(const int *zones, int nb_zones, int *bounds, int size)
+{
+	fail_if_null(bounds, -2, "bounds is null\n");
+	fail_if_inferior(size, nb_zones, -3, "size %d is too small for %d zones\n", size, nb_zones);
+
+	memcpy(bounds, zones, nb_zones * sizeof(int));
+
+	return nb_zones;
+}
+
+int rider_config_get_hr_zones(int *bounds, int size)
+{
+	fail_if_false(rider_conf.is_initialized, -1, "rider_conf is not initialized\n");
+
+	return _get_zones(rider_conf.hr_zones, rider_conf.nb_hr_zones, bounds, size);
+}
+
+int rider_config_get_power_zones(int *bounds, int size)
+{
+	fail_if_false(rider_conf.is_initialized, -1, "rider_conf is not initialized\n");
+
+	return _get_zones(rider_conf.power_zones, rider_conf.nb_power_zones, bounds, size);
+}
+
 int rider_config_set_name(const char *name)
 {
 	fail_if_false(rider_conf.is_initialized, -1, "rider_conf is not initialized\n");
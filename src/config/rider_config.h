@@ -26,6 +26,9 @@ int rider_config_get_first_name(char *buff, int size);
 int rider_config_get_age(void);
 int rider_config_get_weight(void);
 int rider_config_get_height(void);
+/* Copy the zone lower bounds in increasing order, return the number of bounds */
+int rider_config_get_hr_zones(int *bounds, int size);
+int rider_config_get_power_zones(int *bounds, int size);
 
 int rider_config_set_name(const char *name);
 int rider_config_set_first_name(const char *first_name);
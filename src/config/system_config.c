@@ -30,6 +30,10 @@ static struct {
 	int enable_ant;
 	int enable_bluetooth;
 	int enable_wifi;
+	int sample_period; //ms
+	int ride_flush_period; //ms
+	int ride_direct_io;
+	int ride_write_size; //bytes
 } system_conf = {
 	.is_initialized = false,
 };
@@ -50,6 +54,14 @@ int system_config_init(void)
 	fail_if_negative(ret, -4, "getting system enable_bluetooth conf failed\n");
 	ret = libconfig_helper_get_int(SYSTEM_CONF_FILE_PATH, "enable_wifi", &system_conf.enable_wifi);
 	fail_if_negative(ret, -5, "getting system enable_wifi conf failed\n");
+	ret = libconfig_helper_get_int(SYSTEM_CONF_FILE_PATH, "sample_period", &system_conf.sample_period);
+	fail_if_negative(ret, -6, "getting system sample_period conf failed\n");
+	ret = libconfig_helper_get_int(SYSTEM_CONF_FILE_PATH, "ride_flush_period", &system_conf.ride_flush_period);
+	fail_if_negative(ret, -7, "getting system ride_flush_period conf failed\n");
+	ret = libconfig_helper_get_int(SYSTEM_CONF_FILE_PATH, "ride_direct_io", &system_conf.ride_direct_io);
+	fail_if_negative(ret, -8, "getting system ride_direct_io conf failed\n");
+	ret = libconfig_helper_get_int(SYSTEM_CONF_FILE_PATH, "ride_write_size", &system_conf.ride_write_size);
+	fail_if_negative(ret, -9, "getting system ride_write_size conf failed\n");
 
 	system_conf.is_initialized = true;
 	return 0;
@@ -99,3 +111,31 @@ int system_config_get_enable_wifi(void)
 
 	return system_conf.enable_wifi;
 }
+
+int system_config_get_sample_period(void)
+{
+	fail_if_false(system_conf.is_initialized, -1, "system_conf is not initialized\n");
+
+	return system_conf.sample_period;
+}
+
+int system_config_get_ride_flush_period(void)
+{
+	fail_if_false(system_conf.is_initialized, -1, "system_conf is not initialized\n");
+
+	return system_conf.ride_flush_period;
+}
+
+int system_config_get_ride_direct_io(void)
+{
+	fail_if_false(system_conf.is_initialized, -1, "system_conf is not initialized\n");
+
+	return system_conf.ride_direct_io;
+}
+
+int system_config_get_ride_write_size(void)
+{
+	fail_if_false(system_conf.is_initialized, -1, "system_conf is not initialized\n");
+
+	return system_conf.ride_write_size;
+}
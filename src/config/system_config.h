@@ -25,5 +25,9 @@ int system_config_get_enable_gps(void);
 int system_config_get_enable_ant(void);
 int system_config_get_enable_bluetooth(void);
 int system_config_get_enable_wifi(void);
+int system_config_get_sample_period(void);
+int system_config_get_ride_flush_period(void);
+int system_config_get_ride_direct_io(void);
+int system_config_get_ride_write_size(void);
 
 #endif //_SYSTEM_CONFIG_
@@ -30,6 +30,11 @@ static struct {
 	int ant_on;
 	int bluetooth_on;
 	int wifi_on;
+	int auto_pause_on;
+	int auto_pause_speed; /* mm/s */
+	int auto_pause_cadence; /* rpm */
+	int auto_pause_delay; /* ms */
+	int auto_resume_delay; /* ms */
 } user_conf = {
 	.is_initialized = false,
 };
@@ -50,6 +55,16 @@ int user_config_init(void)
 	fail_if_negative(ret, -5, "getting user bluetooth_on conf failed\n");
 	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "wifi_on", &user_conf.wifi_on);
 	fail_if_negative(ret, -6, "getting user wifi_on conf failed\n");
+	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "auto_pause_on", &user_conf.auto_pause_on);
+	fail_if_negative(ret, -7, "getting user auto_pause_on conf failed\n");
+	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "auto_pause_speed", &user_conf.auto_pause_speed);
+	fail_if_negative(ret, -8, "getting user auto_pause_speed conf failed\n");
+	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "auto_pause_cadence", &user_conf.auto_pause_cadence);
+	fail_if_negative(ret, -9, "getting user auto_pause_cadence conf failed\n");
+	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "auto_pause_delay", &user_conf.auto_pause_delay);
+	fail_if_negative(ret, -10, "getting user auto_pause_delay conf failed\n");
+	ret = libconfig_helper_get_int(USER_CONF_FILE_PATH, "auto_resume_delay", &user_conf.auto_resume_delay);
+	fail_if_negative(ret, -11, "getting user auto_resume_delay conf failed\n");
 
 	user_conf.is_initialized = true;
 	return 0;
@@ -90,6 +105,41 @@ int user_config_get_wifi_on(void)
 	return user_conf.wifi_on;
 }
 
+int user_config_get_auto_pause_on(void)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	return user_conf.auto_pause_on;
+}
+
+int user_config_get_auto_pause_speed(void)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	return user_conf.auto_pause_speed;
+}
+
+int user_config_get_auto_pause_cadence(void)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	return user_conf.auto_pause_cadence;
+}
+
+int user_config_get_auto_pause_delay(void)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	return user_conf.auto_pause_delay;
+}
+
+int user_config_get_auto_resume_delay(void)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	return user_conf.auto_resume_delay;
+}
+
 int user_config_set_brightness(const int value)
 {
 	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
@@ -159,3 +209,17 @@ int user_config_set_wifi_on(const int value)
 
 	return 0;
 }
+
+int user_config_set_auto_pause_on(const int value)
+{
+	fail_if_false(user_conf.is_initialized, -1, "user_conf is not initialized\n");
+
+	int ret = 0;
+
+	ret = libconfig_helper_set_int(USER_CONF_FILE_PATH, "auto_pause_on", value);
+	fail_if_negative(ret, -2, "set auto_pause_on failed, return: %d\n", ret);
+
+	user_conf.auto_pause_on = value;
+
+	return 0;
+}
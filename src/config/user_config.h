@@ -26,11 +26,17 @@ int user_config_get_gps_on(void);
 int user_config_get_ant_on(void);
 int user_config_get_bluetooth_on(void);
 int user_config_get_wifi_on(void);
+int user_config_get_auto_pause_on(void);
+int user_config_get_auto_pause_speed(void);
+int user_config_get_auto_pause_cadence(void);
+int user_config_get_auto_pause_delay(void);
+int user_config_get_auto_resume_delay(void);
 
 int user_config_set_brightness(const int value);
 int user_config_set_gps_on(const int value);
 int user_config_set_ant_on(const int value);
 int user_config_set_bluetooth_on(const int value);
 int user_config_set_wifi_on(const int value);
+int user_config_set_auto_pause_on(const int value);
 
 #endif //_USER_HEADER_
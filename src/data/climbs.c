@@ -0,0 +1,383 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "climbs.h"
+
+typedef struct {
+	int32_t distance; /* cm */
+	int32_t altitude; /* cm, smoothed */
+	int32_t time; /* ms, moving time */
+} T_climb_point;
+
+static struct {
+	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the climbs, read by the ui */
+	bool has_altitude;
+	int64_t timestamp; /* ms, last tick of the filter */
+	int64_t altitude; /* 0.001 cm, smoothed, the extra precision keeps the small steps */
+	T_climb_point window[CLIMBS_WINDOW_DEPTH]; /* ring of points spaced by CLIMBS_STEP */
+	int first;
+	int count;
+	bool is_climbing;
+	T_climb_point start;
+	T_climb_point top;
+	int32_t number; /* climbs started since the start of the ride */
+	T_climb current;
+	int nb_climbs;
+	T_climb climb[CLIMBS_MAX_CLIMBS];
+} climbs = {
+	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void _window_push(const T_climb_point *point)
+{
+	int index = (climbs.first + climbs.count) % CLIMBS_WINDOW_DEPTH;
+
+	if(climbs.count == CLIMBS_WINDOW_DEPTH)
+	{
+		climbs.first = (climbs.first + 1) % CLIMBS_WINDOW_DEPTH;
+		climbs.count--;
+	}
+
+	climbs.window[index] = *point;
+	climbs.count++;
+}
+
+static inline const T_climb_point * _window_get(int n)
+{
+	return &climbs.window[(climbs.first + n) % CLIMBS_WINDOW_DEPTH];
+}
+
+/* Grade in 0.1 % between two points, 0 when they are at the same distance */
+static inline int32_t _grade(const T_climb_point *from, const T_climb_point *to)
+{
+	int32_t distance = to->distance - from->distance;
+
+	return (distance > 0) ? (int32_t)fixed_point_mul_div(to->altitude - from->altitude, 1000, distance) : 0;
+}
+
+static void _set_stats(T_climb *climb, const T_climb_point *start, const T_climb_point *end)
+{
+	climb->start_distance = start->distance;
+	climb->start_altitude = start->altitude;
+	climb->start_time = start->time;
+	climb->distance = end->distance - start->distance;
+	climb->gain = end->altitude - start->altitude;
+	climb->duration = end->time - start->time;
+	climb->grade = _grade(start, end);
+	/* cm per ms to m/h */
+	climb->vam = (climb->duration > 0) ? (int32_t)fixed_point_mul_div(climb->gain, 36000, climb->duration) : 0;
+}
+
+/* Lowest point of the window from which the point is reached at the climb grade, NULL if none */
+static const T_climb_point * _find_start(const T_climb_point *point)
+{
+	const T_climb_point *start = NULL;
+
+	for(int n = 0; n < climbs.count; n++)
+	{
+		const T_climb_point *candidate = _window_get(n);
+
+		if(point->altitude - candidate->altitude >= CLIMBS_START_GAIN
+		&& _grade(candidate, point) >= CLIMBS_MIN_GRADE
+		&& (start == NULL || candidate->altitude < start->altitude))
+		{
+			start = candidate;
+		}
+	}
+
+	return start;
+}
+
+/* True when the grade over the last CLIMBS_END_DISTANCE is below CLIMBS_END_GRADE */
+static bool _is_flattening(const T_climb_point *point)
+{
+	for(int n = climbs.count - 1; n >= 0; n--)
+	{
+		const T_climb_point *previous = _window_get(n);
+
+		if(point->distance - previous->distance >= CLIMBS_END_DISTANCE)
+		{
+			return _grade(previous, point) < CLIMBS_END_GRADE;
+		}
+	}
+
+	return false;
+}
+
+static void _finish_climb(void)
+{
+	pthread_mutex_lock(&climbs.mutex);
+
+	if(climbs.nb_climbs < CLIMBS_MAX_CLIMBS)
+	{
+		_set_stats(&climbs.climb[climbs.nb_climbs], &climbs.start, &climbs.top);
+		climbs.nb_climbs++;
+	}
+	else
+	{
+		log_warn("more than %d climbs, climb %d is not kept\n", CLIMBS_MAX_CLIMBS, climbs.number);
+	}
+	climbs.is_climbing = false;
+
+	pthread_mutex_unlock(&climbs.mutex);
+
+	log_info("climb %d finished\n", climbs.number);
+}
+
+static int _climbs_update(T_data_frame *frame)
+{
+	static const uint64_t live_mask = data_channel_bit(E_DATA_CLIMB_GAIN) | data_channel_bit(E_DATA_CLIMB_DISTANCE)
+		| data_channel_bit(E_DATA_CLIMB_GRADE) | data_channel_bit(E_DATA_CLIMB_VAM);
+
+	if(!data_frame_is_valid(frame, E_DATA_ALTITUDE) || !data_frame_is_valid(frame, E_DATA_DISTANCE) || !data_frame_is_valid(frame, E_DATA_MOVING_TIME))
+	{
+		frame->valid_mask &= ~(live_mask | data_channel_bit(E_DATA_CLIMB));
+		return 0;
+	}
+
+	/* First order low pass on the altitude, independent of the sample period */
+	int64_t elapsed = frame->timestamp - climbs.timestamp;
+	if(!climbs.has_altitude)
+	{
+		climbs.altitude = (int64_t)frame->value[E_DATA_ALTITUDE] * 1000;
+		climbs.has_altitude = true;
+	}
+	else if(elapsed > 0)
+	{
+		climbs.altitude += fixed_point_mul_div((int64_t)frame->value[E_DATA_ALTITUDE] * 1000 - climbs.altitude, elapsed, CLIMBS_SMOOTHING + elapsed);
+	}
+	climbs.timestamp = frame->timestamp;
+
+	T_climb_point point = {
+		.distance = frame->value[E_DATA_DISTANCE],
+		.altitude = (int32_t)(climbs.altitude / 1000),
+		.time = frame->value[E_DATA_MOVING_TIME],
+	};
+
+	/* The look-back window only moves with the distance, the searches run once per step */
+	bool is_new_step = (climbs.count == 0 || point.distance - _window_get(climbs.count - 1)->distance >= CLIMBS_STEP);
+
+	if(climbs.is_climbing)
+	{
+		/* Noise on a flat after the summit does not move the top */
+		if(point.altitude > climbs.top.altitude && _grade(&climbs.top, &point) >= CLIMBS_END_GRADE)
+		{
+			climbs.top = point;
+		}
+		else if(climbs.top.altitude - point.altitude >= CLIMBS_END_DROP || (is_new_step && _is_flattening(&point)))
+		{
+			_finish_climb();
+
+			/* The next climb starts after this one */
+			climbs.count = 0;
+		}
+	}
+	else if(is_new_step)
+	{
+		const T_climb_point *start = _find_start(&point);
+		if(start != NULL)
+		{
+			climbs.start = *start;
+			climbs.top = point;
+			climbs.number++;
+			climbs.is_climbing = true;
+			log_info("climb %d started\n", climbs.number);
+		}
+	}
+
+	if(is_new_step || climbs.count == 0)
+	{
+		_window_push(&point);
+	}
+
+	pthread_mutex_lock(&climbs.mutex);
+	if(climbs.is_climbing)
+	{
+		_set_stats(&climbs.current, &climbs.start, &point);
+	}
+	pthread_mutex_unlock(&climbs.mutex);
+
+	frame->value[E_DATA_CLIMB] = climbs.is_climbing ? climbs.number : 0;
+	frame->valid_mask |= data_channel_bit(E_DATA_CLIMB);
+
+	if(!climbs.is_climbing)
+	{
+		frame->valid_mask &= ~live_mask;
+		return 0;
+	}
+
+	frame->value[E_DATA_CLIMB_GAIN] = climbs.current.gain;
+	frame->value[E_DATA_CLIMB_DISTANCE] = climbs.current.distance;
+	frame->value[E_DATA_CLIMB_GRADE] = climbs.current.grade;
+	frame->value[E_DATA_CLIMB_VAM] = climbs.current.vam;
+	frame->valid_mask |= live_mask;
+
+	return 0;
+}
+
+static void _climbs_reset(void)
+{
+	pthread_mutex_lock(&climbs.mutex);
+	climbs.nb_climbs = 0;
+	climbs.is_climbing = false;
+	pthread_mutex_unlock(&climbs.mutex);
+
+	climbs.has_altitude = false;
+	climbs.count = 0;
+	climbs.first = 0;
+	climbs.number = 0;
+}
+
+/* The climbs completed since the start of the ride, a climb in progress
+ * starts again from the next points
+ */
+static int _climbs_save(void *buff, int size)
+{
+	uint8_t *state = buff;
+	int32_t header[2];
+
+	pthread_mutex_lock(&climbs.mutex);
+	header[0] = climbs.number;
+	header[1] = climbs.nb_climbs;
+	int length = sizeof(header) + climbs.nb_climbs * sizeof(T_climb);
+	if(length <= size)
+	{
+		memcpy(state, header, sizeof(header));
+		memcpy(&state[sizeof(header)], climbs.climb, climbs.nb_climbs * sizeof(T_climb));
+	}
+	pthread_mutex_unlock(&climbs.mutex);
+
+	fail_if_superior(length, size, -1, "no room for the state\n");
+
+	return length;
+}
+
+static int _climbs_restore(const void *buff, int size)
+{
+	const uint8_t *state = buff;
+	int32_t header[2];
+	fail_if_inferior(size, (int)sizeof(header), -1, "invalid state size %d\n", size);
+
+	memcpy(header, state, sizeof(header));
+	fail_if_false((header[1] >= 0 && header[1] <= CLIMBS_MAX_CLIMBS), -2, "invalid number of climbs %d\n", header[1]);
+	fail_if_not_equal(size, (int)(sizeof(header) + header[1] * sizeof(T_climb)), -3, "invalid state size %d\n", size);
+
+	pthread_mutex_lock(&climbs.mutex);
+	climbs.number = header[0];
+	climbs.nb_climbs = header[1];
+	memcpy(climbs.climb, &state[sizeof(header)], header[1] * sizeof(T_climb));
+	pthread_mutex_unlock(&climbs.mutex);
+
+	return 0;
+}
+
+/* A climb still in progress at the end of the ride is kept up to its top */
+static void _climbs_finish(void)
+{
+	if(climbs.is_climbing)
+	{
+		_finish_climb();
+		climbs.count = 0;
+	}
+}
+
+static const T_metric climbs_metric = {
+	.name = "climbs",
+	.inputs = data_channel_bit(E_DATA_ALTITUDE) | data_channel_bit(E_DATA_DISTANCE) | data_channel_bit(E_DATA_MOVING_TIME),
+	.outputs = data_channel_bit(E_DATA_CLIMB) | data_channel_bit(E_DATA_CLIMB_GAIN) | data_channel_bit(E_DATA_CLIMB_DISTANCE)
+		| data_channel_bit(E_DATA_CLIMB_GRADE) | data_channel_bit(E_DATA_CLIMB_VAM),
+	.update = &_climbs_update,
+	.reset = &_climbs_reset,
+	.save = &_climbs_save,
+	.restore = &_climbs_restore,
+	.finish = &_climbs_finish,
+};
+
+int climbs_init(void)
+{
+	fail_if_true(climbs.is_initialized, -1, "climbs is already initialized\n");
+
+	int ret = metric_registry_register(&climbs_metric);
+	fail_if_negative(ret, -2, "metric_registry_register failed, return: %d\n", ret);
+
+	_climbs_reset();
+
+	/* Mark module as initialized */
+	climbs.is_initialized = true;
+
+	return 0;
+}
+
+int climbs_get_count(void)
+{
+	fail_if_false(climbs.is_initialized, -1, "climbs is not initialized\n");
+
+	pthread_mutex_lock(&climbs.mutex);
+	int count = climbs.nb_climbs;
+	pthread_mutex_unlock(&climbs.mutex);
+
+	return count;
+}
+
+int climbs_get(int index, T_climb *climb)
+{
+	fail_if_false(climbs.is_initialized, -1, "climbs is not initialized\n");
+	fail_if_null(climb, -2, "climb is null\n");
+
+	int ret = 0;
+
+	pthread_mutex_lock(&climbs.mutex);
+	if(index < 0 || index >= climbs.nb_climbs)
+	{
+		log_error("invalid climb index %d\n", index);
+		ret = -3;
+	}
+	else
+	{
+		*climb = climbs.climb[index];
+	}
+	pthread_mutex_unlock(&climbs.mutex);
+
+	return ret;
+}
+
+int climbs_get_current(T_climb *climb)
+{
+	fail_if_false(climbs.is_initialized, -1, "climbs is not initialized\n");
+	fail_if_null(climb, -2, "climb is null\n");
+
+	pthread_mutex_lock(&climbs.mutex);
+	bool is_climbing = climbs.is_climbing;
+	if(is_climbing)
+	{
+		*climb = climbs.current;
+	}
+	pthread_mutex_unlock(&climbs.mutex);
+
+	return is_climbing ? 1 : 0;
+}
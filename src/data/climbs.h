@@ -0,0 +1,61 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CLIMBS_HEADER_
+#define _CLIMBS_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLIMBS_SMOOTHING 5000 /* ms, time constant of the altitude filter */
+#define CLIMBS_STEP 1000 /* cm between two points of the look-back window */
+#define CLIMBS_WINDOW_DEPTH 64 /* points, the look-back covers CLIMBS_STEP * CLIMBS_WINDOW_DEPTH */
+#define CLIMBS_START_GAIN 1000 /* cm over CLIMBS_MIN_GRADE to start a climb */
+#define CLIMBS_MIN_GRADE 30 /* 0.1 % */
+#define CLIMBS_END_DROP 1000 /* cm below the top to end the climb */
+#define CLIMBS_END_DISTANCE 50000 /* cm, the climb ends when the grade over this distance ... */
+#define CLIMBS_END_GRADE 10 /* 0.1 %, ... falls below this one */
+#define CLIMBS_MAX_CLIMBS 64 /* climbs kept per ride */
+
+/* Statistics of a climb, from its lowest to its highest point */
+typedef struct {
+	int32_t start_distance; /* cm, ride distance at the start */
+	int32_t start_altitude; /* cm */
+	int32_t start_time; /* ms, moving time at the start */
+	int32_t distance; /* cm */
+	int32_t gain; /* cm */
+	int32_t duration; /* ms, moving time */
+	int32_t grade; /* 0.1 %, average */
+	int32_t vam; /* m/h */
+} T_climb;
+
+/* Register the climb metric, the live statistics of the climb in progress
+ * are given by the climb channels of the data manager
+ */
+int climbs_init(void);
+
+/* Climbs finished since the start of the ride, the climb in progress is
+ * finished at the end of the ride
+ */
+int climbs_get_count(void);
+int climbs_get(int index, T_climb *climb);
+
+/* Statistics of the climb in progress, return 1 while climbing, 0 otherwise */
+int climbs_get_current(T_climb *climb);
+
+#endif //_CLIMBS_HEADER_
@@ -0,0 +1,260 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "data_manager.h"
+#include "column_codec.h"
+#include "varint.h"
+
+#define TIME_COLUMN 0
+#define MASK_COLUMN 1
+#define CHANNEL_COLUMN(channel) ((channel) + 2)
+#define CHANNELS_MASK (data_channel_bit(E_DATA_CHANNEL_NUMBER) - 1)
+
+/* Coordinates move by a few units at each sample, the XOR with the previous
+ * value only keeps the low bits
+ */
+#define COORDINATES_MASK (data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE))
+
+/* Code of the value in its column */
+static inline uint64_t _encode_value(const T_column_encoder *encoder, int channel, int32_t value)
+{
+	if(!((encoder->channel_mask >> channel) & 1))
+	{
+		return varint_zigzag(value);
+	}
+	if((COORDINATES_MASK >> channel) & 1)
+	{
+		return (uint32_t)(value ^ encoder->last_value[channel]);
+	}
+
+	return varint_zigzag((int64_t)value - encoder->last_value[channel]);
+}
+
+int column_codec_encoder_reset(T_column_encoder *encoder, int64_t clock_offset)
+{
+	fail_if_null(encoder, -1, "encoder is null\n");
+
+	encoder->nb_frames = 0;
+	encoder->clock_offset = clock_offset;
+	encoder->last_timestamp = 0;
+	encoder->last_delta = 0;
+	encoder->last_mask = 0;
+	encoder->channel_mask = 0;
+	memset(encoder->column_size, 0, sizeof(encoder->column_size));
+	encoder->size = varint_size(0) + varint_size(varint_zigzag(clock_offset));
+
+	return 0;
+}
+
+int column_codec_encoder_add(T_column_encoder *encoder, const T_data_frame *frame, int capacity)
+{
+	fail_if_null(encoder, -1, "encoder is null\n");
+	fail_if_null(frame, -2, "frame is null\n");
+	fail_if_superior(capacity, COLUMN_CODEC_MAX_BLOCK_SIZE, -3, "capacity %d is too large\n", capacity);
+
+	uint8_t codes[COLUMN_CODEC_NB_COLUMNS][VARINT_MAX_SIZE];
+	int code_size[COLUMN_CODEC_NB_COLUMNS];
+	uint64_t mask = frame->valid_mask & CHANNELS_MASK;
+	int64_t delta = frame->timestamp - encoder->last_timestamp;
+
+	if(encoder->nb_frames == COLUMN_CODEC_MAX_FRAMES)
+	{
+		return 0;
+	}
+
+	/* The frame count of the header can take one more byte */
+	int size = encoder->size + varint_size(encoder->nb_frames + 1) - varint_size(encoder->nb_frames);
+
+	code_size[TIME_COLUMN] = varint_put(codes[TIME_COLUMN],
+		(encoder->nb_frames == 0) ? varint_zigzag(frame->timestamp) : varint_zigzag(delta - encoder->last_delta));
+	code_size[MASK_COLUMN] = varint_put(codes[MASK_COLUMN], mask ^ encoder->last_mask);
+	size += code_size[TIME_COLUMN] + code_size[MASK_COLUMN];
+
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		code_size[CHANNEL_COLUMN(i)] = 0;
+		if((mask >> i) & 1)
+		{
+			code_size[CHANNEL_COLUMN(i)] = varint_put(codes[CHANNEL_COLUMN(i)], _encode_value(encoder, i, frame->value[i]));
+			size += code_size[CHANNEL_COLUMN(i)];
+		}
+	}
+
+	if(size > capacity)
+	{
+		return 0;
+	}
+
+	for(int i = 0; i < COLUMN_CODEC_NB_COLUMNS; i++)
+	{
+		memcpy(&encoder->column[i][encoder->column_size[i]], codes[i], code_size[i]);
+		encoder->column_size[i] += code_size[i];
+	}
+
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		if((mask >> i) & 1)
+		{
+			encoder->last_value[i] = frame->value[i];
+		}
+	}
+
+	encoder->last_delta = (encoder->nb_frames == 0) ? 0 : delta;
+	encoder->last_timestamp = frame->timestamp;
+	encoder->last_mask = mask;
+	encoder->channel_mask |= mask;
+	encoder->nb_frames++;
+	encoder->size = size;
+
+	return 1;
+}
+
+int column_codec_encoder_write(const T_column_encoder *encoder, uint8_t *buff)
+{
+	fail_if_null(encoder, -1, "encoder is null\n");
+	fail_if_null(buff, -2, "buff is null\n");
+
+	int size = 0;
+
+	size += varint_put(&buff[size], encoder->nb_frames);
+	size += varint_put(&buff[size], varint_zigzag(encoder->clock_offset));
+
+	for(int i = 0; i < COLUMN_CODEC_NB_COLUMNS; i++)
+	{
+		memcpy(&buff[size], encoder->column[i], encoder->column_size[i]);
+		size += encoder->column_size[i];
+	}
+
+	return size;
+}
+
+int column_codec_peek(const uint8_t *buff, int size, int64_t *clock_offset, int64_t *first_timestamp)
+{
+	fail_if_null(buff, -1, "buff is null\n");
+	fail_if_null(clock_offset, -2, "clock_offset is null\n");
+	fail_if_null(first_timestamp, -3, "first_timestamp is null\n");
+
+	int position = 0;
+	uint64_t code = 0;
+	uint64_t nb_frames = 0;
+
+	fail_if_false(varint_get(buff, size, &position, &nb_frames), -4, "invalid frame count\n");
+	fail_if_superior(nb_frames, (uint64_t)COLUMN_CODEC_MAX_FRAMES, -5, "%d frames, more than %d\n", (int)nb_frames, COLUMN_CODEC_MAX_FRAMES);
+	fail_if_false(varint_get(buff, size, &position, &code), -6, "invalid clock offset\n");
+	*clock_offset = varint_unzigzag(code);
+
+	/* The time column comes first, it starts with the first timestamp */
+	*first_timestamp = 0;
+	if(nb_frames > 0)
+	{
+		fail_if_false(varint_get(buff, size, &position, &code), -7, "invalid time of frame 0\n");
+		*first_timestamp = varint_unzigzag(code);
+	}
+
+	return (int)nb_frames;
+}
+
+int column_codec_decode(const uint8_t *buff, int size, T_data_frame *frames, int max_frames, int64_t *clock_offset)
+{
+	fail_if_null(buff, -1, "buff is null\n");
+	fail_if_null(frames, -2, "frames is null\n");
+	fail_if_null(clock_offset, -3, "clock_offset is null\n");
+
+	int position = 0;
+	uint64_t code = 0;
+	uint64_t nb_frames = 0;
+	uint64_t mask = 0;
+	uint64_t channel_mask = 0;
+	int64_t timestamp = 0;
+	int64_t delta = 0;
+
+	fail_if_false(varint_get(buff, size, &position, &nb_frames), -4, "invalid frame count\n");
+	fail_if_superior(nb_frames, (uint64_t)max_frames, -5, "%d frames, more than %d\n", (int)nb_frames, max_frames);
+	fail_if_false(varint_get(buff, size, &position, &code), -6, "invalid clock offset\n");
+	*clock_offset = varint_unzigzag(code);
+
+	int count = (int)nb_frames;
+
+	for(int f = 0; f < count; f++)
+	{
+		fail_if_false(varint_get(buff, size, &position, &code), -7, "invalid time of frame %d\n", f);
+		if(f == 0)
+		{
+			timestamp = varint_unzigzag(code);
+		}
+		else
+		{
+			delta += varint_unzigzag(code);
+			timestamp += delta;
+		}
+		frames[f].timestamp = timestamp;
+	}
+
+	for(int f = 0; f < count; f++)
+	{
+		fail_if_false(varint_get(buff, size, &position, &code), -8, "invalid mask of frame %d\n", f);
+		mask ^= code;
+		fail_if_not_zero((mask & ~CHANNELS_MASK), -9, "invalid channels in the mask of frame %d\n", f);
+		frames[f].valid_mask = mask;
+		channel_mask |= mask;
+		memset(frames[f].value, 0, sizeof(frames[f].value));
+	}
+
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		bool is_first = true;
+		bool is_coordinate = (COORDINATES_MASK >> i) & 1;
+		int32_t value = 0;
+
+		if(!((channel_mask >> i) & 1))
+		{
+			continue;
+		}
+
+		for(int f = 0; f < count; f++)
+		{
+			if(!data_frame_is_valid(&frames[f], i))
+			{
+				continue;
+			}
+
+			fail_if_false(varint_get(buff, size, &position, &code), -10, "invalid value of channel %d\n", i);
+			if(is_first)
+			{
+				value = (int32_t)varint_unzigzag(code);
+				is_first = false;
+			}
+			else if(is_coordinate)
+			{
+				value ^= (int32_t)(uint32_t)code;
+			}
+			else
+			{
+				value = (int32_t)(uint32_t)((uint32_t)value + (uint32_t)varint_unzigzag(code));
+			}
+			frames[f].value[i] = value;
+		}
+	}
+
+	fail_if_not_equal(position, size, -11, "%d bytes left after the columns\n", size - position);
+
+	return count;
+}
@@ -0,0 +1,76 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COLUMN_CODEC_HEADER_
+#define _COLUMN_CODEC_HEADER_
+
+#include <stdint.h>
+#include "data_manager.h"
+
+/* Column-wise encoding of a block of frames.
+ *
+ * The frames of a block are stored channel by channel, each column being a
+ * sequence of varints:
+ *  - header: number of frames, clock offset (zig-zag)
+ *  - time: first timestamp, then the delta of the deltas (zig-zag), 1 byte
+ *    per frame at a constant rate
+ *  - mask: valid mask XOR the previous one, 1 byte per frame while the
+ *    channels do not change
+ *  - one column per channel valid in at least one frame, in channel order,
+ *    with the values of the frames where it is valid: first value, then the
+ *    delta to the previous value (zig-zag), or the XOR with the previous value
+ *    for the coordinates
+ * The number of values of each column comes from the masks, columns have no
+ * length field.
+ */
+
+#define COLUMN_CODEC_MAX_BLOCK_SIZE 512 /* bytes */
+#define COLUMN_CODEC_MAX_FRAMES 256 /* a frame takes at least 2 bytes */
+#define COLUMN_CODEC_NB_COLUMNS (E_DATA_CHANNEL_NUMBER + 2) /* time, mask, channels */
+
+typedef struct {
+	int nb_frames;
+	int size; /* bytes of the encoded block */
+	int64_t clock_offset; /* ms, UTC time minus the frame timestamps */
+	int64_t last_timestamp;
+	int64_t last_delta;
+	uint64_t last_mask;
+	uint64_t channel_mask; /* channels with a column */
+	int32_t last_value[E_DATA_CHANNEL_NUMBER];
+	int column_size[COLUMN_CODEC_NB_COLUMNS];
+	uint8_t column[COLUMN_CODEC_NB_COLUMNS][COLUMN_CODEC_MAX_BLOCK_SIZE];
+} T_column_encoder;
+
+/* Start a new block */
+int column_codec_encoder_reset(T_column_encoder *encoder, int64_t clock_offset);
+
+/* Add a frame, return 0 and leave the encoder unchanged when the block would
+ * be larger than capacity bytes
+ */
+int column_codec_encoder_add(T_column_encoder *encoder, const T_data_frame *frame, int capacity);
+
+/* Write the block, buff holds encoder->size bytes, return the size */
+int column_codec_encoder_write(const T_column_encoder *encoder, uint8_t *buff);
+
+/* Decode a whole block, return the number of frames */
+int column_codec_decode(const uint8_t *buff, int size, T_data_frame *frames, int max_frames, int64_t *clock_offset);
+
+/* Decode the header and the first timestamp only, for the indexes, return the number of frames */
+int column_codec_peek(const uint8_t *buff, int size, int64_t *clock_offset, int64_t *first_timestamp);
+
+#endif //_COLUMN_CODEC_HEADER_
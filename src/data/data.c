@@ -29,7 +29,38 @@ int data_init(void)
 	fail_if_negative(ret, -1, "data_manager_init failed, return: %d\n", ret);
 
 	ret = data_recorder_init();
-	fail_if_negative(ret, -2, "data_manager_init failed, return: %d\n", ret);
+	fail_if_negative(ret, -2, "data_recorder_init failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_start_ride(void)
+{
+	int ret = 0;
+
+	/* Checked before the metrics are reset, the interrupted ride can still be resumed */
+	ret = data_recorder_can_start();
+	fail_if_negative_or_zero(ret, -1, "the interrupted ride is not resumed or closed yet\n");
+
+	ret = data_manager_start_ride();
+	fail_if_negative(ret, -2, "data_manager_start_ride failed, return: %d\n", ret);
+
+	ret = data_recorder_start();
+	fail_if_negative(ret, -3, "data_recorder_start failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_stop_ride(void)
+{
+	int ret = 0;
+
+	/* The climb in progress is kept before the recorder reads the totals */
+	ret = data_manager_stop_ride();
+	fail_if_negative(ret, -1, "data_manager_stop_ride failed, return: %d\n", ret);
+
+	ret = data_recorder_stop();
+	fail_if_negative(ret, -2, "data_recorder_stop failed, return: %d\n", ret);
 
 	return 0;
 }
@@ -21,4 +21,8 @@
 
 int data_init(void);
 
+/* Start a new ride: reset the metrics and record it until data_stop_ride */
+int data_start_ride(void);
+int data_stop_ride(void);
+
 #endif //_DATA_HEADER_
@@ -21,21 +21,736 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include "log.h"
+#include "system_config.h"
+#include "user_config.h"
+#include "bike_config.h"
+#include "resampler.h"
+#include "metric_registry.h"
+#include "metrics.h"
+#include "zones.h"
+#include "speed_fusion.h"
+#include "climbs.h"
+#include "route_follow.h"
+#include "ride_history.h"
+#include "data_recorder.h"
 #include "data_manager.h"
 
+/* Resampling of each sensor on the common timeline */
+static const T_resampler_channel_config channel_config[DATA_NB_SENSOR_CHANNELS] = {
+	[E_DATA_GPS_SPEED]         = {.interpolation = E_RESAMPLER_LINEAR, .max_gap = 3000},
+	[E_DATA_ALTITUDE]          = {.interpolation = E_RESAMPLER_LINEAR, .max_gap = 5000},
+	[E_DATA_LATITUDE]          = {.interpolation = E_RESAMPLER_LINEAR, .max_gap = 5000},
+	[E_DATA_LONGITUDE]         = {.interpolation = E_RESAMPLER_LINEAR, .max_gap = 5000},
+	[E_DATA_TEMPERATURE]       = {.interpolation = E_RESAMPLER_HOLD,   .max_gap = 60000},
+	[E_DATA_HEART_RATE]        = {.interpolation = E_RESAMPLER_HOLD,   .max_gap = 5000},
+	[E_DATA_POWER]             = {.interpolation = E_RESAMPLER_HOLD,   .max_gap = 3000},
+	[E_DATA_CADENCE]           = {.interpolation = E_RESAMPLER_HOLD,   .max_gap = 3000},
+	[E_DATA_WHEEL_REVOLUTIONS] = {.interpolation = E_RESAMPLER_LINEAR, .max_gap = 3000},
+};
+
+/* Auto-pause states, the intermediate ones debounce the transitions */
+typedef enum {
+	E_AUTO_PAUSE_MOVING = 0,
+	E_AUTO_PAUSE_STOPPING, /* below the thresholds, not for long enough to pause */
+	E_AUTO_PAUSE_PAUSED,
+	E_AUTO_PAUSE_STARTING, /* above the thresholds, not for long enough to resume */
+	E_AUTO_PAUSE_STATE_NUMBER, // must be last
+} E_auto_pause_state;
+
+typedef struct {
+	bool is_enabled;
+	int32_t speed; /* mm/s */
+	int32_t circumference; /* mm, wheel speed from the revolutions */
+	int32_t cadence; /* rpm */
+	int32_t pause_delay; /* ms */
+	int32_t resume_delay; /* ms */
+	E_auto_pause_state state;
+	int64_t since; /* ms, start of the debounce */
+	bool has_previous; /* false on the first tick of the ride and after a resume */
+	int64_t previous; /* ms, previous tick */
+	int64_t moving_time; /* ms */
+} T_auto_pause;
+
+typedef struct {
+	bool is_used;
+	E_data_channel channel;
+	T_fixed_point_ratio ratio; /* from the channel unit to the display unit */
+	int32_t value; /* channel value in the display unit */
+	int32_t published; /* value given to the subject */
+	bool is_published; /* false until the subject got its first value */
+	lv_subject_t *subject;
+} T_subscription;
+
 static struct {
 	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the resampler, the frame and the subscriptions */
+	T_resampler resampler;
+	T_data_frame frame; /* last tick of the common timeline */
+	bool has_start;
+	int64_t start_timestamp; /* first tick of the ride, ms */
+	int nb_consumers[E_DATA_CHANNEL_NUMBER]; /* subscriptions and acquired channels */
+	T_auto_pause auto_pause;
+	T_subscription subscription[DATA_MANAGER_MAX_SUBSCRIPTIONS];
+	bool has_subject_changes; /* at least one subscription value differs from its subject */
 } data_manager = {
 	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
 };
 
+/* Convert the channel value to the subscription display unit */
+static int32_t _get_subscription_value(const T_subscription *sub, const T_data_frame *frame)
+{
+	if(!data_frame_is_valid(frame, sub->channel))
+	{
+		return DATA_MANAGER_NO_VALUE;
+	}
+
+	return (int32_t)fixed_point_rescale(frame->value[sub->channel], sub->ratio);
+}
+
+static void _update_subscriptions(const T_data_frame *frame, uint64_t changed)
+{
+	for(int i = 0; i < DATA_MANAGER_MAX_SUBSCRIPTIONS; i++)
+	{
+		T_subscription *sub = &data_manager.subscription[i];
+		if(!sub->is_used || !(changed & data_channel_bit(sub->channel)))
+		{
+			continue;
+		}
+
+		sub->value = _get_subscription_value(sub, frame);
+		if(!sub->is_published || sub->value != sub->published)
+		{
+			data_manager.has_subject_changes = true;
+		}
+	}
+}
+
+/* Called with the mutex locked when the consumers of a channel changed */
+static void _update_demand(void)
+{
+	uint64_t demand = 0;
+
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		if(data_manager.nb_consumers[i] > 0)
+		{
+			demand |= data_channel_bit(i);
+		}
+	}
+
+	metric_registry_set_demand(demand);
+}
+
+static void _acquire_channel(E_data_channel channel)
+{
+	if(data_manager.nb_consumers[channel]++ == 0)
+	{
+		_update_demand();
+	}
+}
+
+static void _release_channel(E_data_channel channel)
+{
+	if(data_manager.nb_consumers[channel] > 0 && --data_manager.nb_consumers[channel] == 0)
+	{
+		_update_demand();
+	}
+}
+
+/* The fused speed is computed by the metrics after the auto-pause, use the sensors */
+static bool _is_moving(const T_data_frame *frame, const T_data_frame *previous)
+{
+	int32_t wheel_speed = 0;
+
+	if(data_frame_is_valid(frame, E_DATA_WHEEL_REVOLUTIONS) && data_frame_is_valid(previous, E_DATA_WHEEL_REVOLUTIONS))
+	{
+		wheel_speed = speed_fusion_wheel_speed(data_manager.auto_pause.circumference, frame->value[E_DATA_WHEEL_REVOLUTIONS],
+			previous->value[E_DATA_WHEEL_REVOLUTIONS], frame->timestamp - previous->timestamp);
+	}
+
+	return (wheel_speed >= data_manager.auto_pause.speed)
+		|| (data_frame_is_valid(frame, E_DATA_GPS_SPEED) && frame->value[E_DATA_GPS_SPEED] >= data_manager.auto_pause.speed)
+		|| (data_frame_is_valid(frame, E_DATA_CADENCE) && frame->value[E_DATA_CADENCE] >= data_manager.auto_pause.cadence);
+}
+
+/* Run the auto-pause state machine and set the moving time and paused channels */
+static void _update_auto_pause(T_data_frame *frame, uint64_t *changed)
+{
+	T_auto_pause *ap = &data_manager.auto_pause;
+	bool was_paused = (ap->state == E_AUTO_PAUSE_PAUSED || ap->state == E_AUTO_PAUSE_STARTING);
+	bool is_moving = !ap->is_enabled || _is_moving(frame, &data_manager.frame);
+	int64_t timestamp = frame->timestamp;
+
+	switch(ap->state)
+	{
+		case E_AUTO_PAUSE_MOVING:
+			if(!is_moving)
+			{
+				ap->state = E_AUTO_PAUSE_STOPPING;
+				ap->since = timestamp;
+			}
+			break;
+		case E_AUTO_PAUSE_STOPPING:
+			if(is_moving)
+			{
+				ap->state = E_AUTO_PAUSE_MOVING;
+			}
+			else if(timestamp - ap->since >= ap->pause_delay)
+			{
+				/* The rider stopped when the debounce started */
+				ap->state = E_AUTO_PAUSE_PAUSED;
+				ap->moving_time -= ap->previous - ap->since;
+			}
+			break;
+		case E_AUTO_PAUSE_PAUSED:
+			if(is_moving)
+			{
+				ap->state = E_AUTO_PAUSE_STARTING;
+				ap->since = timestamp;
+			}
+			break;
+		case E_AUTO_PAUSE_STARTING:
+			if(!is_moving)
+			{
+				ap->state = E_AUTO_PAUSE_PAUSED;
+			}
+			else if(timestamp - ap->since >= ap->resume_delay)
+			{
+				/* The rider started when the debounce started */
+				ap->state = E_AUTO_PAUSE_MOVING;
+				ap->moving_time += timestamp - ap->since;
+			}
+			break;
+		default:
+			ap->state = E_AUTO_PAUSE_MOVING;
+			break;
+	}
+
+	bool is_paused = (ap->state == E_AUTO_PAUSE_PAUSED || ap->state == E_AUTO_PAUSE_STARTING);
+
+	/* The first tick of the ride has no previous one */
+	if(!is_paused && !was_paused && ap->has_previous)
+	{
+		ap->moving_time += timestamp - ap->previous;
+	}
+	ap->has_previous = true;
+	ap->previous = timestamp;
+
+	if(frame->value[E_DATA_MOVING_TIME] != (int32_t)ap->moving_time || !data_frame_is_valid(frame, E_DATA_MOVING_TIME))
+	{
+		*changed |= data_channel_bit(E_DATA_MOVING_TIME);
+	}
+	if(is_paused != was_paused || !data_frame_is_valid(frame, E_DATA_PAUSED))
+	{
+		*changed |= data_channel_bit(E_DATA_PAUSED);
+	}
+
+	frame->value[E_DATA_MOVING_TIME] = (int32_t)ap->moving_time;
+	frame->value[E_DATA_PAUSED] = is_paused;
+	frame->valid_mask |= data_channel_bit(E_DATA_MOVING_TIME) | data_channel_bit(E_DATA_PAUSED);
+}
+
+static void _reset_auto_pause(void)
+{
+	data_manager.auto_pause.state = E_AUTO_PAUSE_MOVING;
+	data_manager.auto_pause.has_previous = false;
+	data_manager.auto_pause.moving_time = 0;
+}
+
+/* Called with the mutex locked for each new tick of the common timeline,
+ * frame holds the resampled sensors and the derived channels of the previous tick
+ */
+static void _process_frame(T_data_frame *frame)
+{
+	int ret = 0;
+	const T_data_frame *previous = &data_manager.frame;
+	uint64_t changed = data_channel_bit(E_DATA_ELAPSED_TIME);
+
+	/* Sensor channels changed by the tick */
+	for(int i = 0; i < DATA_NB_SENSOR_CHANNELS; i++)
+	{
+		if(data_frame_is_valid(frame, i) != data_frame_is_valid(previous, i)
+		|| (data_frame_is_valid(frame, i) && frame->value[i] != previous->value[i]))
+		{
+			changed |= data_channel_bit(i);
+		}
+	}
+
+	if(!data_manager.has_start)
+	{
+		data_manager.start_timestamp = frame->timestamp;
+		data_manager.has_start = true;
+	}
+	frame->value[E_DATA_ELAPSED_TIME] = (int32_t)(frame->timestamp - data_manager.start_timestamp);
+	frame->valid_mask |= data_channel_bit(E_DATA_ELAPSED_TIME);
+
+	_update_auto_pause(frame, &changed);
+
+	/* While paused the ticks are identical, only the one starting the pause is
+	 * processed, the metrics keep their value, the history and the ride log get no point
+	 */
+	bool is_frozen = frame->value[E_DATA_PAUSED] && !(changed & data_channel_bit(E_DATA_PAUSED));
+
+	if(!is_frozen)
+	{
+		ret = metric_registry_evaluate(frame, &changed);
+		if(ret < 0)
+		{
+			log_error("metric_registry_evaluate failed, return: %d\n", ret);
+		}
+	}
+
+	data_manager.frame = *frame;
+
+	if(!is_frozen)
+	{
+		ret = ride_history_push(frame);
+		if(ret < 0)
+		{
+			log_error("ride_history_push failed, return: %d\n", ret);
+		}
+
+		ret = data_recorder_push(frame);
+		if(ret < 0)
+		{
+			log_error("data_recorder_push failed, return: %d\n", ret);
+		}
+	}
+
+	_update_subscriptions(frame, changed);
+}
+
 int data_manager_init(void)
 {
+	fail_if_true(data_manager.is_initialized, -1, "data_manager is already initialized\n");
+
+	int ret = 0;
+	int period = system_config_get_sample_period();
+	fail_if_negative_or_zero(period, -2, "invalid sample period: %d\n", period);
+
+	ret = resampler_init(&data_manager.resampler, period, DATA_MANAGER_RESAMPLER_DELAY, channel_config, DATA_NB_SENSOR_CHANNELS);
+	fail_if_negative(ret, -3, "resampler_init failed, return: %d\n", ret);
+
+	ret = metrics_init();
+	fail_if_negative(ret, -4, "metrics_init failed, return: %d\n", ret);
+
+	ret = zones_init();
+	fail_if_negative(ret, -5, "zones_init failed, return: %d\n", ret);
+
+	ret = speed_fusion_init();
+	fail_if_negative(ret, -6, "speed_fusion_init failed, return: %d\n", ret);
+
+	ret = climbs_init();
+	fail_if_negative(ret, -7, "climbs_init failed, return: %d\n", ret);
+
+	ret = route_follow_init();
+	fail_if_negative(ret, -8, "route_follow_init failed, return: %d\n", ret);
+
+	ret = metric_registry_sort();
+	fail_if_negative(ret, -9, "metric_registry_sort failed, return: %d\n", ret);
+
+	ret = ride_history_init();
+	fail_if_negative(ret, -10, "ride_history_init failed, return: %d\n", ret);
+
+	memset(&data_manager.frame, 0, sizeof(data_manager.frame));
+	memset(data_manager.nb_consumers, 0, sizeof(data_manager.nb_consumers));
+	data_manager.has_start = false;
+
+	/* Auto-pause settings */
+	data_manager.auto_pause.is_enabled = (user_config_get_auto_pause_on() > 0);
+	data_manager.auto_pause.speed = user_config_get_auto_pause_speed();
+	data_manager.auto_pause.cadence = user_config_get_auto_pause_cadence();
+	data_manager.auto_pause.pause_delay = user_config_get_auto_pause_delay();
+	data_manager.auto_pause.resume_delay = user_config_get_auto_resume_delay();
+	data_manager.auto_pause.circumference = SPEED_FUSION_CIRCUMFERENCE(bike_config_get_wheel_size());
+	fail_if_negative(data_manager.auto_pause.speed, -11, "invalid auto-pause speed\n");
+	fail_if_negative(data_manager.auto_pause.cadence, -12, "invalid auto-pause cadence\n");
+	fail_if_negative(data_manager.auto_pause.pause_delay, -13, "invalid auto-pause delay\n");
+	fail_if_negative(data_manager.auto_pause.resume_delay, -14, "invalid auto-resume delay\n");
+	_reset_auto_pause();
+	metric_registry_set_demand(0);
+
+	/* The history records from the start, its derived channels are always computed */
+	uint64_t history_mask = ride_history_get_channel_mask();
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		if(history_mask & data_channel_bit(i))
+		{
+			_acquire_channel(i);
+		}
+	}
 
 	/* Mark module as initialized */
 	data_manager.is_initialized = true;
 
 	return 0;
 }
+
+int data_manager_start_ride(void)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+
+	int ret = 0;
+	const uint64_t sensor_mask = data_channel_bit(DATA_NB_SENSOR_CHANNELS) - 1;
+
+	pthread_mutex_lock(&data_manager.mutex);
+
+	ret = metric_registry_reset();
+	if(ret < 0)
+	{
+		log_error("metric_registry_reset failed, return: %d\n", ret);
+		ret = -2;
+		goto start_cleanup;
+	}
+
+	ret = ride_history_reset();
+	if(ret < 0)
+	{
+		log_error("ride_history_reset failed, return: %d\n", ret);
+		ret = -3;
+		goto start_cleanup;
+	}
+
+	/* The elapsed time restarts on the next tick, the derived channels have no value until then */
+	data_manager.has_start = false;
+	_reset_auto_pause();
+	data_manager.frame.valid_mask &= sensor_mask;
+	_update_subscriptions(&data_manager.frame, ~sensor_mask);
+
+start_cleanup:
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return ret;
+}
+
+int data_manager_stop_ride(void)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+
+	pthread_mutex_lock(&data_manager.mutex);
+	int ret = metric_registry_finish();
+	pthread_mutex_unlock(&data_manager.mutex);
+	fail_if_negative(ret, -2, "metric_registry_finish failed, return: %d\n", ret);
+
+	return 0;
+}
+
+/* Load the metrics from the checkpoint and replay the frames after it, called
+ * with the mutex locked, last is the last replayed tick
+ */
+static int _restore_ride(const void *checkpoint, int size, const T_data_frame *frames, int nb_frames, T_data_frame *last)
+{
+	int ret = 0;
+	uint64_t changed = 0;
+
+	*last = frames[0];
+
+	ret = metric_registry_reset();
+	fail_if_negative(ret, -1, "metric_registry_reset failed, return: %d\n", ret);
+
+	ret = ride_history_reset();
+	fail_if_negative(ret, -2, "ride_history_reset failed, return: %d\n", ret);
+
+	ret = metric_registry_restore(checkpoint, size);
+	fail_if_negative(ret, -3, "metric_registry_restore failed, return: %d\n", ret);
+
+	/* The first frame is already accounted for in the checkpoint */
+	for(int i = 1; i < nb_frames; i++)
+	{
+		*last = frames[i];
+		changed = ~(uint64_t)0;
+		ret = metric_registry_evaluate(last, &changed);
+		fail_if_negative(ret, -4, "metric_registry_evaluate failed, return: %d\n", ret);
+	}
+
+	return 0;
+}
+
+int data_manager_resume_ride(const void *checkpoint, int size, const T_data_frame *frames, int nb_frames, int64_t clock_shift)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_null(checkpoint, -2, "checkpoint is null\n");
+	fail_if_null(frames, -3, "frames is null\n");
+	fail_if_negative_or_zero(nb_frames, -4, "no frame to resume from\n");
+
+	int ret = 0;
+	const uint64_t sensor_mask = data_channel_bit(DATA_NB_SENSOR_CHANNELS) - 1;
+	T_data_frame last;
+
+	pthread_mutex_lock(&data_manager.mutex);
+
+	ret = _restore_ride(checkpoint, size, frames, nb_frames, &last);
+	if(ret < 0)
+	{
+		log_error("_restore_ride failed, return: %d\n", ret);
+		ret = -5;
+		goto resume_cleanup;
+	}
+
+	/* The ride goes on from the last tick, the time the device was off counts as a pause */
+	_reset_auto_pause();
+	data_manager.auto_pause.moving_time = last.value[E_DATA_MOVING_TIME];
+	data_manager.start_timestamp = last.timestamp + clock_shift - last.value[E_DATA_ELAPSED_TIME];
+	data_manager.has_start = true;
+
+	/* Derived channels of the last tick until the next one */
+	data_manager.frame.valid_mask = (data_manager.frame.valid_mask & sensor_mask) | (last.valid_mask & ~sensor_mask);
+	memcpy(&data_manager.frame.value[DATA_NB_SENSOR_CHANNELS], &last.value[DATA_NB_SENSOR_CHANNELS],
+		(E_DATA_CHANNEL_NUMBER - DATA_NB_SENSOR_CHANNELS) * sizeof(last.value[0]));
+	_update_subscriptions(&data_manager.frame, ~sensor_mask);
+	ret = 0;
+
+resume_cleanup:
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return ret;
+}
+
+int data_manager_replay_ride(const void *checkpoint, int size, const T_data_frame *frames, int nb_frames,
+	void (*read)(void *user_data), void *user_data)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_null(checkpoint, -2, "checkpoint is null\n");
+	fail_if_null(frames, -3, "frames is null\n");
+	fail_if_negative_or_zero(nb_frames, -4, "no frame to replay\n");
+	fail_if_null(read, -5, "read is null\n");
+
+	int ret = 0;
+	T_data_frame last;
+
+	/* No ride is going on, the next one resets the metrics */
+	pthread_mutex_lock(&data_manager.mutex);
+	ret = _restore_ride(checkpoint, size, frames, nb_frames, &last);
+	if(ret == 0)
+	{
+		metric_registry_finish();
+		read(user_data);
+	}
+	pthread_mutex_unlock(&data_manager.mutex);
+	fail_if_negative(ret, -6, "_restore_ride failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_manager_set_auto_pause(bool is_enabled)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+
+	pthread_mutex_lock(&data_manager.mutex);
+	data_manager.auto_pause.is_enabled = is_enabled;
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return 0;
+}
+
+bool data_manager_is_paused(void)
+{
+	bool is_paused = false;
+
+	pthread_mutex_lock(&data_manager.mutex);
+	is_paused = data_frame_is_valid(&data_manager.frame, E_DATA_PAUSED) && data_manager.frame.value[E_DATA_PAUSED];
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return is_paused;
+}
+
+int data_manager_push(E_data_channel channel, int64_t timestamp, int32_t value)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_negative(channel, -2, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, DATA_NB_SENSOR_CHANNELS, -3, "channel %d is not a sensor channel\n", channel);
+
+	int ret = 0;
+	uint32_t gap_mask = 0;
+	const uint64_t sensor_mask = data_channel_bit(DATA_NB_SENSOR_CHANNELS) - 1;
+	T_data_frame frame;
+
+	pthread_mutex_lock(&data_manager.mutex);
+
+	ret = resampler_push(&data_manager.resampler, channel, timestamp, value);
+	if(ret < 0)
+	{
+		log_error("resampler_push failed, return: %d\n", ret);
+		ret = -4;
+		goto push_cleanup;
+	}
+
+	/* A sample can complete several ticks when a sensor was late */
+	frame = data_manager.frame;
+	while((ret = resampler_pop(&data_manager.resampler, &frame.timestamp, frame.value, &gap_mask)) == 1)
+	{
+		/* The derived channels keep their value until the metrics update them */
+		frame.valid_mask = (data_manager.frame.valid_mask & ~sensor_mask) | (~(uint64_t)gap_mask & sensor_mask);
+		_process_frame(&frame);
+	}
+
+	if(ret < 0)
+	{
+		log_error("resampler_pop failed, return: %d\n", ret);
+		ret = -5;
+		goto push_cleanup;
+	}
+
+push_cleanup:
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return ret;
+}
+
+int data_manager_get_frame(T_data_frame *frame)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_null(frame, -2, "frame is null\n");
+
+	pthread_mutex_lock(&data_manager.mutex);
+	*frame = data_manager.frame;
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return 0;
+}
+
+int data_manager_subscribe(E_data_channel channel, T_fixed_point_ratio ratio, lv_subject_t *subject)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_negative(channel, -2, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, E_DATA_CHANNEL_NUMBER, -3, "invalid channel %d\n", channel);
+	fail_if_negative_or_zero(ratio.den, -4, "invalid ratio denominator %d\n", ratio.den);
+	fail_if_null(subject, -5, "subject is null\n");
+
+	int id = -6;
+
+	pthread_mutex_lock(&data_manager.mutex);
+
+	for(int i = 0; i < DATA_MANAGER_MAX_SUBSCRIPTIONS; i++)
+	{
+		T_subscription *sub = &data_manager.subscription[i];
+		if(sub->is_used)
+		{
+			continue;
+		}
+
+		sub->channel = channel;
+		sub->ratio = ratio;
+		sub->subject = subject;
+		sub->is_published = false;
+
+		/* Start from the last frame so the subject is set on the next update */
+		sub->value = _get_subscription_value(sub, &data_manager.frame);
+		sub->is_used = true;
+		data_manager.has_subject_changes = true;
+		_acquire_channel(channel);
+
+		id = i;
+		break;
+	}
+
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	fail_if_negative(id, id, "no more subscription available\n");
+
+	return id;
+}
+
+int data_manager_unsubscribe(int id)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_negative(id, -2, "invalid subscription id %d\n", id);
+	fail_if_superior_or_equal(id, DATA_MANAGER_MAX_SUBSCRIPTIONS, -3, "invalid subscription id %d\n", id);
+
+	pthread_mutex_lock(&data_manager.mutex);
+	if(data_manager.subscription[id].is_used)
+	{
+		_release_channel(data_manager.subscription[id].channel);
+	}
+	data_manager.subscription[id].is_used = false;
+	data_manager.subscription[id].subject = NULL;
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return 0;
+}
+
+int data_manager_acquire_channel(E_data_channel channel)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_negative(channel, -2, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, E_DATA_CHANNEL_NUMBER, -3, "invalid channel %d\n", channel);
+
+	pthread_mutex_lock(&data_manager.mutex);
+	_acquire_channel(channel);
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return 0;
+}
+
+int data_manager_release_channel(E_data_channel channel)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+	fail_if_negative(channel, -2, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, E_DATA_CHANNEL_NUMBER, -3, "invalid channel %d\n", channel);
+
+	pthread_mutex_lock(&data_manager.mutex);
+	_release_channel(channel);
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	return 0;
+}
+
+int data_manager_update_subjects(void)
+{
+	fail_if_false(data_manager.is_initialized, -1, "data_manager is not initialized\n");
+
+	int nb_changes = 0;
+	struct {
+		lv_subject_t *subject;
+		int32_t value;
+	} changes[DATA_MANAGER_MAX_SUBSCRIPTIONS];
+
+	/* Nothing changed since the last call, the usual case between two ticks.
+	 * Read without the mutex, a change missed here is published on the next call.
+	 */
+	if(!data_manager.has_subject_changes)
+	{
+		return 0;
+	}
+
+	/* Collect the changes with the mutex locked ... */
+	pthread_mutex_lock(&data_manager.mutex);
+	for(int i = 0; i < DATA_MANAGER_MAX_SUBSCRIPTIONS; i++)
+	{
+		T_subscription *sub = &data_manager.subscription[i];
+		if(!sub->is_used || (sub->is_published && sub->value == sub->published))
+		{
+			continue;
+		}
+
+		sub->published = sub->value;
+		sub->is_published = true;
+		changes[nb_changes].subject = sub->subject;
+		changes[nb_changes].value = sub->value;
+		nb_changes++;
+	}
+	data_manager.has_subject_changes = false;
+	pthread_mutex_unlock(&data_manager.mutex);
+
+	/* ... and notify the observers without it, they can call the data manager back */
+	for(int i = 0; i < nb_changes; i++)
+	{
+		lv_subject_set_int(changes[i].subject, changes[i].value);
+	}
+
+	return nb_changes;
+}
+
+int64_t data_manager_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -18,6 +18,121 @@
 #ifndef _DATA_MANAGER_HEADER_
 #define _DATA_MANAGER_HEADER_
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <lvgl.h>
+#include "fixed_point.h"
+
+/* Delay before a tick of the common timeline is produced, lets the slow sensors catch up */
+#define DATA_MANAGER_RESAMPLER_DELAY 1000 /* ms */
+
+#define DATA_MANAGER_MAX_SUBSCRIPTIONS 32
+#define DATA_MANAGER_NO_VALUE INT32_MIN /* subject value when the channel has no value */
+
+/* Channel values are fixed point integers, see fixed_point.h */
+typedef enum {
+	E_DATA_GPS_SPEED = 0, /* mm/s */
+	E_DATA_ALTITUDE, /* cm */
+	E_DATA_LATITUDE, /* 1e-7 degree */
+	E_DATA_LONGITUDE, /* 1e-7 degree */
+	E_DATA_TEMPERATURE, /* 0.1 degree Celsius */
+	E_DATA_HEART_RATE, /* bpm */
+	E_DATA_POWER, /* W */
+	E_DATA_CADENCE, /* rpm */
+	E_DATA_WHEEL_REVOLUTIONS, /* 0.001 revolution, cumulative counter of the wheel sensor */
+
+	/* Derived channels, set by the data manager and the metrics */
+	E_DATA_ELAPSED_TIME, /* ms since the start of the ride */
+	E_DATA_MOVING_TIME, /* ms, elapsed time without the pauses */
+	E_DATA_PAUSED, /* 1 while the ride is auto-paused */
+	E_DATA_SPEED, /* mm/s, wheel and GPS fused */
+	E_DATA_DISTANCE, /* cm */
+	E_DATA_AVERAGE_SPEED, /* mm/s */
+	E_DATA_ELEVATION_GAIN, /* cm */
+	E_DATA_GRADE, /* 0.1 % */
+	E_DATA_VAM, /* m/h */
+	E_DATA_NORMALIZED_POWER, /* W */
+	E_DATA_HEART_RATE_ZONE, /* zone number, starting at 1 */
+	E_DATA_POWER_ZONE, /* zone number, starting at 1 */
+	E_DATA_CLIMB, /* number of the climb in progress, starting at 1, 0 when not climbing */
+	E_DATA_CLIMB_GAIN, /* cm, since the start of the climb in progress */
+	E_DATA_CLIMB_DISTANCE, /* cm */
+	E_DATA_CLIMB_GRADE, /* 0.1 %, average */
+	E_DATA_CLIMB_VAM, /* m/h, average */
+	E_DATA_ROUTE_DISTANCE, /* cm along the followed route */
+	E_DATA_ROUTE_REMAINING, /* cm to the end of the followed route */
+	E_DATA_OFF_ROUTE, /* cm from the position to the followed route */
+	E_DATA_CHANNEL_NUMBER, // must be last
+} E_data_channel;
+
+/* Sensor channels are the first ones of the list, the only ones accepted by data_manager_push */
+#define DATA_NB_SENSOR_CHANNELS (E_DATA_ELAPSED_TIME)
+
+#define data_channel_bit(channel) (UINT64_C(1) << (channel))
+
+/* One tick of the common timeline, all the channels aligned on the same timestamp */
+typedef struct {
+	int64_t timestamp; /* ms */
+	uint64_t valid_mask; /* bit set when the channel has a value, cleared during a gap */
+	int32_t value[E_DATA_CHANNEL_NUMBER];
+} T_data_frame;
+
+#define data_frame_is_valid(frame, channel) (((frame)->valid_mask >> (channel)) & 1)
+
 int data_manager_init(void);
 
+/* Reset the ride time and the derived metrics */
+int data_manager_start_ride(void);
+
+/* Close the metrics still in progress, before the totals of the ride are read */
+int data_manager_stop_ride(void);
+
+/* Resume a ride interrupted by a power cut, the metrics load their state from
+ * the checkpoint saved by metric_registry_save. frames[0] is the tick the
+ * checkpoint was saved at, the next ones were recorded after it and are
+ * replayed. clock_shift converts the timestamps of the frames to the actual
+ * time, in ms.
+ */
+int data_manager_resume_ride(const void *checkpoint, int size, const T_data_frame *frames, int nb_frames, int64_t clock_shift);
+
+/* Rebuild the metrics of an interrupted ride the same way without going on
+ * with it, read is called with the rebuilt metrics, closed as at the end of
+ * a ride, before the next tick can change them. Only while no ride is
+ * recorded.
+ */
+int data_manager_replay_ride(const void *checkpoint, int size, const T_data_frame *frames, int nb_frames,
+	void (*read)(void *user_data), void *user_data);
+
+/* Auto-pause, the metrics and the ride history are frozen while paused */
+int data_manager_set_auto_pause(bool is_enabled);
+bool data_manager_is_paused(void);
+
+/* Push a raw sensor sample, timestamp in ms on the monotonic clock */
+int data_manager_push(E_data_channel channel, int64_t timestamp, int32_t value);
+
+/* Copy the last frame of the common timeline */
+int data_manager_get_frame(T_data_frame *frame);
+
+/* Declare a consumer of a channel (screen, recorder, alert), the metrics
+ * are only evaluated while one of their outputs has a consumer
+ */
+int data_manager_acquire_channel(E_data_channel channel);
+int data_manager_release_channel(E_data_channel channel);
+
+/* Subscribe a LVGL subject to a channel, the subject holds the channel value
+ * converted with ratio to the display unit (speed with FIXED_POINT_RATIO(36, 1000)
+ * gives 0.1 km/h steps) and is only set when the converted value changes.
+ * Return the subscription id.
+ */
+int data_manager_subscribe(E_data_channel channel, T_fixed_point_ratio ratio, lv_subject_t *subject);
+int data_manager_unsubscribe(int id);
+
+/* Set the subjects whose value changed since the last call, must be called
+ * with the LVGL mutex locked
+ */
+int data_manager_update_subjects(void);
+
+/* Actual monotonic time in ms, to timestamp the sensor samples */
+int64_t data_manager_get_time(void);
+
 #endif //_DATA_MANAGER_HEADER_
@@ -16,9 +16,1136 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "utils.h"
+#include "fifo.h"
+#include "system.h"
+#include "system_config.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "zones.h"
+#include "climbs.h"
+#include "ride_log.h"
+#include "fit_encoder.h"
+#include "ride_catalogue.h"
+#include "ride_summary.h"
+#include "io_policy.h"
 #include "data_recorder.h"
 
+/* Holds the name of the ride being recorded, left behind by a power cut */
+#define CURRENT_RIDE_FILE_PATH RIDES_FOLDER_PATH "/current"
+
+/* Derived channels recorded in the ride log or needed by the files written
+ * at the end of the ride, the sensor channels are always recorded
+ */
+static const E_data_channel recorded_channels[] = {
+	E_DATA_SPEED,
+	E_DATA_DISTANCE,
+	E_DATA_ELEVATION_GAIN,
+	E_DATA_HEART_RATE_ZONE,
+	E_DATA_POWER_ZONE,
+	E_DATA_CLIMB,
+};
+
+#define NB_RECORDED_CHANNELS ((int)(sizeof(recorded_channels) / sizeof(recorded_channels[0])))
+
+/* fsync latency histogram, 8 buckets per power of two of us, 12.5 % resolution */
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_SUB_BUCKETS_SHIFT 3
+#define LATENCY_BUCKETS (30 * LATENCY_SUB_BUCKETS)
+
+/* State of the metrics kept with the ride when it ends */
+typedef struct {
+	T_zones_histogram histogram[E_ZONES_TYPE_NUMBER];
+	int nb_climbs;
+	T_climb climb[CLIMBS_MAX_CLIMBS];
+} T_ride_state;
+
+/* Head of the checkpoints of the ride log, followed by the metric states */
+typedef struct {
+	T_ride_catalogue_entry summary;
+	int64_t power_sum;
+	int32_t nb_power;
+	int64_t clock_offset; /* ms, of the frame */
+	T_data_frame frame; /* tick the checkpoint was saved at */
+} T_checkpoint_header;
+
+static struct {
+	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the ride log encoding and the stats, the data manager pushes the frames */
+	pthread_cond_t released; /* a buffer was written by the writer thread */
+	pthread_t writer_thread;
+	T_fifo queue; /* buffers handed to the writer thread */
+	bool is_recording;
+	char ride_name[DATA_RECORDER_RIDE_NAME_SIZE];
+	T_ride_log_writer log;
+	T_ride_catalogue_entry summary; /* catalogue entry, updated with each frame */
+	int64_t power_sum; /* W, frames with power while moving */
+	int32_t nb_power;
+	bool has_checkpoint; /* a checkpoint was saved since the start or the resume of the ride */
+	int64_t last_checkpoint; /* ms, timestamp of the frame of the last checkpoint */
+	uint8_t checkpoint[RIDE_LOG_MAX_CHECKPOINT_SIZE];
+	pthread_mutex_t state_mutex; /* serialize the start, stop, resume and close of the rides */
+	pthread_cond_t state_changed; /* the interrupted ride was resumed or closed */
+	bool has_interrupted_ride; /* written with both mutexes locked */
+	bool is_closing; /* the writer thread closes the interrupted ride, written with both mutexes locked */
+	T_ride_log_recovery recovery; /* tail of the interrupted ride log */
+	T_data_frame *frames; /* tick of the last checkpoint and the ones recorded after it */
+	int nb_frames;
+	T_data_recorder_stats stats;
+	uint32_t latency[LATENCY_BUCKETS];
+} data_recorder = {
+	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.released = PTHREAD_COND_INITIALIZER,
+	.state_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.state_changed = PTHREAD_COND_INITIALIZER,
+	.log = {.fd = -1},
+};
+
+static int _build_path(const char *extension, char *buff, int size)
+{
+	int ret = snprintf(buff, size, "%s/%s%s", RIDES_FOLDER_PATH, data_recorder.ride_name, extension);
+	fail_if_negative(ret, -1, "snprintf failed\n");
+	fail_if_superior_or_equal(ret, size, -2, "path is too long\n");
+
+	return 0;
+}
+
+/* Offset from the data manager time to the UTC time, in ms */
+static int64_t _get_clock_offset(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - data_manager_get_time();
+}
+
+static int _get_latency_bucket(uint32_t latency)
+{
+	if(latency < LATENCY_SUB_BUCKETS)
+	{
+		return latency;
+	}
+
+	int msb = 31 - __builtin_clz(latency);
+	int sub = (latency >> (msb - LATENCY_SUB_BUCKETS_SHIFT)) & (LATENCY_SUB_BUCKETS - 1);
+
+	return (msb - LATENCY_SUB_BUCKETS_SHIFT + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/* Highest latency of the bucket */
+static uint32_t _get_latency_bucket_max(int bucket)
+{
+	if(bucket < LATENCY_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+	uint32_t low = (uint32_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+
+	return low + (1U << shift) - 1;
+}
+
+/* Latency under which percent of the syncs completed, in us */
+static int32_t _get_latency_percentile(int percent)
+{
+	int64_t count = 0;
+	int64_t target = ((int64_t)data_recorder.stats.nb_flushes * percent + 99) / 100;
+
+	if(data_recorder.stats.nb_flushes == 0)
+	{
+		return 0;
+	}
+
+	for(int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		count += data_recorder.latency[i];
+		if(count >= target)
+		{
+			uint32_t latency = _get_latency_bucket_max(i);
+			return (latency < (uint32_t)data_recorder.stats.fsync_max) ? (int32_t)latency : data_recorder.stats.fsync_max;
+		}
+	}
+
+	return data_recorder.stats.fsync_max;
+}
+
+static void _close_queued_ride(void);
+
+/* Write the buffers handed by data_recorder_push, the data manager never waits
+ * for the flash. A null buffer closes the interrupted ride.
+ */
+static void * writer_thread_handler(void *data)
+{
+	int ret = 0;
+	int size = 0;
+	T_ride_log_buffer *buffer = NULL;
+	struct timespec start, end;
+
+	while(1)
+	{
+		ret = fifo_pop_wait(&data_recorder.queue, &buffer);
+		if(ret < 0)
+		{
+			log_error("fifo_pop_wait failed, return: %d\n", ret);
+			continue;
+		}
+
+		if(buffer == NULL)
+		{
+			_close_queued_ride();
+			continue;
+		}
+
+		size = ride_log_writer_write(&data_recorder.log, buffer);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = (size < 0) ? size : ride_log_writer_sync(&data_recorder.log);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if(ret < 0)
+		{
+			log_error("writing the ride log failed, return: %d\n", ret);
+		}
+		else
+		{
+			/* The files written meanwhile go to the flash with the log */
+			io_policy_account(E_IO_POLICY_RIDE_LOG, buffer->new_size, size, 1);
+			io_policy_flush();
+		}
+
+		int64_t latency = (int64_t)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+		if(latency > INT32_MAX)
+		{
+			latency = INT32_MAX;
+		}
+
+		pthread_mutex_lock(&data_recorder.mutex);
+		ride_log_writer_release(&data_recorder.log, buffer);
+		if(ret >= 0)
+		{
+			data_recorder.stats.bytes_written += size;
+			data_recorder.stats.nb_flushes++;
+			data_recorder.latency[_get_latency_bucket((uint32_t)latency)]++;
+			if(latency > data_recorder.stats.fsync_max)
+			{
+				data_recorder.stats.fsync_max = (int32_t)latency;
+			}
+		}
+		pthread_cond_broadcast(&data_recorder.released);
+		pthread_mutex_unlock(&data_recorder.mutex);
+	}
+
+	return NULL;
+}
+
+/* Totals of the ride for the catalogue, the frames hold the cumulated values */
+static void _update_summary(const T_data_frame *frame)
+{
+	T_ride_catalogue_entry *summary = &data_recorder.summary;
+	bool is_paused = data_frame_is_valid(frame, E_DATA_PAUSED) && frame->value[E_DATA_PAUSED];
+
+	if(data_frame_is_valid(frame, E_DATA_MOVING_TIME))
+	{
+		summary->duration = frame->value[E_DATA_MOVING_TIME] / 1000;
+	}
+	if(data_frame_is_valid(frame, E_DATA_DISTANCE))
+	{
+		summary->distance = frame->value[E_DATA_DISTANCE] / 100;
+	}
+	if(data_frame_is_valid(frame, E_DATA_ELEVATION_GAIN))
+	{
+		summary->elevation_gain = frame->value[E_DATA_ELEVATION_GAIN] / 100;
+	}
+	if(data_frame_is_valid(frame, E_DATA_POWER) && !is_paused)
+	{
+		data_recorder.power_sum += frame->value[E_DATA_POWER];
+		data_recorder.nb_power++;
+		summary->average_power = (int32_t)(data_recorder.power_sum / data_recorder.nb_power);
+	}
+}
+
+/* Save the state of the ride after the frame, return 1 when the checkpoint was added to the log */
+static int _checkpoint(const T_data_frame *frame)
+{
+	int ret = 0;
+	T_checkpoint_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.summary = data_recorder.summary;
+	header.power_sum = data_recorder.power_sum;
+	header.nb_power = data_recorder.nb_power;
+	header.clock_offset = data_recorder.log.clock_offset;
+	header.frame = *frame;
+	memcpy(data_recorder.checkpoint, &header, sizeof(header));
+
+	/* Called from the data manager thread, the metrics are not running */
+	ret = metric_registry_save(&data_recorder.checkpoint[sizeof(header)], sizeof(data_recorder.checkpoint) - sizeof(header));
+	fail_if_negative(ret, -1, "metric_registry_save failed, return: %d\n", ret);
+
+	ret = ride_log_writer_checkpoint(&data_recorder.log, data_recorder.checkpoint, sizeof(header) + ret);
+	fail_if_negative(ret, -2, "ride_log_writer_checkpoint failed, return: %d\n", ret);
+
+	/* Otherwise the buffer is full, retried with the next frame */
+	if(ret == 1)
+	{
+		data_recorder.has_checkpoint = true;
+		data_recorder.last_checkpoint = frame->timestamp;
+	}
+
+	return ret;
+}
+
+/* The ride is named after its local start time */
+static time_t _get_start_time(const char *name)
+{
+	struct tm tm;
+
+	memset(&tm, 0, sizeof(tm));
+	if(sscanf(name, "%d-%d-%d_%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+	{
+		return 0;
+	}
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_isdst = -1;
+
+	return mktime(&tm);
+}
+
+/* Without checkpoint the totals come from the frames of the tail searched by
+ * the recovery, the cumulative channels are exact, the average power only
+ * covers these frames
+ */
+static int _load_tail_summary(const char *path)
+{
+	int ret = 0;
+	T_ride_log_reader reader;
+	T_data_frame frame;
+	int nb_blocks = data_recorder.recovery.nb_blocks;
+	uint32_t first = (nb_blocks > RIDE_LOG_CHECKPOINT_SEARCH_BLOCKS) ? nb_blocks - RIDE_LOG_CHECKPOINT_SEARCH_BLOCKS : 0;
+
+	ret = ride_log_reader_open(&reader, path);
+	fail_if_negative(ret, -1, "ride_log_reader_open failed, return: %d\n", ret);
+
+	ret = ride_log_reader_seek(&reader, first);
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_seek failed, return: %d\n", ret);
+		ret = -2;
+		goto tail_cleanup;
+	}
+
+	while((ret = ride_log_reader_next(&reader, &frame)) == 1)
+	{
+		_update_summary(&frame);
+	}
+
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_next failed, return: %d\n", ret);
+		ret = -3;
+		goto tail_cleanup;
+	}
+
+tail_cleanup:
+	ride_log_reader_close(&reader);
+
+	return ret;
+}
+
+/* Rebuild the totals of the interrupted ride from its last checkpoint and the frames after it */
+static int _load_interrupted_ride(const char *path)
+{
+	int ret = 0;
+	int capacity = 0;
+	T_checkpoint_header header;
+	T_ride_log_reader reader;
+	T_data_frame frame;
+
+	memset(&data_recorder.summary, 0, sizeof(data_recorder.summary));
+	data_recorder.summary.start_time = _get_start_time(data_recorder.ride_name);
+	safe_strncpy(data_recorder.summary.name, data_recorder.ride_name, sizeof(data_recorder.summary.name));
+	data_recorder.power_sum = 0;
+	data_recorder.nb_power = 0;
+	data_recorder.nb_frames = 0;
+
+	/* Without checkpoint the ride can only be closed */
+	if(!data_recorder.recovery.has_checkpoint)
+	{
+		ret = _load_tail_summary(path);
+		fail_if_negative(ret, -1, "_load_tail_summary failed, return: %d\n", ret);
+		return 0;
+	}
+	fail_if_inferior(data_recorder.recovery.checkpoint_size, (int)sizeof(header), -2, "checkpoint is too small\n");
+
+	memcpy(&header, data_recorder.recovery.checkpoint, sizeof(header));
+	data_recorder.summary = header.summary;
+	data_recorder.power_sum = header.power_sum;
+	data_recorder.nb_power = header.nb_power;
+
+	ret = ride_log_reader_open(&reader, path);
+	fail_if_negative(ret, -3, "ride_log_reader_open failed, return: %d\n", ret);
+
+	ret = ride_log_reader_seek(&reader, data_recorder.recovery.sequence);
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_seek failed, return: %d\n", ret);
+		ret = -4;
+		goto load_cleanup;
+	}
+
+	/* Only the frames after the last checkpoint are read, a few minutes at most */
+	frame = header.frame;
+	do
+	{
+		if(data_recorder.nb_frames == capacity)
+		{
+			capacity = (capacity == 0) ? 64 : 2 * capacity;
+			T_data_frame *frames = realloc(data_recorder.frames, capacity * sizeof(T_data_frame));
+			if(frames == NULL)
+			{
+				log_error("realloc failed\n");
+				ret = -5;
+				goto load_cleanup;
+			}
+			data_recorder.frames = frames;
+		}
+
+		if(data_recorder.nb_frames > 0)
+		{
+			_update_summary(&frame);
+		}
+		data_recorder.frames[data_recorder.nb_frames++] = frame;
+	}
+	while((ret = ride_log_reader_next(&reader, &frame)) == 1);
+
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_next failed, return: %d\n", ret);
+		ret = -6;
+		goto load_cleanup;
+	}
+
+load_cleanup:
+	ride_log_reader_close(&reader);
+
+	return ret;
+}
+
+static void _release_recorded_channels(int nb_channels)
+{
+	for(int i = 0; i < nb_channels; i++)
+	{
+		data_manager_release_channel(recorded_channels[i]);
+	}
+}
+
+/* All the recorded channels or none of them */
+static int _acquire_recorded_channels(void)
+{
+	int ret = 0;
+
+	for(int i = 0; i < NB_RECORDED_CHANNELS; i++)
+	{
+		ret = data_manager_acquire_channel(recorded_channels[i]);
+		if(ret < 0)
+		{
+			log_error("data_manager_acquire_channel failed, return: %d\n", ret);
+			_release_recorded_channels(i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void _free_interrupted_ride(void)
+{
+	free(data_recorder.frames);
+	data_recorder.frames = NULL;
+	data_recorder.nb_frames = 0;
+}
+
+/* Called with the state mutex locked, the readers only lock the other one */
+static void _set_interrupted_ride(bool has_interrupted_ride, bool is_closing)
+{
+	pthread_mutex_lock(&data_recorder.mutex);
+	data_recorder.has_interrupted_ride = has_interrupted_ride;
+	data_recorder.is_closing = is_closing;
+	pthread_mutex_unlock(&data_recorder.mutex);
+
+	pthread_cond_broadcast(&data_recorder.state_changed);
+}
+
+/* A ride still marked as current was interrupted, keep its log up to the
+ * last valid block until it is resumed or closed
+ */
+static int _recover_current_ride(void)
+{
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+	FILE *file = fopen(CURRENT_RIDE_FILE_PATH, "r");
+
+	if(file == NULL)
+	{
+		return 0;
+	}
+
+	if(fgets(data_recorder.ride_name, sizeof(data_recorder.ride_name), file) == NULL)
+	{
+		log_error("reading %s failed\n", CURRENT_RIDE_FILE_PATH);
+		ret = -1;
+		goto recover_cleanup;
+	}
+	data_recorder.ride_name[strcspn(data_recorder.ride_name, "\n")] = '\0';
+
+	ret = _build_path(DATA_RECORDER_LOG_EXTENSION, path, sizeof(path));
+	if(ret < 0)
+	{
+		log_error("_build_path failed, return: %d\n", ret);
+		ret = -2;
+		goto recover_cleanup;
+	}
+
+	/* Only the tail of the log is read, the boot time does not depend on the ride length */
+	ret = ride_log_recover(path, &data_recorder.recovery);
+	if(ret < 0)
+	{
+		log_error("ride_log_recover %s failed, return: %d\n", path, ret);
+		ret = -3;
+		goto recover_cleanup;
+	}
+
+	ret = _load_interrupted_ride(path);
+	if(ret < 0)
+	{
+		log_error("_load_interrupted_ride failed, return: %d\n", ret);
+		_free_interrupted_ride();
+		ret = -4;
+		goto recover_cleanup;
+	}
+
+	log_warn("ride %s was interrupted, %d blocks recovered, %d frames after the last checkpoint\n", data_recorder.ride_name,
+		data_recorder.recovery.nb_blocks, data_recorder.nb_frames);
+	data_recorder.has_interrupted_ride = true;
+	ret = 0;
+
+recover_cleanup:
+	fclose(file);
+	if(ret < 0)
+	{
+		remove(CURRENT_RIDE_FILE_PATH);
+	}
+
+	return ret;
+}
+
+/* Account a file written at the end of the ride and sync it */
+static void _account_file(const char *path)
+{
+	struct stat st;
+
+	if(stat(path, &st) == 0)
+	{
+		io_policy_account(E_IO_POLICY_RIDE_FILES, st.st_size, st.st_size, 0);
+	}
+
+	if(io_policy_sync(E_IO_POLICY_RIDE_FILES, path) < 0)
+	{
+		log_error("io_policy_sync %s failed\n", path);
+	}
+}
+
+/* Sidecar of the detail view, a ride without it is still listed */
+static void _write_summary(const char *log_path, const T_ride_state *state)
+{
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+
+	T_ride_summary *summary = malloc(sizeof(T_ride_summary));
+	if(summary == NULL)
+	{
+		log_error("malloc summary failed\n");
+		return;
+	}
+
+	ret = _build_path(RIDE_SUMMARY_EXTENSION, path, sizeof(path));
+	if(ret == 0)
+	{
+		ret = ride_summary_build(log_path, &data_recorder.summary, (state != NULL) ? state->histogram : NULL,
+			(state != NULL) ? state->climb : NULL, (state != NULL) ? state->nb_climbs : 0, summary);
+	}
+	if(ret == 0)
+	{
+		ret = ride_summary_save(path, summary);
+	}
+
+	if(ret < 0)
+	{
+		log_error("writing the summary of %s failed, return: %d\n", data_recorder.ride_name, ret);
+	}
+	else
+	{
+		_account_file(path);
+	}
+
+	free(summary);
+}
+
+/* Read the zones and the climbs of the ride from the metrics */
+static void _get_ride_state(void *user_data)
+{
+	T_ride_state *state = user_data;
+	int count = 0;
+
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		zones_get_histogram(i, &state->histogram[i]);
+	}
+
+	state->nb_climbs = 0;
+	count = climbs_get_count();
+	for(int i = 0; i < count && state->nb_climbs < CLIMBS_MAX_CLIMBS; i++)
+	{
+		if(climbs_get(i, &state->climb[state->nb_climbs]) == 0)
+		{
+			state->nb_climbs++;
+		}
+	}
+}
+
+/* Files written at the end of the ride, from its log and its totals, state is
+ * null when the zones and the climbs of the ride are not known
+ */
+static int _finish_ride(const T_ride_state *state)
+{
+	int ret = 0;
+	struct stat st;
+	char path[DATA_RECORDER_PATH_SIZE];
+	char log_path[DATA_RECORDER_PATH_SIZE];
+
+	/* FIT activity converted from the ride log, for the analysis tools */
+	ret = _build_path(DATA_RECORDER_LOG_EXTENSION, log_path, sizeof(log_path));
+	fail_if_negative(ret, -1, "_build_path failed, return: %d\n", ret);
+
+	ret = _build_path(".fit", path, sizeof(path));
+	fail_if_negative(ret, -2, "_build_path failed, return: %d\n", ret);
+
+	ret = fit_encoder_export(log_path, path);
+	fail_if_negative(ret, -3, "fit_encoder_export failed, return: %d\n", ret);
+	_account_file(path);
+
+	/* Catalogue entry, the results screen lists the rides without opening them */
+	if(stat(log_path, &st) == 0)
+	{
+		data_recorder.summary.log_size = (uint32_t)st.st_size;
+	}
+
+	ret = ride_catalogue_add(RIDE_CATALOGUE_PATH, &data_recorder.summary);
+	fail_if_negative(ret, -4, "ride_catalogue_add failed, return: %d\n", ret);
+
+	/* The catalogue syncs itself, the file and its directory */
+	if(stat(RIDE_CATALOGUE_PATH, &st) == 0)
+	{
+		io_policy_account(E_IO_POLICY_RIDE_FILES, sizeof(data_recorder.summary), st.st_size, 2);
+	}
+
+	_write_summary(log_path, state);
+
+	return 0;
+}
+
+/* Called with the state mutex locked, once the interrupted ride is taken. The
+ * metrics are rebuilt from the checkpoint for the zones and the climbs.
+ */
+static int _close_interrupted_ride(void)
+{
+	int ret = 0;
+	T_checkpoint_header header;
+	T_ride_state *state = NULL;
+
+	if(data_recorder.nb_frames > 0)
+	{
+		state = malloc(sizeof(T_ride_state));
+	}
+
+	if(state != NULL)
+	{
+		/* The metrics only run with a consumer of their channels */
+		ret = _acquire_recorded_channels();
+		if(ret == 0)
+		{
+			memcpy(&header, data_recorder.recovery.checkpoint, sizeof(header));
+			ret = data_manager_replay_ride(&data_recorder.recovery.checkpoint[sizeof(header)],
+				data_recorder.recovery.checkpoint_size - sizeof(header), data_recorder.frames, data_recorder.nb_frames, &_get_ride_state, state);
+			_release_recorded_channels(NB_RECORDED_CHANNELS);
+		}
+		if(ret < 0)
+		{
+			log_error("the zones and the climbs of %s are not rebuilt, return: %d\n", data_recorder.ride_name, ret);
+			free(state);
+			state = NULL;
+		}
+	}
+
+	ret = _finish_ride(state);
+	free(state);
+
+	_free_interrupted_ride();
+	remove(CURRENT_RIDE_FILE_PATH);
+	fail_if_negative(ret, -1, "_finish_ride failed, return: %d\n", ret);
+
+	log_info("interrupted ride %s closed\n", data_recorder.ride_name);
+
+	return 0;
+}
+
+/* Called by the writer thread, the files are not written by the UI thread */
+static void _close_queued_ride(void)
+{
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	if(_close_interrupted_ride() < 0)
+	{
+		log_error("_close_interrupted_ride failed\n");
+	}
+	_set_interrupted_ride(false, false);
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+}
+
+/* Take the interrupted ride and hand its closing to the writer thread, called
+ * with the state mutex locked, no ride can start until it is closed
+ */
+static int _post_close(void)
+{
+	int ret = 0;
+	T_ride_log_buffer *buffer = NULL;
+
+	fail_if_false(data_recorder.has_interrupted_ride, -1, "no interrupted ride\n");
+	_set_interrupted_ride(false, true);
+
+	/* A null buffer asks the writer thread to close the ride */
+	ret = fifo_push(&data_recorder.queue, &buffer);
+	if(ret < 0)
+	{
+		log_error("fifo_push failed, return: %d\n", ret);
+		ret = _close_interrupted_ride();
+		_set_interrupted_ride(false, false);
+		fail_if_negative(ret, -2, "_close_interrupted_ride failed, return: %d\n", ret);
+	}
+
+	return 0;
+}
+
 int data_recorder_init(void)
 {
+	fail_if_true(data_recorder.is_initialized, -1, "data_recorder is already initialized\n");
+
+	int ret = 0;
+
+	if(mkdir(RIDES_FOLDER_PATH, 0755) < 0 && errno != EEXIST)
+	{
+		fail(-2, "mkdir %s failed, errno: %d\n", RIDES_FOLDER_PATH, errno);
+	}
+
+	data_recorder.is_recording = false;
+	data_recorder.has_interrupted_ride = false;
+
+	if(_recover_current_ride() < 0)
+	{
+		log_error("_recover_current_ride failed\n");
+	}
+
+	/* Only one buffer is written at a time, the other one is being filled */
+	ret = fifo_create(&data_recorder.queue, 2, sizeof(T_ride_log_buffer *));
+	fail_if_negative(ret, -3, "fifo_create failed, return: %d\n", ret);
+
+	ret = pthread_create(&data_recorder.writer_thread, NULL, &writer_thread_handler, NULL);
+	fail_if_not_zero(ret, -4, "Create writer thread failed, return: %d\n", ret);
+
+	/* Mark module as initialized */
+	data_recorder.is_initialized = true;
+
+	return 0;
+}
+
+int data_recorder_get_interrupted_ride(T_ride_catalogue_entry *summary)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+	fail_if_null(summary, -2, "summary is null\n");
+
+	int ret = 0;
+
+	pthread_mutex_lock(&data_recorder.mutex);
+	if(data_recorder.has_interrupted_ride)
+	{
+		*summary = data_recorder.summary;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&data_recorder.mutex);
+
+	return ret;
+}
+
+/* Called with the state mutex locked */
+static int _resume(void)
+{
+	fail_if_true(data_recorder.is_recording, -1, "data_recorder is already recording\n");
+	fail_if_false(data_recorder.has_interrupted_ride, -2, "no interrupted ride\n");
+	fail_if_zero(data_recorder.nb_frames, -3, "ride %s has no checkpoint, it can not be resumed\n", data_recorder.ride_name);
+
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+	T_checkpoint_header header;
+	int64_t clock_offset = _get_clock_offset();
+
+	ret = _build_path(DATA_RECORDER_LOG_EXTENSION, path, sizeof(path));
+	fail_if_negative(ret, -4, "_build_path failed, return: %d\n", ret);
+
+	ret = _acquire_recorded_channels();
+	fail_if_negative(ret, -5, "_acquire_recorded_channels failed, return: %d\n", ret);
+
+	/* Not under the recorder mutex, the data manager pushes the frames with its own mutex locked */
+	memcpy(&header, data_recorder.recovery.checkpoint, sizeof(header));
+	ret = data_manager_resume_ride(&data_recorder.recovery.checkpoint[sizeof(header)], data_recorder.recovery.checkpoint_size - sizeof(header),
+		data_recorder.frames, data_recorder.nb_frames, header.clock_offset - clock_offset);
+	if(ret < 0)
+	{
+		_release_recorded_channels(NB_RECORDED_CHANNELS);
+		fail(-6, "data_manager_resume_ride failed, return: %d\n", ret);
+	}
+
+	/* A checkpoint is saved with the first frame, the next recovery does not go back before the resume */
+	pthread_mutex_lock(&data_recorder.mutex);
+	memset(&data_recorder.stats, 0, sizeof(data_recorder.stats));
+	memset(data_recorder.latency, 0, sizeof(data_recorder.latency));
+	data_recorder.has_checkpoint = false;
+	io_policy_reset_stats();
+	io_policy_open_window();
+	ret = ride_log_writer_reopen(&data_recorder.log, path, data_recorder.recovery.nb_blocks, clock_offset, system_config_get_ride_flush_period(),
+		system_config_get_ride_write_size(), system_config_get_ride_direct_io() > 0);
+	data_recorder.is_recording = (ret >= 0);
+	pthread_mutex_unlock(&data_recorder.mutex);
+	if(ret < 0)
+	{
+		/* The log is left as recovered, the ride is closed from it */
+		io_policy_close_window();
+		_release_recorded_channels(NB_RECORDED_CHANNELS);
+		if(_post_close() < 0)
+		{
+			log_error("_post_close failed\n");
+		}
+		fail(-7, "ride_log_writer_reopen failed, return: %d\n", ret);
+	}
+
+	_free_interrupted_ride();
+	_set_interrupted_ride(false, false);
+
+	log_info("resuming ride %s\n", data_recorder.ride_name);
+
+	return 0;
+}
+
+int data_recorder_resume(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	int ret = _resume();
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+	fail_if_negative(ret, -2, "_resume failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_recorder_close_interrupted_ride(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	int ret = _post_close();
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+	fail_if_negative(ret, -2, "_post_close failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_recorder_can_start(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.mutex);
+	int ret = (data_recorder.has_interrupted_ride || data_recorder.is_closing) ? 0 : 1;
+	pthread_mutex_unlock(&data_recorder.mutex);
+
+	return ret;
+}
+
+int data_recorder_wait_interrupted_ride(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	while(data_recorder.has_interrupted_ride || data_recorder.is_closing)
+	{
+		pthread_cond_wait(&data_recorder.state_changed, &data_recorder.state_mutex);
+	}
+	int ret = data_recorder.is_recording ? 1 : 0;
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+
+	return ret;
+}
+
+/* Called with the state mutex locked */
+static int _start(void)
+{
+	fail_if_true(data_recorder.is_recording, -1, "data_recorder is already recording\n");
+	/* The closing of the interrupted ride uses its name */
+	fail_if_true((data_recorder.has_interrupted_ride || data_recorder.is_closing), -2,
+		"the interrupted ride %s is not resumed or closed yet\n", data_recorder.ride_name);
+
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+
+	time_t t = time(NULL);
+	struct tm *tmp = localtime(&t);
+	fail_if_null(tmp, -3, "localtime failed\n");
+
+	ret = strftime(data_recorder.ride_name, sizeof(data_recorder.ride_name), "%Y-%m-%d_%H-%M-%S", tmp);
+	fail_if_zero(ret, -4, "strftime failed\n");
+
+	ret = _build_path(DATA_RECORDER_LOG_EXTENSION, path, sizeof(path));
+	fail_if_negative(ret, -5, "_build_path failed, return: %d\n", ret);
+
+	/* Mark the ride as current until it is stopped */
+	FILE *file = fopen(CURRENT_RIDE_FILE_PATH, "w");
+	fail_if_null(file, -6, "fopen %s failed, errno: %d\n", CURRENT_RIDE_FILE_PATH, errno);
+	fprintf(file, "%s\n", data_recorder.ride_name);
+	fclose(file);
+
+	ret = _acquire_recorded_channels();
+	if(ret < 0)
+	{
+		remove(CURRENT_RIDE_FILE_PATH);
+		fail(-7, "_acquire_recorded_channels failed, return: %d\n", ret);
+	}
+
+	pthread_mutex_lock(&data_recorder.mutex);
+	memset(&data_recorder.summary, 0, sizeof(data_recorder.summary));
+	data_recorder.summary.start_time = t;
+	safe_strncpy(data_recorder.summary.name, data_recorder.ride_name, sizeof(data_recorder.summary.name));
+	data_recorder.power_sum = 0;
+	data_recorder.nb_power = 0;
+	data_recorder.has_checkpoint = false;
+	memset(&data_recorder.stats, 0, sizeof(data_recorder.stats));
+	memset(data_recorder.latency, 0, sizeof(data_recorder.latency));
+	io_policy_reset_stats();
+	io_policy_open_window();
+	ret = ride_log_writer_open(&data_recorder.log, path, _get_clock_offset(), system_config_get_ride_flush_period(),
+		system_config_get_ride_write_size(), system_config_get_ride_direct_io() > 0);
+	data_recorder.is_recording = (ret >= 0);
+	pthread_mutex_unlock(&data_recorder.mutex);
+	if(ret < 0)
+	{
+		io_policy_close_window();
+		_release_recorded_channels(NB_RECORDED_CHANNELS);
+		remove(CURRENT_RIDE_FILE_PATH);
+		fail(-8, "ride_log_writer_open failed, return: %d\n", ret);
+	}
+
+	log_info("recording ride %s\n", data_recorder.ride_name);
+
+	return 0;
+}
+
+int data_recorder_start(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	int ret = _start();
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+	fail_if_negative(ret, -2, "_start failed, return: %d\n", ret);
+
+	return 0;
+}
+
+/* Called with the state mutex locked */
+static int _stop(void)
+{
+	fail_if_false(data_recorder.is_recording, -1, "data_recorder is not recording\n");
+
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+	T_ride_state state;
+
+	/* Wait for the writer thread, the rest of the log is written here */
+	pthread_mutex_lock(&data_recorder.mutex);
+	data_recorder.is_recording = false;
+	while(data_recorder.log.buffer[0].is_busy || data_recorder.log.buffer[1].is_busy)
+	{
+		pthread_cond_wait(&data_recorder.released, &data_recorder.mutex);
+	}
+	data_recorder.stats.nb_dropped_frames = data_recorder.log.nb_dropped;
+	pthread_mutex_unlock(&data_recorder.mutex);
+
+	uint32_t end = data_recorder.log.end;
+	ret = ride_log_writer_close(&data_recorder.log);
+	if(ret < 0)
+	{
+		log_error("ride_log_writer_close failed, return: %d\n", ret);
+	}
+	else
+	{
+		io_policy_account(E_IO_POLICY_RIDE_LOG, (int64_t)(data_recorder.log.end - end) * RIDE_LOG_BLOCK_SIZE,
+			(int64_t)(data_recorder.log.end - end) * RIDE_LOG_BLOCK_SIZE, 1);
+	}
+
+	/* The log is closed, nothing left to sync the other files with */
+	io_policy_close_window();
+
+	log_info("ride log: %lld bytes in %d flushes, fsync p50 %d us, p99 %d us, %d stalls, %d frames dropped\n",
+		(long long)data_recorder.stats.bytes_written, data_recorder.stats.nb_flushes, _get_latency_percentile(50),
+		_get_latency_percentile(99), data_recorder.stats.nb_stalls, data_recorder.stats.nb_dropped_frames);
+
+	_release_recorded_channels(NB_RECORDED_CHANNELS);
+	remove(CURRENT_RIDE_FILE_PATH);
+
+	/* Zone histograms, read back by the results screen, the ride is kept without them */
+	ret = _build_path(".zones", path, sizeof(path));
+	if(ret == 0)
+	{
+		ret = zones_save(path);
+	}
+	if(ret < 0)
+	{
+		log_error("writing the zones of %s failed, return: %d\n", data_recorder.ride_name, ret);
+	}
+	else
+	{
+		_account_file(path);
+	}
+
+	/* Zones and climbs of the ride, kept in the summary */
+	_get_ride_state(&state);
+
+	ret = _finish_ride(&state);
+	fail_if_negative(ret, -2, "_finish_ride failed, return: %d\n", ret);
+
+	io_policy_dump();
+
+	log_info("ride %s recorded\n", data_recorder.ride_name);
+
+	return 0;
+}
+
+int data_recorder_stop(void)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+
+	pthread_mutex_lock(&data_recorder.state_mutex);
+	int ret = _stop();
+	pthread_mutex_unlock(&data_recorder.state_mutex);
+	fail_if_negative(ret, -2, "_stop failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int data_recorder_push(const T_data_frame *frame)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+	fail_if_null(frame, -2, "frame is null\n");
+
+	int ret = 0;
+	int is_due = 0;
+	T_ride_log_buffer *buffer = NULL;
+
+	pthread_mutex_lock(&data_recorder.mutex);
+	if(!data_recorder.is_recording)
+	{
+		goto push_cleanup;
+	}
+
+	_update_summary(frame);
+
+	ret = ride_log_writer_push(&data_recorder.log, frame);
+	if(ret < 0)
+	{
+		log_error("ride_log_writer_push failed, return: %d\n", ret);
+		ret = -3;
+		goto push_cleanup;
+	}
+
+	is_due = ret;
+
+	/* The checkpoint is written with the buffer it closes */
+	if(!data_recorder.has_checkpoint || frame->timestamp - data_recorder.last_checkpoint >= DATA_RECORDER_CHECKPOINT_PERIOD)
+	{
+		ret = _checkpoint(frame);
+		if(ret < 0)
+		{
+			log_error("_checkpoint failed, return: %d\n", ret);
+			ret = -6;
+			goto push_cleanup;
+		}
+		is_due |= ret;
+	}
+
+	/* The buffer is due, hand it to the writer thread unless it still writes the other one */
+	if(is_due)
+	{
+		ret = ride_log_writer_swap(&data_recorder.log, &buffer);
+		if(ret < 0)
+		{
+			log_error("ride_log_writer_swap failed, return: %d\n", ret);
+			ret = -4;
+			goto push_cleanup;
+		}
+
+		if(buffer == NULL)
+		{
+			data_recorder.stats.nb_stalls++;
+		}
+		else if(fifo_push(&data_recorder.queue, &buffer) < 0)
+		{
+			log_error("fifo_push failed\n");
+			ride_log_writer_release(&data_recorder.log, buffer);
+			ret = -5;
+			goto push_cleanup;
+		}
+	}
+	ret = 0;
+
+push_cleanup:
+	pthread_mutex_unlock(&data_recorder.mutex);
+
+	return ret;
+}
+
+int data_recorder_get_stats(T_data_recorder_stats *stats)
+{
+	fail_if_false(data_recorder.is_initialized, -1, "data_recorder is not initialized\n");
+	fail_if_null(stats, -2, "stats is null\n");
+
+	pthread_mutex_lock(&data_recorder.mutex);
+	if(data_recorder.is_recording)
+	{
+		data_recorder.stats.nb_dropped_frames = data_recorder.log.nb_dropped;
+	}
+	data_recorder.stats.fsync_p50 = _get_latency_percentile(50);
+	data_recorder.stats.fsync_p90 = _get_latency_percentile(90);
+	data_recorder.stats.fsync_p99 = _get_latency_percentile(99);
+	*stats = data_recorder.stats;
+	pthread_mutex_unlock(&data_recorder.mutex);
+
 	return 0;
 }
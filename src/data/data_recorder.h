@@ -19,6 +19,63 @@
 #ifndef _DATA_RECORDER_HEADER_
 #define _DATA_RECORDER_HEADER_
 
+#include "data_manager.h"
+#include "ride_catalogue.h"
+
+#define DATA_RECORDER_RIDE_NAME_SIZE 32
+#define DATA_RECORDER_PATH_SIZE 128
+#define DATA_RECORDER_LOG_EXTENSION ".ride"
+#define DATA_RECORDER_CHECKPOINT_PERIOD 300000 /* ms, state of the ride saved in the log for the recovery */
+
+/* Ride log writing, since the start of the ride */
+typedef struct {
+	int64_t bytes_written;
+	int32_t nb_flushes;
+	int32_t nb_stalls; /* frames pushed while a buffer was due and the other one still being written */
+	int32_t nb_dropped_frames; /* frames lost, both buffers were full */
+	int32_t fsync_p50; /* us */
+	int32_t fsync_p90; /* us */
+	int32_t fsync_p99; /* us */
+	int32_t fsync_max; /* us */
+} T_data_recorder_stats;
+
+/* Load the ride interrupted by a power cut, if any, it is kept until it is
+ * resumed or closed
+ */
 int data_recorder_init(void);
 
+/* Return 1 and the totals of the interrupted ride when there is one, 0 otherwise */
+int data_recorder_get_interrupted_ride(T_ride_catalogue_entry *summary);
+
+/* Go on recording the interrupted ride, the metrics start again from its
+ * last checkpoint and the frames recorded after it
+ */
+int data_recorder_resume(void);
+
+/* Keep the interrupted ride as it was recorded, the FIT file and the
+ * catalogue entry are written by the writer thread as if it was stopped.
+ */
+int data_recorder_close_interrupted_ride(void);
+
+/* Return 1 when a ride can be started, 0 while the interrupted ride is not
+ * resumed or closed yet: a new ride is refused meanwhile.
+ */
+int data_recorder_can_start(void);
+
+/* Wait until the interrupted ride, if any, is resumed or closed, return 1
+ * when it was resumed and is being recorded
+ */
+int data_recorder_wait_interrupted_ride(void);
+
+/* Start and stop the recording of a ride, the ride is named after its start date */
+int data_recorder_start(void);
+int data_recorder_stop(void);
+
+/* Record a tick of the common timeline in the ride log, ignored when not recording.
+ * The frame is only encoded in memory, the flash is written by a dedicated thread.
+ */
+int data_recorder_push(const T_data_frame *frame);
+
+int data_recorder_get_stats(T_data_recorder_stats *stats);
+
 #endif //_DATA_RECORDER_HEADER_
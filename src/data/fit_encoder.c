@@ -0,0 +1,493 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "data_manager.h"
+#include "ride_log.h"
+#include "fit_encoder.h"
+
+#define FIT_HEADER_SIZE 14
+#define FIT_PROTOCOL_VERSION 0x20 /* 2.0 */
+#define FIT_PROFILE_VERSION 2132 /* 21.32 */
+#define FIT_DEFINITION_HEADER 0x40
+#define FIT_MAX_FIELDS 12
+
+/* 1e-7 degree to semicircles, 2^31 per 180 degrees, reduced to fit the ratio */
+#define FIT_SEMICIRCLE_RATIO FIXED_POINT_RATIO(16777216, 14062500)
+
+/* Base types */
+#define FIT_ENUM 0x00
+#define FIT_SINT8 0x01
+#define FIT_UINT8 0x02
+#define FIT_UINT16 0x84
+#define FIT_SINT32 0x85
+#define FIT_UINT32 0x86
+
+/* Invalid values of the base types */
+#define FIT_INVALID_SINT8 0x7F
+#define FIT_INVALID_UINT8 0xFF
+#define FIT_INVALID_UINT16 0xFFFF
+#define FIT_INVALID_SINT32 0x7FFFFFFF
+#define FIT_INVALID_UINT32 0xFFFFFFFF
+
+/* Profile values */
+#define FIT_FILE_ACTIVITY 4
+#define FIT_MANUFACTURER_DEVELOPMENT 255
+#define FIT_EVENT_TIMER 0
+#define FIT_EVENT_SESSION 8
+#define FIT_EVENT_LAP 9
+#define FIT_EVENT_ACTIVITY 26
+#define FIT_EVENT_TYPE_START 0
+#define FIT_EVENT_TYPE_STOP 1
+#define FIT_EVENT_TYPE_STOP_ALL 4
+#define FIT_SPORT_CYCLING 2
+
+/* Local message types, one per global message written */
+typedef enum {
+	E_FIT_FILE_ID = 0,
+	E_FIT_EVENT,
+	E_FIT_RECORD,
+	E_FIT_LAP,
+	E_FIT_SESSION,
+	E_FIT_ACTIVITY,
+	E_FIT_MESSAGE_NUMBER, // must be last
+} E_fit_message;
+
+typedef struct {
+	uint8_t number;
+	uint8_t size;
+	uint8_t base_type;
+} T_fit_field;
+
+typedef struct {
+	uint16_t global;
+	int nb_fields;
+	T_fit_field field[FIT_MAX_FIELDS];
+} T_fit_message;
+
+/* Fields in the order of the data messages */
+static const T_fit_message fit_messages[E_FIT_MESSAGE_NUMBER] = {
+	[E_FIT_FILE_ID] = {.global = 0, .nb_fields = 5, .field = {
+		{0, 1, FIT_ENUM},     /* type */
+		{1, 2, FIT_UINT16},   /* manufacturer */
+		{2, 2, FIT_UINT16},   /* product */
+		{3, 4, FIT_UINT32},   /* serial number */
+		{4, 4, FIT_UINT32},   /* time created */
+	}},
+	[E_FIT_EVENT] = {.global = 21, .nb_fields = 3, .field = {
+		{253, 4, FIT_UINT32}, /* timestamp */
+		{0, 1, FIT_ENUM},     /* event */
+		{1, 1, FIT_ENUM},     /* event type */
+	}},
+	[E_FIT_RECORD] = {.global = 20, .nb_fields = 10, .field = {
+		{253, 4, FIT_UINT32}, /* timestamp */
+		{0, 4, FIT_SINT32},   /* latitude, semicircles */
+		{1, 4, FIT_SINT32},   /* longitude, semicircles */
+		{2, 2, FIT_UINT16},   /* altitude, 0.2 m + 500 m */
+		{3, 1, FIT_UINT8},    /* heart rate, bpm */
+		{4, 1, FIT_UINT8},    /* cadence, rpm */
+		{5, 4, FIT_UINT32},   /* distance, cm */
+		{6, 2, FIT_UINT16},   /* speed, mm/s */
+		{7, 2, FIT_UINT16},   /* power, W */
+		{13, 1, FIT_SINT8},   /* temperature, degree Celsius */
+	}},
+	[E_FIT_LAP] = {.global = 19, .nb_fields = 8, .field = {
+		{253, 4, FIT_UINT32}, /* timestamp */
+		{254, 2, FIT_UINT16}, /* message index */
+		{2, 4, FIT_UINT32},   /* start time */
+		{7, 4, FIT_UINT32},   /* total elapsed time, ms */
+		{8, 4, FIT_UINT32},   /* total timer time, ms */
+		{9, 4, FIT_UINT32},   /* total distance, cm */
+		{0, 1, FIT_ENUM},     /* event */
+		{1, 1, FIT_ENUM},     /* event type */
+	}},
+	[E_FIT_SESSION] = {.global = 18, .nb_fields = 12, .field = {
+		{253, 4, FIT_UINT32}, /* timestamp */
+		{254, 2, FIT_UINT16}, /* message index */
+		{2, 4, FIT_UINT32},   /* start time */
+		{7, 4, FIT_UINT32},   /* total elapsed time, ms */
+		{8, 4, FIT_UINT32},   /* total timer time, ms */
+		{9, 4, FIT_UINT32},   /* total distance, cm */
+		{25, 2, FIT_UINT16},  /* first lap index */
+		{26, 2, FIT_UINT16},  /* number of laps */
+		{0, 1, FIT_ENUM},     /* event */
+		{1, 1, FIT_ENUM},     /* event type */
+		{5, 1, FIT_ENUM},     /* sport */
+		{6, 1, FIT_ENUM},     /* sub sport */
+	}},
+	[E_FIT_ACTIVITY] = {.global = 34, .nb_fields = 5, .field = {
+		{253, 4, FIT_UINT32}, /* timestamp */
+		{0, 4, FIT_UINT32},   /* total timer time, ms */
+		{1, 2, FIT_UINT16},   /* number of sessions */
+		{3, 1, FIT_ENUM},     /* event */
+		{4, 1, FIT_ENUM},     /* event type */
+	}},
+};
+
+typedef struct {
+	FILE *file;
+	bool has_error;
+	uint32_t data_size; /* bytes of records after the header */
+	bool is_defined[E_FIT_MESSAGE_NUMBER];
+	char buffer[FIT_ENCODER_BUFFER_SIZE];
+} T_fit_encoder;
+
+/* Summary of the ride for the lap and the session */
+typedef struct {
+	uint32_t start_time; /* s, FIT epoch */
+	uint32_t end_time;
+	int64_t start_timestamp; /* ms, frame time */
+	int64_t end_timestamp;
+	uint32_t timer_time; /* ms, moving time */
+	uint32_t distance; /* cm */
+} T_fit_summary;
+
+static const uint16_t fit_crc_table[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400,
+};
+
+static uint16_t _crc_update(uint16_t crc, const uint8_t *data, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		uint16_t tmp = fit_crc_table[crc & 0xF];
+		crc = ((crc >> 4) & 0x0FFF) ^ tmp ^ fit_crc_table[data[i] & 0xF];
+		tmp = fit_crc_table[crc & 0xF];
+		crc = ((crc >> 4) & 0x0FFF) ^ tmp ^ fit_crc_table[(data[i] >> 4) & 0xF];
+	}
+
+	return crc;
+}
+
+static uint8_t * _put(uint8_t *buff, uint64_t value, int size)
+{
+	for(int i = 0; i < size; i++)
+	{
+		buff[i] = (uint8_t)(value >> (8 * i));
+	}
+
+	return buff + size;
+}
+
+static void _write(T_fit_encoder *encoder, const uint8_t *data, size_t size)
+{
+	if(fwrite(data, 1, size, encoder->file) != size)
+	{
+		encoder->has_error = true;
+	}
+	encoder->data_size += size;
+}
+
+/* Data message, preceded by its definition the first time */
+static void _write_message(T_fit_encoder *encoder, E_fit_message type, const uint8_t *values, int size)
+{
+	const T_fit_message *message = &fit_messages[type];
+
+	if(!encoder->is_defined[type])
+	{
+		uint8_t definition[6 + 3 * FIT_MAX_FIELDS];
+		uint8_t *p = definition;
+
+		p = _put(p, FIT_DEFINITION_HEADER | type, 1);
+		p = _put(p, 0, 1); /* reserved */
+		p = _put(p, 0, 1); /* little endian */
+		p = _put(p, message->global, 2);
+		p = _put(p, message->nb_fields, 1);
+		for(int i = 0; i < message->nb_fields; i++)
+		{
+			p = _put(p, message->field[i].number, 1);
+			p = _put(p, message->field[i].size, 1);
+			p = _put(p, message->field[i].base_type, 1);
+		}
+
+		_write(encoder, definition, p - definition);
+		encoder->is_defined[type] = true;
+	}
+
+	uint8_t header = type;
+	_write(encoder, &header, 1);
+	_write(encoder, values, size);
+}
+
+static void _write_header(T_fit_encoder *encoder)
+{
+	uint8_t header[FIT_HEADER_SIZE];
+	uint8_t *p = header;
+
+	p = _put(p, FIT_HEADER_SIZE, 1);
+	p = _put(p, FIT_PROTOCOL_VERSION, 1);
+	p = _put(p, FIT_PROFILE_VERSION, 2);
+	p = _put(p, encoder->data_size, 4);
+	memcpy(p, ".FIT", 4);
+	p += 4;
+	_put(p, _crc_update(0, header, FIT_HEADER_SIZE - 2), 2);
+
+	if(fwrite(header, 1, FIT_HEADER_SIZE, encoder->file) != FIT_HEADER_SIZE)
+	{
+		encoder->has_error = true;
+	}
+}
+
+static uint32_t _fit_time(int64_t timestamp, int64_t clock_offset)
+{
+	return (uint32_t)((timestamp + clock_offset) / 1000 - FIT_ENCODER_EPOCH_OFFSET);
+}
+
+static void _write_event(T_fit_encoder *encoder, uint32_t time, uint8_t event, uint8_t event_type)
+{
+	uint8_t values[6];
+	uint8_t *p = values;
+
+	p = _put(p, time, 4);
+	p = _put(p, event, 1);
+	p = _put(p, event_type, 1);
+
+	_write_message(encoder, E_FIT_EVENT, values, p - values);
+}
+
+static uint64_t _channel(const T_data_frame *frame, E_data_channel channel, T_fixed_point_ratio ratio, int64_t offset,
+	int64_t min, int64_t max, uint64_t invalid)
+{
+	if(!data_frame_is_valid(frame, channel))
+	{
+		return invalid;
+	}
+
+	int64_t value = fixed_point_rescale(frame->value[channel] + offset, ratio);
+
+	return (value < min || value > max) ? invalid : (uint64_t)value;
+}
+
+static void _write_record(T_fit_encoder *encoder, uint32_t time, const T_data_frame *frame)
+{
+	uint8_t values[26];
+	uint8_t *p = values;
+
+	p = _put(p, time, 4);
+	p = _put(p, _channel(frame, E_DATA_LATITUDE, FIT_SEMICIRCLE_RATIO, 0, INT32_MIN, INT32_MAX - 1, FIT_INVALID_SINT32), 4);
+	p = _put(p, _channel(frame, E_DATA_LONGITUDE, FIT_SEMICIRCLE_RATIO, 0, INT32_MIN, INT32_MAX - 1, FIT_INVALID_SINT32), 4);
+	/* cm to 0.2 m with 500 m offset */
+	p = _put(p, _channel(frame, E_DATA_ALTITUDE, FIXED_POINT_RATIO(1, 20), 50000, 0, FIT_INVALID_UINT16 - 1, FIT_INVALID_UINT16), 2);
+	p = _put(p, _channel(frame, E_DATA_HEART_RATE, FIXED_POINT_IDENTITY, 0, 0, FIT_INVALID_UINT8 - 1, FIT_INVALID_UINT8), 1);
+	p = _put(p, _channel(frame, E_DATA_CADENCE, FIXED_POINT_IDENTITY, 0, 0, FIT_INVALID_UINT8 - 1, FIT_INVALID_UINT8), 1);
+	p = _put(p, _channel(frame, E_DATA_DISTANCE, FIXED_POINT_IDENTITY, 0, 0, FIT_INVALID_UINT32 - 1, FIT_INVALID_UINT32), 4);
+	p = _put(p, _channel(frame, E_DATA_SPEED, FIXED_POINT_IDENTITY, 0, 0, FIT_INVALID_UINT16 - 1, FIT_INVALID_UINT16), 2);
+	p = _put(p, _channel(frame, E_DATA_POWER, FIXED_POINT_IDENTITY, 0, 0, FIT_INVALID_UINT16 - 1, FIT_INVALID_UINT16), 2);
+	/* 0.1 degree to degree */
+	p = _put(p, _channel(frame, E_DATA_TEMPERATURE, FIXED_POINT_RATIO(1, 10), 0, INT8_MIN, FIT_INVALID_SINT8 - 1, FIT_INVALID_SINT8), 1);
+
+	_write_message(encoder, E_FIT_RECORD, values, p - values);
+}
+
+static void _write_summary(T_fit_encoder *encoder, const T_fit_summary *summary)
+{
+	uint8_t values[32];
+	uint8_t *p = NULL;
+	uint32_t elapsed = (uint32_t)(summary->end_timestamp - summary->start_timestamp);
+
+	p = values;
+	p = _put(p, summary->end_time, 4);
+	p = _put(p, 0, 2);
+	p = _put(p, summary->start_time, 4);
+	p = _put(p, elapsed, 4);
+	p = _put(p, summary->timer_time, 4);
+	p = _put(p, summary->distance, 4);
+	p = _put(p, FIT_EVENT_LAP, 1);
+	p = _put(p, FIT_EVENT_TYPE_STOP, 1);
+	_write_message(encoder, E_FIT_LAP, values, p - values);
+
+	p = values;
+	p = _put(p, summary->end_time, 4);
+	p = _put(p, 0, 2);
+	p = _put(p, summary->start_time, 4);
+	p = _put(p, elapsed, 4);
+	p = _put(p, summary->timer_time, 4);
+	p = _put(p, summary->distance, 4);
+	p = _put(p, 0, 2);
+	p = _put(p, 1, 2);
+	p = _put(p, FIT_EVENT_SESSION, 1);
+	p = _put(p, FIT_EVENT_TYPE_STOP, 1);
+	p = _put(p, FIT_SPORT_CYCLING, 1);
+	p = _put(p, 0, 1);
+	_write_message(encoder, E_FIT_SESSION, values, p - values);
+
+	p = values;
+	p = _put(p, summary->end_time, 4);
+	p = _put(p, summary->timer_time, 4);
+	p = _put(p, 1, 2);
+	p = _put(p, FIT_EVENT_ACTIVITY, 1);
+	p = _put(p, FIT_EVENT_TYPE_STOP, 1);
+	_write_message(encoder, E_FIT_ACTIVITY, values, p - values);
+}
+
+/* Rewrite the header now that the size is known, then append the CRC of the whole file */
+static int _finish_file(T_fit_encoder *encoder)
+{
+	uint8_t chunk[FIT_ENCODER_BUFFER_SIZE];
+	uint16_t crc = 0;
+	size_t size = 0;
+
+	fail_if_not_zero(fseek(encoder->file, 0, SEEK_SET), -1, "fseek failed\n");
+	_write_header(encoder);
+	fail_if_not_zero(fflush(encoder->file), -2, "fflush failed\n");
+
+	fail_if_not_zero(fseek(encoder->file, 0, SEEK_SET), -3, "fseek failed\n");
+	while((size = fread(chunk, 1, sizeof(chunk), encoder->file)) > 0)
+	{
+		crc = _crc_update(crc, chunk, size);
+	}
+	fail_if_true(ferror(encoder->file), -4, "fread failed\n");
+
+	_put(chunk, crc, 2);
+	fail_if_not_zero(fseek(encoder->file, 0, SEEK_END), -5, "fseek failed\n");
+	fail_if_not_equal(fwrite(chunk, 1, 2, encoder->file), 2, -6, "fwrite failed\n");
+
+	return 0;
+}
+
+int fit_encoder_export(const char *log_path, const char *fit_path)
+{
+	fail_if_null(log_path, -1, "log_path is null\n");
+	fail_if_null(fit_path, -2, "fit_path is null\n");
+
+	int ret = 0;
+	T_ride_log_reader reader;
+	T_data_frame frame;
+	T_fit_summary summary;
+	bool was_paused = false;
+	uint32_t last_record = 0;
+	T_fit_encoder *encoder = NULL;
+
+	/* On the heap, exports can run in several threads */
+	encoder = malloc(sizeof(T_fit_encoder));
+	fail_if_null(encoder, -3, "malloc encoder failed\n");
+	memset(encoder, 0, sizeof(T_fit_encoder));
+	memset(&summary, 0, sizeof(summary));
+
+	ret = ride_log_reader_open(&reader, log_path);
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_open failed, return: %d\n", ret);
+		ret = -4;
+		goto export_encoder_cleanup;
+	}
+
+	ret = ride_log_reader_next(&reader, &frame);
+	if(ret <= 0)
+	{
+		log_error("%s holds no frame, return: %d\n", log_path, ret);
+		ret = -5;
+		goto export_reader_cleanup;
+	}
+
+	encoder->file = fopen(fit_path, "w+b");
+	if(encoder->file == NULL)
+	{
+		log_error("fopen %s failed\n", fit_path);
+		ret = -6;
+		goto export_reader_cleanup;
+	}
+	setvbuf(encoder->file, encoder->buffer, _IOFBF, sizeof(encoder->buffer));
+
+	summary.start_time = _fit_time(frame.timestamp, reader.clock_offset);
+	summary.start_timestamp = frame.timestamp;
+
+	/* The size is not known yet, the header is written again at the end */
+	_write_header(encoder);
+
+	uint8_t file_id[13];
+	uint8_t *p = file_id;
+	p = _put(p, FIT_FILE_ACTIVITY, 1);
+	p = _put(p, FIT_MANUFACTURER_DEVELOPMENT, 2);
+	p = _put(p, 0, 2);
+	p = _put(p, 1, 4);
+	p = _put(p, summary.start_time, 4);
+	_write_message(encoder, E_FIT_FILE_ID, file_id, p - file_id);
+	_write_event(encoder, summary.start_time, FIT_EVENT_TIMER, FIT_EVENT_TYPE_START);
+
+	do
+	{
+		uint32_t time = _fit_time(frame.timestamp, reader.clock_offset);
+		bool is_paused = data_frame_is_valid(&frame, E_DATA_PAUSED) && frame.value[E_DATA_PAUSED];
+
+		/* One record per second, the first frame of the second */
+		if(time != last_record || frame.timestamp == summary.start_timestamp)
+		{
+			_write_record(encoder, time, &frame);
+			last_record = time;
+		}
+
+		if(is_paused != was_paused)
+		{
+			_write_event(encoder, time, FIT_EVENT_TIMER, is_paused ? FIT_EVENT_TYPE_STOP_ALL : FIT_EVENT_TYPE_START);
+			was_paused = is_paused;
+		}
+
+		summary.end_time = time;
+		summary.end_timestamp = frame.timestamp;
+		if(data_frame_is_valid(&frame, E_DATA_MOVING_TIME))
+		{
+			summary.timer_time = frame.value[E_DATA_MOVING_TIME];
+		}
+		if(data_frame_is_valid(&frame, E_DATA_DISTANCE))
+		{
+			summary.distance = frame.value[E_DATA_DISTANCE];
+		}
+
+		ret = ride_log_reader_next(&reader, &frame);
+	} while(ret > 0);
+
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_next failed, return: %d\n", ret);
+		ret = -7;
+		goto export_file_cleanup;
+	}
+
+	if(!was_paused)
+	{
+		_write_event(encoder, summary.end_time, FIT_EVENT_TIMER, FIT_EVENT_TYPE_STOP_ALL);
+	}
+	_write_summary(encoder, &summary);
+
+	ret = _finish_file(encoder);
+	if(ret < 0 || encoder->has_error)
+	{
+		log_error("writing %s failed, return: %d\n", fit_path, ret);
+		ret = -8;
+		goto export_file_cleanup;
+	}
+
+	log_info("%s exported, %u bytes of records\n", fit_path, encoder->data_size);
+	ret = 0;
+
+export_file_cleanup:
+	fclose(encoder->file);
+export_reader_cleanup:
+	ride_log_reader_close(&reader);
+export_encoder_cleanup:
+	free(encoder);
+
+	return ret;
+}
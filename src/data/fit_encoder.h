@@ -0,0 +1,35 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FIT_ENCODER_HEADER_
+#define _FIT_ENCODER_HEADER_
+
+#include <stdint.h>
+
+#define FIT_ENCODER_EPOCH_OFFSET (631065600) /* s, from 1970-01-01 to the FIT epoch 1989-12-31 */
+#define FIT_ENCODER_BUFFER_SIZE 4096 /* bytes, output buffer */
+#define FIT_ENCODER_RECORD_PERIOD 1000 /* ms, FIT timestamps are in seconds */
+
+/* Convert a ride log to a FIT activity file in a single streaming pass, the
+ * memory used does not depend on the ride length. The file holds file_id,
+ * timer events on the pauses, one record per second, a lap, a session and
+ * the activity message.
+ */
+int fit_encoder_export(const char *log_path, const char *fit_path);
+
+#endif //_FIT_ENCODER_HEADER_
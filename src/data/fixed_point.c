@@ -0,0 +1,209 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+
+static const int64_t power_of_ten[FIXED_POINT_MAX_DECIMALS + 1] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+uint32_t fixed_point_isqrt(uint64_t value)
+{
+	uint64_t result = 0;
+	uint64_t bit = UINT64_C(1) << 62;
+
+	/* Digit by digit in base 4, one result bit per iteration */
+	while(bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while(bit != 0)
+	{
+		if(value >= result + bit)
+		{
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)result;
+}
+
+/* Two digits at a time halves the divisions */
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+int fixed_point_write(char *buff, int64_t value, int decimals)
+{
+	char digits[FIXED_POINT_MAX_LENGTH];
+	char *end = digits + sizeof(digits);
+	char *p = end;
+	int length = 0;
+	uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+	/* Digits from the least significant */
+	while(magnitude >= 100)
+	{
+		uint64_t quotient = magnitude / 100;
+		int pair = (int)(magnitude - quotient * 100);
+
+		p -= 2;
+		memcpy(p, &digit_pairs[2 * pair], 2);
+		magnitude = quotient;
+	}
+	if(magnitude >= 10)
+	{
+		p -= 2;
+		memcpy(p, &digit_pairs[2 * magnitude], 2);
+	}
+	else
+	{
+		*--p = '0' + (char)magnitude;
+	}
+
+	/* At least one digit before the decimal point */
+	while(end - p <= decimals)
+	{
+		*--p = '0';
+	}
+
+	int nb_integer_digits = (int)(end - p) - decimals;
+
+	if(value < 0)
+	{
+		buff[length++] = '-';
+	}
+	memcpy(&buff[length], p, nb_integer_digits);
+	length += nb_integer_digits;
+
+	if(decimals > 0)
+	{
+		buff[length++] = '.';
+		memcpy(&buff[length], p + nb_integer_digits, decimals);
+		length += decimals;
+	}
+
+	return length;
+}
+
+int fixed_point_format(char *buff, int size, int64_t value, int decimals)
+{
+	fail_if_null(buff, -1, "buff is null\n");
+	fail_if_negative_or_zero(size, -2, "size is not valid\n");
+	fail_if_negative(decimals, -3, "invalid decimals %d\n", decimals);
+	fail_if_superior(decimals, FIXED_POINT_MAX_DECIMALS, -4, "invalid decimals %d\n", decimals);
+
+	char str[FIXED_POINT_MAX_LENGTH];
+	int length = fixed_point_write(str, value, decimals);
+
+	fail_if_superior_or_equal(length, size, -5, "buff is too small\n");
+
+	memcpy(buff, str, length);
+	buff[length] = '\0';
+
+	return length;
+}
+
+int fixed_point_parse(const char *str, int decimals, int32_t *value, const char **end)
+{
+	fail_if_null(str, -1, "str is null\n");
+	fail_if_negative(decimals, -2, "invalid decimals %d\n", decimals);
+	fail_if_superior(decimals, FIXED_POINT_MAX_DECIMALS, -3, "invalid decimals %d\n", decimals);
+	fail_if_null(value, -4, "value is null\n");
+
+	const char *c = str;
+	bool is_negative = false;
+	int64_t result = 0;
+	int nb_digits = 0;
+	int nb_decimals = 0;
+
+	while(*c == ' ' || *c == '\t')
+	{
+		c++;
+	}
+
+	if(*c == '-' || *c == '+')
+	{
+		is_negative = (*c == '-');
+		c++;
+	}
+
+	for(; *c >= '0' && *c <= '9'; c++, nb_digits++)
+	{
+		result = result * 10 + (*c - '0');
+		if(result > INT32_MAX)
+		{
+			fail(-5, "value out of range\n");
+		}
+	}
+
+	if(*c == '.')
+	{
+		for(c++; *c >= '0' && *c <= '9'; c++, nb_digits++)
+		{
+			/* Round on the first extra decimal, ignore the next ones */
+			if(nb_decimals == decimals)
+			{
+				result += (*c >= '5');
+				nb_decimals++;
+			}
+			else if(nb_decimals < decimals)
+			{
+				result = result * 10 + (*c - '0');
+				nb_decimals++;
+			}
+		}
+	}
+
+	fail_if_zero(nb_digits, -6, "no digit found\n");
+
+	if(nb_decimals > decimals)
+	{
+		nb_decimals = decimals;
+	}
+	result *= power_of_ten[decimals - nb_decimals];
+	fail_if_superior(result, INT32_MAX, -7, "value out of range\n");
+
+	*value = (int32_t)(is_negative ? -result : result);
+	if(end != NULL)
+	{
+		*end = c;
+	}
+
+	return 0;
+}
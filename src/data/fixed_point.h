@@ -0,0 +1,81 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FIXED_POINT_HEADER_
+#define _FIXED_POINT_HEADER_
+
+#include <stdint.h>
+
+/* Units of the data path, all the values are integers:
+ *  - coordinates in 1e-7 degree (about 1 cm)
+ *  - speed in mm/s
+ *  - altitude in cm
+ *  - temperature in 0.1 degree Celsius
+ *  - power in W
+ *  - time in ms
+ */
+#define FIXED_POINT_COORDINATE_DECIMALS 7
+#define FIXED_POINT_COORDINATE_SCALE 10000000 /* 1 degree */
+#define FIXED_POINT_MAX_DECIMALS 9
+#define FIXED_POINT_MAX_LENGTH 24 /* characters of the longest decimal string, without the terminator */
+
+/* Conversion between two units, to = from * num / den */
+typedef struct {
+	int32_t num;
+	int32_t den;
+} T_fixed_point_ratio;
+
+#define FIXED_POINT_RATIO(n, d) ((T_fixed_point_ratio){.num = (n), .den = (d)})
+#define FIXED_POINT_IDENTITY FIXED_POINT_RATIO(1, 1)
+
+/* value * num / den rounded to the nearest, half away from zero, den must be positive */
+static inline int64_t fixed_point_mul_div(int64_t value, int64_t num, int64_t den)
+{
+	int64_t product = value * num;
+
+	return (product >= 0 ? product + den / 2 : product - den / 2) / den;
+}
+
+static inline int64_t fixed_point_rescale(int64_t value, T_fixed_point_ratio ratio)
+{
+	return fixed_point_mul_div(value, ratio.num, ratio.den);
+}
+
+/* Value at position / span between v0 and v1 */
+static inline int32_t fixed_point_lerp(int32_t v0, int32_t v1, int64_t position, int64_t span)
+{
+	return v0 + (int32_t)fixed_point_mul_div((int64_t)v1 - v0, position, span);
+}
+
+/* Integer square root, floor(sqrt(value)) */
+uint32_t fixed_point_isqrt(uint64_t value);
+
+/* Write value / 10^decimals as a decimal string ("-1.05"), return the length written */
+int fixed_point_format(char *buff, int size, int64_t value, int decimals);
+
+/* Same as fixed_point_format without check nor terminator for the export loops,
+ * buff must hold FIXED_POINT_MAX_LENGTH characters and decimals be valid
+ */
+int fixed_point_write(char *buff, int64_t value, int decimals);
+
+/* Parse a decimal string ("45.1234567") into value * 10^decimals, the extra
+ * decimals are rounded. end is set after the last character used, can be NULL.
+ */
+int fixed_point_parse(const char *str, int decimals, int32_t *value, const char **end);
+
+#endif //_FIXED_POINT_HEADER_
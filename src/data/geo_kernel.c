@@ -0,0 +1,444 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "log.h"
+#include "fixed_point.h"
+#include "geo_kernel.h"
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+/* cos() of each degree of latitude in Q16 */
+#define COS_TABLE_SHIFT 16
+static const int32_t cos_table[91] = {
+	65536, 65526, 65496, 65446, 65376, 65287, 65177, 65048, 64898, 64729,
+	64540, 64332, 64104, 63856, 63589, 63303, 62997, 62672, 62328, 61966,
+	61584, 61183, 60764, 60326, 59870, 59396, 58903, 58393, 57865, 57319,
+	56756, 56175, 55578, 54963, 54332, 53684, 53020, 52339, 51643, 50931,
+	50203, 49461, 48703, 47930, 47143, 46341, 45525, 44695, 43852, 42995,
+	42126, 41243, 40348, 39441, 38521, 37590, 36647, 35693, 34729, 33754,
+	32768, 31772, 30767, 29753, 28729, 27697, 26656, 25607, 24550, 23486,
+	22415, 21336, 20252, 19161, 18064, 16962, 15855, 14742, 13626, 12505,
+	11380, 10252, 9121, 7987, 6850, 5712, 4572, 3430, 2287, 1144,
+	0,
+};
+
+/* Extra bits kept on the fixed point deltas before the square root */
+#define FIXED_DISTANCE_SHIFT 4
+#define FIXED_DISTANCE_MAX_DELTA (INT64_C(1) << 26) /* beyond the squares overflow, about 700 km */
+
+/* Length of 1e-7 degree on the mean earth radius, in 1e-8 mm */
+#define FIXED_MM_PER_UNIT_NUM 1111950802
+#define FIXED_MM_PER_UNIT_DEN 100000000
+
+/* Number of segments computed at once on the stack by geo_kernel_total_distance */
+#define TOTAL_DISTANCE_CHUNK 256
+
+/* Taylor coefficients of cos(x) up to x^12, the error is below 1e-8 for
+ * |x| <= pi/2 which is the whole latitude range.
+ */
+#define COS_C1 (-1.0 / 2.0)
+#define COS_C2 (1.0 / 24.0)
+#define COS_C3 (-1.0 / 720.0)
+#define COS_C4 (1.0 / 40320.0)
+#define COS_C5 (-1.0 / 3628800.0)
+#define COS_C6 (1.0 / 479001600.0)
+
+/* Plain arithmetic version of cos(), unlike libm it can be inlined and
+ * vectorized by the compiler.
+ */
+static inline double _cos_poly(double x)
+{
+	double x2 = x * x;
+
+	return 1.0 + x2 * (COS_C1 + x2 * (COS_C2 + x2 * (COS_C3 + x2 * (COS_C4 + x2 * (COS_C5 + x2 * COS_C6)))));
+}
+
+/* Generic equirectangular kernel, written without any dependency between
+ * iterations so the compiler can vectorize it (sqrt is only vectorized
+ * when building with -fno-math-errno).
+ */
+static void _equirectangular(const double *restrict lat, const double *restrict lon, double *restrict distances, int nb_segments)
+{
+	for(int i = 0; i < nb_segments; i++)
+	{
+		double mean_lat = (lat[i] + lat[i+1]) * (0.5 * DEG_TO_RAD);
+		double x = (lon[i+1] - lon[i]) * DEG_TO_RAD * _cos_poly(mean_lat);
+		double y = (lat[i+1] - lat[i]) * DEG_TO_RAD;
+
+		distances[i] = GEO_KERNEL_EARTH_RADIUS_M * sqrt(x * x + y * y);
+	}
+}
+
+#if defined(__AVX__)
+static inline __m256d _cos_poly_avx(__m256d x)
+{
+	__m256d x2 = _mm256_mul_pd(x, x);
+	__m256d res = _mm256_set1_pd(COS_C6);
+
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(COS_C5));
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(COS_C4));
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(COS_C3));
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(COS_C2));
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(COS_C1));
+	res = _mm256_add_pd(_mm256_mul_pd(res, x2), _mm256_set1_pd(1.0));
+
+	return res;
+}
+
+static void _equirectangular_simd(const double *lat, const double *lon, double *distances, int nb_segments)
+{
+	const __m256d half_deg_to_rad = _mm256_set1_pd(0.5 * DEG_TO_RAD);
+	const __m256d deg_to_rad = _mm256_set1_pd(DEG_TO_RAD);
+	const __m256d radius = _mm256_set1_pd(GEO_KERNEL_EARTH_RADIUS_M);
+	int i = 0;
+
+	/* 4 segments per iteration */
+	for(; i + 4 <= nb_segments; i += 4)
+	{
+		__m256d lat0 = _mm256_loadu_pd(&lat[i]);
+		__m256d lat1 = _mm256_loadu_pd(&lat[i+1]);
+		__m256d lon0 = _mm256_loadu_pd(&lon[i]);
+		__m256d lon1 = _mm256_loadu_pd(&lon[i+1]);
+
+		__m256d mean_lat = _mm256_mul_pd(_mm256_add_pd(lat0, lat1), half_deg_to_rad);
+		__m256d x = _mm256_mul_pd(_mm256_mul_pd(_mm256_sub_pd(lon1, lon0), deg_to_rad), _cos_poly_avx(mean_lat));
+		__m256d y = _mm256_mul_pd(_mm256_sub_pd(lat1, lat0), deg_to_rad);
+		__m256d norm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)));
+
+		_mm256_storeu_pd(&distances[i], _mm256_mul_pd(norm, radius));
+	}
+
+	/* Tail of the batch */
+	_equirectangular(&lat[i], &lon[i], &distances[i], nb_segments - i);
+}
+#elif defined(__SSE2__)
+static inline __m128d _cos_poly_sse2(__m128d x)
+{
+	__m128d x2 = _mm_mul_pd(x, x);
+	__m128d res = _mm_set1_pd(COS_C6);
+
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(COS_C5));
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(COS_C4));
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(COS_C3));
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(COS_C2));
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(COS_C1));
+	res = _mm_add_pd(_mm_mul_pd(res, x2), _mm_set1_pd(1.0));
+
+	return res;
+}
+
+static void _equirectangular_simd(const double *lat, const double *lon, double *distances, int nb_segments)
+{
+	const __m128d half_deg_to_rad = _mm_set1_pd(0.5 * DEG_TO_RAD);
+	const __m128d deg_to_rad = _mm_set1_pd(DEG_TO_RAD);
+	const __m128d radius = _mm_set1_pd(GEO_KERNEL_EARTH_RADIUS_M);
+	int i = 0;
+
+	/* 2 segments per iteration */
+	for(; i + 2 <= nb_segments; i += 2)
+	{
+		__m128d lat0 = _mm_loadu_pd(&lat[i]);
+		__m128d lat1 = _mm_loadu_pd(&lat[i+1]);
+		__m128d lon0 = _mm_loadu_pd(&lon[i]);
+		__m128d lon1 = _mm_loadu_pd(&lon[i+1]);
+
+		__m128d mean_lat = _mm_mul_pd(_mm_add_pd(lat0, lat1), half_deg_to_rad);
+		__m128d x = _mm_mul_pd(_mm_mul_pd(_mm_sub_pd(lon1, lon0), deg_to_rad), _cos_poly_sse2(mean_lat));
+		__m128d y = _mm_mul_pd(_mm_sub_pd(lat1, lat0), deg_to_rad);
+		__m128d norm = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)));
+
+		_mm_storeu_pd(&distances[i], _mm_mul_pd(norm, radius));
+	}
+
+	/* Tail of the batch */
+	_equirectangular(&lat[i], &lon[i], &distances[i], nb_segments - i);
+}
+#else
+static void _equirectangular_simd(const double *lat, const double *lon, double *distances, int nb_segments)
+{
+	/* No explicit SIMD for this target, rely on the compiler */
+	_equirectangular(lat, lon, distances, nb_segments);
+}
+#endif
+
+static inline double _haversine_segment(double lat0, double lat1, double dlon, double cos_lat0, double cos_lat1)
+{
+	double sin_dlat = sin((lat1 - lat0) * (0.5 * DEG_TO_RAD));
+	double sin_dlon = sin(dlon * (0.5 * DEG_TO_RAD));
+	double a = sin_dlat * sin_dlat + cos_lat0 * cos_lat1 * sin_dlon * sin_dlon;
+
+	/* Rounding can push a slightly above 1 for antipodal points */
+	if(a > 1.0)
+	{
+		a = 1.0;
+	}
+
+	return 2.0 * GEO_KERNEL_EARTH_RADIUS_M * asin(sqrt(a));
+}
+
+static void _haversine(const double *lat, const double *lon, double *distances, int nb_segments)
+{
+	/* cos(latitude) of each point is shared by the two segments around it */
+	double cos_prev = cos(lat[0] * DEG_TO_RAD);
+
+	for(int i = 0; i < nb_segments; i++)
+	{
+		double cos_next = cos(lat[i+1] * DEG_TO_RAD);
+
+		distances[i] = _haversine_segment(lat[i], lat[i+1], lon[i+1] - lon[i], cos_prev, cos_next);
+		cos_prev = cos_next;
+	}
+}
+
+/* cos() of a latitude in 1e-7 degree, Q16 */
+static inline int64_t _cos_fixed(int32_t latitude)
+{
+	uint32_t angle = latitude < 0 ? -(uint32_t)latitude : (uint32_t)latitude;
+	uint32_t index = angle / FIXED_POINT_COORDINATE_SCALE;
+
+	if(index >= 90)
+	{
+		return 0;
+	}
+
+	return cos_table[index] + fixed_point_mul_div(cos_table[index+1] - cos_table[index], angle % FIXED_POINT_COORDINATE_SCALE, FIXED_POINT_COORDINATE_SCALE);
+}
+
+static inline int32_t _equirectangular_fixed(int32_t lat0, int32_t lon0, int32_t lat1, int32_t lon1)
+{
+	int64_t dlon = (int64_t)lon1 - lon0;
+	int64_t dlat = (int64_t)lat1 - lat0;
+	int shift = FIXED_DISTANCE_SHIFT;
+
+	/* Shortest way around the antimeridian */
+	if(dlon > 180 * (int64_t)FIXED_POINT_COORDINATE_SCALE)
+	{
+		dlon -= 360 * (int64_t)FIXED_POINT_COORDINATE_SCALE;
+	}
+	else if(dlon < -180 * (int64_t)FIXED_POINT_COORDINATE_SCALE)
+	{
+		dlon += 360 * (int64_t)FIXED_POINT_COORDINATE_SCALE;
+	}
+
+	int64_t x = dlon * _cos_fixed(lat0 + (int32_t)(dlat / 2));
+	int64_t y = dlat * (INT64_C(1) << COS_TABLE_SHIFT);
+
+	if(llabs(dlon) >= FIXED_DISTANCE_MAX_DELTA || llabs(dlat) >= FIXED_DISTANCE_MAX_DELTA)
+	{
+		shift = 0;
+	}
+	x >>= COS_TABLE_SHIFT - shift;
+	y >>= COS_TABLE_SHIFT - shift;
+
+	uint64_t length = fixed_point_isqrt((uint64_t)(x * x) + (uint64_t)(y * y));
+
+	int64_t distance = fixed_point_mul_div(length, FIXED_MM_PER_UNIT_NUM, (int64_t)FIXED_MM_PER_UNIT_DEN << shift);
+
+	return distance > INT32_MAX ? INT32_MAX : (int32_t)distance;
+}
+
+static int _check_points(E_geo_kernel_method method, const T_geo_points *points)
+{
+	fail_if_null(points, -1, "points is null\n");
+	fail_if_null(points->latitude, -2, "latitude is null\n");
+	fail_if_null(points->longitude, -3, "longitude is null\n");
+	fail_if_negative(points->count, -4, "count is negative\n");
+	fail_if_negative(method, -5, "invalid method %d\n", method);
+	fail_if_superior_or_equal(method, E_GEO_KERNEL_METHOD_NUMBER, -6, "invalid method %d\n", method);
+
+	return 0;
+}
+
+int geo_kernel_segment_distances(E_geo_kernel_method method, const T_geo_points *points, double *distances)
+{
+	int ret = 0;
+
+	ret = _check_points(method, points);
+	fail_if_negative(ret, -1, "_check_points failed, return: %d\n", ret);
+	fail_if_null(distances, -2, "distances is null\n");
+
+	/* Need at least one segment */
+	if(points->count < 2)
+	{
+		return 0;
+	}
+
+	switch(method)
+	{
+		case E_GEO_KERNEL_HAVERSINE:
+			_haversine(points->latitude, points->longitude, distances, points->count - 1);
+			break;
+		case E_GEO_KERNEL_EQUIRECTANGULAR:
+			_equirectangular_simd(points->latitude, points->longitude, distances, points->count - 1);
+			break;
+		default:
+			fail(-3, "invalid method %d\n", method);
+			break;
+	}
+
+	return 0;
+}
+
+int geo_kernel_segment_distances_scalar(E_geo_kernel_method method, const T_geo_points *points, double *distances)
+{
+	int ret = 0;
+
+	ret = _check_points(method, points);
+	fail_if_negative(ret, -1, "_check_points failed, return: %d\n", ret);
+	fail_if_null(distances, -2, "distances is null\n");
+
+	const double *lat = points->latitude;
+	const double *lon = points->longitude;
+
+	for(int i = 0; i < points->count - 1; i++)
+	{
+		if(method == E_GEO_KERNEL_HAVERSINE)
+		{
+			distances[i] = _haversine_segment(lat[i], lat[i+1], lon[i+1] - lon[i], cos(lat[i] * DEG_TO_RAD), cos(lat[i+1] * DEG_TO_RAD));
+		}
+		else
+		{
+			double x = (lon[i+1] - lon[i]) * DEG_TO_RAD * cos((lat[i] + lat[i+1]) * (0.5 * DEG_TO_RAD));
+			double y = (lat[i+1] - lat[i]) * DEG_TO_RAD;
+
+			distances[i] = GEO_KERNEL_EARTH_RADIUS_M * sqrt(x * x + y * y);
+		}
+	}
+
+	return 0;
+}
+
+int geo_kernel_segment_distances_fixed(const T_geo_points_fixed *points, int32_t *distances)
+{
+	fail_if_null(points, -1, "points is null\n");
+	fail_if_null(points->latitude, -2, "latitude is null\n");
+	fail_if_null(points->longitude, -3, "longitude is null\n");
+	fail_if_null(distances, -4, "distances is null\n");
+	fail_if_inferior(points->count, 2, -5, "at least 2 points are needed, count: %d\n", points->count);
+
+	const int32_t *lat = points->latitude;
+	const int32_t *lon = points->longitude;
+
+	for(int i = 0; i < points->count - 1; i++)
+	{
+		distances[i] = _equirectangular_fixed(lat[i], lon[i], lat[i+1], lon[i+1]);
+	}
+
+	return 0;
+}
+
+int32_t geo_kernel_cos_fixed(int32_t latitude)
+{
+	return (int32_t)_cos_fixed(latitude);
+}
+
+int geo_kernel_total_distance(E_geo_kernel_method method, const T_geo_points *points, double *total)
+{
+	int ret = 0;
+	double distances[TOTAL_DISTANCE_CHUNK];
+
+	ret = _check_points(method, points);
+	fail_if_negative(ret, -1, "_check_points failed, return: %d\n", ret);
+	fail_if_null(total, -2, "total is null\n");
+
+	*total = 0;
+
+	/* Process the track by chunk, each chunk start on the last point of the previous one */
+	for(int first = 0; first < points->count - 1; first += TOTAL_DISTANCE_CHUNK)
+	{
+		T_geo_points chunk = {
+			.latitude = &points->latitude[first],
+			.longitude = &points->longitude[first],
+			.count = points->count - first,
+		};
+
+		if(chunk.count > TOTAL_DISTANCE_CHUNK + 1)
+		{
+			chunk.count = TOTAL_DISTANCE_CHUNK + 1;
+		}
+
+		ret = geo_kernel_segment_distances(method, &chunk, distances);
+		fail_if_negative(ret, -3, "geo_kernel_segment_distances failed, return: %d\n", ret);
+
+		for(int i = 0; i < chunk.count - 1; i++)
+		{
+			*total += distances[i];
+		}
+	}
+
+	return 0;
+}
+
+int geo_kernel_elevation_init(T_geo_elevation *elevation, int32_t hysteresis)
+{
+	fail_if_null(elevation, -1, "elevation is null\n");
+	fail_if_negative(hysteresis, -2, "hysteresis is negative\n");
+
+	elevation->has_reference = false;
+	elevation->hysteresis = hysteresis;
+	elevation->reference = 0;
+	elevation->gain = 0;
+	elevation->loss = 0;
+	elevation->is_initialized = true;
+
+	return 0;
+}
+
+int geo_kernel_elevation_update(T_geo_elevation *elevation, const int32_t *altitude, int count)
+{
+	fail_if_null(elevation, -1, "elevation is null\n");
+	fail_if_false(elevation->is_initialized, -2, "elevation is not initialized\n");
+	fail_if_null(altitude, -3, "altitude is null\n");
+
+	int i = 0;
+
+	/* The first altitude ever received is the initial reference */
+	if(!elevation->has_reference && count > 0)
+	{
+		elevation->reference = altitude[i++];
+		elevation->has_reference = true;
+	}
+
+	for(; i < count; i++)
+	{
+		int32_t delta = altitude[i] - elevation->reference;
+
+		if(delta >= elevation->hysteresis)
+		{
+			elevation->gain += delta;
+			elevation->reference = altitude[i];
+		}
+		else if(delta <= -elevation->hysteresis)
+		{
+			elevation->loss -= delta;
+			elevation->reference = altitude[i];
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GEO_KERNEL_HEADER_
+#define _GEO_KERNEL_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Mean earth radius (IUGG) */
+#define GEO_KERNEL_EARTH_RADIUS_M (6371008.8)
+
+typedef enum {
+	E_GEO_KERNEL_HAVERSINE = 0, /* exact on the sphere, uses libm trigonometry */
+	E_GEO_KERNEL_EQUIRECTANGULAR, /* flat projection per segment, vectorized */
+	E_GEO_KERNEL_METHOD_NUMBER, // must be last
+} E_geo_kernel_method;
+
+/* Track stored as a structure of arrays, all the arrays have count elements.
+ * Latitude and longitude are in degrees, altitude in meters.
+ */
+typedef struct {
+	const double *latitude;
+	const double *longitude;
+	int count;
+} T_geo_points;
+
+/* Same track in fixed point, coordinates in 1e-7 degree */
+typedef struct {
+	const int32_t *latitude;
+	const int32_t *longitude;
+	int count;
+} T_geo_points_fixed;
+
+/* Elevation gain and loss accumulator, a variation is only taken into account
+ * once the altitude moved by more than the hysteresis from the last reference,
+ * this filters the barometer and GPS altitude noise.
+ */
+typedef struct {
+	bool is_initialized;
+	bool has_reference;
+	int32_t hysteresis; /* cm */
+	int32_t reference; /* altitude of the last validated variation, cm */
+	int32_t gain; /* cm */
+	int32_t loss; /* cm */
+} T_geo_elevation;
+
+/* Compute the distance in meters between each consecutive point of the track,
+ * distances must be able to hold (points->count - 1) elements, distances[i]
+ * being the distance between point i and point i+1.
+ * When the track is processed in several batches, the last point of a batch
+ * must be repeated as the first point of the next one.
+ */
+int geo_kernel_segment_distances(E_geo_kernel_method method, const T_geo_points *points, double *distances);
+
+/* Same as geo_kernel_segment_distances but point by point with libm only,
+ * used as reference for the validation and the benchmark.
+ */
+int geo_kernel_segment_distances_scalar(E_geo_kernel_method method, const T_geo_points *points, double *distances);
+
+/* Equirectangular segment distances without float, in mm, for the per-sample
+ * path. The cosine comes from a table interpolated every degree, the relative
+ * error is below 1e-4.
+ */
+int geo_kernel_segment_distances_fixed(const T_geo_points_fixed *points, int32_t *distances);
+
+/* cos() of a latitude in 1e-7 degree in Q16, interpolated in the table of
+ * geo_kernel_segment_distances_fixed
+ */
+int32_t geo_kernel_cos_fixed(int32_t latitude);
+
+/* Sum of the segment distances of the track in meters */
+int geo_kernel_total_distance(E_geo_kernel_method method, const T_geo_points *points, double *total);
+
+/* Altitudes and hysteresis in cm */
+int geo_kernel_elevation_init(T_geo_elevation *elevation, int32_t hysteresis);
+int geo_kernel_elevation_update(T_geo_elevation *elevation, const int32_t *altitude, int count);
+
+#endif //_GEO_KERNEL_HEADER_
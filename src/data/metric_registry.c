@@ -0,0 +1,309 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "crc32.h"
+#include "metric_registry.h"
+
+/* Header of the state of a metric in a checkpoint, followed by the state */
+typedef struct {
+	uint32_t id; /* CRC32 of the metric name */
+	uint32_t size;
+} T_metric_state_header;
+
+static struct {
+	bool is_sorted;
+	int nb_metrics;
+	const T_metric *metric[METRIC_REGISTRY_MAX_METRICS]; /* in topological order once sorted */
+	bool is_active[METRIC_REGISTRY_MAX_METRICS]; /* an output of the metric is needed */
+	uint64_t outputs; /* channels written by all the metrics */
+	uint64_t demand; /* channels having a consumer */
+} metric_registry = {
+	.is_sorted = false,
+	.nb_metrics = 0,
+};
+
+/* Metric j must run before metric i when it produces one of its inputs */
+static inline bool _depends_on(const T_metric *i, const T_metric *j)
+{
+	return (i != j) && (i->inputs & j->outputs);
+}
+
+static void _update_active_metrics(void)
+{
+	uint64_t needed = metric_registry.demand;
+
+	/* Walk the metrics backward so that the inputs of a needed metric
+	 * are added to the needed mask before their producers are visited
+	 */
+	for(int i = metric_registry.nb_metrics - 1; i >= 0; i--)
+	{
+		const T_metric *metric = metric_registry.metric[i];
+
+		metric_registry.is_active[i] = (metric->outputs & needed) != 0;
+		if(metric_registry.is_active[i])
+		{
+			needed |= metric->inputs;
+		}
+	}
+}
+
+int metric_registry_register(const T_metric *metric)
+{
+	fail_if_null(metric, -1, "metric is null\n");
+	fail_if_null(metric->update, -2, "metric %s update is null\n", metric->name);
+	fail_if_zero(metric->outputs, -3, "metric %s has no output\n", metric->name);
+	fail_if_superior_or_equal(metric_registry.nb_metrics, METRIC_REGISTRY_MAX_METRICS, -4, "too many metrics\n");
+
+	if(metric->outputs & (data_channel_bit(DATA_NB_SENSOR_CHANNELS) - 1))
+	{
+		fail(-5, "metric %s writes a sensor channel\n", metric->name);
+	}
+
+	if(metric->outputs & metric_registry.outputs)
+	{
+		fail(-6, "metric %s writes a channel already written by another metric\n", metric->name);
+	}
+
+	metric_registry.metric[metric_registry.nb_metrics++] = metric;
+	metric_registry.outputs |= metric->outputs;
+	metric_registry.is_sorted = false;
+
+	return 0;
+}
+
+int metric_registry_sort(void)
+{
+	int nb_metrics = metric_registry.nb_metrics;
+	int nb_sorted = 0;
+	int indegree[METRIC_REGISTRY_MAX_METRICS];
+	bool is_sorted[METRIC_REGISTRY_MAX_METRICS];
+	const T_metric *sorted[METRIC_REGISTRY_MAX_METRICS];
+
+	/* Count the producers each metric depends on */
+	for(int i = 0; i < nb_metrics; i++)
+	{
+		indegree[i] = 0;
+		is_sorted[i] = false;
+		for(int j = 0; j < nb_metrics; j++)
+		{
+			if(_depends_on(metric_registry.metric[i], metric_registry.metric[j]))
+			{
+				indegree[i]++;
+			}
+		}
+	}
+
+	/* Kahn algorithm, the registry is small so the quadratic search is fine */
+	while(nb_sorted < nb_metrics)
+	{
+		int next = -1;
+
+		for(int i = 0; i < nb_metrics; i++)
+		{
+			if(!is_sorted[i] && indegree[i] == 0)
+			{
+				next = i;
+				break;
+			}
+		}
+
+		fail_if_negative(next, -1, "dependency cycle between the metrics\n");
+
+		is_sorted[next] = true;
+		sorted[nb_sorted++] = metric_registry.metric[next];
+
+		for(int i = 0; i < nb_metrics; i++)
+		{
+			if(!is_sorted[i] && _depends_on(metric_registry.metric[i], metric_registry.metric[next]))
+			{
+				indegree[i]--;
+			}
+		}
+	}
+
+	memcpy(metric_registry.metric, sorted, nb_metrics * sizeof(sorted[0]));
+	metric_registry.is_sorted = true;
+
+	_update_active_metrics();
+
+	for(int i = 0; i < nb_metrics; i++)
+	{
+		log_debug("metric %d: %s\n", i, metric_registry.metric[i]->name);
+	}
+
+	return 0;
+}
+
+int metric_registry_set_demand(uint64_t demand)
+{
+	fail_if_false(metric_registry.is_sorted, -1, "metric registry is not sorted\n");
+
+	metric_registry.demand = demand;
+	_update_active_metrics();
+
+	return 0;
+}
+
+int metric_registry_reset(void)
+{
+	for(int i = 0; i < metric_registry.nb_metrics; i++)
+	{
+		if(metric_registry.metric[i]->reset)
+		{
+			metric_registry.metric[i]->reset();
+		}
+	}
+
+	return 0;
+}
+
+int metric_registry_finish(void)
+{
+	for(int i = 0; i < metric_registry.nb_metrics; i++)
+	{
+		if(metric_registry.metric[i]->finish)
+		{
+			metric_registry.metric[i]->finish();
+		}
+	}
+
+	return 0;
+}
+
+static uint32_t _get_id(const T_metric *metric)
+{
+	return crc32_compute(metric->name, strlen(metric->name));
+}
+
+int metric_registry_save(void *buff, int size)
+{
+	fail_if_null(buff, -1, "buff is null\n");
+
+	int ret = 0;
+	int offset = 0;
+	T_metric_state_header header;
+
+	for(int i = 0; i < metric_registry.nb_metrics; i++)
+	{
+		const T_metric *metric = metric_registry.metric[i];
+		if(metric->save == NULL)
+		{
+			continue;
+		}
+
+		fail_if_superior(offset + (int)sizeof(header), size, -2, "no room left for the state of metric %s\n", metric->name);
+
+		ret = metric->save((uint8_t *)buff + offset + sizeof(header), size - offset - sizeof(header));
+		fail_if_negative(ret, -3, "metric %s save failed, return: %d\n", metric->name, ret);
+
+		header.id = _get_id(metric);
+		header.size = ret;
+		memcpy((uint8_t *)buff + offset, &header, sizeof(header));
+		offset += sizeof(header) + ret;
+	}
+
+	return offset;
+}
+
+int metric_registry_restore(const void *buff, int size)
+{
+	fail_if_null(buff, -1, "buff is null\n");
+
+	int ret = 0;
+	int offset = 0;
+	T_metric_state_header header;
+
+	while(offset + (int)sizeof(header) <= size)
+	{
+		memcpy(&header, (const uint8_t *)buff + offset, sizeof(header));
+		offset += sizeof(header);
+		fail_if_superior(header.size, (uint32_t)(size - offset), -2, "truncated metric state\n");
+
+		for(int i = 0; i < metric_registry.nb_metrics; i++)
+		{
+			const T_metric *metric = metric_registry.metric[i];
+			if(metric->restore == NULL || _get_id(metric) != header.id)
+			{
+				continue;
+			}
+
+			ret = metric->restore((const uint8_t *)buff + offset, header.size);
+			if(ret < 0)
+			{
+				log_error("metric %s restore failed, return: %d\n", metric->name, ret);
+			}
+		}
+
+		offset += header.size;
+	}
+
+	return 0;
+}
+
+int metric_registry_evaluate(T_data_frame *frame, uint64_t *changed)
+{
+	fail_if_false(metric_registry.is_sorted, -1, "metric registry is not sorted\n");
+	fail_if_null(frame, -2, "frame is null\n");
+	fail_if_null(changed, -3, "changed is null\n");
+
+	int ret = 0;
+	int32_t previous[E_DATA_CHANNEL_NUMBER];
+
+	for(int i = 0; i < metric_registry.nb_metrics; i++)
+	{
+		const T_metric *metric = metric_registry.metric[i];
+
+		/* Lazy evaluation: nobody needs the result or nothing new to compute it */
+		if(!metric_registry.is_active[i] || !(metric->inputs & *changed))
+		{
+			continue;
+		}
+
+		uint64_t previous_valid = frame->valid_mask & metric->outputs;
+		for(int channel = 0; channel < E_DATA_CHANNEL_NUMBER; channel++)
+		{
+			if(metric->outputs & data_channel_bit(channel))
+			{
+				previous[channel] = frame->value[channel];
+			}
+		}
+
+		ret = metric->update(frame);
+		if(ret < 0)
+		{
+			log_error("metric %s update failed, return: %d\n", metric->name, ret);
+			continue;
+		}
+
+		/* Propagate the changes to the metrics using the outputs */
+		*changed |= (frame->valid_mask & metric->outputs) ^ previous_valid;
+		for(int channel = 0; channel < E_DATA_CHANNEL_NUMBER; channel++)
+		{
+			if((metric->outputs & data_channel_bit(channel)) && previous[channel] != frame->value[channel])
+			{
+				*changed |= data_channel_bit(channel);
+			}
+		}
+	}
+
+	return 0;
+}
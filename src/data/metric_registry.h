@@ -0,0 +1,67 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _METRIC_REGISTRY_HEADER_
+#define _METRIC_REGISTRY_HEADER_
+
+#include <stdint.h>
+#include "data_manager.h"
+
+#define METRIC_REGISTRY_MAX_METRICS 32
+
+typedef struct {
+	const char *name;
+	uint64_t inputs; /* mask of the channels read by the metric */
+	uint64_t outputs; /* mask of the channels written by the metric, a channel has only one writer */
+	int (*update)(T_data_frame *frame); /* compute the outputs from the inputs of the frame */
+	void (*reset)(void); /* forget the accumulated state, at the start of a ride */
+	int (*save)(void *buff, int size); /* copy the state accumulated since the start of the ride, return its size */
+	int (*restore)(const void *buff, int size); /* load a state copied by save, after a reset */
+	void (*finish)(void); /* close what is still in progress, at the end of a ride */
+} T_metric;
+
+/* Register a metric, the definition must stay valid for the application lifetime */
+int metric_registry_register(const T_metric *metric);
+
+/* Order the registered metrics so that each one runs after the metrics producing its inputs */
+int metric_registry_sort(void);
+
+/* Set the mask of the channels having a consumer, only the metrics needed
+ * to produce them are evaluated
+ */
+int metric_registry_set_demand(uint64_t demand);
+
+int metric_registry_reset(void);
+
+/* End of the ride, the metrics close their state before it is read */
+int metric_registry_finish(void);
+
+/* Checkpoint of the state accumulated by the metrics, the metrics without save
+ * hook only depend on the last ticks and start again from a reset. Save
+ * returns the size written in buff, restore ignores the states of unknown
+ * metrics.
+ */
+int metric_registry_save(void *buff, int size);
+int metric_registry_restore(const void *buff, int size);
+
+/* Evaluate the needed metrics whose inputs are in changed, the outputs that
+ * changed are added to changed
+ */
+int metric_registry_evaluate(T_data_frame *frame, uint64_t *changed);
+
+#endif //_METRIC_REGISTRY_HEADER_
@@ -0,0 +1,386 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "geo_kernel.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "metrics.h"
+
+#define WINDOW_DEPTH 64
+
+#define frame_set(frame, channel, val) do { (frame)->value[channel] = (val); (frame)->valid_mask |= data_channel_bit(channel); } while(0)
+#define frame_clear(frame, channel) do { (frame)->value[channel] = 0; (frame)->valid_mask &= ~data_channel_bit(channel); } while(0)
+
+/* Small ring of (x, y) points used by the sliding window metrics */
+typedef struct {
+	int64_t x[WINDOW_DEPTH];
+	int32_t y[WINDOW_DEPTH];
+	int first;
+	int count;
+} T_window;
+
+static void _window_push(T_window *window, int64_t x, int32_t y)
+{
+	int index = (window->first + window->count) % WINDOW_DEPTH;
+
+	if(window->count == WINDOW_DEPTH)
+	{
+		window->first = (window->first + 1) % WINDOW_DEPTH;
+		window->count--;
+	}
+
+	window->x[index] = x;
+	window->y[index] = y;
+	window->count++;
+}
+
+/* Index of the n-th newest point, 0 being the newest */
+static inline int _window_index(const T_window *window, int n)
+{
+	return (window->first + window->count - 1 - n) % WINDOW_DEPTH;
+}
+
+/* Index of the newest point at least span behind the newest one on x,
+ * return -1 if the window does not cover that span
+ */
+static int _window_find_span(const T_window *window, int64_t span)
+{
+	if(window->count == 0)
+	{
+		return -1;
+	}
+
+	int64_t newest = window->x[_window_index(window, 0)];
+
+	for(int n = 1; n < window->count; n++)
+	{
+		int index = _window_index(window, n);
+		if(newest - window->x[index] >= span)
+		{
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Average speed over the moving time of the ride
+ */
+static int _average_speed_update(T_data_frame *frame)
+{
+	int32_t elapsed = frame->value[E_DATA_MOVING_TIME];
+
+	if(!data_frame_is_valid(frame, E_DATA_DISTANCE) || elapsed <= 0)
+	{
+		frame_clear(frame, E_DATA_AVERAGE_SPEED);
+		return 0;
+	}
+
+	/* cm over ms to mm/s */
+	frame_set(frame, E_DATA_AVERAGE_SPEED, (int32_t)fixed_point_mul_div(frame->value[E_DATA_DISTANCE], 10000, elapsed));
+
+	return 0;
+}
+
+/*
+ * Elevation gain, with hysteresis to filter the altitude noise
+ */
+static T_geo_elevation elevation_metric;
+
+static int _elevation_gain_update(T_data_frame *frame)
+{
+	int ret = 0;
+
+	if(data_frame_is_valid(frame, E_DATA_ALTITUDE))
+	{
+		ret = geo_kernel_elevation_update(&elevation_metric, &frame->value[E_DATA_ALTITUDE], 1);
+		fail_if_negative(ret, -1, "geo_kernel_elevation_update failed, return: %d\n", ret);
+	}
+
+	frame_set(frame, E_DATA_ELEVATION_GAIN, elevation_metric.gain);
+
+	return 0;
+}
+
+static void _elevation_gain_reset(void)
+{
+	geo_kernel_elevation_init(&elevation_metric, METRICS_ELEVATION_HYSTERESIS);
+}
+
+static int _elevation_gain_save(void *buff, int size)
+{
+	fail_if_inferior(size, (int)sizeof(elevation_metric), -1, "no room for the state\n");
+
+	memcpy(buff, &elevation_metric, sizeof(elevation_metric));
+
+	return sizeof(elevation_metric);
+}
+
+static int _elevation_gain_restore(const void *buff, int size)
+{
+	fail_if_not_equal(size, (int)sizeof(elevation_metric), -1, "invalid state size %d\n", size);
+
+	memcpy(&elevation_metric, buff, sizeof(elevation_metric));
+
+	return 0;
+}
+
+/*
+ * Grade over the last meters, window of (distance, altitude)
+ */
+static T_window grade_window;
+
+static int _grade_update(T_data_frame *frame)
+{
+	if(!data_frame_is_valid(frame, E_DATA_ALTITUDE) || !data_frame_is_valid(frame, E_DATA_DISTANCE))
+	{
+		return 0;
+	}
+
+	int32_t distance = frame->value[E_DATA_DISTANCE];
+
+	/* Only keep points spaced by a few meters so the window covers the grade distance */
+	if(grade_window.count == 0 || distance - grade_window.x[_window_index(&grade_window, 0)] >= METRICS_GRADE_STEP)
+	{
+		_window_push(&grade_window, distance, frame->value[E_DATA_ALTITUDE]);
+	}
+
+	int index = _window_find_span(&grade_window, METRICS_GRADE_DISTANCE);
+	if(index >= 0)
+	{
+		int newest = _window_index(&grade_window, 0);
+		/* cm over cm to 0.1 % */
+		int64_t grade = fixed_point_mul_div(grade_window.y[newest] - grade_window.y[index], 1000, grade_window.x[newest] - grade_window.x[index]);
+		frame_set(frame, E_DATA_GRADE, (int32_t)grade);
+	}
+
+	return 0;
+}
+
+static void _grade_reset(void)
+{
+	memset(&grade_window, 0, sizeof(grade_window));
+}
+
+/*
+ * VAM, vertical ascent speed over the last minute, window of (timestamp, altitude)
+ */
+static T_window vam_window;
+
+static int _vam_update(T_data_frame *frame)
+{
+	if(!data_frame_is_valid(frame, E_DATA_ALTITUDE))
+	{
+		frame_clear(frame, E_DATA_VAM);
+		return 0;
+	}
+
+	int64_t timestamp = frame->timestamp;
+
+	if(vam_window.count == 0 || timestamp - vam_window.x[_window_index(&vam_window, 0)] >= METRICS_WINDOW_STEP)
+	{
+		_window_push(&vam_window, timestamp, frame->value[E_DATA_ALTITUDE]);
+	}
+
+	/* Use the full window when available, the oldest point otherwise */
+	int index = _window_find_span(&vam_window, METRICS_VAM_WINDOW);
+	if(index < 0)
+	{
+		index = _window_find_span(&vam_window, METRICS_VAM_MIN_WINDOW);
+		if(index >= 0)
+		{
+			index = vam_window.first;
+		}
+	}
+
+	if(index >= 0)
+	{
+		int newest = _window_index(&vam_window, 0);
+		/* cm over ms to m/h */
+		int64_t vam = fixed_point_mul_div(vam_window.y[newest] - vam_window.y[index], 36000, vam_window.x[newest] - vam_window.x[index]);
+		frame_set(frame, E_DATA_VAM, (int32_t)vam);
+	}
+
+	return 0;
+}
+
+static void _vam_reset(void)
+{
+	memset(&vam_window, 0, sizeof(vam_window));
+}
+
+/*
+ * Normalized power, fourth root of the mean of the 30s rolling average power to the fourth
+ */
+static struct {
+	T_window window; /* (timestamp, power) */
+	int64_t sum; /* sum of the power in the window */
+	uint64_t sum_pow4; /* sum of the rolling average to the fourth */
+	int count;
+} np_metric;
+
+static int _normalized_power_update(T_data_frame *frame)
+{
+	if(!data_frame_is_valid(frame, E_DATA_POWER))
+	{
+		return 0;
+	}
+
+	T_window *window = &np_metric.window;
+	int64_t timestamp = frame->timestamp;
+
+	if(window->count > 0 && timestamp - window->x[_window_index(window, 0)] < METRICS_WINDOW_STEP)
+	{
+		return 0;
+	}
+
+	/* Drop the oldest point from the rolling sum when the ring is full */
+	if(window->count == WINDOW_DEPTH)
+	{
+		np_metric.sum -= window->y[window->first];
+	}
+	_window_push(window, timestamp, frame->value[E_DATA_POWER]);
+	np_metric.sum += frame->value[E_DATA_POWER];
+
+	/* Remove the points older than the rolling window */
+	while(window->count > 1 && timestamp - window->x[window->first] >= METRICS_NP_WINDOW)
+	{
+		np_metric.sum -= window->y[window->first];
+		window->first = (window->first + 1) % WINDOW_DEPTH;
+		window->count--;
+	}
+
+	/* Wait until the first rolling window is complete */
+	if(window->count * METRICS_WINDOW_STEP < METRICS_NP_WINDOW && np_metric.count == 0)
+	{
+		return 0;
+	}
+
+	/* Up to 2 kW the fourth powers of a 10 hours ride fit in 64 bits */
+	uint64_t average = (uint64_t)fixed_point_mul_div(np_metric.sum, 1, window->count);
+	np_metric.sum_pow4 += average * average * average * average;
+	np_metric.count++;
+
+	frame_set(frame, E_DATA_NORMALIZED_POWER, (int32_t)fixed_point_isqrt(fixed_point_isqrt(np_metric.sum_pow4 / np_metric.count)));
+
+	return 0;
+}
+
+static void _normalized_power_reset(void)
+{
+	memset(&np_metric, 0, sizeof(np_metric));
+}
+
+/* The rolling window starts again empty, only the mean is kept */
+static int _normalized_power_save(void *buff, int size)
+{
+	uint64_t state[2] = {np_metric.sum_pow4, (uint64_t)np_metric.count};
+	fail_if_inferior(size, (int)sizeof(state), -1, "no room for the state\n");
+
+	memcpy(buff, state, sizeof(state));
+
+	return sizeof(state);
+}
+
+static int _normalized_power_restore(const void *buff, int size)
+{
+	uint64_t state[2];
+	fail_if_not_equal(size, (int)sizeof(state), -1, "invalid state size %d\n", size);
+
+	memcpy(state, buff, sizeof(state));
+	np_metric.sum_pow4 = state[0];
+	np_metric.count = (int)state[1];
+
+	return 0;
+}
+
+static const T_metric metrics_table[] = {
+	{
+		.name = "average speed",
+		.inputs = data_channel_bit(E_DATA_DISTANCE) | data_channel_bit(E_DATA_MOVING_TIME),
+		.outputs = data_channel_bit(E_DATA_AVERAGE_SPEED),
+		.update = &_average_speed_update,
+		.reset = NULL,
+		.save = NULL,
+		.restore = NULL,
+		.finish = NULL,
+	},
+	{
+		.name = "elevation gain",
+		.inputs = data_channel_bit(E_DATA_ALTITUDE),
+		.outputs = data_channel_bit(E_DATA_ELEVATION_GAIN),
+		.update = &_elevation_gain_update,
+		.reset = &_elevation_gain_reset,
+		.save = &_elevation_gain_save,
+		.restore = &_elevation_gain_restore,
+		.finish = NULL,
+	},
+	{
+		.name = "grade",
+		.inputs = data_channel_bit(E_DATA_ALTITUDE) | data_channel_bit(E_DATA_DISTANCE),
+		.outputs = data_channel_bit(E_DATA_GRADE),
+		.update = &_grade_update,
+		.reset = &_grade_reset,
+		.save = NULL,
+		.restore = NULL,
+		.finish = NULL,
+	},
+	{
+		.name = "vam",
+		.inputs = data_channel_bit(E_DATA_ALTITUDE) | data_channel_bit(E_DATA_ELAPSED_TIME),
+		.outputs = data_channel_bit(E_DATA_VAM),
+		.update = &_vam_update,
+		.reset = &_vam_reset,
+		.save = NULL,
+		.restore = NULL,
+		.finish = NULL,
+	},
+	{
+		.name = "normalized power",
+		.inputs = data_channel_bit(E_DATA_POWER) | data_channel_bit(E_DATA_ELAPSED_TIME),
+		.outputs = data_channel_bit(E_DATA_NORMALIZED_POWER),
+		.update = &_normalized_power_update,
+		.reset = &_normalized_power_reset,
+		.save = &_normalized_power_save,
+		.restore = &_normalized_power_restore,
+		.finish = NULL,
+	},
+};
+
+int metrics_init(void)
+{
+	int ret = 0;
+
+	for(int i = 0; i < sizeof(metrics_table) / sizeof(metrics_table[0]); i++)
+	{
+		ret = metric_registry_register(&metrics_table[i]);
+		fail_if_negative(ret, -1, "metric_registry_register %s failed, return: %d\n", metrics_table[i].name, ret);
+	}
+
+	/* Start from a clean state */
+	ret = metric_registry_reset();
+	fail_if_negative(ret, -2, "metric_registry_reset failed, return: %d\n", ret);
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _METRICS_HEADER_
+#define _METRICS_HEADER_
+
+#define METRICS_ELEVATION_HYSTERESIS 300 /* cm */
+#define METRICS_GRADE_DISTANCE 2000 /* cm, distance over which the grade is computed */
+#define METRICS_GRADE_STEP 500 /* cm between two points of the grade window */
+#define METRICS_VAM_WINDOW 60000 /* ms */
+#define METRICS_VAM_MIN_WINDOW 10000 /* ms */
+#define METRICS_NP_WINDOW 30000 /* ms, rolling average of the normalized power */
+#define METRICS_WINDOW_STEP 1000 /* ms between two points of the time windows */
+#define METRICS_MAX_INTEGRATION_GAP 5000 /* ms, longer holes are not integrated */
+
+/* Register the built-in derived metrics in the metric registry */
+int metrics_init(void);
+
+#endif //_METRICS_HEADER_
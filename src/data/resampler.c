@@ -0,0 +1,210 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "resampler.h"
+
+/* Get the n-th oldest sample of a channel history */
+static inline T_resampler_sample *_get_sample(T_resampler_channel *channel, int n)
+{
+	return &channel->history[(channel->first + n) % RESAMPLER_HISTORY_DEPTH];
+}
+
+/* Compute the value of one channel at the tick, return false if the channel is in a gap */
+static bool _evaluate_channel(T_resampler_channel *channel, int64_t tick, int32_t *value)
+{
+	T_resampler_sample *before = NULL;
+	T_resampler_sample *after = NULL;
+	int nb_before = 0;
+
+	/* History is small and sorted, find the samples surrounding the tick */
+	for(int i = 0; i < channel->count; i++)
+	{
+		T_resampler_sample *sample = _get_sample(channel, i);
+		if(sample->timestamp <= tick)
+		{
+			before = sample;
+			nb_before = i + 1;
+		}
+		else
+		{
+			after = sample;
+			break;
+		}
+	}
+
+	/* Nothing received before the tick, or the sensor stopped sending */
+	if(before == NULL || tick - before->timestamp > channel->config.max_gap)
+	{
+		return false;
+	}
+
+	/* The samples older than the one before the tick are not needed for the next ticks */
+	channel->first = (channel->first + nb_before - 1) % RESAMPLER_HISTORY_DEPTH;
+	channel->count -= nb_before - 1;
+
+	/* Hold the value when asked, when the next sample did not arrived yet or when
+	 * the next sample is too far to interpolate across the hole
+	 */
+	if(channel->config.interpolation == E_RESAMPLER_HOLD
+		|| after == NULL
+		|| after->timestamp - before->timestamp > channel->config.max_gap)
+	{
+		*value = before->value;
+		return true;
+	}
+
+	*value = fixed_point_lerp(before->value, after->value, tick - before->timestamp, after->timestamp - before->timestamp);
+
+	return true;
+}
+
+int resampler_init(T_resampler *resampler, int period, int delay, const T_resampler_channel_config *config, int nb_channels)
+{
+	fail_if_null(resampler, -1, "resampler is null\n");
+	fail_if_null(config, -2, "config is null\n");
+	fail_if_negative_or_zero(period, -3, "period is invalid: %d\n", period);
+	fail_if_negative(delay, -4, "delay is invalid: %d\n", delay);
+	fail_if_negative_or_zero(nb_channels, -5, "nb_channels is invalid: %d\n", nb_channels);
+	fail_if_superior(nb_channels, RESAMPLER_MAX_CHANNELS, -6, "too many channels: %d\n", nb_channels);
+
+	memset(resampler, 0, sizeof(T_resampler));
+
+	resampler->period = period;
+	resampler->delay = delay;
+	resampler->nb_channels = nb_channels;
+
+	for(int i = 0; i < nb_channels; i++)
+	{
+		resampler->channel[i].config = config[i];
+	}
+
+	resampler->is_initialized = true;
+
+	return 0;
+}
+
+int resampler_reset(T_resampler *resampler)
+{
+	fail_if_null(resampler, -1, "resampler is null\n");
+	fail_if_false(resampler->is_initialized, -2, "resampler is not initialized\n");
+
+	for(int i = 0; i < resampler->nb_channels; i++)
+	{
+		resampler->channel[i].first = 0;
+		resampler->channel[i].count = 0;
+	}
+
+	resampler->has_tick = false;
+
+	return 0;
+}
+
+int resampler_push(T_resampler *resampler, int channel, int64_t timestamp, int32_t value)
+{
+	fail_if_null(resampler, -1, "resampler is null\n");
+	fail_if_false(resampler->is_initialized, -2, "resampler is not initialized\n");
+	fail_if_negative(channel, -3, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, resampler->nb_channels, -4, "invalid channel %d\n", channel);
+
+	T_resampler_channel *chan = &resampler->channel[channel];
+
+	if(chan->count > 0)
+	{
+		T_resampler_sample *last = _get_sample(chan, chan->count - 1);
+		fail_if_inferior(timestamp, last->timestamp, -5, "channel %d sample is out of order\n", channel);
+
+		/* Same timestamp, the newest value wins */
+		if(timestamp == last->timestamp)
+		{
+			last->value = value;
+			return 0;
+		}
+	}
+
+	/* The look-behind is bounded, the oldest sample is dropped when the history is full */
+	if(chan->count == RESAMPLER_HISTORY_DEPTH)
+	{
+		chan->first = (chan->first + 1) % RESAMPLER_HISTORY_DEPTH;
+		chan->count--;
+	}
+
+	T_resampler_sample *sample = _get_sample(chan, chan->count);
+	sample->timestamp = timestamp;
+	sample->value = value;
+	chan->count++;
+
+	/* The timeline starts on the first period boundary after the first sample */
+	if(!resampler->has_tick)
+	{
+		resampler->next_tick = timestamp + (resampler->period - timestamp % resampler->period) % resampler->period;
+		resampler->newest = timestamp;
+		resampler->has_tick = true;
+	}
+
+	if(timestamp > resampler->newest)
+	{
+		resampler->newest = timestamp;
+	}
+
+	return 0;
+}
+
+int resampler_pop(T_resampler *resampler, int64_t *timestamp, int32_t *values, uint32_t *gap_mask)
+{
+	fail_if_null(resampler, -1, "resampler is null\n");
+	fail_if_false(resampler->is_initialized, -2, "resampler is not initialized\n");
+	fail_if_null(timestamp, -3, "timestamp is null\n");
+	fail_if_null(values, -4, "values is null\n");
+	fail_if_null(gap_mask, -5, "gap_mask is null\n");
+
+	/* Wait the look-behind delay so the late channels can catch up */
+	if(!resampler->has_tick || resampler->newest < resampler->next_tick + resampler->delay)
+	{
+		return 0;
+	}
+
+	/* After a long interruption (sleep, clock jump) restart the timeline instead
+	 * of emitting thousands of empty ticks
+	 */
+	if((resampler->newest - resampler->delay - resampler->next_tick) / resampler->period > RESAMPLER_MAX_CATCHUP_TICKS)
+	{
+		int64_t restart = resampler->newest - resampler->delay;
+		log_warn("resampler timeline jumped from %lld to %lld ms\n", (long long)resampler->next_tick, (long long)restart);
+		resampler->next_tick = restart - restart % resampler->period;
+	}
+
+	*timestamp = resampler->next_tick;
+	*gap_mask = 0;
+
+	for(int i = 0; i < resampler->nb_channels; i++)
+	{
+		if(!_evaluate_channel(&resampler->channel[i], resampler->next_tick, &values[i]))
+		{
+			values[i] = 0;
+			*gap_mask |= (1u << i);
+		}
+	}
+
+	resampler->next_tick += resampler->period;
+
+	return 1;
+}
@@ -0,0 +1,74 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESAMPLER_HEADER_
+#define _RESAMPLER_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RESAMPLER_MAX_CHANNELS 32 /* one bit per channel in the gap mask */
+#define RESAMPLER_HISTORY_DEPTH 16 /* samples kept per channel for the look-behind */
+#define RESAMPLER_MAX_CATCHUP_TICKS 3600 /* beyond this the timeline restarts instead of emitting gaps */
+
+typedef enum {
+	E_RESAMPLER_LINEAR = 0, /* linear interpolation between the two surrounding samples */
+	E_RESAMPLER_HOLD, /* last sample before the tick */
+} E_resampler_interpolation;
+
+typedef struct {
+	E_resampler_interpolation interpolation;
+	int max_gap; /* ms, a channel without sample for longer is marked as a gap */
+} T_resampler_channel_config;
+
+typedef struct {
+	int64_t timestamp; /* ms */
+	int32_t value; /* fixed point, in the unit of the channel */
+} T_resampler_sample;
+
+typedef struct {
+	T_resampler_channel_config config;
+	T_resampler_sample history[RESAMPLER_HISTORY_DEPTH]; /* ring buffer, oldest at first */
+	int first;
+	int count;
+} T_resampler_channel;
+
+typedef struct {
+	bool is_initialized;
+	int period; /* ms between two ticks of the common timeline */
+	int delay; /* ms, a tick is only emitted once a sample newer than tick + delay was received */
+	int nb_channels;
+	bool has_tick;
+	int64_t next_tick; /* ms */
+	int64_t newest; /* ms, newest timestamp received on any channel */
+	T_resampler_channel channel[RESAMPLER_MAX_CHANNELS];
+} T_resampler;
+
+int resampler_init(T_resampler *resampler, int period, int delay, const T_resampler_channel_config *config, int nb_channels);
+int resampler_reset(T_resampler *resampler);
+
+/* Add a sample to a channel, samples of a channel must be pushed in time order */
+int resampler_push(T_resampler *resampler, int channel, int64_t timestamp, int32_t value);
+
+/* Get the next tick of the common timeline, values must hold nb_channels elements.
+ * Return 1 when a tick was produced, 0 when the next tick is not complete yet.
+ * The bit of a channel in gap_mask is set when it has no value for the tick.
+ */
+int resampler_pop(T_resampler *resampler, int64_t *timestamp, int32_t *values, uint32_t *gap_mask);
+
+#endif //_RESAMPLER_HEADER_
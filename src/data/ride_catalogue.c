@@ -0,0 +1,156 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "ride_catalogue.h"
+
+#define CATALOGUE_MAGIC "OBCI"
+#define CATALOGUE_VERSION 1
+
+/* Sort key of an entry, with its index */
+typedef struct {
+	int64_t key;
+	int index;
+} T_catalogue_sort_item;
+
+static int64_t _get_key(const T_ride_catalogue_entry *entry, E_ride_catalogue_key key)
+{
+	switch(key)
+	{
+		case E_RIDE_CATALOGUE_START_TIME:
+			return entry->start_time;
+		case E_RIDE_CATALOGUE_DURATION:
+			return entry->duration;
+		case E_RIDE_CATALOGUE_DISTANCE:
+			return entry->distance;
+		case E_RIDE_CATALOGUE_ELEVATION_GAIN:
+			return entry->elevation_gain;
+		case E_RIDE_CATALOGUE_AVERAGE_POWER:
+			return entry->average_power;
+		default:
+			return 0;
+	}
+}
+
+static int _compare_items(const void *a, const void *b)
+{
+	const T_catalogue_sort_item *item_a = a;
+	const T_catalogue_sort_item *item_b = b;
+
+	if(item_a->key != item_b->key)
+	{
+		return (item_a->key < item_b->key) ? -1 : 1;
+	}
+
+	/* Stable on the recording order */
+	return item_a->index - item_b->index;
+}
+
+int ride_catalogue_open(T_ride_catalogue *catalogue, const char *path)
+{
+	fail_if_null(catalogue, -1, "catalogue is null\n");
+	fail_if_null(path, -2, "path is null\n");
+
+	int ret = record_file_open(&catalogue->file, path, CATALOGUE_MAGIC, CATALOGUE_VERSION, sizeof(T_ride_catalogue_entry));
+	catalogue->nb_rides = catalogue->file.nb_records;
+	catalogue->entries = catalogue->file.records;
+	fail_if_negative(ret, -3, "record_file_open failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int ride_catalogue_close(T_ride_catalogue *catalogue)
+{
+	fail_if_null(catalogue, -1, "catalogue is null\n");
+
+	record_file_close(&catalogue->file);
+	catalogue->nb_rides = 0;
+	catalogue->entries = NULL;
+
+	return 0;
+}
+
+int ride_catalogue_add(const char *path, T_ride_catalogue_entry *entry)
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(entry, -2, "entry is null\n");
+
+	int ret = 0;
+	T_ride_catalogue catalogue;
+
+	ret = ride_catalogue_open(&catalogue, path);
+	fail_if_negative(ret, -3, "ride_catalogue_open failed, return: %d\n", ret);
+
+	entry->id = (catalogue.nb_rides > 0) ? catalogue.entries[catalogue.nb_rides - 1].id + 1 : 1;
+	ret = record_file_append(path, CATALOGUE_MAGIC, CATALOGUE_VERSION, sizeof(T_ride_catalogue_entry), &catalogue.file, entry);
+	ride_catalogue_close(&catalogue);
+	fail_if_negative(ret, -4, "record_file_append failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int ride_catalogue_get_path(const T_ride_catalogue_entry *entry, const char *extension, char *buff, int size)
+{
+	fail_if_null(entry, -1, "entry is null\n");
+	fail_if_null(extension, -2, "extension is null\n");
+	fail_if_null(buff, -3, "buff is null\n");
+
+	int ret = snprintf(buff, size, "%s/%s%s", RIDES_FOLDER_PATH, entry->name, extension);
+	fail_if_negative(ret, -4, "snprintf failed\n");
+	fail_if_superior_or_equal(ret, size, -5, "path is too long\n");
+
+	return 0;
+}
+
+int ride_catalogue_sort(const T_ride_catalogue *catalogue, E_ride_catalogue_key key, bool is_descending, int *order)
+{
+	fail_if_null(catalogue, -1, "catalogue is null\n");
+	fail_if_null(order, -2, "order is null\n");
+	fail_if_negative(key, -3, "invalid key %d\n", key);
+	fail_if_superior_or_equal(key, E_RIDE_CATALOGUE_KEY_NUMBER, -4, "invalid key %d\n", key);
+
+	if(catalogue->nb_rides == 0)
+	{
+		return 0;
+	}
+
+	T_catalogue_sort_item *items = malloc(catalogue->nb_rides * sizeof(T_catalogue_sort_item));
+	fail_if_null(items, -5, "malloc sort items failed\n");
+
+	for(int i = 0; i < catalogue->nb_rides; i++)
+	{
+		int64_t value = _get_key(&catalogue->entries[i], key);
+
+		items[i].key = is_descending ? -value : value;
+		items[i].index = i;
+	}
+
+	qsort(items, catalogue->nb_rides, sizeof(T_catalogue_sort_item), &_compare_items);
+
+	for(int i = 0; i < catalogue->nb_rides; i++)
+	{
+		order[i] = items[i].index;
+	}
+
+	free(items);
+
+	return 0;
+}
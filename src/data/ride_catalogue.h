@@ -0,0 +1,79 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_CATALOGUE_HEADER_
+#define _RIDE_CATALOGUE_HEADER_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "system.h"
+#include "record_file.h"
+
+/* Index of the recorded rides, one fixed size entry per ride after a small
+ * header, so that the list is read with a single mmap instead of opening
+ * each ride. The file is replaced atomically when a ride is added.
+ */
+
+#define RIDE_CATALOGUE_PATH RIDES_FOLDER_PATH "/catalogue"
+#define RIDE_CATALOGUE_NAME_SIZE 32
+
+typedef struct {
+	int64_t start_time; /* s since the epoch, UTC */
+	uint32_t id; /* order of recording, starting at 1 */
+	int32_t duration; /* s, moving time */
+	int32_t distance; /* m */
+	int32_t elevation_gain; /* m */
+	int32_t average_power; /* W, 0 without power meter */
+	uint32_t log_size; /* bytes of the ride log */
+	char name[RIDE_CATALOGUE_NAME_SIZE]; /* files of the ride in RIDES_FOLDER_PATH, without extension */
+} T_ride_catalogue_entry;
+
+typedef enum {
+	E_RIDE_CATALOGUE_START_TIME = 0,
+	E_RIDE_CATALOGUE_DURATION,
+	E_RIDE_CATALOGUE_DISTANCE,
+	E_RIDE_CATALOGUE_ELEVATION_GAIN,
+	E_RIDE_CATALOGUE_AVERAGE_POWER,
+	E_RIDE_CATALOGUE_KEY_NUMBER, // must be last
+} E_ride_catalogue_key;
+
+/* Catalogue mapped read-only */
+typedef struct {
+	T_record_file file;
+	int nb_rides;
+	const T_ride_catalogue_entry *entries;
+} T_ride_catalogue;
+
+/* Add a ride, entry->id is given by the catalogue. The new catalogue is
+ * written next to the current one and renamed over it, a power cut leaves
+ * either the old or the new catalogue.
+ */
+int ride_catalogue_add(const char *path, T_ride_catalogue_entry *entry);
+
+/* A missing catalogue is opened empty */
+int ride_catalogue_open(T_ride_catalogue *catalogue, const char *path);
+int ride_catalogue_close(T_ride_catalogue *catalogue);
+
+/* Path of a file of the ride of an entry, extension gives the file type (".zones", ".ride", ".fit") */
+int ride_catalogue_get_path(const T_ride_catalogue_entry *entry, const char *extension, char *buff, int size);
+
+/* Fill order with the indexes of the entries sorted on key */
+int ride_catalogue_sort(const T_ride_catalogue *catalogue, E_ride_catalogue_key key, bool is_descending, int *order);
+
+#endif //_RIDE_CATALOGUE_HEADER_
@@ -0,0 +1,543 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "data_manager.h"
+#include "ride_reader.h"
+#include "fit_encoder.h"
+#include "ride_export.h"
+
+#define EXPORT_CREATOR "OpenBikeComputer"
+#define EXPORT_TIME_LENGTH 24 /* "2023-11-14T22:13:20.100Z" */
+#define EXPORT_PLACEHOLDER "                " /* patched once the value is known */
+#define EXPORT_PLACEHOLDER_LENGTH ((int)sizeof(EXPORT_PLACEHOLDER) - 1)
+#define EXPORT_PATH_SIZE 256
+
+typedef struct {
+	int fd;
+	bool has_error;
+	int64_t offset; /* bytes already written to the file */
+	int size; /* bytes in the buffer */
+	int64_t day; /* day of the cached date */
+	char date[11]; /* "2023-11-14" */
+	char buffer[RIDE_EXPORT_BUFFER_SIZE];
+} T_export_output;
+
+/* State of the conversion shared by the formats */
+typedef struct {
+	int64_t clock_offset; /* ms, UTC time minus the frame timestamps */
+	int64_t start_timestamp; /* ms, first frame */
+	bool is_paused;
+	int32_t moving_time; /* ms */
+	int32_t distance; /* cm */
+	bool has_first_moving_time;
+	int32_t first_moving_time; /* ms, first value of the range, the totals start from it */
+	bool has_first_distance;
+	int32_t first_distance; /* cm */
+	int64_t total_time_position; /* TCX placeholders */
+	int64_t distance_position;
+} T_export_state;
+
+typedef struct {
+	const char *extension;
+	void (*begin)(T_export_output *out, T_export_state *state, const T_data_frame *frame);
+	void (*point)(T_export_output *out, T_export_state *state, const T_data_frame *frame);
+	void (*end)(T_export_output *out, T_export_state *state);
+} T_export_format;
+
+static void _flush(T_export_output *out)
+{
+	const char *p = out->buffer;
+	int size = out->size;
+
+	while(size > 0)
+	{
+		ssize_t ret = write(out->fd, p, size);
+		if(ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(ret <= 0)
+		{
+			log_error("write failed, errno: %d\n", errno);
+			out->has_error = true;
+			break;
+		}
+		p += ret;
+		size -= ret;
+	}
+
+	out->offset += out->size;
+	out->size = 0;
+}
+
+static void _write(T_export_output *out, const char *str, int length)
+{
+	if(out->size + length > RIDE_EXPORT_BUFFER_SIZE)
+	{
+		_flush(out);
+	}
+
+	memcpy(&out->buffer[out->size], str, length);
+	out->size += length;
+}
+
+#define _literal(out, str) _write(out, str, (int)sizeof(str) - 1)
+
+static void _fixed(T_export_output *out, int64_t value, int decimals)
+{
+	if(out->size + FIXED_POINT_MAX_LENGTH > RIDE_EXPORT_BUFFER_SIZE)
+	{
+		_flush(out);
+	}
+
+	out->size += fixed_point_write(&out->buffer[out->size], value, decimals);
+}
+
+static inline void _two_digits(char *buff, int value)
+{
+	buff[0] = '0' + value / 10;
+	buff[1] = '0' + value % 10;
+}
+
+/* ISO 8601 UTC time, the date is only computed when the day changes */
+static void _time(T_export_output *out, int64_t time)
+{
+	char str[EXPORT_TIME_LENGTH];
+	int64_t seconds = (time >= 0 ? time : time - 999) / 1000;
+	int milliseconds = (int)(time - seconds * 1000);
+	int64_t day = (seconds >= 0 ? seconds : seconds - 86399) / 86400;
+	int second_of_day = (int)(seconds - day * 86400);
+
+	if(day != out->day || out->date[0] == '\0')
+	{
+		/* Civil date from the days since 1970-01-01 */
+		int64_t z = day + 719468;
+		int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+		int64_t doe = z - era * 146097;
+		int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		int64_t mp = (5 * doy + 2) / 153;
+		int d = (int)(doy - (153 * mp + 2) / 5 + 1);
+		int m = (int)(mp < 10 ? mp + 3 : mp - 9);
+		int y = (int)(yoe + era * 400 + (m <= 2));
+
+		_two_digits(&out->date[0], y / 100);
+		_two_digits(&out->date[2], y % 100);
+		out->date[4] = '-';
+		_two_digits(&out->date[5], m);
+		out->date[7] = '-';
+		_two_digits(&out->date[8], d);
+		out->date[10] = '\0';
+		out->day = day;
+	}
+
+	memcpy(str, out->date, 10);
+	str[10] = 'T';
+	_two_digits(&str[11], second_of_day / 3600);
+	str[13] = ':';
+	_two_digits(&str[14], second_of_day / 60 % 60);
+	str[16] = ':';
+	_two_digits(&str[17], second_of_day % 60);
+
+	int length = 19;
+	if(milliseconds != 0)
+	{
+		str[length++] = '.';
+		str[length++] = '0' + milliseconds / 100;
+		_two_digits(&str[length], milliseconds % 100);
+		length += 2;
+	}
+	str[length++] = 'Z';
+
+	_write(out, str, length);
+}
+
+static inline bool _is_valid(const T_data_frame *frame, E_data_channel channel)
+{
+	return data_frame_is_valid(frame, channel);
+}
+
+/*
+ * GPX 1.1, with the Garmin track point extension for the sensors
+ */
+static void _gpx_begin(T_export_output *out, T_export_state *state, const T_data_frame *frame)
+{
+	_literal(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<gpx version=\"1.1\" creator=\"" EXPORT_CREATOR "\" xmlns=\"http://www.topografix.com/GPX/1/1\""
+		" xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v1\">\n"
+		"<metadata><time>");
+	_time(out, frame->timestamp + state->clock_offset);
+	_literal(out, "</time></metadata>\n<trk><type>cycling</type><trkseg>\n");
+}
+
+static void _gpx_point(T_export_output *out, T_export_state *state, const T_data_frame *frame)
+{
+	bool is_paused = _is_valid(frame, E_DATA_PAUSED) && frame->value[E_DATA_PAUSED];
+
+	/* A new segment after each pause */
+	if(state->is_paused && !is_paused)
+	{
+		_literal(out, "</trkseg><trkseg>\n");
+	}
+	state->is_paused = is_paused;
+
+	if(!_is_valid(frame, E_DATA_LATITUDE) || !_is_valid(frame, E_DATA_LONGITUDE))
+	{
+		return;
+	}
+
+	_literal(out, "<trkpt lat=\"");
+	_fixed(out, frame->value[E_DATA_LATITUDE], FIXED_POINT_COORDINATE_DECIMALS);
+	_literal(out, "\" lon=\"");
+	_fixed(out, frame->value[E_DATA_LONGITUDE], FIXED_POINT_COORDINATE_DECIMALS);
+	_literal(out, "\">");
+
+	if(_is_valid(frame, E_DATA_ALTITUDE))
+	{
+		_literal(out, "<ele>");
+		_fixed(out, frame->value[E_DATA_ALTITUDE], 2);
+		_literal(out, "</ele>");
+	}
+
+	_literal(out, "<time>");
+	_time(out, frame->timestamp + state->clock_offset);
+	_literal(out, "</time>");
+
+	if(_is_valid(frame, E_DATA_POWER) || _is_valid(frame, E_DATA_TEMPERATURE)
+	|| _is_valid(frame, E_DATA_HEART_RATE) || _is_valid(frame, E_DATA_CADENCE))
+	{
+		_literal(out, "<extensions>");
+		if(_is_valid(frame, E_DATA_POWER))
+		{
+			_literal(out, "<power>");
+			_fixed(out, frame->value[E_DATA_POWER], 0);
+			_literal(out, "</power>");
+		}
+		_literal(out, "<gpxtpx:TrackPointExtension>");
+		if(_is_valid(frame, E_DATA_TEMPERATURE))
+		{
+			_literal(out, "<gpxtpx:atemp>");
+			_fixed(out, frame->value[E_DATA_TEMPERATURE], 1);
+			_literal(out, "</gpxtpx:atemp>");
+		}
+		if(_is_valid(frame, E_DATA_HEART_RATE))
+		{
+			_literal(out, "<gpxtpx:hr>");
+			_fixed(out, frame->value[E_DATA_HEART_RATE], 0);
+			_literal(out, "</gpxtpx:hr>");
+		}
+		if(_is_valid(frame, E_DATA_CADENCE))
+		{
+			_literal(out, "<gpxtpx:cad>");
+			_fixed(out, frame->value[E_DATA_CADENCE], 0);
+			_literal(out, "</gpxtpx:cad>");
+		}
+		_literal(out, "</gpxtpx:TrackPointExtension></extensions>");
+	}
+
+	_literal(out, "</trkpt>\n");
+}
+
+static void _gpx_end(T_export_output *out, T_export_state *state)
+{
+	_literal(out, "</trkseg></trk>\n</gpx>\n");
+}
+
+/*
+ * TCX, one lap, the lap totals are only known at the end and patched
+ */
+static void _tcx_begin(T_export_output *out, T_export_state *state, const T_data_frame *frame)
+{
+	_literal(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<TrainingCenterDatabase xmlns=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\""
+		" xmlns:ns3=\"http://www.garmin.com/xmlschemas/ActivityExtension/v2\">\n"
+		"<Activities><Activity Sport=\"Biking\"><Id>");
+	_time(out, frame->timestamp + state->clock_offset);
+	_literal(out, "</Id>\n<Lap StartTime=\"");
+	_time(out, frame->timestamp + state->clock_offset);
+	_literal(out, "\"><TotalTimeSeconds>");
+	state->total_time_position = out->offset + out->size;
+	_literal(out, EXPORT_PLACEHOLDER);
+	_literal(out, "</TotalTimeSeconds><DistanceMeters>");
+	state->distance_position = out->offset + out->size;
+	_literal(out, EXPORT_PLACEHOLDER);
+	_literal(out, "</DistanceMeters><Intensity>Active</Intensity><TriggerMethod>Manual</TriggerMethod>\n<Track>\n");
+}
+
+static void _tcx_point(T_export_output *out, T_export_state *state, const T_data_frame *frame)
+{
+	_literal(out, "<Trackpoint><Time>");
+	_time(out, frame->timestamp + state->clock_offset);
+	_literal(out, "</Time>");
+
+	if(_is_valid(frame, E_DATA_LATITUDE) && _is_valid(frame, E_DATA_LONGITUDE))
+	{
+		_literal(out, "<Position><LatitudeDegrees>");
+		_fixed(out, frame->value[E_DATA_LATITUDE], FIXED_POINT_COORDINATE_DECIMALS);
+		_literal(out, "</LatitudeDegrees><LongitudeDegrees>");
+		_fixed(out, frame->value[E_DATA_LONGITUDE], FIXED_POINT_COORDINATE_DECIMALS);
+		_literal(out, "</LongitudeDegrees></Position>");
+	}
+	if(_is_valid(frame, E_DATA_ALTITUDE))
+	{
+		_literal(out, "<AltitudeMeters>");
+		_fixed(out, frame->value[E_DATA_ALTITUDE], 2);
+		_literal(out, "</AltitudeMeters>");
+	}
+	if(_is_valid(frame, E_DATA_DISTANCE))
+	{
+		_literal(out, "<DistanceMeters>");
+		_fixed(out, frame->value[E_DATA_DISTANCE], 2);
+		_literal(out, "</DistanceMeters>");
+	}
+	if(_is_valid(frame, E_DATA_HEART_RATE))
+	{
+		_literal(out, "<HeartRateBpm><Value>");
+		_fixed(out, frame->value[E_DATA_HEART_RATE], 0);
+		_literal(out, "</Value></HeartRateBpm>");
+	}
+	if(_is_valid(frame, E_DATA_CADENCE))
+	{
+		_literal(out, "<Cadence>");
+		_fixed(out, frame->value[E_DATA_CADENCE], 0);
+		_literal(out, "</Cadence>");
+	}
+	if(_is_valid(frame, E_DATA_SPEED) || _is_valid(frame, E_DATA_POWER))
+	{
+		_literal(out, "<Extensions><ns3:TPX>");
+		if(_is_valid(frame, E_DATA_SPEED))
+		{
+			_literal(out, "<ns3:Speed>");
+			_fixed(out, frame->value[E_DATA_SPEED], 3);
+			_literal(out, "</ns3:Speed>");
+		}
+		if(_is_valid(frame, E_DATA_POWER))
+		{
+			_literal(out, "<ns3:Watts>");
+			_fixed(out, frame->value[E_DATA_POWER], 0);
+			_literal(out, "</ns3:Watts>");
+		}
+		_literal(out, "</ns3:TPX></Extensions>");
+	}
+
+	_literal(out, "</Trackpoint>\n");
+}
+
+static void _tcx_end(T_export_output *out, T_export_state *state)
+{
+	_literal(out, "</Track>\n</Lap>\n</Activity></Activities>\n</TrainingCenterDatabase>\n");
+}
+
+/* Replace a placeholder already flushed to the file, the value is left aligned */
+static void _patch(T_export_output *out, int64_t position, int64_t value, int decimals)
+{
+	char str[EXPORT_PLACEHOLDER_LENGTH + FIXED_POINT_MAX_LENGTH];
+	int length = fixed_point_write(str, value, decimals);
+
+	if(length > EXPORT_PLACEHOLDER_LENGTH || pwrite(out->fd, str, length, position) != length)
+	{
+		log_error("patching the value at %lld failed\n", (long long)position);
+		out->has_error = true;
+	}
+}
+
+static const T_export_format export_formats[E_RIDE_EXPORT_FORMAT_NUMBER] = {
+	[E_RIDE_EXPORT_GPX] = {.extension = ".gpx", .begin = &_gpx_begin, .point = &_gpx_point, .end = &_gpx_end},
+	[E_RIDE_EXPORT_TCX] = {.extension = ".tcx", .begin = &_tcx_begin, .point = &_tcx_point, .end = &_tcx_end},
+	[E_RIDE_EXPORT_FIT] = {.extension = ".fit", .begin = NULL, .point = NULL, .end = NULL},
+};
+
+int ride_export_get_format(const char *path)
+{
+	fail_if_null(path, -1, "path is null\n");
+
+	const char *extension = strrchr(path, '.');
+	fail_if_null(extension, -2, "%s has no extension\n", path);
+
+	for(int i = 0; i < E_RIDE_EXPORT_FORMAT_NUMBER; i++)
+	{
+		if(strcasecmp(extension, export_formats[i].extension) == 0)
+		{
+			return i;
+		}
+	}
+
+	fail(-3, "unknown export format %s\n", extension);
+}
+
+/* Too large for the stack of the callers */
+typedef struct {
+	T_ride_reader_iterator iterator;
+	T_export_output out;
+} T_export_context;
+
+/* The index is kept next to the log, with the extension of the index */
+static int _get_index_path(const char *log_path, char *buff, int size)
+{
+	const char *slash = strrchr(log_path, '/');
+	const char *dot = strrchr(log_path, '.');
+	int length = (dot != NULL && (slash == NULL || dot > slash)) ? (int)(dot - log_path) : (int)strlen(log_path);
+
+	int ret = snprintf(buff, size, "%.*s%s", length, log_path, RIDE_READER_INDEX_EXTENSION);
+	fail_if_negative(ret, -1, "snprintf failed\n");
+	fail_if_superior_or_equal(ret, size, -2, "path is too long\n");
+
+	return 0;
+}
+
+int ride_export(const char *log_path, const char *output_path, E_ride_export_format format, int64_t start, int64_t end)
+{
+	fail_if_null(log_path, -1, "log_path is null\n");
+	fail_if_null(output_path, -2, "output_path is null\n");
+	fail_if_negative(format, -3, "invalid format %d\n", format);
+	fail_if_superior_or_equal(format, E_RIDE_EXPORT_FORMAT_NUMBER, -4, "invalid format %d\n", format);
+
+	int ret = 0;
+	const T_export_format *exporter = &export_formats[format];
+	char index_path[EXPORT_PATH_SIZE];
+	T_ride_reader reader;
+	T_data_frame frame;
+	T_export_state state;
+	T_export_context *context = NULL;
+
+	/* FIT is binary, it has its own encoder */
+	if(format == E_RIDE_EXPORT_FIT)
+	{
+		fail_if_false((start == 0 && end == RIDE_READER_END), -5, "the FIT export covers the whole ride\n");
+		return fit_encoder_export(log_path, output_path);
+	}
+
+	ret = _get_index_path(log_path, index_path, sizeof(index_path));
+	fail_if_negative(ret, -6, "_get_index_path failed, return: %d\n", ret);
+
+	/* On the heap, exports can run in several threads */
+	context = malloc(sizeof(T_export_context));
+	fail_if_null(context, -7, "malloc context failed\n");
+	T_ride_reader_iterator *iterator = &context->iterator;
+	T_export_output *out = &context->out;
+
+	ret = ride_reader_open(&reader, log_path, index_path);
+	if(ret < 0)
+	{
+		log_error("ride_reader_open failed, return: %d\n", ret);
+		ret = -8;
+		goto export_context_cleanup;
+	}
+
+	/* Only the blocks of the range are decoded */
+	ret = ride_reader_iterate(&reader, start, end, iterator);
+	if(ret == 0)
+	{
+		ret = ride_reader_next(iterator, &frame);
+	}
+	if(ret <= 0)
+	{
+		log_error("%s holds no frame in the range, return: %d\n", log_path, ret);
+		ret = -9;
+		goto export_reader_cleanup;
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.clock_offset = iterator->clock_offset;
+	state.start_timestamp = frame.timestamp;
+
+	out->fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out->fd < 0)
+	{
+		log_error("open %s failed, errno: %d\n", output_path, errno);
+		ret = -10;
+		goto export_reader_cleanup;
+	}
+	out->has_error = false;
+	out->offset = 0;
+	out->size = 0;
+	out->date[0] = '\0';
+
+	exporter->begin(out, &state, &frame);
+	do
+	{
+		exporter->point(out, &state, &frame);
+
+		if(data_frame_is_valid(&frame, E_DATA_MOVING_TIME))
+		{
+			if(!state.has_first_moving_time)
+			{
+				state.first_moving_time = frame.value[E_DATA_MOVING_TIME];
+				state.has_first_moving_time = true;
+			}
+			state.moving_time = frame.value[E_DATA_MOVING_TIME];
+		}
+		if(data_frame_is_valid(&frame, E_DATA_DISTANCE))
+		{
+			if(!state.has_first_distance)
+			{
+				state.first_distance = frame.value[E_DATA_DISTANCE];
+				state.has_first_distance = true;
+			}
+			state.distance = frame.value[E_DATA_DISTANCE];
+		}
+
+		ret = ride_reader_next(iterator, &frame);
+		state.clock_offset = iterator->clock_offset;
+	} while(ret > 0);
+	exporter->end(out, &state);
+	_flush(out);
+
+	if(ret < 0)
+	{
+		log_error("ride_reader_next failed, return: %d\n", ret);
+		ret = -11;
+		goto export_file_cleanup;
+	}
+
+	/* The channels are totals since the start of the ride, the lap only covers the range */
+	if(format == E_RIDE_EXPORT_TCX)
+	{
+		_patch(out, state.total_time_position, state.moving_time - state.first_moving_time, 3);
+		_patch(out, state.distance_position, state.distance - state.first_distance, 2);
+	}
+
+	if(out->has_error)
+	{
+		log_error("writing %s failed\n", output_path);
+		ret = -12;
+		goto export_file_cleanup;
+	}
+
+	log_info("%s exported, %lld bytes\n", output_path, (long long)out->offset);
+	ret = 0;
+
+export_file_cleanup:
+	close(out->fd);
+export_reader_cleanup:
+	ride_reader_close(&reader);
+export_context_cleanup:
+	free(context);
+
+	return ret;
+}
@@ -0,0 +1,47 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_EXPORT_HEADER_
+#define _RIDE_EXPORT_HEADER_
+
+#include <stdint.h>
+#include "ride_reader.h"
+
+#define RIDE_EXPORT_BUFFER_SIZE 4096 /* bytes, output buffer of the text formats */
+
+typedef enum {
+	E_RIDE_EXPORT_GPX = 0,
+	E_RIDE_EXPORT_TCX,
+	E_RIDE_EXPORT_FIT,
+	E_RIDE_EXPORT_FORMAT_NUMBER, // must be last
+} E_ride_export_format;
+
+/* Format given by the extension of the path (".gpx", ".tcx", ".fit"), negative if unknown */
+int ride_export_get_format(const char *path);
+
+/* Convert a ride log in a single streaming pass, the memory used does not
+ * depend on the ride length. The numbers of the text formats are written
+ * with fixed_point_write, printf is too slow for hours of points.
+ * Only the frames from start to end, in ms since the start of the ride, are
+ * exported, the FIT export covers the whole ride (0 to RIDE_READER_END).
+ * The TCX lap totals are the moving time and distance of the range. Each
+ * call allocates its own buffers, exports can run in several threads.
+ */
+int ride_export(const char *log_path, const char *output_path, E_ride_export_format format, int64_t start, int64_t end);
+
+#endif //_RIDE_EXPORT_HEADER_
@@ -0,0 +1,422 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "data_manager.h"
+#include "ride_history.h"
+
+/* Points of a tier waiting to be downsampled into the next one: the bucket
+ * being selected and the next bucket whose average is the third LTTB point
+ */
+#define BUCKET_SIZE 2
+#define PENDING_SIZE (2 * BUCKET_SIZE)
+
+typedef struct {
+	T_ride_history_point point[RIDE_HISTORY_TIER_SIZE]; /* ring buffer, oldest at first */
+	int first;
+	int count;
+	bool has_dropped; /* the oldest points of the ride are no longer in this tier */
+
+	/* Downsampling of the previous tier into this one */
+	T_ride_history_point pending[PENDING_SIZE];
+	int nb_pending;
+	bool has_selected;
+	T_ride_history_point selected; /* last point added, first point of the LTTB triangle */
+} T_tier;
+
+typedef struct {
+	T_tier tier[RIDE_HISTORY_NB_TIERS];
+} T_history_channel;
+
+/* Channels kept in the history */
+static const E_data_channel history_channels[] = {
+	E_DATA_SPEED,
+	E_DATA_ALTITUDE,
+	E_DATA_HEART_RATE,
+	E_DATA_POWER,
+	E_DATA_CADENCE,
+};
+
+#define NB_HISTORY_CHANNELS ((int)(sizeof(history_channels) / sizeof(history_channels[0])))
+
+/* Read only view of consecutive points of a ring buffer */
+typedef struct {
+	const T_ride_history_point *base;
+	int first;
+	int size;
+} T_view;
+
+static struct {
+	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the tiers, read by the ui */
+	int index[E_DATA_CHANNEL_NUMBER]; /* channel to history index, -1 when not kept */
+	T_history_channel channel[NB_HISTORY_CHANNELS];
+} ride_history = {
+	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void _tier_add(T_history_channel *channel, int level, T_ride_history_point point);
+
+static inline const T_ride_history_point *_view_get(const T_view *view, int i)
+{
+	return &view->base[(view->first + i) % view->size];
+}
+
+/* Twice the area of the triangle abc, time and values differences stay below
+ * 2^31 and 2^24 so the products fit in 64 bits
+ */
+static inline int64_t _triangle_area(int64_t at, int64_t av, int64_t bt, int64_t bv, int64_t ct, int64_t cv)
+{
+	int64_t area = (at - ct) * (bv - av) - (at - bt) * (cv - av);
+
+	return area < 0 ? -area : area;
+}
+
+static int _lttb(const T_view *view, int count, T_ride_history_point *output, int max_points)
+{
+	int nb_output = 0;
+
+	if(count <= max_points || max_points < 3)
+	{
+		int nb_copy = count < max_points ? count : max_points;
+		for(int i = 0; i < nb_copy; i++)
+		{
+			output[i] = *_view_get(view, i);
+		}
+		return nb_copy;
+	}
+
+	/* First point is always kept */
+	const T_ride_history_point *a = _view_get(view, 0);
+	output[nb_output++] = *a;
+
+	/* The points between the first and the last one are split in max_points - 2 buckets */
+	int nb_buckets = max_points - 2;
+	for(int bucket = 0; bucket < nb_buckets; bucket++)
+	{
+		int start = 1 + (int)((int64_t)bucket * (count - 2) / nb_buckets);
+		int end = 1 + (int)((int64_t)(bucket + 1) * (count - 2) / nb_buckets);
+		int next_end = 1 + (int)((int64_t)(bucket + 2) * (count - 2) / nb_buckets);
+
+		/* Third point is the average of the next bucket, the last point for the last bucket */
+		int64_t ct = 0;
+		int64_t cv = 0;
+		if(bucket == nb_buckets - 1)
+		{
+			ct = _view_get(view, count - 1)->time;
+			cv = _view_get(view, count - 1)->value;
+		}
+		else
+		{
+			for(int i = end; i < next_end; i++)
+			{
+				ct += _view_get(view, i)->time;
+				cv += _view_get(view, i)->value;
+			}
+			ct /= next_end - end;
+			cv /= next_end - end;
+		}
+
+		const T_ride_history_point *selected = _view_get(view, start);
+		int64_t max_area = -1;
+		for(int i = start; i < end; i++)
+		{
+			const T_ride_history_point *b = _view_get(view, i);
+			int64_t area = _triangle_area(a->time, a->value, b->time, b->value, ct, cv);
+			if(area > max_area)
+			{
+				max_area = area;
+				selected = b;
+			}
+		}
+
+		output[nb_output++] = *selected;
+		a = selected;
+	}
+
+	/* Last point is always kept */
+	output[nb_output++] = *_view_get(view, count - 1);
+
+	return nb_output;
+}
+
+/* The last tier is full, downsample it to half its size so it keeps the whole ride */
+static void _tier_compact(T_tier *tier)
+{
+	T_ride_history_point compacted[RIDE_HISTORY_TIER_SIZE / 2];
+	T_view view = {.base = tier->point, .first = tier->first, .size = RIDE_HISTORY_TIER_SIZE};
+
+	int count = _lttb(&view, tier->count, compacted, RIDE_HISTORY_TIER_SIZE / 2);
+
+	memcpy(tier->point, compacted, count * sizeof(T_ride_history_point));
+	tier->first = 0;
+	tier->count = count;
+}
+
+/* Streaming LTTB with buckets of BUCKET_SIZE points from a tier to the next one */
+static void _tier_feed(T_history_channel *channel, int level, T_ride_history_point point)
+{
+	T_tier *tier = &channel->tier[level];
+
+	/* The first point of the ride is always kept */
+	if(!tier->has_selected)
+	{
+		tier->selected = point;
+		tier->has_selected = true;
+		_tier_add(channel, level, point);
+		return;
+	}
+
+	tier->pending[tier->nb_pending++] = point;
+	if(tier->nb_pending < PENDING_SIZE)
+	{
+		return;
+	}
+
+	int64_t ct = 0;
+	int64_t cv = 0;
+	for(int i = BUCKET_SIZE; i < PENDING_SIZE; i++)
+	{
+		ct += tier->pending[i].time;
+		cv += tier->pending[i].value;
+	}
+	ct /= BUCKET_SIZE;
+	cv /= BUCKET_SIZE;
+
+	int selected = 0;
+	int64_t max_area = -1;
+	for(int i = 0; i < BUCKET_SIZE; i++)
+	{
+		int64_t area = _triangle_area(tier->selected.time, tier->selected.value, tier->pending[i].time, tier->pending[i].value, ct, cv);
+		if(area > max_area)
+		{
+			max_area = area;
+			selected = i;
+		}
+	}
+
+	tier->selected = tier->pending[selected];
+
+	/* The next bucket becomes the bucket to select */
+	memmove(&tier->pending[0], &tier->pending[BUCKET_SIZE], BUCKET_SIZE * sizeof(T_ride_history_point));
+	tier->nb_pending = BUCKET_SIZE;
+
+	_tier_add(channel, level, tier->selected);
+}
+
+static void _tier_add(T_history_channel *channel, int level, T_ride_history_point point)
+{
+	T_tier *tier = &channel->tier[level];
+
+	if(tier->count == RIDE_HISTORY_TIER_SIZE)
+	{
+		if(level == RIDE_HISTORY_NB_TIERS - 1)
+		{
+			_tier_compact(tier);
+		}
+		else
+		{
+			tier->first = (tier->first + 1) % RIDE_HISTORY_TIER_SIZE;
+			tier->count--;
+			tier->has_dropped = true;
+		}
+	}
+
+	tier->point[(tier->first + tier->count) % RIDE_HISTORY_TIER_SIZE] = point;
+	tier->count++;
+
+	if(level < RIDE_HISTORY_NB_TIERS - 1)
+	{
+		_tier_feed(channel, level + 1, point);
+	}
+}
+
+/* Index of the first point of the tier with a time greater than time (or equal when is_inclusive) */
+static int _tier_search(const T_tier *tier, int32_t time, bool is_inclusive)
+{
+	int low = 0;
+	int high = tier->count;
+
+	while(low < high)
+	{
+		int middle = low + (high - low) / 2;
+		int32_t point_time = tier->point[(tier->first + middle) % RIDE_HISTORY_TIER_SIZE].time;
+
+		if(point_time < time || (!is_inclusive && point_time == time))
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+int ride_history_init(void)
+{
+	fail_if_true(ride_history.is_initialized, -1, "ride_history is already initialized\n");
+
+	for(int i = 0; i < E_DATA_CHANNEL_NUMBER; i++)
+	{
+		ride_history.index[i] = -1;
+	}
+
+	for(int i = 0; i < NB_HISTORY_CHANNELS; i++)
+	{
+		ride_history.index[history_channels[i]] = i;
+	}
+
+	memset(ride_history.channel, 0, sizeof(ride_history.channel));
+
+	ride_history.is_initialized = true;
+
+	return 0;
+}
+
+int ride_history_reset(void)
+{
+	fail_if_false(ride_history.is_initialized, -1, "ride_history is not initialized\n");
+
+	pthread_mutex_lock(&ride_history.mutex);
+	memset(ride_history.channel, 0, sizeof(ride_history.channel));
+	pthread_mutex_unlock(&ride_history.mutex);
+
+	return 0;
+}
+
+int ride_history_push(const T_data_frame *frame)
+{
+	fail_if_false(ride_history.is_initialized, -1, "ride_history is not initialized\n");
+	fail_if_null(frame, -2, "frame is null\n");
+
+	if(!data_frame_is_valid(frame, E_DATA_ELAPSED_TIME))
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&ride_history.mutex);
+
+	for(int i = 0; i < NB_HISTORY_CHANNELS; i++)
+	{
+		/* Gaps are not stored, the charts join the points around them */
+		if(!data_frame_is_valid(frame, history_channels[i]))
+		{
+			continue;
+		}
+
+		T_ride_history_point point = {
+			.time = frame->value[E_DATA_ELAPSED_TIME],
+			.value = frame->value[history_channels[i]],
+		};
+		_tier_add(&ride_history.channel[i], 0, point);
+	}
+
+	pthread_mutex_unlock(&ride_history.mutex);
+
+	return 0;
+}
+
+uint64_t ride_history_get_channel_mask(void)
+{
+	uint64_t mask = 0;
+
+	for(int i = 0; i < NB_HISTORY_CHANNELS; i++)
+	{
+		mask |= data_channel_bit(history_channels[i]);
+	}
+
+	return mask;
+}
+
+int ride_history_get(E_data_channel channel, int32_t start, int32_t end, T_ride_history_point *points, int max_points)
+{
+	fail_if_false(ride_history.is_initialized, -1, "ride_history is not initialized\n");
+	fail_if_negative(channel, -2, "invalid channel %d\n", channel);
+	fail_if_superior_or_equal(channel, E_DATA_CHANNEL_NUMBER, -3, "invalid channel %d\n", channel);
+	fail_if_negative(ride_history.index[channel], -4, "channel %d is not kept in the history\n", channel);
+	fail_if_null(points, -5, "points is null\n");
+	fail_if_negative_or_zero(max_points, -6, "invalid max_points %d\n", max_points);
+
+	int ret = 0;
+	T_history_channel *history = &ride_history.channel[ride_history.index[channel]];
+
+	pthread_mutex_lock(&ride_history.mutex);
+
+	/* Finest tier covering the start of the range with at most twice the points asked */
+	for(int level = 0; level < RIDE_HISTORY_NB_TIERS; level++)
+	{
+		const T_tier *tier = &history->tier[level];
+		bool is_last = (level == RIDE_HISTORY_NB_TIERS - 1);
+
+		if(tier->count == 0 || (!is_last && tier->has_dropped && tier->point[tier->first].time > start))
+		{
+			continue;
+		}
+
+		int first = _tier_search(tier, start, true);
+		int last = _tier_search(tier, end, false);
+		int count = last - first;
+
+		if(count <= 2 * max_points || is_last)
+		{
+			T_view view = {.base = tier->point, .first = (tier->first + first) % RIDE_HISTORY_TIER_SIZE, .size = RIDE_HISTORY_TIER_SIZE};
+			ret = _lttb(&view, count, points, max_points);
+			break;
+		}
+	}
+
+	/* The coarse tiers lag behind, end on the newest point so the chart reaches now */
+	const T_tier *newest_tier = &history->tier[0];
+	if(ret > 0 && newest_tier->count > 0)
+	{
+		const T_ride_history_point *newest = &newest_tier->point[(newest_tier->first + newest_tier->count - 1) % RIDE_HISTORY_TIER_SIZE];
+		if(newest->time <= end && newest->time > points[ret-1].time)
+		{
+			if(ret == max_points)
+			{
+				ret--;
+			}
+			points[ret++] = *newest;
+		}
+	}
+
+	pthread_mutex_unlock(&ride_history.mutex);
+
+	return ret;
+}
+
+int ride_history_lttb(const T_ride_history_point *input, int count, T_ride_history_point *output, int max_points)
+{
+	fail_if_null(input, -1, "input is null\n");
+	fail_if_negative(count, -2, "invalid count %d\n", count);
+	fail_if_null(output, -3, "output is null\n");
+	fail_if_negative_or_zero(max_points, -4, "invalid max_points %d\n", max_points);
+
+	/* count is 0 only when there is nothing to read */
+	T_view view = {.base = input, .first = 0, .size = count > 0 ? count : 1};
+
+	return _lttb(&view, count, output, max_points);
+}
@@ -0,0 +1,60 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_HISTORY_HEADER_
+#define _RIDE_HISTORY_HEADER_
+
+#include <stdint.h>
+#include "data_manager.h"
+
+/* Each tier keeps the newest RIDE_HISTORY_TIER_SIZE points of a channel,
+ * tier 0 at the sample period (10 minutes at 1 Hz) and each next tier at half
+ * the resolution of the previous one, downsampled with LTTB. The last tier
+ * halves itself when full so it always covers the whole ride.
+ */
+#define RIDE_HISTORY_NB_TIERS 8
+#define RIDE_HISTORY_TIER_SIZE 600
+
+typedef struct {
+	int32_t time; /* ms since the start of the ride */
+	int32_t value; /* fixed point, in the unit of the channel */
+} T_ride_history_point;
+
+int ride_history_init(void);
+
+/* Forget the points of the previous ride */
+int ride_history_reset(void);
+
+/* Add the recorded channels of a tick of the common timeline */
+int ride_history_push(const T_data_frame *frame);
+
+/* Channels kept in the history, as data_channel_bit mask */
+uint64_t ride_history_get_channel_mask(void);
+
+/* Get at most max_points points of the channel between start and end (ms since
+ * the start of the ride) from the finest tier covering that range, the cost is
+ * in O(max_points). Return the number of points written.
+ */
+int ride_history_get(E_data_channel channel, int32_t start, int32_t end, T_ride_history_point *points, int max_points);
+
+/* Downsample count points to max_points with the Largest Triangle Three Buckets
+ * algorithm, keeps the first and last points. Return the number of points written.
+ */
+int ride_history_lttb(const T_ride_history_point *input, int count, T_ride_history_point *output, int max_points);
+
+#endif //_RIDE_HISTORY_HEADER_
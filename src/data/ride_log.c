@@ -0,0 +1,850 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* O_DIRECT */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "log.h"
+#include "crc32.h"
+#include "data_manager.h"
+#include "ride_log.h"
+
+/* Header layout */
+#define HEADER_MAGIC 0
+#define HEADER_SEQUENCE 4
+#define HEADER_VERSION 8
+#define HEADER_TYPE 9
+#define HEADER_SIZE 10
+#define HEADER_CRC 12
+
+/* Checkpoint payload: part index, number of parts, then the state */
+#define CHECKPOINT_PART 0
+#define CHECKPOINT_NB_PARTS 1
+#define CHECKPOINT_DATA 2
+#define CHECKPOINT_PART_SIZE (RIDE_LOG_PAYLOAD_SIZE - CHECKPOINT_DATA)
+
+typedef enum {
+	E_BLOCK_FRAMES = 0,
+	E_BLOCK_CHECKPOINT,
+	E_BLOCK_TYPE_NUMBER, // must be last
+} E_block_type;
+
+#if RIDE_LOG_PAYLOAD_SIZE > COLUMN_CODEC_MAX_BLOCK_SIZE
+#error "the blocks are larger than the column codec can encode"
+#endif
+
+#if RIDE_LOG_MAX_CHECKPOINT_SIZE > (RIDE_LOG_BUFFER_BLOCKS - 2) * CHECKPOINT_PART_SIZE
+#error "a checkpoint does not fit in a buffer"
+#endif
+
+static void _put_le(uint8_t *buff, uint64_t value, int size)
+{
+	for(int i = 0; i < size; i++)
+	{
+		buff[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+static uint64_t _get_le(const uint8_t *buff, int size)
+{
+	uint64_t value = 0;
+
+	for(int i = 0; i < size; i++)
+	{
+		value |= (uint64_t)buff[i] << (8 * i);
+	}
+
+	return value;
+}
+
+static uint32_t _block_crc(const uint8_t *block, int size)
+{
+	uint8_t header[RIDE_LOG_HEADER_SIZE];
+
+	/* The CRC covers the header with a null CRC field */
+	memcpy(header, block, RIDE_LOG_HEADER_SIZE);
+	_put_le(&header[HEADER_CRC], 0, 4);
+
+	uint32_t crc = crc32_update(CRC32_INIT, header, RIDE_LOG_HEADER_SIZE);
+	crc = crc32_update(crc, &block[RIDE_LOG_HEADER_SIZE], size);
+
+	return crc32_final(crc);
+}
+
+static void _block_seal(uint8_t *block, uint32_t sequence, E_block_type type, int size)
+{
+	memcpy(&block[HEADER_MAGIC], RIDE_LOG_MAGIC, 4);
+	_put_le(&block[HEADER_SEQUENCE], sequence, 4);
+	block[HEADER_VERSION] = RIDE_LOG_VERSION;
+	block[HEADER_TYPE] = type;
+	_put_le(&block[HEADER_SIZE], size, 2);
+	_put_le(&block[HEADER_CRC], _block_crc(block, size), 4);
+}
+
+/* Return the size of the payload, negative if the block is not the expected valid one */
+static int _block_check(const uint8_t *block, uint32_t sequence)
+{
+	int size = (int)_get_le(&block[HEADER_SIZE], 2);
+
+	if(memcmp(&block[HEADER_MAGIC], RIDE_LOG_MAGIC, 4) != 0)
+	{
+		return -1;
+	}
+	if(block[HEADER_VERSION] != RIDE_LOG_VERSION || block[HEADER_TYPE] >= E_BLOCK_TYPE_NUMBER
+	|| _get_le(&block[HEADER_SEQUENCE], 4) != sequence)
+	{
+		return -2;
+	}
+	if(size > RIDE_LOG_PAYLOAD_SIZE || _get_le(&block[HEADER_CRC], 4) != _block_crc(block, size))
+	{
+		return -3;
+	}
+
+	return size;
+}
+
+static int _write_all(int fd, const uint8_t *buff, size_t size, off_t offset)
+{
+	while(size > 0)
+	{
+		ssize_t ret = pwrite(fd, buff, size, offset);
+		if(ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		fail_if_negative_or_zero(ret, -1, "pwrite failed, errno: %d\n", errno);
+
+		buff += ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/* Return the number of bytes read, less than size only at the end of the file */
+static ssize_t _read_all(int fd, uint8_t *buff, size_t size)
+{
+	size_t total = 0;
+
+	while(total < size)
+	{
+		ssize_t ret = read(fd, buff + total, size - total);
+		if(ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		fail_if_negative(ret, -1, "read failed, errno: %d\n", errno);
+
+		if(ret == 0)
+		{
+			break;
+		}
+		total += ret;
+	}
+
+	return total;
+}
+
+/* Read and check a block of the log, return the size of its payload, -1 when
+ * the block is not valid and -2 on read error
+ */
+static int _read_block(int fd, uint32_t sequence, uint8_t *block)
+{
+	if(lseek(fd, (off_t)sequence * RIDE_LOG_BLOCK_SIZE, SEEK_SET) < 0)
+	{
+		log_error("lseek failed, errno: %d\n", errno);
+		return -2;
+	}
+
+	ssize_t ret = _read_all(fd, block, RIDE_LOG_BLOCK_SIZE);
+	fail_if_negative(ret, -2, "_read_all failed, return: %zd\n", ret);
+
+	if(ret < RIDE_LOG_BLOCK_SIZE)
+	{
+		return -1;
+	}
+
+	int size = _block_check(block, sequence);
+
+	return (size < 0) ? -1 : size;
+}
+
+/* Encode the block being filled in the active buffer and seal it */
+static void _encode_block(T_ride_log_writer *writer)
+{
+	T_ride_log_buffer *buffer = &writer->buffer[writer->active];
+	uint8_t *block = &buffer->block[writer->nb_pending * RIDE_LOG_BLOCK_SIZE];
+	int size = column_codec_encoder_write(&writer->encoder, &block[RIDE_LOG_HEADER_SIZE]);
+
+	_block_seal(block, buffer->first_sequence + writer->nb_pending, E_BLOCK_FRAMES, size);
+}
+
+/* Close the block being filled and start the next one, 0 when the active
+ * buffer has no block left
+ */
+static int _next_block(T_ride_log_writer *writer)
+{
+	T_ride_log_buffer *buffer = &writer->buffer[writer->active];
+
+	if(writer->nb_pending == RIDE_LOG_BUFFER_BLOCKS - 1)
+	{
+		return 0;
+	}
+
+	_encode_block(writer);
+	writer->nb_pending++;
+	column_codec_encoder_reset(&writer->encoder, writer->clock_offset);
+
+	memset(&buffer->block[writer->nb_pending * RIDE_LOG_BLOCK_SIZE], 0, RIDE_LOG_BLOCK_SIZE);
+
+	return 1;
+}
+
+static void _free_buffers(T_ride_log_writer *writer)
+{
+	for(int i = 0; i < 2; i++)
+	{
+		free(writer->buffer[i].block);
+		writer->buffer[i].block = NULL;
+	}
+}
+
+static int _open(T_ride_log_writer *writer, const char *path, int flags, uint32_t first_sequence, int64_t clock_offset, int32_t flush_period,
+	int32_t write_size, bool is_direct)
+{
+	int ret = 0;
+
+	/* Aligned for O_DIRECT, whatever the mode */
+	for(int i = 0; i < 2; i++)
+	{
+		void *block = NULL;
+
+		ret = posix_memalign(&block, RIDE_LOG_DIRECT_ALIGNMENT, RIDE_LOG_BUFFER_BLOCKS * RIDE_LOG_BLOCK_SIZE);
+		if(ret != 0)
+		{
+			log_error("posix_memalign failed, return: %d\n", ret);
+			writer->buffer[i].block = NULL;
+			_free_buffers(writer);
+			return -4;
+		}
+		writer->buffer[i].block = block;
+		writer->buffer[i].first_sequence = first_sequence;
+		writer->buffer[i].count = 0;
+		writer->buffer[i].is_busy = false;
+	}
+
+	writer->is_direct = false;
+	writer->fd = -1;
+	if(is_direct)
+	{
+		writer->fd = open(path, flags | O_DIRECT, 0644);
+		if(writer->fd < 0)
+		{
+			log_warn("open %s with O_DIRECT failed, errno: %d, using the page cache\n", path, errno);
+		}
+		writer->is_direct = (writer->fd >= 0);
+	}
+	if(writer->fd < 0)
+	{
+		writer->fd = open(path, flags, 0644);
+	}
+	if(writer->fd < 0)
+	{
+		log_error("open %s failed, errno: %d\n", path, errno);
+		_free_buffers(writer);
+		return -5;
+	}
+
+	writer->clock_offset = clock_offset;
+	writer->flush_period = flush_period;
+	writer->unit_blocks = write_size / RIDE_LOG_BLOCK_SIZE;
+	writer->end = first_sequence;
+	writer->last_flush = INT64_MIN;
+	writer->last_timestamp = INT64_MIN;
+	writer->active = 0;
+	writer->nb_pending = 0;
+	writer->is_dirty = false;
+	writer->nb_dropped = 0;
+	column_codec_encoder_reset(&writer->encoder, clock_offset);
+	memset(writer->buffer[0].block, 0, RIDE_LOG_BLOCK_SIZE);
+
+	return 0;
+}
+
+int ride_log_writer_open(T_ride_log_writer *writer, const char *path, int64_t clock_offset, int32_t flush_period, int32_t write_size, bool is_direct)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(path, -2, "path is null\n");
+	fail_if_negative(flush_period, -3, "invalid flush period %d\n", flush_period);
+	fail_if_false((write_size > 0 && write_size % RIDE_LOG_BLOCK_SIZE == 0 && write_size <= RIDE_LOG_MAX_WRITE_SIZE), -4,
+		"invalid write size %d\n", write_size);
+
+	int ret = _open(writer, path, O_WRONLY | O_CREAT | O_TRUNC, 0, clock_offset, flush_period, write_size, is_direct);
+	fail_if_negative(ret, -5, "_open %s failed, return: %d\n", path, ret);
+
+	return 0;
+}
+
+int ride_log_writer_reopen(T_ride_log_writer *writer, const char *path, int nb_blocks, int64_t clock_offset, int32_t flush_period,
+	int32_t write_size, bool is_direct)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(path, -2, "path is null\n");
+	fail_if_negative(nb_blocks, -3, "invalid number of blocks %d\n", nb_blocks);
+	fail_if_negative(flush_period, -4, "invalid flush period %d\n", flush_period);
+	fail_if_false((write_size > 0 && write_size % RIDE_LOG_BLOCK_SIZE == 0 && write_size <= RIDE_LOG_MAX_WRITE_SIZE), -5,
+		"invalid write size %d\n", write_size);
+
+	/* The last block may be partial, it is never written again, the frames
+	 * go on in the next block
+	 */
+	int ret = _open(writer, path, O_WRONLY, nb_blocks, clock_offset, flush_period, write_size, is_direct);
+	fail_if_negative(ret, -6, "_open %s failed, return: %d\n", path, ret);
+
+	return 0;
+}
+
+int ride_log_writer_push(T_ride_log_writer *writer, const T_data_frame *frame)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(frame, -2, "frame is null\n");
+	fail_if_negative(writer->fd, -3, "writer is not opened\n");
+
+	/* Frames do not span blocks */
+	int ret = column_codec_encoder_add(&writer->encoder, frame, RIDE_LOG_PAYLOAD_SIZE);
+	fail_if_negative(ret, -4, "column_codec_encoder_add failed, return: %d\n", ret);
+
+	bool is_new_block = (ret == 0);
+	if(is_new_block)
+	{
+		if(_next_block(writer) == 0)
+		{
+			/* The other buffer is still being written, the frame is lost */
+			writer->nb_dropped++;
+			return 1;
+		}
+
+		ret = column_codec_encoder_add(&writer->encoder, frame, RIDE_LOG_PAYLOAD_SIZE);
+		fail_if_negative_or_zero(ret, -5, "column_codec_encoder_add failed, return: %d\n", ret);
+	}
+
+	writer->is_dirty = true;
+	writer->last_timestamp = frame->timestamp;
+
+	if(writer->last_flush == INT64_MIN)
+	{
+		writer->last_flush = frame->timestamp;
+	}
+
+	/* Hand the buffer before it is full, and as soon as a write unit is
+	 * complete so that it is appended in one write
+	 */
+	uint32_t filling = writer->buffer[writer->active].first_sequence + writer->nb_pending;
+	if(frame->timestamp - writer->last_flush >= writer->flush_period
+	|| writer->nb_pending == RIDE_LOG_BUFFER_BLOCKS - 1
+	|| (is_new_block && filling % writer->unit_blocks == 0))
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+int ride_log_writer_checkpoint(T_ride_log_writer *writer, const void *state, int size)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(state, -2, "state is null\n");
+	fail_if_negative(writer->fd, -3, "writer is not opened\n");
+	fail_if_negative_or_zero(size, -4, "invalid checkpoint size %d\n", size);
+	fail_if_superior(size, RIDE_LOG_MAX_CHECKPOINT_SIZE, -5, "checkpoint of %d bytes is too large\n", size);
+
+	T_ride_log_buffer *buffer = &writer->buffer[writer->active];
+	int nb_parts = (size + CHECKPOINT_PART_SIZE - 1) / CHECKPOINT_PART_SIZE;
+	int first = writer->nb_pending + (writer->encoder.nb_frames > 0 ? 1 : 0);
+
+	/* The parts and the next block being filled must fit in the buffer */
+	if(first + nb_parts > RIDE_LOG_BUFFER_BLOCKS - 1)
+	{
+		return 0;
+	}
+
+	if(writer->encoder.nb_frames > 0)
+	{
+		_encode_block(writer);
+	}
+
+	for(int part = 0; part < nb_parts; part++)
+	{
+		uint8_t *block = &buffer->block[(first + part) * RIDE_LOG_BLOCK_SIZE];
+		int offset = part * CHECKPOINT_PART_SIZE;
+		int length = (size - offset < CHECKPOINT_PART_SIZE) ? size - offset : CHECKPOINT_PART_SIZE;
+
+		memset(block, 0, RIDE_LOG_BLOCK_SIZE);
+		block[RIDE_LOG_HEADER_SIZE + CHECKPOINT_PART] = part;
+		block[RIDE_LOG_HEADER_SIZE + CHECKPOINT_NB_PARTS] = nb_parts;
+		memcpy(&block[RIDE_LOG_HEADER_SIZE + CHECKPOINT_DATA], (const uint8_t *)state + offset, length);
+		_block_seal(block, buffer->first_sequence + first + part, E_BLOCK_CHECKPOINT, CHECKPOINT_DATA + length);
+	}
+
+	writer->nb_pending = first + nb_parts;
+	column_codec_encoder_reset(&writer->encoder, writer->clock_offset);
+	memset(&buffer->block[writer->nb_pending * RIDE_LOG_BLOCK_SIZE], 0, RIDE_LOG_BLOCK_SIZE);
+	writer->is_dirty = true;
+
+	return 1;
+}
+
+int ride_log_writer_swap(T_ride_log_writer *writer, T_ride_log_buffer **buffer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(buffer, -2, "buffer is null\n");
+	fail_if_negative(writer->fd, -3, "writer is not opened\n");
+
+	T_ride_log_buffer *active = &writer->buffer[writer->active];
+	T_ride_log_buffer *next = &writer->buffer[1 - writer->active];
+
+	*buffer = NULL;
+	if(!writer->is_dirty || next->is_busy)
+	{
+		return 0;
+	}
+
+	int count = writer->nb_pending + (writer->encoder.nb_frames > 0 ? 1 : 0);
+	if(writer->encoder.nb_frames > 0)
+	{
+		_encode_block(writer);
+	}
+
+	/* Only the block being filled is written again, it goes on in the next
+	 * buffer. The complete blocks are written once, a torn write never
+	 * reaches the blocks synced before.
+	 */
+	next->first_sequence = active->first_sequence + writer->nb_pending;
+	memcpy(next->block, &active->block[writer->nb_pending * RIDE_LOG_BLOCK_SIZE], RIDE_LOG_BLOCK_SIZE);
+
+	uint32_t end = active->first_sequence + count;
+	active->count = count;
+	active->new_size = (end > writer->end) ? (int32_t)(end - writer->end) * RIDE_LOG_BLOCK_SIZE : 0;
+	active->is_busy = true;
+	if(end > writer->end)
+	{
+		writer->end = end;
+	}
+
+	writer->active = 1 - writer->active;
+	writer->nb_pending = 0;
+	writer->is_dirty = false;
+	writer->last_flush = writer->last_timestamp;
+
+	*buffer = active;
+
+	return 1;
+}
+
+int ride_log_writer_write(T_ride_log_writer *writer, const T_ride_log_buffer *buffer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(buffer, -2, "buffer is null\n");
+
+	int ret = _write_all(writer->fd, buffer->block, (size_t)buffer->count * RIDE_LOG_BLOCK_SIZE, (off_t)buffer->first_sequence * RIDE_LOG_BLOCK_SIZE);
+	fail_if_negative(ret, -3, "_write_all failed, return: %d\n", ret);
+
+	return buffer->count * RIDE_LOG_BLOCK_SIZE;
+}
+
+int ride_log_writer_sync(T_ride_log_writer *writer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+
+	int ret = fdatasync(writer->fd);
+	fail_if_negative(ret, -2, "fdatasync failed, errno: %d\n", errno);
+
+	return 0;
+}
+
+int ride_log_writer_release(T_ride_log_writer *writer, T_ride_log_buffer *buffer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_null(buffer, -2, "buffer is null\n");
+
+	buffer->is_busy = false;
+
+	return 0;
+}
+
+int ride_log_writer_flush(T_ride_log_writer *writer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_negative(writer->fd, -2, "writer is not opened\n");
+
+	int ret = 0;
+	T_ride_log_buffer *buffer = NULL;
+
+	ret = ride_log_writer_swap(writer, &buffer);
+	fail_if_negative(ret, -3, "ride_log_writer_swap failed, return: %d\n", ret);
+	if(buffer == NULL)
+	{
+		fail_if_true(writer->is_dirty, -4, "a buffer is still being written\n");
+		return 0;
+	}
+
+	ret = ride_log_writer_write(writer, buffer);
+	if(ret >= 0)
+	{
+		ret = ride_log_writer_sync(writer);
+	}
+	ride_log_writer_release(writer, buffer);
+	fail_if_negative(ret, -5, "writing the buffer failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int ride_log_writer_close(T_ride_log_writer *writer)
+{
+	fail_if_null(writer, -1, "writer is null\n");
+	fail_if_negative(writer->fd, -2, "writer is not opened\n");
+
+	int ret = ride_log_writer_flush(writer);
+	if(ret < 0)
+	{
+		log_error("ride_log_writer_flush failed, return: %d\n", ret);
+	}
+	else if(ftruncate(writer->fd, (off_t)writer->end * RIDE_LOG_BLOCK_SIZE) < 0)
+	{
+		log_error("ftruncate failed, errno: %d\n", errno);
+		ret = -4;
+	}
+
+	close(writer->fd);
+	writer->fd = -1;
+	_free_buffers(writer);
+
+	return (ret < 0) ? -3 : 0;
+}
+
+int ride_log_reader_open(T_ride_log_reader *reader, const char *path)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_null(path, -2, "path is null\n");
+
+	reader->fd = open(path, O_RDONLY);
+	fail_if_negative(reader->fd, -3, "open %s failed, errno: %d\n", path, errno);
+
+	reader->sequence = 0;
+	reader->nb_frames = 0;
+	reader->position = 0;
+	reader->clock_offset = 0;
+
+	return 0;
+}
+
+/* Return 1 when the next valid block was loaded, 0 at the end of the log */
+static int _load_block(T_ride_log_reader *reader)
+{
+	ssize_t ret = _read_all(reader->fd, reader->block, RIDE_LOG_BLOCK_SIZE);
+	fail_if_negative(ret, -1, "_read_all failed, return: %zd\n", ret);
+
+	if(ret == 0)
+	{
+		return 0;
+	}
+	if(ret < RIDE_LOG_BLOCK_SIZE)
+	{
+		log_warn("block %u is truncated, end of the log\n", reader->sequence);
+		return 0;
+	}
+
+	/* Checkpoints are only read by the recovery, they are decoded as empty blocks */
+	int nb_frames = ride_log_decode_block(reader->block, reader->sequence, reader->frames, &reader->clock_offset);
+	if(nb_frames < 0)
+	{
+		log_warn("block %u is invalid (%d), end of the log\n", reader->sequence, nb_frames);
+		return 0;
+	}
+
+	reader->nb_frames = nb_frames;
+	reader->position = 0;
+	reader->sequence++;
+
+	return 1;
+}
+
+int ride_log_reader_next(T_ride_log_reader *reader, T_data_frame *frame)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_null(frame, -2, "frame is null\n");
+	fail_if_negative(reader->fd, -3, "reader is not opened\n");
+
+	int ret = 0;
+
+	while(reader->position >= reader->nb_frames)
+	{
+		ret = _load_block(reader);
+		fail_if_negative(ret, -4, "_load_block failed, return: %d\n", ret);
+		if(ret == 0)
+		{
+			return 0;
+		}
+	}
+
+	*frame = reader->frames[reader->position++];
+
+	return 1;
+}
+
+int ride_log_reader_seek(T_ride_log_reader *reader, uint32_t sequence)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_negative(reader->fd, -2, "reader is not opened\n");
+
+	off_t ret = lseek(reader->fd, (off_t)sequence * RIDE_LOG_BLOCK_SIZE, SEEK_SET);
+	fail_if_negative(ret, -3, "lseek failed, errno: %d\n", errno);
+
+	reader->sequence = sequence;
+	reader->nb_frames = 0;
+	reader->position = 0;
+
+	return 0;
+}
+
+int ride_log_reader_close(T_ride_log_reader *reader)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_negative(reader->fd, -2, "reader is not opened\n");
+
+	close(reader->fd);
+	reader->fd = -1;
+
+	return 0;
+}
+
+int ride_log_decode_block(const uint8_t *block, uint32_t sequence, T_data_frame *frames, int64_t *clock_offset)
+{
+	fail_if_null(block, -1, "block is null\n");
+	fail_if_null(frames, -2, "frames is null\n");
+	fail_if_null(clock_offset, -3, "clock_offset is null\n");
+
+	int size = _block_check(block, sequence);
+	if(size < 0)
+	{
+		return -4;
+	}
+
+	if(block[HEADER_TYPE] == E_BLOCK_CHECKPOINT)
+	{
+		return 0;
+	}
+
+	/* Each block is decoded alone */
+	int nb_frames = column_codec_decode(&block[RIDE_LOG_HEADER_SIZE], size, frames, COLUMN_CODEC_MAX_FRAMES, clock_offset);
+	if(nb_frames < 0)
+	{
+		return -5;
+	}
+
+	return nb_frames;
+}
+
+int ride_log_peek_block(const uint8_t *block, uint32_t sequence, int64_t *first_time)
+{
+	fail_if_null(block, -1, "block is null\n");
+	fail_if_null(first_time, -2, "first_time is null\n");
+
+	int64_t clock_offset = 0;
+	int64_t timestamp = 0;
+	int size = (int)_get_le(&block[HEADER_SIZE], 2);
+
+	if(memcmp(&block[HEADER_MAGIC], RIDE_LOG_MAGIC, 4) != 0 || block[HEADER_VERSION] != RIDE_LOG_VERSION
+	|| block[HEADER_TYPE] >= E_BLOCK_TYPE_NUMBER || _get_le(&block[HEADER_SEQUENCE], 4) != sequence || size > RIDE_LOG_PAYLOAD_SIZE)
+	{
+		return -3;
+	}
+
+	if(block[HEADER_TYPE] == E_BLOCK_CHECKPOINT)
+	{
+		return 0;
+	}
+
+	int nb_frames = column_codec_peek(&block[RIDE_LOG_HEADER_SIZE], size, &clock_offset, &timestamp);
+	if(nb_frames <= 0)
+	{
+		return -4;
+	}
+
+	*first_time = timestamp + clock_offset;
+
+	return 1;
+}
+
+/* Return the number of valid blocks from first, the log ends at the first invalid one */
+static int _count_valid_blocks(int fd, int first, int nb_blocks)
+{
+	uint8_t block[RIDE_LOG_BLOCK_SIZE];
+
+	for(int i = first; i < nb_blocks; i++)
+	{
+		int ret = _read_block(fd, i, block);
+		fail_if_inferior(ret, -1, -1, "_read_block failed, return: %d\n", ret);
+
+		if(ret < 0)
+		{
+			return i;
+		}
+	}
+
+	return nb_blocks;
+}
+
+/* Search the last complete checkpoint backward from the end of the log, return 1 when found */
+static int _load_checkpoint(int fd, int nb_blocks, T_ride_log_recovery *recovery)
+{
+	int size = 0;
+	uint8_t block[RIDE_LOG_BLOCK_SIZE];
+	const uint8_t *payload = &block[RIDE_LOG_HEADER_SIZE];
+	int first = (nb_blocks > RIDE_LOG_CHECKPOINT_SEARCH_BLOCKS) ? nb_blocks - RIDE_LOG_CHECKPOINT_SEARCH_BLOCKS : 0;
+
+	for(int last = nb_blocks - 1; last >= first; last--)
+	{
+		size = _read_block(fd, last, block);
+		fail_if_inferior(size, -1, -1, "_read_block failed, return: %d\n", size);
+
+		if(size < CHECKPOINT_DATA || block[HEADER_TYPE] != E_BLOCK_CHECKPOINT
+		|| payload[CHECKPOINT_PART] + 1 != payload[CHECKPOINT_NB_PARTS])
+		{
+			continue;
+		}
+
+		/* Gather the parts from the first one */
+		int nb_parts = payload[CHECKPOINT_NB_PARTS];
+		int part = 0;
+		int total = 0;
+
+		for(part = 0; part < nb_parts && last - nb_parts + 1 >= 0; part++)
+		{
+			size = _read_block(fd, last - nb_parts + 1 + part, block);
+			fail_if_inferior(size, -1, -1, "_read_block failed, return: %d\n", size);
+
+			if(size < CHECKPOINT_DATA || block[HEADER_TYPE] != E_BLOCK_CHECKPOINT || payload[CHECKPOINT_PART] != part
+			|| payload[CHECKPOINT_NB_PARTS] != nb_parts || total + size - CHECKPOINT_DATA > RIDE_LOG_MAX_CHECKPOINT_SIZE)
+			{
+				break;
+			}
+
+			memcpy(&recovery->checkpoint[total], &payload[CHECKPOINT_DATA], size - CHECKPOINT_DATA);
+			total += size - CHECKPOINT_DATA;
+		}
+
+		if(part == nb_parts)
+		{
+			recovery->has_checkpoint = true;
+			recovery->sequence = last + 1;
+			recovery->checkpoint_size = total;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int ride_log_recover(const char *path, T_ride_log_recovery *recovery)
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(recovery, -2, "recovery is null\n");
+
+	int ret = 0;
+	int nb_blocks = 0;
+
+	int fd = open(path, O_RDWR);
+	fail_if_negative(fd, -3, "open %s failed, errno: %d\n", path, errno);
+
+	off_t file_size = lseek(fd, 0, SEEK_END);
+	if(file_size < 0)
+	{
+		log_error("lseek failed, errno: %d\n", errno);
+		ret = -4;
+		goto recover_cleanup;
+	}
+
+	/* Only the blocks of the last two buffers can be torn, the older ones
+	 * were synced before them
+	 */
+	int total = (int)(file_size / RIDE_LOG_BLOCK_SIZE);
+	int first = (total > RIDE_LOG_RECOVERY_BLOCKS) ? total - RIDE_LOG_RECOVERY_BLOCKS : 0;
+
+	nb_blocks = _count_valid_blocks(fd, first, total);
+
+	/* The tail is invalid, step back until a valid block starts the window */
+	while(nb_blocks == first && first > 0)
+	{
+		if(total - first >= RIDE_LOG_RECOVERY_MAX_BLOCKS)
+		{
+			log_error("%s: no valid block in the last %d blocks, the log is not recoverable\n", path, total - first);
+			ret = -5;
+			goto recover_cleanup;
+		}
+
+		int end = first;
+		first = (end > RIDE_LOG_RECOVERY_BLOCKS) ? end - RIDE_LOG_RECOVERY_BLOCKS : 0;
+		log_warn("%s: blocks %d to %d are invalid, reading back from block %d\n", path, end, total - 1, first);
+		nb_blocks = _count_valid_blocks(fd, first, end);
+	}
+	if(nb_blocks < 0)
+	{
+		log_error("_count_valid_blocks failed, return: %d\n", nb_blocks);
+		ret = -6;
+		goto recover_cleanup;
+	}
+
+	/* Everything after the first invalid block is dropped */
+	if(file_size > (off_t)nb_blocks * RIDE_LOG_BLOCK_SIZE)
+	{
+		log_warn("%s: dropping %lld bytes after block %d\n", path, (long long)(file_size - (off_t)nb_blocks * RIDE_LOG_BLOCK_SIZE), nb_blocks);
+
+		if(ftruncate(fd, (off_t)nb_blocks * RIDE_LOG_BLOCK_SIZE) < 0 || fsync(fd) < 0)
+		{
+			log_error("truncating %s failed, errno: %d\n", path, errno);
+			ret = -7;
+			goto recover_cleanup;
+		}
+	}
+
+	recovery->nb_blocks = nb_blocks;
+	recovery->has_checkpoint = false;
+	recovery->sequence = 0;
+	recovery->checkpoint_size = 0;
+
+	ret = _load_checkpoint(fd, nb_blocks, recovery);
+	if(ret < 0)
+	{
+		log_error("_load_checkpoint failed, return: %d\n", ret);
+		ret = -8;
+		goto recover_cleanup;
+	}
+
+	ret = nb_blocks;
+
+recover_cleanup:
+	close(fd);
+
+	return ret;
+}
@@ -0,0 +1,184 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_LOG_HEADER_
+#define _RIDE_LOG_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "data_manager.h"
+#include "column_codec.h"
+
+/* Append-only binary log of the frames of a ride.
+ *
+ * The file is a sequence of fixed size blocks, each block starts with a header
+ * holding its sequence number and the CRC32 of the block, followed by the
+ * frames of the block encoded column-wise by column_codec, with the offset in
+ * ms from the timestamps to the UTC time since the epoch. Header integers are
+ * little endian. A frame never spans two blocks, each block can be decoded
+ * alone.
+ *
+ * Checkpoint blocks are inserted between the frame blocks, they hold the
+ * state of the ride given by the caller, split over consecutive blocks when
+ * it does not fit in one. After a power cut the ride is rebuilt from the last
+ * checkpoint and the few frames after it, the recovery reads a bounded number
+ * of blocks whatever the length of the ride.
+ *
+ * Frames are encoded in one of two buffers while the other one is written, a
+ * buffer is handed for writing every flush period, when a write unit of
+ * complete blocks, the flash page, can be appended, or before it is full.
+ * Each write starts at the block being filled by the previous one, the
+ * complete blocks are written once and only this partial block is ever
+ * written again. Writes are block aligned, a 512 bytes block is assumed to
+ * be written atomically by the device, a torn write loses at most the
+ * partial block and the frames not flushed yet, never the blocks synced
+ * before.
+ *
+ * The writer is not thread safe: push, swap and release must be serialized by
+ * the caller, write and sync only use the handed buffer and can run in
+ * another thread.
+ */
+
+#define RIDE_LOG_BLOCK_SIZE 512
+#define RIDE_LOG_HEADER_SIZE 16
+#define RIDE_LOG_PAYLOAD_SIZE (RIDE_LOG_BLOCK_SIZE - RIDE_LOG_HEADER_SIZE)
+#define RIDE_LOG_MAGIC "OBCL"
+#define RIDE_LOG_VERSION 3
+#define RIDE_LOG_BUFFER_BLOCKS 32 /* blocks of each of the two buffers */
+#define RIDE_LOG_DIRECT_ALIGNMENT 4096 /* alignment of the buffers for O_DIRECT */
+#define RIDE_LOG_MAX_WRITE_SIZE (RIDE_LOG_BUFFER_BLOCKS / 2 * RIDE_LOG_BLOCK_SIZE)
+#define RIDE_LOG_MAX_CHECKPOINT_SIZE 4096
+#define RIDE_LOG_RECOVERY_BLOCKS (2 * RIDE_LOG_BUFFER_BLOCKS) /* tail validated by the recovery, both buffers can be torn */
+#define RIDE_LOG_CHECKPOINT_SEARCH_BLOCKS 256 /* blocks searched backward for the last checkpoint */
+#define RIDE_LOG_RECOVERY_MAX_BLOCKS 1024 /* blocks read back from the tail before the log is not recoverable */
+
+typedef struct {
+	uint8_t *block; /* RIDE_LOG_BUFFER_BLOCKS blocks */
+	uint32_t first_sequence; /* sequence of the first block */
+	int count; /* blocks to write, up to the block being filled */
+	int32_t new_size; /* bytes the log grows by with this write */
+	bool is_busy; /* handed for writing and not released yet */
+} T_ride_log_buffer;
+
+typedef struct {
+	int fd;
+	bool is_direct; /* opened with O_DIRECT */
+	int64_t clock_offset; /* ms, UTC time minus the frame timestamps */
+	int32_t flush_period; /* ms */
+	int unit_blocks; /* blocks of the write unit, handed as soon as complete */
+	uint32_t end; /* blocks handed for writing */
+	int64_t last_flush; /* ms, timestamp of the last frame of the last handed buffer */
+	int64_t last_timestamp; /* ms, last frame */
+	T_ride_log_buffer buffer[2];
+	int active; /* buffer being filled */
+	int nb_pending; /* complete blocks before the block being filled */
+	bool is_dirty; /* frames added since the last handed buffer */
+	T_column_encoder encoder; /* block being filled */
+	int32_t nb_dropped; /* frames lost, both buffers were full */
+} T_ride_log_writer;
+
+typedef struct {
+	int fd;
+	uint32_t sequence; /* expected sequence of the next block */
+	int nb_frames; /* frames of the block */
+	int position; /* next frame of the block */
+	int64_t clock_offset; /* ms, UTC time minus the frame timestamps */
+	T_data_frame frames[COLUMN_CODEC_MAX_FRAMES]; /* the whole block is decoded at once */
+	uint8_t block[RIDE_LOG_BLOCK_SIZE];
+} T_ride_log_reader;
+
+typedef struct {
+	int nb_blocks; /* valid blocks kept */
+	bool has_checkpoint;
+	uint32_t sequence; /* first block after the last checkpoint, 0 without checkpoint */
+	int checkpoint_size;
+	uint8_t checkpoint[RIDE_LOG_MAX_CHECKPOINT_SIZE];
+} T_ride_log_recovery;
+
+/* Create the log, an existing file is replaced, clock_offset gives the UTC
+ * time of the frames, the data manager time being monotonic. write_size is
+ * the write unit, a multiple of the block size up to RIDE_LOG_MAX_WRITE_SIZE.
+ * With is_direct the file bypasses the page cache, the page cache is used
+ * when the file system does not support O_DIRECT.
+ */
+int ride_log_writer_open(T_ride_log_writer *writer, const char *path, int64_t clock_offset, int32_t flush_period, int32_t write_size, bool is_direct);
+
+/* Go on with a recovered log, the frames are added after its nb_blocks valid blocks */
+int ride_log_writer_reopen(T_ride_log_writer *writer, const char *path, int nb_blocks, int64_t clock_offset, int32_t flush_period,
+	int32_t write_size, bool is_direct);
+
+/* Encode a frame in the active buffer, never write. Return 1 when the active
+ * buffer is due for writing, the flush period elapsed or it is nearly full.
+ */
+int ride_log_writer_push(T_ride_log_writer *writer, const T_data_frame *frame);
+
+/* Close the block being filled and add a checkpoint after it, the frames
+ * pushed afterwards are the ones replayed from this checkpoint. Return 1 when
+ * the checkpoint was added, the active buffer is then due for writing, 0 when
+ * the active buffer has no room left for it.
+ */
+int ride_log_writer_checkpoint(T_ride_log_writer *writer, const void *state, int size);
+
+/* Hand the active buffer for writing and go on in the other one, return 0 and
+ * a null buffer when there is nothing to write or the other buffer is busy
+ */
+int ride_log_writer_swap(T_ride_log_writer *writer, T_ride_log_buffer **buffer);
+
+/* Write a handed buffer, return the number of bytes written */
+int ride_log_writer_write(T_ride_log_writer *writer, const T_ride_log_buffer *buffer);
+int ride_log_writer_sync(T_ride_log_writer *writer);
+
+/* Give a written buffer back to the writer */
+int ride_log_writer_release(T_ride_log_writer *writer, T_ride_log_buffer *buffer);
+
+/* Swap, write and sync in the calling thread */
+int ride_log_writer_flush(T_ride_log_writer *writer);
+
+/* Flush and cut the file after the last block */
+int ride_log_writer_close(T_ride_log_writer *writer);
+
+int ride_log_reader_open(T_ride_log_reader *reader, const char *path);
+
+/* Read the next frame, return 1 when a frame was read, 0 at the end of the log,
+ * reader->clock_offset is valid once a frame was read
+ */
+int ride_log_reader_next(T_ride_log_reader *reader, T_data_frame *frame);
+
+/* Go to the first frame of the block, the checkpoint blocks are skipped */
+int ride_log_reader_seek(T_ride_log_reader *reader, uint32_t sequence);
+int ride_log_reader_close(T_ride_log_reader *reader);
+
+/* Decode a block of a log mapped in memory, return the number of frames, 0
+ * for a checkpoint block, negative when the block is not the valid block of
+ * this sequence
+ */
+int ride_log_decode_block(const uint8_t *block, uint32_t sequence, T_data_frame *frames, int64_t *clock_offset);
+
+/* Check the header of a block without its CRC and give the UTC time of its
+ * first frame, return 1 for a frame block, 0 for a checkpoint block, negative
+ * when the block is not the one of this sequence
+ */
+int ride_log_peek_block(const uint8_t *block, uint32_t sequence, int64_t *first_time);
+
+/* Truncate the log after the last valid block and load its last checkpoint,
+ * only the tail of the log is read. Return the number of valid blocks, fail
+ * when no valid block is found within RIDE_LOG_RECOVERY_MAX_BLOCKS of the end.
+ */
+int ride_log_recover(const char *path, T_ride_log_recovery *recovery);
+
+#endif //_RIDE_LOG_HEADER_
@@ -0,0 +1,363 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "crc32.h"
+#include "ride_log.h"
+#include "ride_reader.h"
+
+#define INDEX_MAGIC "OBCX"
+#define INDEX_VERSION 2
+
+/* Header of the index file, followed by the entries */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t log_size; /* bytes of the indexed log */
+	int64_t log_mtime; /* ns, modification time of the indexed log */
+	int64_t start_time;
+	uint32_t stride;
+	uint32_t nb_blocks;
+	uint32_t nb_entries;
+	uint32_t crc; /* CRC32 of the entries */
+} T_index_file_header;
+
+/* The log of a ride being recorded is rewritten in place up to its size, the
+ * index is only valid for the log as it was when the index was built
+ */
+static int _load_index(T_ride_reader *reader, const char *path, int64_t log_mtime)
+{
+	int ret = 0;
+	int64_t time = 0;
+	T_index_file_header header;
+
+	FILE *file = fopen(path, "rb");
+	if(file == NULL)
+	{
+		/* Not built yet */
+		return -1;
+	}
+
+	if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0
+	|| header.version != INDEX_VERSION || header.log_size != reader->size || header.log_mtime != log_mtime
+	|| header.stride != RIDE_READER_INDEX_STRIDE || header.nb_blocks > reader->size / RIDE_LOG_BLOCK_SIZE
+	|| header.nb_entries > header.nb_blocks)
+	{
+		ret = -2;
+		goto load_cleanup;
+	}
+
+	reader->index = malloc((header.nb_entries + 1) * sizeof(T_ride_reader_index_entry));
+	if(reader->index == NULL)
+	{
+		log_error("malloc index failed\n");
+		ret = -3;
+		goto load_cleanup;
+	}
+
+	if(fread(reader->index, sizeof(T_ride_reader_index_entry), header.nb_entries, file) != header.nb_entries
+	|| crc32_compute(reader->index, header.nb_entries * sizeof(T_ride_reader_index_entry)) != header.crc)
+	{
+		free(reader->index);
+		reader->index = NULL;
+		ret = -4;
+		goto load_cleanup;
+	}
+
+	/* Same time within the resolution of the file system, the log still ends at the same block */
+	if(header.nb_blocks < reader->size / RIDE_LOG_BLOCK_SIZE
+	&& ride_log_peek_block(&reader->map[(size_t)header.nb_blocks * RIDE_LOG_BLOCK_SIZE], header.nb_blocks, &time) >= 0)
+	{
+		free(reader->index);
+		reader->index = NULL;
+		ret = -5;
+		goto load_cleanup;
+	}
+
+	reader->nb_blocks = header.nb_blocks;
+	reader->nb_entries = header.nb_entries;
+	reader->start_time = header.start_time;
+
+load_cleanup:
+	fclose(file);
+
+	return ret;
+}
+
+static int _save_index(const T_ride_reader *reader, const char *path, int64_t log_mtime)
+{
+	int ret = 0;
+	T_index_file_header header = {.magic = INDEX_MAGIC, .version = INDEX_VERSION, .log_size = reader->size, .log_mtime = log_mtime,
+		.start_time = reader->start_time, .stride = RIDE_READER_INDEX_STRIDE, .nb_blocks = reader->nb_blocks,
+		.nb_entries = reader->nb_entries, .crc = crc32_compute(reader->index, reader->nb_entries * sizeof(T_ride_reader_index_entry))};
+
+	FILE *file = fopen(path, "wb");
+	fail_if_null(file, -1, "fopen %s failed\n", path);
+
+	if(fwrite(&header, sizeof(header), 1, file) != 1
+	|| fwrite(reader->index, sizeof(T_ride_reader_index_entry), reader->nb_entries, file) != (size_t)reader->nb_entries)
+	{
+		log_error("writing %s failed\n", path);
+		ret = -2;
+	}
+
+	if(fclose(file) != 0)
+	{
+		log_error("fclose %s failed\n", path);
+		ret = -3;
+	}
+
+	return ret;
+}
+
+/* Read the headers of all the blocks, the log ends at the first one that is not the expected block */
+static int _build_index(T_ride_reader *reader)
+{
+	int total = (int)(reader->size / RIDE_LOG_BLOCK_SIZE);
+	int64_t time = 0;
+
+	reader->index = malloc((total / RIDE_READER_INDEX_STRIDE + 1) * sizeof(T_ride_reader_index_entry));
+	fail_if_null(reader->index, -1, "malloc index failed\n");
+
+	reader->nb_blocks = 0;
+	reader->nb_entries = 0;
+	for(int i = 0; i < total; i++)
+	{
+		int ret = ride_log_peek_block(&reader->map[(size_t)i * RIDE_LOG_BLOCK_SIZE], i, &time);
+		if(ret < 0)
+		{
+			break;
+		}
+
+		/* The entries point to frame blocks */
+		if(ret == 1 && (reader->nb_entries == 0 || i >= (int)reader->index[reader->nb_entries - 1].block + RIDE_READER_INDEX_STRIDE))
+		{
+			reader->index[reader->nb_entries].time = time;
+			reader->index[reader->nb_entries].block = i;
+			reader->nb_entries++;
+		}
+		reader->nb_blocks = i + 1;
+	}
+
+	reader->start_time = (reader->nb_entries > 0) ? reader->index[0].time : 0;
+
+	return 0;
+}
+
+int ride_reader_open(T_ride_reader *reader, const char *log_path, const char *index_path)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_null(log_path, -2, "log_path is null\n");
+
+	int ret = 0;
+	struct stat st;
+
+	reader->map = NULL;
+	reader->size = 0;
+	reader->nb_blocks = 0;
+	reader->start_time = 0;
+	reader->nb_entries = 0;
+	reader->index = NULL;
+
+	int fd = open(log_path, O_RDONLY);
+	fail_if_negative(fd, -3, "open %s failed, errno: %d\n", log_path, errno);
+
+	if(fstat(fd, &st) < 0)
+	{
+		log_error("fstat %s failed, errno: %d\n", log_path, errno);
+		close(fd);
+		return -4;
+	}
+
+	/* An empty log has no block to map */
+	if(st.st_size >= RIDE_LOG_BLOCK_SIZE)
+	{
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			log_error("mmap %s failed, errno: %d\n", log_path, errno);
+			close(fd);
+			return -5;
+		}
+		reader->map = map;
+		reader->size = st.st_size;
+	}
+
+	/* The log is only read through the mapping */
+	close(fd);
+	int64_t log_mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+	if(index_path != NULL && _load_index(reader, index_path, log_mtime) == 0)
+	{
+		return 0;
+	}
+
+	ret = _build_index(reader);
+	if(ret < 0)
+	{
+		log_error("_build_index failed, return: %d\n", ret);
+		ride_reader_close(reader);
+		return -6;
+	}
+
+	if(index_path != NULL && _save_index(reader, index_path, log_mtime) < 0)
+	{
+		log_warn("the index of %s is not saved\n", log_path);
+	}
+
+	return 0;
+}
+
+int ride_reader_close(T_ride_reader *reader)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+
+	if(reader->map != NULL)
+	{
+		munmap((void *)reader->map, reader->size);
+	}
+	free(reader->index);
+
+	reader->map = NULL;
+	reader->size = 0;
+	reader->nb_blocks = 0;
+	reader->nb_entries = 0;
+	reader->index = NULL;
+
+	return 0;
+}
+
+int ride_reader_iterate(const T_ride_reader *reader, int64_t start, int64_t end, T_ride_reader_iterator *iterator)
+{
+	fail_if_null(reader, -1, "reader is null\n");
+	fail_if_null(iterator, -2, "iterator is null\n");
+	fail_if_negative(start, -3, "invalid start %lld\n", (long long)start);
+	fail_if_inferior(end, start, -4, "end %lld is before start %lld\n", (long long)end, (long long)start);
+
+	int64_t time = 0;
+
+	iterator->reader = reader;
+	iterator->start = reader->start_time + start;
+	iterator->end = (end > INT64_MAX - reader->start_time) ? INT64_MAX : reader->start_time + end;
+	iterator->nb_frames = 0;
+	iterator->position = 0;
+	iterator->clock_offset = 0;
+	iterator->block = reader->nb_blocks;
+
+	if(reader->nb_entries == 0)
+	{
+		return 0;
+	}
+
+	/* Last entry starting before the range */
+	int low = 0;
+	int high = reader->nb_entries - 1;
+	while(low < high)
+	{
+		int middle = (low + high + 1) / 2;
+
+		if(reader->index[middle].time <= iterator->start)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	/* Then the last block starting before the range, at most a stride of headers */
+	uint32_t block = reader->index[low].block;
+	for(uint32_t i = block + 1; i < (uint32_t)reader->nb_blocks; i++)
+	{
+		int ret = ride_log_peek_block(&reader->map[(size_t)i * RIDE_LOG_BLOCK_SIZE], i, &time);
+		if(ret < 0 || (ret == 1 && time > iterator->start))
+		{
+			break;
+		}
+		if(ret == 1)
+		{
+			block = i;
+		}
+	}
+
+	iterator->block = block;
+
+	return 0;
+}
+
+int ride_reader_next(T_ride_reader_iterator *iterator, T_data_frame *frame)
+{
+	fail_if_null(iterator, -1, "iterator is null\n");
+	fail_if_null(frame, -2, "frame is null\n");
+
+	const T_ride_reader *reader = iterator->reader;
+
+	while(1)
+	{
+		if(iterator->position >= iterator->nb_frames)
+		{
+			if(iterator->block >= (uint32_t)reader->nb_blocks)
+			{
+				return 0;
+			}
+
+			/* Only the blocks of the range are decoded, with their CRC */
+			int nb_frames = ride_log_decode_block(&reader->map[(size_t)iterator->block * RIDE_LOG_BLOCK_SIZE], iterator->block,
+				iterator->frames, &iterator->clock_offset);
+			if(nb_frames < 0)
+			{
+				log_warn("block %u is invalid (%d), end of the log\n", iterator->block, nb_frames);
+				iterator->block = reader->nb_blocks;
+				return 0;
+			}
+
+			iterator->nb_frames = nb_frames;
+			iterator->position = 0;
+			iterator->block++;
+			continue;
+		}
+
+		const T_data_frame *next = &iterator->frames[iterator->position++];
+		int64_t time = next->timestamp + iterator->clock_offset;
+
+		if(time < iterator->start)
+		{
+			continue;
+		}
+		if(time >= iterator->end)
+		{
+			iterator->nb_frames = 0;
+			iterator->block = reader->nb_blocks;
+			return 0;
+		}
+
+		*frame = *next;
+
+		return 1;
+	}
+}
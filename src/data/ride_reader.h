@@ -0,0 +1,87 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_READER_HEADER_
+#define _RIDE_READER_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "data_manager.h"
+#include "column_codec.h"
+
+/* Random access to a recorded ride.
+ *
+ * The ride log is mapped in memory and a sparse index gives the time of the
+ * first frame of one block every RIDE_READER_INDEX_STRIDE blocks. A seek is a
+ * binary search in the index followed by at most a stride of block headers,
+ * an iteration only decodes the blocks of its time range. The index is built
+ * from the block headers, without their CRC, and saved next to the log so the
+ * next opening reads it at once.
+ *
+ * Times are in ms since the first frame of the ride, on the UTC clock: the
+ * frames of a resumed ride are on another monotonic clock than the first ones.
+ */
+
+#define RIDE_READER_INDEX_EXTENSION ".index"
+#define RIDE_READER_INDEX_STRIDE 16 /* blocks between two entries of the index */
+#define RIDE_READER_END INT64_MAX /* end of a range up to the last frame */
+
+typedef struct {
+	int64_t time; /* ms, UTC time of the first frame of the block */
+	uint32_t block;
+} T_ride_reader_index_entry;
+
+typedef struct {
+	const uint8_t *map;
+	size_t size;
+	int nb_blocks; /* blocks before the end of the log */
+	int64_t start_time; /* ms, UTC time of the first frame */
+	int nb_entries;
+	T_ride_reader_index_entry *index;
+} T_ride_reader;
+
+typedef struct {
+	const T_ride_reader *reader;
+	uint32_t block; /* next block to decode */
+	int64_t start; /* ms, UTC time of the range */
+	int64_t end;
+	int nb_frames; /* frames of the decoded block */
+	int position; /* next frame of the decoded block */
+	int64_t clock_offset; /* ms, UTC time minus the frame timestamps of the decoded block */
+	T_data_frame frames[COLUMN_CODEC_MAX_FRAMES];
+} T_ride_reader_iterator;
+
+/* Map the log and load its index from index_path, the index is built and
+ * saved there when it is missing or was built from another size or
+ * modification time of the log, or when the log now goes on after its last
+ * indexed block. index_path can be null, the index is then built and not saved.
+ */
+int ride_reader_open(T_ride_reader *reader, const char *log_path, const char *index_path);
+int ride_reader_close(T_ride_reader *reader);
+
+/* Iterate over the frames from start included to end excluded, in ms since
+ * the start of the ride
+ */
+int ride_reader_iterate(const T_ride_reader *reader, int64_t start, int64_t end, T_ride_reader_iterator *iterator);
+
+/* Read the next frame of the range, return 1 when a frame was read, 0 at the
+ * end of the range, iterator->clock_offset gives the UTC time of the frame
+ */
+int ride_reader_next(T_ride_reader_iterator *iterator, T_data_frame *frame);
+
+#endif //_RIDE_READER_HEADER_
@@ -0,0 +1,416 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "log.h"
+#include "system_config.h"
+#include "data_manager.h"
+#include "ride_log.h"
+#include "crc32.h"
+#include "ride_summary.h"
+
+#define RIDE_SUMMARY_MAGIC "OBCS"
+#define RIDE_SUMMARY_VERSION 2
+
+/* Header of the sidecar, followed by the summary */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t size; /* bytes of the summary */
+	uint32_t crc; /* CRC32 of the summary */
+} T_summary_file_header;
+
+/* Cumulated energy at a frame, the average power over a window is the energy difference over the time difference */
+typedef struct {
+	int64_t time; /* ms since the start of the ride */
+	int64_t energy; /* W.ms */
+} T_energy_point;
+
+/* Chart decimated on the fly, the frames are averaged over buckets of
+ * bucket_size frames, when the buffer is full the points are averaged by
+ * pairs and the buckets doubled. Between RIDE_SUMMARY_CHART_POINTS and twice
+ * as many points are left at the end, whatever the length of the ride.
+ */
+typedef struct {
+	int nb_points;
+	int bucket_size;
+	int nb_bucket; /* frames in the bucket being filled */
+	int64_t time_sum;
+	int64_t value_sum;
+	T_ride_history_point point[2 * RIDE_SUMMARY_CHART_POINTS];
+} T_chart_builder;
+
+/* Last values of the cumulative channels */
+typedef struct {
+	int32_t elapsed; /* ms */
+	int32_t moving; /* ms */
+	int32_t distance; /* cm */
+	int32_t gain; /* cm */
+} T_summary_totals;
+
+typedef struct {
+	T_energy_point *energy; /* ring of the last frames, covers RIDE_SUMMARY_MAX_DURATION */
+	int capacity;
+	int64_t count; /* frames pushed in the ring */
+	int64_t window[RIDE_SUMMARY_NB_DURATIONS]; /* frame starting the window of each duration */
+	int32_t max_gap; /* ms, longest time a power value is held */
+	T_chart_builder chart[E_RIDE_SUMMARY_CHART_NUMBER];
+	T_summary_totals totals;
+	T_summary_totals lap_start;
+	int64_t heart_rate_sum;
+	int32_t nb_heart_rate;
+	int64_t power_sum;
+	int32_t nb_power;
+	int32_t max_power;
+} T_summary_builder;
+
+static const int32_t ride_summary_durations[RIDE_SUMMARY_NB_DURATIONS] = {1, 5, 10, 30, 60, 120, 300, 600, 1200, 1800, 3600, 7200};
+
+static const E_data_channel chart_channels[E_RIDE_SUMMARY_CHART_NUMBER] = {
+	[E_RIDE_SUMMARY_CHART_SPEED]      = E_DATA_SPEED,
+	[E_RIDE_SUMMARY_CHART_ALTITUDE]   = E_DATA_ALTITUDE,
+	[E_RIDE_SUMMARY_CHART_HEART_RATE] = E_DATA_HEART_RATE,
+	[E_RIDE_SUMMARY_CHART_POWER]      = E_DATA_POWER,
+};
+
+static void _chart_push(T_chart_builder *chart, int32_t time, int32_t value)
+{
+	chart->time_sum += time;
+	chart->value_sum += value;
+	chart->nb_bucket++;
+	if(chart->nb_bucket < chart->bucket_size)
+	{
+		return;
+	}
+
+	T_ride_history_point *point = &chart->point[chart->nb_points++];
+	point->time = (int32_t)(chart->time_sum / chart->nb_bucket);
+	point->value = (int32_t)(chart->value_sum / chart->nb_bucket);
+	chart->time_sum = 0;
+	chart->value_sum = 0;
+	chart->nb_bucket = 0;
+
+	if(chart->nb_points == 2 * RIDE_SUMMARY_CHART_POINTS)
+	{
+		for(int i = 0; i < RIDE_SUMMARY_CHART_POINTS; i++)
+		{
+			chart->point[i].time = (int32_t)(((int64_t)chart->point[2 * i].time + chart->point[2 * i + 1].time) / 2);
+			chart->point[i].value = (int32_t)(((int64_t)chart->point[2 * i].value + chart->point[2 * i + 1].value) / 2);
+		}
+		chart->nb_points = RIDE_SUMMARY_CHART_POINTS;
+		chart->bucket_size *= 2;
+	}
+}
+
+/* Close the last bucket and keep the most significant points */
+static int _chart_finish(T_chart_builder *chart, T_ride_history_point *output)
+{
+	if(chart->nb_bucket > 0)
+	{
+		T_ride_history_point *point = &chart->point[chart->nb_points++];
+		point->time = (int32_t)(chart->time_sum / chart->nb_bucket);
+		point->value = (int32_t)(chart->value_sum / chart->nb_bucket);
+		chart->nb_bucket = 0;
+	}
+
+	if(chart->nb_points <= RIDE_SUMMARY_CHART_POINTS)
+	{
+		memcpy(output, chart->point, chart->nb_points * sizeof(T_ride_history_point));
+		return chart->nb_points;
+	}
+
+	return ride_history_lttb(chart->point, chart->nb_points, output, RIDE_SUMMARY_CHART_POINTS);
+}
+
+/* Best average power of each duration over the windows ending at this frame */
+static void _update_mean_max(T_summary_builder *builder, T_ride_summary *summary, int32_t time, int32_t power)
+{
+	T_energy_point *newest = &builder->energy[builder->count % builder->capacity];
+	T_energy_point *previous = &builder->energy[(builder->count + builder->capacity - 1) % builder->capacity];
+
+	newest->time = time;
+	newest->energy = 0;
+	if(builder->count > 0)
+	{
+		int64_t delta = time - previous->time;
+		newest->energy = previous->energy + (int64_t)power * ((delta < builder->max_gap) ? delta : builder->max_gap);
+	}
+	builder->count++;
+
+	for(int i = 0; i < RIDE_SUMMARY_NB_DURATIONS; i++)
+	{
+		int64_t duration = (int64_t)ride_summary_durations[i] * 1000;
+		int64_t *window = &builder->window[i];
+
+		/* The ring only keeps the last frames */
+		if(builder->count - *window > builder->capacity)
+		{
+			*window = builder->count - builder->capacity;
+		}
+
+		while(*window + 1 < builder->count && time - builder->energy[(*window + 1) % builder->capacity].time >= duration)
+		{
+			(*window)++;
+		}
+
+		const T_energy_point *start = &builder->energy[*window % builder->capacity];
+		if(time - start->time >= duration)
+		{
+			int32_t average = (int32_t)((newest->energy - start->energy) / (time - start->time));
+			if(average > summary->mean_max[i])
+			{
+				summary->mean_max[i] = average;
+			}
+		}
+	}
+}
+
+static void _close_lap(T_summary_builder *builder, T_ride_summary *summary)
+{
+	T_ride_summary_lap *lap = &summary->lap[summary->nb_laps++];
+
+	lap->start = builder->lap_start.elapsed;
+	lap->duration = builder->totals.moving - builder->lap_start.moving;
+	lap->distance = builder->totals.distance - builder->lap_start.distance;
+	lap->elevation_gain = builder->totals.gain - builder->lap_start.gain;
+	lap->average_speed = (lap->duration > 0) ? (int32_t)((int64_t)lap->distance * 10000 / lap->duration) : 0;
+	lap->average_heart_rate = (builder->nb_heart_rate > 0) ? (int32_t)(builder->heart_rate_sum / builder->nb_heart_rate) : 0;
+	lap->average_power = (builder->nb_power > 0) ? (int32_t)(builder->power_sum / builder->nb_power) : 0;
+	lap->max_power = builder->max_power;
+
+	builder->lap_start = builder->totals;
+	builder->heart_rate_sum = 0;
+	builder->nb_heart_rate = 0;
+	builder->power_sum = 0;
+	builder->nb_power = 0;
+	builder->max_power = 0;
+}
+
+/* Automatic lap every RIDE_SUMMARY_LAP_DISTANCE, the averages are on the moving time */
+static void _update_laps(T_summary_builder *builder, T_ride_summary *summary, const T_data_frame *frame, int32_t time)
+{
+	bool is_paused = data_frame_is_valid(frame, E_DATA_PAUSED) && frame->value[E_DATA_PAUSED];
+
+	builder->totals.elapsed = time;
+	if(data_frame_is_valid(frame, E_DATA_MOVING_TIME))
+	{
+		builder->totals.moving = frame->value[E_DATA_MOVING_TIME];
+	}
+	if(data_frame_is_valid(frame, E_DATA_DISTANCE))
+	{
+		builder->totals.distance = frame->value[E_DATA_DISTANCE];
+	}
+	if(data_frame_is_valid(frame, E_DATA_ELEVATION_GAIN))
+	{
+		builder->totals.gain = frame->value[E_DATA_ELEVATION_GAIN];
+	}
+
+	if(!is_paused && data_frame_is_valid(frame, E_DATA_HEART_RATE))
+	{
+		builder->heart_rate_sum += frame->value[E_DATA_HEART_RATE];
+		builder->nb_heart_rate++;
+	}
+	if(!is_paused && data_frame_is_valid(frame, E_DATA_POWER))
+	{
+		builder->power_sum += frame->value[E_DATA_POWER];
+		builder->nb_power++;
+		if(frame->value[E_DATA_POWER] > builder->max_power)
+		{
+			builder->max_power = frame->value[E_DATA_POWER];
+		}
+	}
+
+	if(builder->totals.distance - builder->lap_start.distance >= RIDE_SUMMARY_LAP_DISTANCE && summary->nb_laps < RIDE_SUMMARY_MAX_LAPS - 1)
+	{
+		_close_lap(builder, summary);
+	}
+}
+
+int ride_summary_build(const char *log_path, const T_ride_catalogue_entry *entry, const T_zones_histogram histogram[E_ZONES_TYPE_NUMBER],
+	const T_climb *climb, int nb_climbs, T_ride_summary *summary)
+{
+	fail_if_null(log_path, -1, "log_path is null\n");
+	fail_if_null(entry, -2, "entry is null\n");
+	fail_if_null(summary, -3, "summary is null\n");
+
+	int ret = 0;
+	int64_t start = 0;
+	T_ride_log_reader reader;
+	T_data_frame frame;
+	int period = system_config_get_sample_period();
+	fail_if_negative_or_zero(period, -4, "invalid sample period %d\n", period);
+
+	memset(summary, 0, sizeof(T_ride_summary));
+	summary->entry = *entry;
+	if(histogram != NULL)
+	{
+		memcpy(summary->zones, histogram, sizeof(summary->zones));
+	}
+	if(climb != NULL && nb_climbs > 0)
+	{
+		summary->nb_climbs = (nb_climbs < CLIMBS_MAX_CLIMBS) ? nb_climbs : CLIMBS_MAX_CLIMBS;
+		memcpy(summary->climb, climb, summary->nb_climbs * sizeof(T_climb));
+	}
+	memcpy(summary->duration, ride_summary_durations, sizeof(summary->duration));
+
+	T_summary_builder *builder = calloc(1, sizeof(T_summary_builder));
+	fail_if_null(builder, -5, "calloc builder failed\n");
+
+	builder->capacity = RIDE_SUMMARY_MAX_DURATION * 1000 / period + 2;
+	builder->max_gap = period;
+	builder->energy = malloc(builder->capacity * sizeof(T_energy_point));
+	if(builder->energy == NULL)
+	{
+		log_error("malloc energy failed\n");
+		ret = -6;
+		goto build_builder_cleanup;
+	}
+
+	for(int i = 0; i < E_RIDE_SUMMARY_CHART_NUMBER; i++)
+	{
+		builder->chart[i].bucket_size = 1;
+	}
+
+	ret = ride_log_reader_open(&reader, log_path);
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_open failed, return: %d\n", ret);
+		ret = -7;
+		goto build_builder_cleanup;
+	}
+
+	ret = ride_log_reader_next(&reader, &frame);
+	if(ret <= 0)
+	{
+		log_error("%s holds no frame, return: %d\n", log_path, ret);
+		ret = -8;
+		goto build_reader_cleanup;
+	}
+
+	/* UTC time, a resumed ride changes the clock of the frames */
+	start = frame.timestamp + reader.clock_offset;
+
+	do
+	{
+		int32_t time = (int32_t)(frame.timestamp + reader.clock_offset - start);
+		int32_t power = data_frame_is_valid(&frame, E_DATA_POWER) ? frame.value[E_DATA_POWER] : 0;
+
+		_update_mean_max(builder, summary, time, power);
+		_update_laps(builder, summary, &frame, time);
+
+		for(int i = 0; i < E_RIDE_SUMMARY_CHART_NUMBER; i++)
+		{
+			if(data_frame_is_valid(&frame, chart_channels[i]))
+			{
+				_chart_push(&builder->chart[i], time, frame.value[chart_channels[i]]);
+			}
+		}
+
+		ret = ride_log_reader_next(&reader, &frame);
+	} while(ret > 0);
+
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_next failed, return: %d\n", ret);
+		ret = -9;
+		goto build_reader_cleanup;
+	}
+
+	/* The last lap goes to the end of the ride */
+	if(builder->totals.elapsed > builder->lap_start.elapsed)
+	{
+		_close_lap(builder, summary);
+	}
+
+	for(int i = 0; i < E_RIDE_SUMMARY_CHART_NUMBER; i++)
+	{
+		summary->nb_points[i] = _chart_finish(&builder->chart[i], summary->chart[i]);
+	}
+
+	ret = 0;
+
+build_reader_cleanup:
+	ride_log_reader_close(&reader);
+build_builder_cleanup:
+	free(builder->energy);
+	free(builder);
+
+	return ret;
+}
+
+int ride_summary_save(const char *path, const T_ride_summary *summary)
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(summary, -2, "summary is null\n");
+
+	int ret = 0;
+	T_summary_file_header header = {.magic = RIDE_SUMMARY_MAGIC, .version = RIDE_SUMMARY_VERSION, .size = sizeof(T_ride_summary),
+		.crc = crc32_compute(summary, sizeof(T_ride_summary))};
+
+	FILE *file = fopen(path, "wb");
+	fail_if_null(file, -3, "fopen %s failed\n", path);
+
+	if(fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(summary, sizeof(T_ride_summary), 1, file) != 1)
+	{
+		log_error("writing %s failed\n", path);
+		ret = -4;
+	}
+
+	if(fclose(file) != 0)
+	{
+		log_error("fclose %s failed\n", path);
+		ret = -5;
+	}
+
+	return ret;
+}
+
+int ride_summary_load(const char *path, T_ride_summary *summary)
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(summary, -2, "summary is null\n");
+
+	T_summary_file_header header;
+	struct iovec iov[2] = {
+		{.iov_base = &header, .iov_len = sizeof(header)},
+		{.iov_base = summary, .iov_len = sizeof(T_ride_summary)},
+	};
+
+	int fd = open(path, O_RDONLY);
+	fail_if_negative(fd, -3, "open %s failed, errno: %d\n", path, errno);
+
+	ssize_t size = readv(fd, iov, 2);
+	close(fd);
+	fail_if_not_equal(size, (ssize_t)(sizeof(header) + sizeof(T_ride_summary)), -4, "reading %s failed, errno: %d\n", path, errno);
+
+	if(memcmp(header.magic, RIDE_SUMMARY_MAGIC, sizeof(header.magic)) != 0 || header.version != RIDE_SUMMARY_VERSION
+	|| header.size != sizeof(T_ride_summary) || header.crc != crc32_compute(summary, sizeof(T_ride_summary)))
+	{
+		log_error("%s is not a valid summary\n", path);
+		return -5;
+	}
+
+	return 0;
+}
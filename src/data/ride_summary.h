@@ -0,0 +1,84 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RIDE_SUMMARY_HEADER_
+#define _RIDE_SUMMARY_HEADER_
+
+#include <stdint.h>
+#include "ride_catalogue.h"
+#include "ride_history.h"
+#include "climbs.h"
+#include "zones.h"
+
+/* Sidecar file written next to the ride log at the end of the ride, with
+ * everything the detail view of a ride shows, so that the view is built from
+ * one read of a few kilobytes instead of decoding the whole log.
+ */
+
+#define RIDE_SUMMARY_EXTENSION ".summary"
+#define RIDE_SUMMARY_NB_DURATIONS 12 /* durations of the mean-max power curve */
+#define RIDE_SUMMARY_MAX_DURATION 7200 /* s, longest duration of the curve */
+#define RIDE_SUMMARY_LAP_DISTANCE 500000 /* cm, automatic lap every 5 km */
+#define RIDE_SUMMARY_MAX_LAPS 64 /* the last lap goes on to the end of the ride */
+#define RIDE_SUMMARY_CHART_POINTS 200 /* points per chart, LTTB downsampled */
+
+typedef enum {
+	E_RIDE_SUMMARY_CHART_SPEED = 0,
+	E_RIDE_SUMMARY_CHART_ALTITUDE,
+	E_RIDE_SUMMARY_CHART_HEART_RATE,
+	E_RIDE_SUMMARY_CHART_POWER,
+	E_RIDE_SUMMARY_CHART_NUMBER, // must be last
+} E_ride_summary_chart;
+
+typedef struct {
+	int32_t start; /* ms since the start of the ride */
+	int32_t duration; /* ms, moving time */
+	int32_t distance; /* cm */
+	int32_t elevation_gain; /* cm */
+	int32_t average_speed; /* mm/s, over the moving time */
+	int32_t average_heart_rate; /* bpm, 0 without sensor */
+	int32_t average_power; /* W, 0 without power meter */
+	int32_t max_power; /* W */
+} T_ride_summary_lap;
+
+typedef struct {
+	T_ride_catalogue_entry entry;
+	T_zones_histogram zones[E_ZONES_TYPE_NUMBER]; /* no zone when the histograms are unknown */
+	int32_t duration[RIDE_SUMMARY_NB_DURATIONS]; /* s */
+	int32_t mean_max[RIDE_SUMMARY_NB_DURATIONS]; /* W, best average power over each duration, 0 when the ride is shorter */
+	int32_t nb_laps;
+	T_ride_summary_lap lap[RIDE_SUMMARY_MAX_LAPS];
+	int32_t nb_climbs;
+	T_climb climb[CLIMBS_MAX_CLIMBS];
+	int32_t nb_points[E_RIDE_SUMMARY_CHART_NUMBER];
+	T_ride_history_point chart[E_RIDE_SUMMARY_CHART_NUMBER][RIDE_SUMMARY_CHART_POINTS]; /* time in ms since the start of the ride */
+} T_ride_summary;
+
+/* Build the summary in one pass over the ride log, the totals, the zone
+ * histograms and the climbs come from the recorder, histogram and climb can be
+ * null when they are not known.
+ */
+int ride_summary_build(const char *log_path, const T_ride_catalogue_entry *entry, const T_zones_histogram histogram[E_ZONES_TYPE_NUMBER],
+	const T_climb *climb, int nb_climbs, T_ride_summary *summary);
+
+int ride_summary_save(const char *path, const T_ride_summary *summary);
+
+/* Read the sidecar with a single read, fail when it is torn or from another version */
+int ride_summary_load(const char *path, T_ride_summary *summary);
+
+#endif //_RIDE_SUMMARY_HEADER_
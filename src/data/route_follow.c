@@ -0,0 +1,133 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "log.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "route_store.h"
+#include "route_index.h"
+#include "route_follow.h"
+
+#define ROUTE_FOLLOW_OUTPUTS (data_channel_bit(E_DATA_ROUTE_DISTANCE) | data_channel_bit(E_DATA_ROUTE_REMAINING) \
+	| data_channel_bit(E_DATA_OFF_ROUTE))
+
+static struct {
+	bool is_initialized;
+	const T_route *route; /* route followed, a reference is held on it */
+	bool has_index; /* the index of the route could be built */
+	T_route_index index;
+	int segment; /* segment of the last match, -1 before the first position */
+} route_follow = {
+	.is_initialized = false,
+	.route = NULL,
+	.segment = -1,
+};
+
+/* Follow the route selected meanwhile, its index is built once */
+static void _set_route(const T_route *route)
+{
+	if(route_follow.route != NULL)
+	{
+		if(route_follow.has_index)
+		{
+			route_index_free(&route_follow.index);
+		}
+		route_store_release(route_follow.route);
+	}
+
+	route_follow.route = route;
+	route_follow.has_index = false;
+	route_follow.segment = -1;
+
+	if(route != NULL)
+	{
+		int ret = route_index_build(&route_follow.index, route);
+		if(ret < 0)
+		{
+			log_error("route_index_build failed for route %s, return: %d\n", route->entry.name, ret);
+			return;
+		}
+		route_follow.has_index = true;
+	}
+}
+
+static int _route_follow_update(T_data_frame *frame)
+{
+	int ret = 0;
+	T_route_index_match match;
+
+	/* The reference taken here is kept when the selected route changed */
+	const T_route *route = route_store_acquire();
+	if(route != route_follow.route)
+	{
+		_set_route(route);
+	}
+	else if(route != NULL)
+	{
+		route_store_release(route);
+	}
+
+	if(!route_follow.has_index || !data_frame_is_valid(frame, E_DATA_LATITUDE) || !data_frame_is_valid(frame, E_DATA_LONGITUDE))
+	{
+		frame->valid_mask &= ~ROUTE_FOLLOW_OUTPUTS;
+		return 0;
+	}
+
+	ret = route_index_follow(&route_follow.index, frame->value[E_DATA_LATITUDE], frame->value[E_DATA_LONGITUDE],
+		&route_follow.segment, &match);
+	fail_if_negative(ret, -1, "route_index_follow failed, return: %d\n", ret);
+
+	frame->value[E_DATA_ROUTE_DISTANCE] = match.distance;
+	frame->value[E_DATA_ROUTE_REMAINING] = route_follow.route->distance[route_follow.route->nb_points - 1] - match.distance;
+	frame->value[E_DATA_OFF_ROUTE] = match.off_route;
+	frame->valid_mask |= ROUTE_FOLLOW_OUTPUTS;
+
+	return 0;
+}
+
+/* A new ride can start anywhere on the route */
+static void _route_follow_reset(void)
+{
+	route_follow.segment = -1;
+}
+
+static const T_metric route_follow_metric = {
+	.name = "route follow",
+	.inputs = data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE),
+	.outputs = ROUTE_FOLLOW_OUTPUTS,
+	.update = &_route_follow_update,
+	.reset = &_route_follow_reset,
+	.save = NULL,
+	.restore = NULL,
+	.finish = NULL,
+};
+
+int route_follow_init(void)
+{
+	fail_if_true(route_follow.is_initialized, -1, "route_follow is already initialized\n");
+
+	int ret = metric_registry_register(&route_follow_metric);
+	fail_if_negative(ret, -2, "metric_registry_register failed, return: %d\n", ret);
+
+	/* Mark module as initialized */
+	route_follow.is_initialized = true;
+
+	return 0;
+}
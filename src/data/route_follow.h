@@ -0,0 +1,30 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROUTE_FOLLOW_HEADER_
+#define _ROUTE_FOLLOW_HEADER_
+
+#define ROUTE_FOLLOW_OFF_ROUTE_DISTANCE 5000 /* cm, the rider is off route beyond this distance */
+
+/* Register the route follow metric, the position of the rider on the route
+ * selected in the route store is given by the route channels of the data
+ * manager
+ */
+int route_follow_init(void);
+
+#endif //_ROUTE_FOLLOW_HEADER_
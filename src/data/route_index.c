@@ -0,0 +1,377 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "geo_kernel.h"
+#include "route_index.h"
+
+/* Length of 1e-7 degree on the mean earth radius in cm, Q16 */
+#define INDEX_CM_PER_UNIT_Q16 72873
+#define INDEX_MAX_EXTENT (INT64_C(1) << 29) /* cm, the squared distances stay in 63 bits */
+#define INDEX_POSITION_SHIFT 16 /* position along a segment in Q16 */
+#define INDEX_MAX_DOT (INT64_C(1) << 46) /* the dot product is shifted to the Q16 position below this */
+
+static inline int64_t _project_x(const T_route_index *index, int32_t longitude)
+{
+	return fixed_point_mul_div((int64_t)longitude - index->origin_longitude, index->x_scale, 65536);
+}
+
+static inline int64_t _project_y(const T_route_index *index, int32_t latitude)
+{
+	return fixed_point_mul_div((int64_t)latitude - index->origin_latitude, index->y_scale, 65536);
+}
+
+/* A position far from the route is moved closer, the products of the segment distance must not overflow */
+static inline void _project_position(const T_route_index *index, int32_t latitude, int32_t longitude, int64_t *x, int64_t *y)
+{
+	*x = _project_x(index, longitude);
+	*y = _project_y(index, latitude);
+	*x = (*x < -INDEX_MAX_EXTENT) ? -INDEX_MAX_EXTENT : (*x > 2 * INDEX_MAX_EXTENT) ? 2 * INDEX_MAX_EXTENT : *x;
+	*y = (*y < -INDEX_MAX_EXTENT) ? -INDEX_MAX_EXTENT : (*y > 2 * INDEX_MAX_EXTENT) ? 2 * INDEX_MAX_EXTENT : *y;
+}
+
+/* Cell of a coordinate, also for the positions outside the grid */
+static inline int64_t _get_cell(const T_route_index *index, int64_t value)
+{
+	return (value >= 0) ? value / index->cell_size : -((-value + index->cell_size - 1) / index->cell_size);
+}
+
+static inline int _clip(int64_t value, int max)
+{
+	return (value < 0) ? 0 : (value > max) ? max : (int)value;
+}
+
+/* Squared distance from the position to the segment starting at point i, in
+ * cm², and position of the nearest point along the segment in Q16
+ */
+static int64_t _segment_distance(const T_route_index *index, int64_t x, int64_t y, int i, int32_t *position)
+{
+	int64_t ux = (int64_t)index->x[i+1] - index->x[i];
+	int64_t uy = (int64_t)index->y[i+1] - index->y[i];
+	int64_t wx = x - index->x[i];
+	int64_t wy = y - index->y[i];
+	int64_t dot = ux * wx + uy * wy;
+	int64_t length = ux * ux + uy * uy;
+
+	if(dot <= 0 || length == 0)
+	{
+		*position = 0;
+		return wx * wx + wy * wy;
+	}
+
+	if(dot >= length)
+	{
+		int64_t vx = x - index->x[i+1];
+		int64_t vy = y - index->y[i+1];
+
+		*position = 1 << INDEX_POSITION_SHIFT;
+		return vx * vx + vy * vy;
+	}
+
+	/* Only the segments longer than 80 km lose bits of the dot product */
+	int shift = 0;
+	while((length >> shift) > INDEX_MAX_DOT)
+	{
+		shift++;
+	}
+	*position = (int32_t)(((dot >> shift) << INDEX_POSITION_SHIFT) / (length >> shift));
+
+	int64_t dx = wx - ((ux * *position) >> INDEX_POSITION_SHIFT);
+	int64_t dy = wy - ((uy * *position) >> INDEX_POSITION_SHIFT);
+
+	return dx * dx + dy * dy;
+}
+
+/* The square root is only taken for the match kept */
+static void _set_match(const T_route_index *index, int segment, int64_t squared_distance, int32_t position, T_route_index_match *match)
+{
+	int64_t length = index->distance[segment+1] - index->distance[segment];
+	uint32_t off_route = fixed_point_isqrt((uint64_t)squared_distance);
+
+	match->segment = segment;
+	match->distance = index->distance[segment] + (int32_t)fixed_point_mul_div(length, position, 1 << INDEX_POSITION_SHIFT);
+	match->off_route = (off_route > INT32_MAX) ? INT32_MAX : (int32_t)off_route;
+}
+
+int route_index_build(T_route_index *index, const T_route *route)
+{
+	fail_if_null(index, -1, "index is null\n");
+	fail_if_null(route, -2, "route is null\n");
+	fail_if_inferior(route->nb_points, 2, -3, "route has less than 2 points\n");
+
+	int nb_segments = route->nb_points - 1;
+	const T_route_store_box *box = &route->entry.box;
+
+	memset(index, 0, sizeof(*index));
+	index->nb_points = route->nb_points;
+	index->distance = route->distance;
+	index->origin_latitude = box->min_latitude;
+	index->origin_longitude = box->min_longitude;
+	index->y_scale = INDEX_CM_PER_UNIT_Q16;
+
+	/* The longitude scale of the middle of the route, the projection is only used near the route */
+	int32_t middle = (int32_t)(((int64_t)box->min_latitude + box->max_latitude) / 2);
+	index->x_scale = (int32_t)fixed_point_mul_div(INDEX_CM_PER_UNIT_Q16, geo_kernel_cos_fixed(middle), 65536);
+
+	int64_t width = _project_x(index, box->max_longitude) + 1;
+	int64_t height = _project_y(index, box->max_latitude) + 1;
+	fail_if_false((width < INDEX_MAX_EXTENT && height < INDEX_MAX_EXTENT), -4, "route is too wide\n");
+
+	index->x = malloc(route->nb_points * sizeof(int32_t));
+	index->y = malloc(route->nb_points * sizeof(int32_t));
+	if(index->x == NULL || index->y == NULL)
+	{
+		log_error("malloc projected points failed\n");
+		route_index_free(index);
+		return -5;
+	}
+
+	for(int i = 0; i < route->nb_points; i++)
+	{
+		index->x[i] = (int32_t)_project_x(index, route->longitude[i]);
+		index->y[i] = (int32_t)_project_y(index, route->latitude[i]);
+	}
+
+	/* Square cells, about ROUTE_INDEX_CELLS_PER_SEGMENT per segment over the bounding box */
+	int32_t cell_size = (int32_t)fixed_point_isqrt((uint64_t)(width * height / ((int64_t)nb_segments * ROUTE_INDEX_CELLS_PER_SEGMENT)));
+	index->cell_size = (cell_size > ROUTE_INDEX_MIN_CELL_SIZE) ? cell_size : ROUTE_INDEX_MIN_CELL_SIZE;
+	index->nb_columns = (int)(width / index->cell_size) + 1;
+	index->nb_rows = (int)(height / index->cell_size) + 1;
+
+	int nb_cells = index->nb_columns * index->nb_rows;
+	index->cell_start = calloc(nb_cells + 1, sizeof(int32_t));
+	if(index->cell_start == NULL)
+	{
+		log_error("calloc %d cells failed\n", nb_cells);
+		route_index_free(index);
+		return -6;
+	}
+
+	/* Count the segments of each cell, then fill the cells from their end */
+	int64_t nb_items = 0;
+	for(int pass = 0; pass < 2; pass++)
+	{
+		for(int i = 0; i < nb_segments; i++)
+		{
+			int column_min = (int)((index->x[i] < index->x[i+1] ? index->x[i] : index->x[i+1]) / index->cell_size);
+			int column_max = (int)((index->x[i] > index->x[i+1] ? index->x[i] : index->x[i+1]) / index->cell_size);
+			int row_min = (int)((index->y[i] < index->y[i+1] ? index->y[i] : index->y[i+1]) / index->cell_size);
+			int row_max = (int)((index->y[i] > index->y[i+1] ? index->y[i] : index->y[i+1]) / index->cell_size);
+
+			for(int row = row_min; row <= row_max; row++)
+			{
+				for(int column = column_min; column <= column_max; column++)
+				{
+					int cell = row * index->nb_columns + column;
+					if(pass == 0)
+					{
+						index->cell_start[cell + 1]++;
+						nb_items++;
+					}
+					else
+					{
+						index->items[--index->cell_start[cell + 1]] = i;
+					}
+				}
+			}
+		}
+
+		if(pass == 0)
+		{
+			if(nb_items > INT32_MAX / (int64_t)sizeof(int32_t))
+			{
+				log_error("route covers too many cells\n");
+				route_index_free(index);
+				return -7;
+			}
+
+			index->items = malloc(nb_items * sizeof(int32_t));
+			if(index->items == NULL)
+			{
+				log_error("malloc %lld items failed\n", (long long)nb_items);
+				route_index_free(index);
+				return -8;
+			}
+
+			/* cell_start[cell + 1] becomes the end of the cell */
+			for(int cell = 0; cell < nb_cells; cell++)
+			{
+				index->cell_start[cell + 1] += index->cell_start[cell];
+			}
+		}
+	}
+
+	return 0;
+}
+
+int route_index_free(T_route_index *index)
+{
+	fail_if_null(index, -1, "index is null\n");
+
+	free(index->x);
+	free(index->y);
+	free(index->cell_start);
+	free(index->items);
+	memset(index, 0, sizeof(*index));
+
+	return 0;
+}
+
+int route_index_nearest(const T_route_index *index, int32_t latitude, int32_t longitude, T_route_index_match *match)
+{
+	fail_if_null(index, -1, "index is null\n");
+	fail_if_null(index->items, -2, "index is not built\n");
+	fail_if_null(match, -3, "match is null\n");
+
+	int64_t x = 0;
+	int64_t y = 0;
+	_project_position(index, latitude, longitude, &x, &y);
+	int64_t column = _get_cell(index, x);
+	int64_t row = _get_cell(index, y);
+	int64_t best = -1;
+	int32_t best_position = 0;
+	int best_segment = 0;
+
+	/* The first ring reaching the grid */
+	int64_t ring = 0;
+	ring = (column < 0) ? -column : (column >= index->nb_columns) ? column - index->nb_columns + 1 : ring;
+	int64_t row_ring = (row < 0) ? -row : (row >= index->nb_rows) ? row - index->nb_rows + 1 : 0;
+	ring = (row_ring > ring) ? row_ring : ring;
+
+	while(1)
+	{
+		/* The cells at ring cells from the cell of the position, the sides clipped to the grid */
+		int row_min = _clip(row - ring, index->nb_rows - 1);
+		int row_max = _clip(row + ring, index->nb_rows - 1);
+		int column_min = _clip(column - ring, index->nb_columns - 1);
+		int column_max = _clip(column + ring, index->nb_columns - 1);
+
+		for(int cell_row = row_min; cell_row <= row_max; cell_row++)
+		{
+			bool is_side_row = (cell_row == row - ring || cell_row == row + ring);
+			int step = (is_side_row || column_max == column_min) ? 1 : column_max - column_min;
+
+			for(int cell_column = column_min; cell_column <= column_max; cell_column += step)
+			{
+				if(!is_side_row && cell_column != column - ring && cell_column != column + ring)
+				{
+					continue;
+				}
+
+				int cell = cell_row * index->nb_columns + cell_column;
+				for(int item = index->cell_start[cell]; item < index->cell_start[cell + 1]; item++)
+				{
+					int32_t position = 0;
+					int64_t distance = _segment_distance(index, x, y, index->items[item], &position);
+
+					if(best < 0 || distance < best)
+					{
+						best = distance;
+						best_position = position;
+						best_segment = index->items[item];
+					}
+				}
+			}
+		}
+
+		/* Any segment outside the rings is farther than ring cells */
+		int64_t reach = ring * index->cell_size;
+		if(best >= 0 && best <= reach * reach)
+		{
+			break;
+		}
+		if(row - ring <= 0 && row + ring >= index->nb_rows - 1 && column - ring <= 0 && column + ring >= index->nb_columns - 1)
+		{
+			break;
+		}
+		ring++;
+	}
+
+	fail_if_negative(best, -4, "route has no segment\n");
+	_set_match(index, best_segment, best, best_position, match);
+
+	return 0;
+}
+
+int route_index_nearest_in_range(const T_route_index *index, int32_t latitude, int32_t longitude, int first, int last,
+	T_route_index_match *match)
+{
+	fail_if_null(index, -1, "index is null\n");
+	fail_if_null(match, -2, "match is null\n");
+	fail_if_false((first >= 0 && first <= last && last < index->nb_points - 1), -3, "invalid range %d to %d\n", first, last);
+
+	int64_t x = 0;
+	int64_t y = 0;
+	_project_position(index, latitude, longitude, &x, &y);
+	int64_t best = -1;
+	int32_t best_position = 0;
+	int best_segment = first;
+
+	for(int i = first; i <= last; i++)
+	{
+		int32_t position = 0;
+		int64_t distance = _segment_distance(index, x, y, i, &position);
+
+		if(best < 0 || distance < best)
+		{
+			best = distance;
+			best_position = position;
+			best_segment = i;
+		}
+	}
+
+	_set_match(index, best_segment, best, best_position, match);
+
+	return 0;
+}
+
+int route_index_follow(const T_route_index *index, int32_t latitude, int32_t longitude, int *segment, T_route_index_match *match)
+{
+	fail_if_null(index, -1, "index is null\n");
+	fail_if_null(segment, -2, "segment is null\n");
+	fail_if_null(match, -3, "match is null\n");
+
+	int ret = 0;
+
+	if(*segment >= 0 && *segment < index->nb_points - 1)
+	{
+		int first = (*segment > ROUTE_INDEX_WINDOW_BEHIND) ? *segment - ROUTE_INDEX_WINDOW_BEHIND : 0;
+		int last = (*segment < index->nb_points - 1 - ROUTE_INDEX_WINDOW_AHEAD) ? *segment + ROUTE_INDEX_WINDOW_AHEAD : index->nb_points - 2;
+
+		ret = route_index_nearest_in_range(index, latitude, longitude, first, last, match);
+		fail_if_negative(ret, -4, "route_index_nearest_in_range failed, return: %d\n", ret);
+
+		if(match->off_route <= ROUTE_INDEX_WINDOW_DISTANCE)
+		{
+			*segment = match->segment;
+			return 0;
+		}
+	}
+
+	/* First position, or the rider left the last segments */
+	ret = route_index_nearest(index, latitude, longitude, match);
+	fail_if_negative(ret, -5, "route_index_nearest failed, return: %d\n", ret);
+
+	*segment = match->segment;
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROUTE_INDEX_HEADER_
+#define _ROUTE_INDEX_HEADER_
+
+#include <stdint.h>
+#include "route_store.h"
+
+/* Nearest segment of a route to a position.
+ *
+ * The route points are projected on a plane in cm from the corner of the
+ * bounding box, with the longitude scale of its middle latitude, and the
+ * segments are put in a uniform grid in the cells
+ * covered by their bounding box. The size of the cells adapts to the extent
+ * of the route to keep about ROUTE_INDEX_CELLS_PER_SEGMENT cells per segment.
+ * A query visits the cells in rings around the position and stops once the
+ * next ring cannot hold a closer segment.
+ *
+ * While following the route the segments just around the last match are
+ * tried first, the grid is only searched when the rider is not on them: the
+ * query is near-constant time and a route going twice by the same road is
+ * followed in order.
+ */
+
+#define ROUTE_INDEX_CELLS_PER_SEGMENT 2
+#define ROUTE_INDEX_MIN_CELL_SIZE 5000 /* cm */
+#define ROUTE_INDEX_WINDOW_BEHIND 4 /* segments before the last match tried first */
+#define ROUTE_INDEX_WINDOW_AHEAD 16 /* segments after the last match tried first */
+#define ROUTE_INDEX_WINDOW_DISTANCE 3000 /* cm, a match of the window closer than this is kept */
+
+typedef struct {
+	int nb_points;
+	const int32_t *distance; /* cm since the first point, from the route */
+	int32_t *x; /* cm, projected points */
+	int32_t *y;
+	int32_t origin_latitude; /* 1e-7 degree, projected at 0, 0 */
+	int32_t origin_longitude;
+	int32_t x_scale; /* cm per 1e-7 degree of longitude, Q16 */
+	int32_t y_scale; /* cm per 1e-7 degree of latitude, Q16 */
+	int32_t cell_size; /* cm */
+	int nb_columns;
+	int nb_rows;
+	int32_t *cell_start; /* first item of each cell, nb_columns * nb_rows + 1 */
+	int32_t *items; /* segments of the cells, a segment is given by its first point */
+} T_route_index;
+
+typedef struct {
+	int segment; /* first point of the nearest segment */
+	int32_t distance; /* cm along the route of the nearest point */
+	int32_t off_route; /* cm from the position to the route */
+} T_route_index_match;
+
+/* The index keeps a pointer on the distances of the route, the route must
+ * outlive it
+ */
+int route_index_build(T_route_index *index, const T_route *route);
+int route_index_free(T_route_index *index);
+
+/* Nearest segment of the whole route, through the grid */
+int route_index_nearest(const T_route_index *index, int32_t latitude, int32_t longitude, T_route_index_match *match);
+
+/* Nearest segment among the segments first to last included, point by point */
+int route_index_nearest_in_range(const T_route_index *index, int32_t latitude, int32_t longitude, int first, int last,
+	T_route_index_match *match);
+
+/* Match of a position while following the route, segment is the segment of
+ * the last match, -1 for the first position, and is updated
+ */
+int route_index_follow(const T_route_index *index, int32_t latitude, int32_t longitude, int *segment, T_route_index_match *match);
+
+#endif //_ROUTE_INDEX_HEADER_
@@ -0,0 +1,310 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "fixed_point.h"
+#include "route_profile.h"
+
+/* Samples of each level for a route of length cm, return the total */
+static int _get_nb_samples(int32_t length, int *nb_samples)
+{
+	int total = 0;
+
+	nb_samples[0] = length / ROUTE_PROFILE_STEP + 1;
+	for(int level = 1; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		nb_samples[level] = (nb_samples[level-1] - 1) / ROUTE_PROFILE_FACTOR + 1;
+	}
+	for(int level = 0; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		total += nb_samples[level];
+	}
+
+	return total;
+}
+
+/* Altitude of the route every ROUTE_PROFILE_STEP, interpolated between the points */
+static void _sample_route(T_route_profile *profile, const int32_t *distance, const int32_t *altitude, int nb_points)
+{
+	int32_t *samples = profile->altitude[0];
+	int point = 0;
+
+	for(int i = 0; i < profile->nb_samples[0]; i++)
+	{
+		int32_t position = i * ROUTE_PROFILE_STEP;
+
+		while(point < nb_points - 2 && distance[point+1] < position)
+		{
+			point++;
+		}
+
+		int32_t span = distance[point+1] - distance[point];
+		samples[i] = (span > 0) ? fixed_point_lerp(altitude[point], altitude[point+1], position - distance[point], span) : altitude[point+1];
+	}
+}
+
+/* Each sample is the weighted mean of the ROUTE_PROFILE_FACTOR samples of the
+ * level below around it, the two halves at the ends, the coarse levels do not
+ * alias the bumps of the road
+ */
+static void _reduce_level(T_route_profile *profile, int level)
+{
+	const int32_t *below = profile->altitude[level-1];
+	int last = profile->nb_samples[level-1] - 1;
+	int half = ROUTE_PROFILE_FACTOR / 2;
+
+	for(int i = 0; i < profile->nb_samples[level]; i++)
+	{
+		int center = i * ROUTE_PROFILE_FACTOR;
+		int64_t sum = 0;
+
+		for(int offset = -half; offset <= half; offset++)
+		{
+			int index = center + offset;
+			index = (index < 0) ? 0 : ((index > last) ? last : index);
+			sum += (offset == -half || offset == half) ? below[index] : 2 * (int64_t)below[index];
+		}
+
+		profile->altitude[level][i] = (int32_t)fixed_point_mul_div(sum, 1, 2 * ROUTE_PROFILE_FACTOR);
+	}
+}
+
+/* Keep the rise from sample low to sample high when it is a climb */
+static void _add_climb(T_route_profile *profile, int low, int high)
+{
+	const int32_t *samples = profile->altitude[0];
+	int start = low;
+	int end = high;
+
+	/* The flat road before and after the climb is not part of it */
+	while(start < high && samples[start+1] - samples[low] < ROUTE_PROFILE_CLIMB_EDGE)
+	{
+		start++;
+	}
+	while(end > start && samples[high] - samples[end-1] < ROUTE_PROFILE_CLIMB_EDGE)
+	{
+		end--;
+	}
+
+	int32_t gain = samples[end] - samples[start];
+	int32_t distance = (end - start) * ROUTE_PROFILE_STEP;
+	if(distance <= 0 || gain < ROUTE_PROFILE_CLIMB_MIN_GAIN)
+	{
+		return;
+	}
+
+	int32_t grade = (int32_t)((int64_t)gain * 1000 / distance);
+	if(grade < ROUTE_PROFILE_CLIMB_MIN_GRADE)
+	{
+		return;
+	}
+
+	if(profile->nb_climbs == ROUTE_PROFILE_MAX_CLIMBS)
+	{
+		log_warn("more than %d climbs, the next ones are dropped\n", ROUTE_PROFILE_MAX_CLIMBS);
+		return;
+	}
+
+	int32_t max_grade = grade;
+	for(int i = start; i + ROUTE_PROFILE_MAX_GRADE_STEPS <= end; i++)
+	{
+		int64_t rise = (int64_t)samples[i + ROUTE_PROFILE_MAX_GRADE_STEPS] - samples[i];
+		int32_t steepest = (int32_t)(rise * 1000 / (ROUTE_PROFILE_MAX_GRADE_STEPS * ROUTE_PROFILE_STEP));
+		max_grade = (steepest > max_grade) ? steepest : max_grade;
+	}
+
+	T_route_climb *climb = &profile->climbs[profile->nb_climbs++];
+	climb->start = start * ROUTE_PROFILE_STEP;
+	climb->end = end * ROUTE_PROFILE_STEP;
+	climb->altitude = samples[start];
+	climb->gain = gain;
+	climb->grade = grade;
+	climb->max_grade = max_grade;
+}
+
+/* Split the finest level in rises and descents, a move back of
+ * ROUTE_PROFILE_CLIMB_DROP from the last extremum changes the direction
+ */
+static void _find_climbs(T_route_profile *profile)
+{
+	const int32_t *samples = profile->altitude[0];
+	int low = 0;
+	int high = 0;
+	bool is_rising = false;
+
+	profile->nb_climbs = 0;
+	for(int i = 1; i < profile->nb_samples[0]; i++)
+	{
+		if(!is_rising)
+		{
+			if(samples[i] < samples[low])
+			{
+				low = i;
+			}
+			else if(samples[i] - samples[low] >= ROUTE_PROFILE_CLIMB_DROP)
+			{
+				is_rising = true;
+				high = i;
+			}
+		}
+		else
+		{
+			if(samples[i] > samples[high])
+			{
+				high = i;
+			}
+			else if(samples[high] - samples[i] >= ROUTE_PROFILE_CLIMB_DROP)
+			{
+				_add_climb(profile, low, high);
+				is_rising = false;
+				low = i;
+			}
+		}
+	}
+
+	/* The route can end at the top */
+	if(is_rising)
+	{
+		_add_climb(profile, low, high);
+	}
+}
+
+int route_profile_alloc(T_route_profile *profile, int32_t length, int nb_climbs)
+{
+	fail_if_null(profile, -1, "profile is null\n");
+	fail_if_negative(length, -2, "invalid length: %d\n", (int)length);
+	fail_if_false((nb_climbs >= 0 && nb_climbs <= ROUTE_PROFILE_MAX_CLIMBS), -3, "invalid number of climbs: %d\n", nb_climbs);
+
+	memset(profile, 0, sizeof(*profile));
+
+	int total = _get_nb_samples(length, profile->nb_samples);
+	int32_t *values = malloc((size_t)total * sizeof(int32_t) + (size_t)nb_climbs * sizeof(T_route_climb));
+	fail_if_null(values, -4, "malloc profile of %d samples failed\n", total);
+
+	for(int level = 0; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		profile->altitude[level] = values;
+		values += profile->nb_samples[level];
+	}
+	profile->length = length;
+	profile->climbs = (T_route_climb *)values;
+	profile->nb_climbs = nb_climbs;
+
+	return 0;
+}
+
+int route_profile_free(T_route_profile *profile)
+{
+	fail_if_null(profile, -1, "profile is null\n");
+
+	/* The other levels and the climbs are in the same allocation */
+	free(profile->altitude[0]);
+	memset(profile, 0, sizeof(*profile));
+
+	return 0;
+}
+
+int route_profile_build(T_route_profile *profile, const int32_t *distance, const int32_t *altitude, int nb_points)
+{
+	fail_if_null(profile, -1, "profile is null\n");
+	fail_if_null(distance, -2, "distance is null\n");
+	fail_if_null(altitude, -3, "altitude is null\n");
+	fail_if_inferior(nb_points, 2, -4, "a route has at least 2 points, got %d\n", nb_points);
+
+	int ret = route_profile_alloc(profile, distance[nb_points-1], ROUTE_PROFILE_MAX_CLIMBS);
+	fail_if_negative(ret, -5, "route_profile_alloc failed, return: %d\n", ret);
+
+	_sample_route(profile, distance, altitude, nb_points);
+	for(int level = 1; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		_reduce_level(profile, level);
+	}
+	_find_climbs(profile);
+
+	return 0;
+}
+
+int32_t route_profile_get_step(int level)
+{
+	fail_if_false((level >= 0 && level < ROUTE_PROFILE_LEVELS), -1, "invalid level: %d\n", level);
+
+	int32_t step = ROUTE_PROFILE_STEP;
+	for(int i = 0; i < level; i++)
+	{
+		step *= ROUTE_PROFILE_FACTOR;
+	}
+
+	return step;
+}
+
+int route_profile_slice(const T_route_profile *profile, int32_t start, int32_t end, int max_samples, T_route_profile_slice *slice)
+{
+	fail_if_null(profile, -1, "profile is null\n");
+	fail_if_null(slice, -2, "slice is null\n");
+	fail_if_negative_or_zero(max_samples, -3, "invalid max_samples: %d\n", max_samples);
+
+	start = (start < 0) ? 0 : ((start > profile->length) ? profile->length : start);
+	end = (end < start) ? start : ((end > profile->length) ? profile->length : end);
+
+	int level = 0;
+	int32_t step = ROUTE_PROFILE_STEP;
+	while(level < ROUTE_PROFILE_LEVELS - 1 && (end - start) / step + 1 > max_samples)
+	{
+		level++;
+		step *= ROUTE_PROFILE_FACTOR;
+	}
+
+	/* The samples around the two ends */
+	int first = start / step;
+	int last = (int)(((int64_t)end + step - 1) / step);
+	last = (last >= profile->nb_samples[level]) ? profile->nb_samples[level] - 1 : last;
+
+	slice->altitude = profile->altitude[level] + first;
+	slice->count = (last - first + 1 > max_samples) ? max_samples : last - first + 1;
+	slice->start = first * step;
+	slice->step = step;
+
+	return slice->count;
+}
+
+int route_profile_next_climb(const T_route_profile *profile, int32_t distance)
+{
+	fail_if_null(profile, -1, "profile is null\n");
+
+	int low = 0;
+	int high = profile->nb_climbs;
+
+	/* The climbs are in route order and do not overlap */
+	while(low < high)
+	{
+		int middle = (low + high) / 2;
+		if(profile->climbs[middle].end <= distance)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
@@ -0,0 +1,94 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROUTE_PROFILE_HEADER_
+#define _ROUTE_PROFILE_HEADER_
+
+#include <stdint.h>
+
+/* Elevation profile and climbs of a route, computed once at import.
+ *
+ * The altitude is sampled every ROUTE_PROFILE_STEP along the route, each
+ * coarser level holds one sample every ROUTE_PROFILE_FACTOR samples of the
+ * level below, smoothed over them. A view of any length is drawn from the
+ * finest level giving no more samples than its width, the samples are a
+ * slice of the level array: nothing is resampled while riding.
+ *
+ * The climbs are the rises of the finest level, a descent of
+ * ROUTE_PROFILE_CLIMB_DROP ends a rise, with their flat ends trimmed. Only the
+ * rises of at least ROUTE_PROFILE_CLIMB_MIN_GAIN and
+ * ROUTE_PROFILE_CLIMB_MIN_GRADE are kept, in route order.
+ */
+
+#define ROUTE_PROFILE_STEP 2000 /* cm between the samples of the finest level */
+#define ROUTE_PROFILE_LEVELS 4
+#define ROUTE_PROFILE_FACTOR 4 /* samples of a level per sample of the next one */
+#define ROUTE_PROFILE_MAX_CLIMBS 256
+#define ROUTE_PROFILE_CLIMB_MIN_GAIN 2000 /* cm */
+#define ROUTE_PROFILE_CLIMB_MIN_GRADE 30 /* 0.1 % */
+#define ROUTE_PROFILE_CLIMB_DROP 1000 /* cm, descent ending a climb */
+#define ROUTE_PROFILE_CLIMB_EDGE 200 /* cm, flat ends trimmed from a climb */
+#define ROUTE_PROFILE_MAX_GRADE_STEPS 5 /* samples of the steepest part of a climb, 100 m */
+
+typedef struct {
+	int32_t start; /* cm since the first point of the route */
+	int32_t end; /* cm since the first point of the route */
+	int32_t altitude; /* cm, at the start */
+	int32_t gain; /* cm */
+	int32_t grade; /* 0.1 %, average */
+	int32_t max_grade; /* 0.1 %, steepest ROUTE_PROFILE_MAX_GRADE_STEPS samples */
+} T_route_climb;
+
+/* The levels and the climbs are in one allocation */
+typedef struct {
+	int32_t length; /* cm, distance of the route */
+	int nb_samples[ROUTE_PROFILE_LEVELS];
+	int32_t *altitude[ROUTE_PROFILE_LEVELS]; /* cm, sample i at i steps of the level */
+	int nb_climbs;
+	T_route_climb *climbs;
+} T_route_profile;
+
+/* Samples of a level between two distances, altitude points in the level */
+typedef struct {
+	const int32_t *altitude;
+	int count;
+	int32_t start; /* cm, distance of the first sample */
+	int32_t step; /* cm between the samples */
+} T_route_profile_slice;
+
+/* Allocate the levels of a route of length cm with room for nb_climbs climbs */
+int route_profile_alloc(T_route_profile *profile, int32_t length, int nb_climbs);
+int route_profile_free(T_route_profile *profile);
+
+/* Sample the altitude of the route points and find the climbs, the distances
+ * are cumulative in cm, the altitudes in cm
+ */
+int route_profile_build(T_route_profile *profile, const int32_t *distance, const int32_t *altitude, int nb_points);
+
+/* cm between the samples of a level */
+int32_t route_profile_get_step(int level);
+
+/* Samples from start to end at the finest level with at most max_samples of
+ * them, the slice stops at the end of the route. Return the number of samples.
+ */
+int route_profile_slice(const T_route_profile *profile, int32_t start, int32_t end, int max_samples, T_route_profile_slice *slice);
+
+/* First climb not finished at this distance, nb_climbs when none is left */
+int route_profile_next_climb(const T_route_profile *profile, int32_t distance);
+
+#endif //_ROUTE_PROFILE_HEADER_
@@ -0,0 +1,777 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "utils.h"
+#include "crc32.h"
+#include "fixed_point.h"
+#include "varint.h"
+#include "geo_kernel.h"
+#include "metrics.h"
+#include "route_store.h"
+
+#define ROUTE_MAGIC "OBCR"
+#define ROUTE_VERSION 2
+#define ROUTE_NB_COLUMNS 4 /* latitude, longitude, altitude and segment length */
+#define ROUTE_CATALOGUE_NAME "catalogue"
+#define ROUTE_CATALOGUE_MAGIC "OBCT"
+#define ROUTE_CATALOGUE_VERSION 1
+#define ROUTE_IMPORT_INITIAL_POINTS 4096
+#define ROUTE_ALTITUDE_DECIMALS 2 /* ele in m, altitudes in cm */
+
+/* Header of a route file, followed by the encoded columns of the points, the
+ * encoded levels of the profile and the climbs
+ */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	T_route_store_entry entry;
+	uint32_t nb_climbs;
+	uint32_t size; /* bytes after the header */
+	uint32_t crc; /* CRC32 of the bytes after the header */
+} T_route_file_header;
+
+/* Points read from the GPX file, grown while parsing */
+typedef struct {
+	int nb_points;
+	int capacity;
+	int32_t *latitude;
+	int32_t *longitude;
+	int32_t *altitude;
+	char name[ROUTE_STORE_NAME_SIZE];
+} T_route_import;
+
+/* Selected route with the references taken on it, the route must stay the first member */
+typedef struct {
+	T_route route;
+	int references;
+} T_route_selection;
+
+static struct {
+	pthread_mutex_t mutex; /* protect the selection and its references */
+	T_route_selection *selection;
+} route_store = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.selection = NULL,
+};
+
+static int _build_path(const char *folder, const char *name, const char *extension, char *buff, int size)
+{
+	int ret = snprintf(buff, size, "%s/%s%s", folder, name, extension);
+	fail_if_negative(ret, -1, "snprintf failed\n");
+	fail_if_superior_or_equal(ret, size, -2, "path is too long\n");
+
+	return 0;
+}
+
+/*
+ * GPX parsing
+ *
+ * Only what a route needs is read: the trkpt elements, or the rtept ones when
+ * the file has no track, with their lat and lon attributes and their ele
+ * child, and the first name element.
+ */
+
+static int _add_point(T_route_import *import, int32_t latitude, int32_t longitude, int32_t altitude)
+{
+	/* A repeated point would give an empty segment */
+	if(import->nb_points > 0 && import->latitude[import->nb_points-1] == latitude
+	&& import->longitude[import->nb_points-1] == longitude)
+	{
+		return 0;
+	}
+
+	fail_if_superior_or_equal(import->nb_points, ROUTE_STORE_MAX_POINTS, -1, "route has more than %d points\n", ROUTE_STORE_MAX_POINTS);
+
+	if(import->nb_points == import->capacity)
+	{
+		int capacity = (import->capacity > 0) ? 2 * import->capacity : ROUTE_IMPORT_INITIAL_POINTS;
+		int32_t *latitude_array = realloc(import->latitude, capacity * sizeof(int32_t));
+		fail_if_null(latitude_array, -2, "realloc latitudes failed\n");
+		import->latitude = latitude_array;
+		int32_t *longitude_array = realloc(import->longitude, capacity * sizeof(int32_t));
+		fail_if_null(longitude_array, -3, "realloc longitudes failed\n");
+		import->longitude = longitude_array;
+		int32_t *altitude_array = realloc(import->altitude, capacity * sizeof(int32_t));
+		fail_if_null(altitude_array, -4, "realloc altitudes failed\n");
+		import->altitude = altitude_array;
+		import->capacity = capacity;
+	}
+
+	import->latitude[import->nb_points] = latitude;
+	import->longitude[import->nb_points] = longitude;
+	import->altitude[import->nb_points] = altitude;
+	import->nb_points++;
+
+	return 0;
+}
+
+/* Value of the attribute of a start tag, in 1e-7 degree */
+static int _get_coordinate(const char *tag, const char *tag_end, const char *attribute, int32_t *value)
+{
+	size_t length = strlen(attribute);
+
+	for(const char *p = tag; p + length + 2 < tag_end; p++)
+	{
+		if((p[0] == ' ' || p[0] == '\t' || p[0] == '\n' || p[0] == '\r')
+		&& strncmp(p + 1, attribute, length) == 0 && p[length+1] == '=' && (p[length+2] == '"' || p[length+2] == '\''))
+		{
+			int ret = fixed_point_parse(p + length + 3, FIXED_POINT_COORDINATE_DECIMALS, value, NULL);
+			fail_if_negative(ret, -1, "invalid %s attribute, return: %d\n", attribute, ret);
+
+			return 0;
+		}
+	}
+
+	return -2;
+}
+
+/* Text of an element, the character data markers and the predefined entities are decoded */
+static void _copy_text(char *dst, int size, const char *src)
+{
+	static const struct {
+		const char *entity;
+		char c;
+	} entities[] = {{"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+	int length = 0;
+
+	if(strncmp(src, "<![CDATA[", 9) == 0)
+	{
+		src += 9;
+		while(*src != '\0' && strncmp(src, "]]>", 3) != 0 && length < size - 1)
+		{
+			dst[length++] = *src++;
+		}
+		dst[length] = '\0';
+		return;
+	}
+
+	while(*src != '\0' && *src != '<' && length < size - 1)
+	{
+		char c = *src++;
+
+		if(c == '&')
+		{
+			for(int i = 0; i < (int)(sizeof(entities) / sizeof(entities[0])); i++)
+			{
+				size_t entity_length = strlen(entities[i].entity);
+				if(strncmp(src - 1, entities[i].entity, entity_length) == 0)
+				{
+					c = entities[i].c;
+					src += entity_length - 1;
+					break;
+				}
+			}
+		}
+		dst[length++] = c;
+	}
+	dst[length] = '\0';
+}
+
+/* Read the points of the elements named tag */
+static int _parse_points(const char *text, const char *tag, T_route_import *import)
+{
+	int ret = 0;
+	size_t tag_length = strlen(tag);
+	int32_t altitude = 0;
+	const char *p = text;
+
+	while((p = strchr(p, '<')) != NULL)
+	{
+		p++;
+		if(strncmp(p, tag, tag_length) != 0 || (p[tag_length] != ' ' && p[tag_length] != '\t' && p[tag_length] != '\n' && p[tag_length] != '\r'))
+		{
+			continue;
+		}
+
+		const char *tag_end = strchr(p, '>');
+		fail_if_null(tag_end, -1, "unterminated %s element\n", tag);
+
+		int32_t latitude = 0;
+		int32_t longitude = 0;
+		ret = _get_coordinate(p, tag_end, "lat", &latitude);
+		fail_if_negative(ret, -2, "%s element without valid lat, return: %d\n", tag, ret);
+		ret = _get_coordinate(p, tag_end, "lon", &longitude);
+		fail_if_negative(ret, -3, "%s element without valid lon, return: %d\n", tag, ret);
+		fail_if_false((latitude >= -90 * FIXED_POINT_COORDINATE_SCALE && latitude <= 90 * FIXED_POINT_COORDINATE_SCALE
+			&& longitude >= -180 * FIXED_POINT_COORDINATE_SCALE && longitude <= 180 * FIXED_POINT_COORDINATE_SCALE), -4,
+			"invalid coordinates %d %d\n", (int)latitude, (int)longitude);
+
+		/* The altitude of the previous point is kept when the point has none */
+		p = tag_end + 1;
+		if(tag_end[-1] != '/')
+		{
+			while((p = strchr(p, '<')) != NULL)
+			{
+				p++;
+				if(strncmp(p, "ele>", 4) == 0)
+				{
+					ret = fixed_point_parse(p + 4, ROUTE_ALTITUDE_DECIMALS, &altitude, NULL);
+					fail_if_negative(ret, -5, "invalid ele of a %s element, return: %d\n", tag, ret);
+				}
+				else if(p[0] == '/' && strncmp(p + 1, tag, tag_length) == 0)
+				{
+					break;
+				}
+			}
+			fail_if_null(p, -6, "unterminated %s element\n", tag);
+		}
+
+		ret = _add_point(import, latitude, longitude, altitude);
+		fail_if_negative(ret, -7, "_add_point failed, return: %d\n", ret);
+	}
+
+	return 0;
+}
+
+static int _parse_gpx(const char *text, T_route_import *import)
+{
+	int ret = 0;
+
+	const char *name = strstr(text, "<name>");
+	if(name != NULL)
+	{
+		_copy_text(import->name, sizeof(import->name), name + 6);
+	}
+
+	ret = _parse_points(text, "trkpt", import);
+	fail_if_negative(ret, -1, "_parse_points trkpt failed, return: %d\n", ret);
+
+	if(import->nb_points == 0)
+	{
+		ret = _parse_points(text, "rtept", import);
+		fail_if_negative(ret, -2, "_parse_points rtept failed, return: %d\n", ret);
+	}
+
+	fail_if_inferior(import->nb_points, 2, -3, "route has less than 2 points\n");
+
+	return 0;
+}
+
+static int _read_gpx(const char *path, T_route_import *import)
+{
+	int ret = 0;
+	struct stat st;
+	char *text = NULL;
+
+	int fd = open(path, O_RDONLY);
+	fail_if_negative(fd, -1, "open %s failed, errno: %d\n", path, errno);
+
+	/* Read at once and terminated, the parser works on a string */
+	if(fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		text = malloc(st.st_size + 1);
+	}
+	if(text == NULL || read(fd, text, st.st_size) != st.st_size)
+	{
+		log_error("reading %s failed, errno: %d\n", path, errno);
+		close(fd);
+		free(text);
+		return -2;
+	}
+	close(fd);
+	text[st.st_size] = '\0';
+
+	ret = _parse_gpx(text, import);
+	free(text);
+	fail_if_negative(ret, -3, "%s is not a valid GPX route, return: %d\n", path, ret);
+
+	/* Without name the route is named after the file */
+	if(import->name[0] == '\0')
+	{
+		const char *slash = strrchr(path, '/');
+		const char *base = (slash == NULL) ? path : slash + 1;
+		const char *dot = strrchr(base, '.');
+		int length = (dot == NULL) ? (int)strlen(base) : (int)(dot - base);
+
+		snprintf(import->name, sizeof(import->name), "%.*s", length, base);
+	}
+
+	return 0;
+}
+
+/*
+ * Column encoding
+ */
+
+static int _encode_column(const int32_t *values, int count, uint8_t *buff)
+{
+	int size = 0;
+	int64_t previous = 0;
+
+	for(int i = 0; i < count; i++)
+	{
+		size += varint_put(buff + size, varint_zigzag((int64_t)values[i] - previous));
+		previous = values[i];
+	}
+
+	return size;
+}
+
+/* Return the number of bytes read */
+static int _decode_column(const uint8_t *buff, const uint8_t *end, int count, int32_t *values)
+{
+	int size = (int)(end - buff);
+	int position = 0;
+	int64_t value = 0;
+	uint64_t code = 0;
+
+	for(int i = 0; i < count; i++)
+	{
+		fail_if_false(varint_get(buff, size, &position, &code), -1, "column is truncated at point %d\n", i);
+
+		value += varint_unzigzag(code);
+		fail_if_false((value >= INT32_MIN && value <= INT32_MAX), -2, "invalid value at point %d\n", i);
+		values[i] = (int32_t)value;
+	}
+
+	return position;
+}
+
+/* Totals of the route and its cumulative distance, in cm */
+static int _measure(const T_route_import *import, T_route_store_entry *entry, int32_t *distance)
+{
+	int ret = 0;
+	T_geo_elevation elevation;
+	T_geo_points_fixed points = {.latitude = import->latitude, .longitude = import->longitude, .count = import->nb_points};
+	int64_t total = 0; /* mm */
+
+	/* The segment lengths are written after the first point, then accumulated in place */
+	ret = geo_kernel_segment_distances_fixed(&points, distance + 1);
+	fail_if_negative(ret, -1, "geo_kernel_segment_distances_fixed failed, return: %d\n", ret);
+
+	distance[0] = 0;
+	for(int i = 1; i < import->nb_points; i++)
+	{
+		total += distance[i];
+		fail_if_superior((total / 10), INT32_MAX, -2, "route is too long\n");
+		distance[i] = (int32_t)(total / 10);
+	}
+
+	ret = geo_kernel_elevation_init(&elevation, METRICS_ELEVATION_HYSTERESIS);
+	fail_if_negative(ret, -3, "geo_kernel_elevation_init failed, return: %d\n", ret);
+	ret = geo_kernel_elevation_update(&elevation, import->altitude, import->nb_points);
+	fail_if_negative(ret, -4, "geo_kernel_elevation_update failed, return: %d\n", ret);
+
+	entry->nb_points = import->nb_points;
+	entry->distance = distance[import->nb_points-1] / 100;
+	entry->elevation_gain = elevation.gain / 100;
+	entry->elevation_loss = elevation.loss / 100;
+	entry->box.min_latitude = entry->box.max_latitude = import->latitude[0];
+	entry->box.min_longitude = entry->box.max_longitude = import->longitude[0];
+	for(int i = 1; i < import->nb_points; i++)
+	{
+		entry->box.min_latitude = (import->latitude[i] < entry->box.min_latitude) ? import->latitude[i] : entry->box.min_latitude;
+		entry->box.max_latitude = (import->latitude[i] > entry->box.max_latitude) ? import->latitude[i] : entry->box.max_latitude;
+		entry->box.min_longitude = (import->longitude[i] < entry->box.min_longitude) ? import->longitude[i] : entry->box.min_longitude;
+		entry->box.max_longitude = (import->longitude[i] > entry->box.max_longitude) ? import->longitude[i] : entry->box.max_longitude;
+	}
+	safe_strncpy(entry->name, import->name, sizeof(entry->name));
+
+	return 0;
+}
+
+static int _save_route(const char *path, const T_route_store_entry *entry, const T_route_import *import, const int32_t *distance,
+	const T_route_profile *profile)
+{
+	int ret = 0;
+	const int32_t *columns[ROUTE_NB_COLUMNS] = {import->latitude, import->longitude, import->altitude, distance};
+	size_t nb_values = (size_t)import->nb_points * ROUTE_NB_COLUMNS;
+
+	for(int level = 0; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		nb_values += profile->nb_samples[level];
+	}
+
+	uint8_t *buff = malloc(nb_values * VARINT_MAX_SIZE + (size_t)profile->nb_climbs * sizeof(T_route_climb));
+	fail_if_null(buff, -1, "malloc route buffer failed\n");
+
+	int size = 0;
+	for(int i = 0; i < ROUTE_NB_COLUMNS; i++)
+	{
+		size += _encode_column(columns[i], import->nb_points, buff + size);
+	}
+	for(int level = 0; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		size += _encode_column(profile->altitude[level], profile->nb_samples[level], buff + size);
+	}
+	memcpy(buff + size, profile->climbs, profile->nb_climbs * sizeof(T_route_climb));
+	size += profile->nb_climbs * sizeof(T_route_climb);
+
+	T_route_file_header header = {.magic = ROUTE_MAGIC, .version = ROUTE_VERSION, .entry = *entry, .nb_climbs = profile->nb_climbs,
+		.size = size, .crc = crc32_compute(buff, size)};
+
+	FILE *file = fopen(path, "wb");
+	if(file == NULL)
+	{
+		log_error("fopen %s failed\n", path);
+		free(buff);
+		return -2;
+	}
+
+	if(fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(buff, size, 1, file) != 1)
+	{
+		log_error("writing %s failed\n", path);
+		ret = -3;
+	}
+
+	if(fclose(file) != 0)
+	{
+		log_error("fclose %s failed\n", path);
+		ret = -4;
+	}
+	free(buff);
+
+	return ret;
+}
+
+int route_store_import(const char *folder, const char *gpx_path, T_route_store_entry *entry)
+{
+	fail_if_null(folder, -1, "folder is null\n");
+	fail_if_null(gpx_path, -2, "gpx_path is null\n");
+	fail_if_null(entry, -3, "entry is null\n");
+
+	int ret = 0;
+	char path[ROUTE_STORE_PATH_SIZE];
+	char catalogue_path[ROUTE_STORE_PATH_SIZE] = "";
+	T_route_import import = {0};
+	T_route_store_catalogue catalogue;
+	T_route_profile profile = {0};
+	int32_t *distance = NULL;
+
+	if(mkdir(folder, 0755) < 0 && errno != EEXIST)
+	{
+		fail(-4, "mkdir %s failed, errno: %d\n", folder, errno);
+	}
+
+	ret = route_store_open(&catalogue, folder);
+	fail_if_negative(ret, -5, "route_store_open failed, return: %d\n", ret);
+
+	ret = _read_gpx(gpx_path, &import);
+	if(ret < 0)
+	{
+		log_error("_read_gpx failed, return: %d\n", ret);
+		ret = -6;
+		goto import_cleanup;
+	}
+
+	distance = malloc(import.nb_points * sizeof(int32_t));
+	if(distance == NULL)
+	{
+		log_error("malloc distances failed\n");
+		ret = -7;
+		goto import_cleanup;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->id = (catalogue.nb_routes > 0) ? catalogue.entries[catalogue.nb_routes - 1].id + 1 : 1;
+	snprintf(entry->file, sizeof(entry->file), "%06u", (unsigned int)entry->id);
+
+	ret = _measure(&import, entry, distance);
+	if(ret < 0)
+	{
+		log_error("_measure failed, return: %d\n", ret);
+		ret = -8;
+		goto import_cleanup;
+	}
+
+	ret = route_profile_build(&profile, distance, import.altitude, import.nb_points);
+	if(ret < 0)
+	{
+		log_error("route_profile_build failed, return: %d\n", ret);
+		ret = -9;
+		goto import_cleanup;
+	}
+
+	/* The route file is complete before the catalogue refers to it */
+	ret = _build_path(folder, entry->file, ROUTE_STORE_EXTENSION, path, sizeof(path));
+	if(ret < 0 || _save_route(path, entry, &import, distance, &profile) < 0)
+	{
+		log_error("saving route %s failed\n", path);
+		ret = -10;
+		goto import_cleanup;
+	}
+
+	ret = _build_path(folder, ROUTE_CATALOGUE_NAME, "", catalogue_path, sizeof(catalogue_path));
+	if(ret == 0)
+	{
+		ret = record_file_append(catalogue_path, ROUTE_CATALOGUE_MAGIC, ROUTE_CATALOGUE_VERSION, sizeof(T_route_store_entry),
+			&catalogue.file, entry);
+	}
+	if(ret < 0)
+	{
+		log_error("adding route to %s failed, return: %d\n", catalogue_path, ret);
+		remove(path);
+		ret = -11;
+		goto import_cleanup;
+	}
+
+	log_info("route %s imported: %d points, %d m, %d m of elevation gain, %d climbs\n", entry->name, (int)entry->nb_points,
+		(int)entry->distance, (int)entry->elevation_gain, profile.nb_climbs);
+	ret = 0;
+
+import_cleanup:
+	route_store_close(&catalogue);
+	route_profile_free(&profile);
+	free(distance);
+	free(import.latitude);
+	free(import.longitude);
+	free(import.altitude);
+
+	return ret;
+}
+
+int route_store_open(T_route_store_catalogue *catalogue, const char *folder)
+{
+	fail_if_null(catalogue, -1, "catalogue is null\n");
+	fail_if_null(folder, -2, "folder is null\n");
+
+	int ret = 0;
+	char path[ROUTE_STORE_PATH_SIZE];
+
+	memset(catalogue, 0, sizeof(*catalogue));
+
+	ret = _build_path(folder, ROUTE_CATALOGUE_NAME, "", path, sizeof(path));
+	fail_if_negative(ret, -3, "_build_path failed, return: %d\n", ret);
+
+	ret = record_file_open(&catalogue->file, path, ROUTE_CATALOGUE_MAGIC, ROUTE_CATALOGUE_VERSION, sizeof(T_route_store_entry));
+	fail_if_negative(ret, -4, "record_file_open failed, return: %d\n", ret);
+
+	catalogue->nb_routes = catalogue->file.nb_records;
+	catalogue->entries = catalogue->file.records;
+
+	return 0;
+}
+
+int route_store_close(T_route_store_catalogue *catalogue)
+{
+	fail_if_null(catalogue, -1, "catalogue is null\n");
+
+	record_file_close(&catalogue->file);
+	catalogue->nb_routes = 0;
+	catalogue->entries = NULL;
+
+	return 0;
+}
+
+int route_store_load(const char *folder, const T_route_store_entry *entry, T_route *route)
+{
+	fail_if_null(folder, -1, "folder is null\n");
+	fail_if_null(entry, -2, "entry is null\n");
+	fail_if_null(route, -3, "route is null\n");
+
+	int ret = 0;
+	char path[ROUTE_STORE_PATH_SIZE];
+	struct stat st;
+
+	memset(route, 0, sizeof(*route));
+
+	ret = _build_path(folder, entry->file, ROUTE_STORE_EXTENSION, path, sizeof(path));
+	fail_if_negative(ret, -4, "_build_path failed, return: %d\n", ret);
+
+	int fd = open(path, O_RDONLY);
+	fail_if_negative(fd, -5, "open %s failed, errno: %d\n", path, errno);
+
+	/* The whole file in one read */
+	uint8_t *buff = NULL;
+	if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(T_route_file_header))
+	{
+		buff = malloc(st.st_size);
+	}
+	if(buff == NULL || read(fd, buff, st.st_size) != st.st_size)
+	{
+		log_error("reading %s failed, errno: %d\n", path, errno);
+		close(fd);
+		free(buff);
+		return -6;
+	}
+	close(fd);
+
+	const T_route_file_header *header = (const T_route_file_header *)buff;
+	const uint8_t *columns = buff + sizeof(T_route_file_header);
+	if(memcmp(header->magic, ROUTE_MAGIC, sizeof(header->magic)) != 0 || header->version != ROUTE_VERSION
+	|| (off_t)header->size != st.st_size - (off_t)sizeof(T_route_file_header) || header->crc != crc32_compute(columns, header->size)
+	|| header->entry.nb_points < 2 || header->entry.nb_points > ROUTE_STORE_MAX_POINTS || header->nb_climbs > ROUTE_PROFILE_MAX_CLIMBS)
+	{
+		log_error("%s is not a valid route\n", path);
+		ret = -7;
+		goto load_cleanup;
+	}
+
+	/* The four arrays in one allocation */
+	int nb_points = header->entry.nb_points;
+	int32_t *values = malloc((size_t)nb_points * ROUTE_NB_COLUMNS * sizeof(int32_t));
+	if(values == NULL)
+	{
+		log_error("malloc route of %d points failed\n", nb_points);
+		ret = -8;
+		goto load_cleanup;
+	}
+
+	const uint8_t *p = columns;
+	const uint8_t *end = columns + header->size;
+	for(int i = 0; i < ROUTE_NB_COLUMNS; i++)
+	{
+		int size = _decode_column(p, end, nb_points, values + i * nb_points);
+		if(size < 0)
+		{
+			log_error("%s column %d is invalid, return: %d\n", path, i, size);
+			free(values);
+			ret = -9;
+			goto load_cleanup;
+		}
+		p += size;
+	}
+
+	/* The levels of the profile follow the points, the climbs are stored as is */
+	ret = route_profile_alloc(&route->profile, values[ROUTE_NB_COLUMNS * nb_points - 1], header->nb_climbs);
+	if(ret < 0)
+	{
+		log_error("route_profile_alloc failed, return: %d\n", ret);
+		free(values);
+		ret = -10;
+		goto load_cleanup;
+	}
+
+	for(int level = 0; level < ROUTE_PROFILE_LEVELS; level++)
+	{
+		int size = _decode_column(p, end, route->profile.nb_samples[level], route->profile.altitude[level]);
+		if(size < 0)
+		{
+			log_error("%s profile level %d is invalid, return: %d\n", path, level, size);
+			route_profile_free(&route->profile);
+			free(values);
+			ret = -11;
+			goto load_cleanup;
+		}
+		p += size;
+	}
+
+	if(end - p != (ptrdiff_t)(header->nb_climbs * sizeof(T_route_climb)))
+	{
+		log_error("%s climbs are invalid\n", path);
+		route_profile_free(&route->profile);
+		free(values);
+		ret = -12;
+		goto load_cleanup;
+	}
+	memcpy(route->profile.climbs, p, header->nb_climbs * sizeof(T_route_climb));
+
+	route->entry = header->entry;
+	route->nb_points = nb_points;
+	route->latitude = values;
+	route->longitude = values + nb_points;
+	route->altitude = values + 2 * nb_points;
+	route->distance = values + 3 * nb_points;
+	ret = 0;
+
+load_cleanup:
+	free(buff);
+
+	return ret;
+}
+
+int route_store_free(T_route *route)
+{
+	fail_if_null(route, -1, "route is null\n");
+
+	/* The other arrays are in the same allocation */
+	free(route->latitude);
+	route_profile_free(&route->profile);
+	memset(route, 0, sizeof(*route));
+
+	return 0;
+}
+
+/* Drop a reference, the last one frees the route, called with the mutex held */
+static void _unreference(T_route_selection *selection)
+{
+	selection->references--;
+	if(selection->references == 0)
+	{
+		route_store_free(&selection->route);
+		free(selection);
+	}
+}
+
+int route_store_select(const T_route_store_entry *entry)
+{
+	int ret = 0;
+	T_route_selection *selection = NULL;
+
+	/* Loaded before taking the mutex, the users of the current route are not held */
+	if(entry != NULL)
+	{
+		selection = malloc(sizeof(T_route_selection));
+		fail_if_null(selection, -1, "malloc selection failed\n");
+
+		ret = route_store_load(ROUTES_FOLDER_PATH, entry, &selection->route);
+		if(ret < 0)
+		{
+			log_error("route_store_load failed, return: %d\n", ret);
+			free(selection);
+			return -2;
+		}
+		selection->references = 1;
+	}
+
+	pthread_mutex_lock(&route_store.mutex);
+	if(route_store.selection != NULL)
+	{
+		_unreference(route_store.selection);
+	}
+	route_store.selection = selection;
+	pthread_mutex_unlock(&route_store.mutex);
+
+	return 0;
+}
+
+const T_route *route_store_acquire(void)
+{
+	T_route *route = NULL;
+
+	pthread_mutex_lock(&route_store.mutex);
+	if(route_store.selection != NULL)
+	{
+		route_store.selection->references++;
+		route = &route_store.selection->route;
+	}
+	pthread_mutex_unlock(&route_store.mutex);
+
+	return route;
+}
+
+int route_store_release(const T_route *route)
+{
+	fail_if_null(route, -1, "route is null\n");
+
+	pthread_mutex_lock(&route_store.mutex);
+	_unreference((T_route_selection *)route);
+	pthread_mutex_unlock(&route_store.mutex);
+
+	return 0;
+}
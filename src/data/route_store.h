@@ -0,0 +1,109 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROUTE_STORE_HEADER_
+#define _ROUTE_STORE_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "system.h"
+#include "route_profile.h"
+#include "record_file.h"
+
+/* Library of the routes to follow.
+ *
+ * A GPX route or track is imported once into a compact route file: the
+ * coordinates in 1e-7 degree, the altitudes in cm and the segment lengths in
+ * cm are stored column-wise as zigzag varints of the difference with the
+ * previous point, a few bytes per point instead of about a hundred in GPX.
+ * Loading a route is one read and one decoding pass, the cumulative distance
+ * is rebuilt from the segment lengths. The elevation profile and the climbs of
+ * the route are computed at import and stored after the points.
+ *
+ * A catalogue holds one fixed size entry per route, with the totals and the
+ * bounding box, the routes screen lists the routes with a single mmap.
+ */
+
+#define ROUTE_STORE_EXTENSION ".route"
+#define ROUTE_STORE_NAME_SIZE 48
+#define ROUTE_STORE_FILE_SIZE 16
+#define ROUTE_STORE_PATH_SIZE 128
+#define ROUTE_STORE_MAX_POINTS 1000000
+
+/* Coordinates in 1e-7 degree */
+typedef struct {
+	int32_t min_latitude;
+	int32_t min_longitude;
+	int32_t max_latitude;
+	int32_t max_longitude;
+} T_route_store_box;
+
+typedef struct {
+	uint32_t id; /* order of import, starting at 1 */
+	int32_t nb_points;
+	int32_t distance; /* m */
+	int32_t elevation_gain; /* m */
+	int32_t elevation_loss; /* m */
+	T_route_store_box box;
+	char name[ROUTE_STORE_NAME_SIZE]; /* from the GPX, the file name when it has none */
+	char file[ROUTE_STORE_FILE_SIZE]; /* route file in the folder, without extension */
+} T_route_store_entry;
+
+/* Catalogue mapped read-only */
+typedef struct {
+	T_record_file file;
+	int nb_routes;
+	const T_route_store_entry *entries;
+} T_route_store_catalogue;
+
+/* Route loaded in memory, the arrays have nb_points elements */
+typedef struct {
+	T_route_store_entry entry;
+	int nb_points;
+	int32_t *latitude; /* 1e-7 degree */
+	int32_t *longitude; /* 1e-7 degree */
+	int32_t *altitude; /* cm */
+	int32_t *distance; /* cm since the first point */
+	T_route_profile profile;
+} T_route;
+
+/* Import the track or the route of a GPX file into folder and add it to the
+ * catalogue of the folder, entry is filled with the new entry
+ */
+int route_store_import(const char *folder, const char *gpx_path, T_route_store_entry *entry);
+
+/* A missing catalogue is opened empty */
+int route_store_open(T_route_store_catalogue *catalogue, const char *folder);
+int route_store_close(T_route_store_catalogue *catalogue);
+
+/* Load the route of an entry of the catalogue, free it with route_store_free */
+int route_store_load(const char *folder, const T_route_store_entry *entry, T_route *route);
+int route_store_free(T_route *route);
+
+/* Route followed by the navigation, loaded from the catalogue of
+ * ROUTES_FOLDER_PATH, a null entry stops following a route
+ */
+int route_store_select(const T_route_store_entry *entry);
+
+/* Take a reference on the selected route, null when none is selected. The
+ * route stays valid until it is released, even when another one is selected.
+ */
+const T_route *route_store_acquire(void);
+int route_store_release(const T_route *route);
+
+#endif //_ROUTE_STORE_HEADER_
@@ -0,0 +1,238 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "log.h"
+#include "bike_config.h"
+#include "fixed_point.h"
+#include "geo_kernel.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "speed_fusion.h"
+
+#define WHEEL_VARIANCE ((int64_t)SPEED_FUSION_WHEEL_NOISE * SPEED_FUSION_WHEEL_NOISE)
+#define GPS_SPEED_VARIANCE ((int64_t)SPEED_FUSION_GPS_SPEED_NOISE * SPEED_FUSION_GPS_SPEED_NOISE)
+#define GPS_POSITION_VARIANCE ((int64_t)SPEED_FUSION_GPS_POSITION_NOISE * SPEED_FUSION_GPS_POSITION_NOISE)
+#define ACCELERATION_VARIANCE ((int64_t)SPEED_FUSION_ACCELERATION_NOISE * SPEED_FUSION_ACCELERATION_NOISE)
+
+/* Correct the estimation with a speed measurement of the given variance */
+static void _correct(T_speed_fusion *fusion, int32_t measurement, int64_t variance, bool is_gated)
+{
+	if(!fusion->has_speed)
+	{
+		fusion->speed = measurement;
+		fusion->variance = variance;
+		fusion->has_speed = true;
+		return;
+	}
+
+	int64_t innovation = (int64_t)measurement - fusion->speed;
+	int64_t innovation_variance = fusion->variance + variance;
+
+	/* GPS glitches, far from what the estimation allows */
+	if(is_gated && innovation * innovation > SPEED_FUSION_GATE * innovation_variance)
+	{
+		return;
+	}
+
+	fusion->speed += (int32_t)fixed_point_mul_div(innovation, fusion->variance, innovation_variance);
+	fusion->variance = fixed_point_mul_div(fusion->variance, variance, innovation_variance);
+}
+
+int32_t speed_fusion_wheel_speed(int32_t circumference, int32_t revolutions, int32_t previous_revolutions, int64_t elapsed)
+{
+	/* The counter wraps around */
+	int32_t delta = (int32_t)((uint32_t)revolutions - (uint32_t)previous_revolutions);
+
+	if(elapsed <= 0 || delta < 0)
+	{
+		return 0;
+	}
+
+	/* 0.001 revolution * mm / ms is mm/s */
+	return (int32_t)fixed_point_mul_div(delta, circumference, elapsed);
+}
+
+int speed_fusion_reset(T_speed_fusion *fusion, int32_t circumference)
+{
+	fail_if_null(fusion, -1, "fusion is null\n");
+	fail_if_negative_or_zero(circumference, -2, "invalid circumference %d\n", circumference);
+
+	memset(fusion, 0, sizeof(T_speed_fusion));
+	fusion->circumference = circumference;
+
+	return 0;
+}
+
+int speed_fusion_update(T_speed_fusion *fusion, const T_data_frame *frame)
+{
+	fail_if_null(fusion, -1, "fusion is null\n");
+	fail_if_null(frame, -2, "frame is null\n");
+
+	int ret = 0;
+	int64_t elapsed = frame->timestamp - fusion->timestamp;
+	bool has_wheel = data_frame_is_valid(frame, E_DATA_WHEEL_REVOLUTIONS);
+	bool has_position = data_frame_is_valid(frame, E_DATA_LATITUDE) && data_frame_is_valid(frame, E_DATA_LONGITUDE);
+
+	/* Nothing to predict from after a long hole, start again from the next measurements */
+	if(!fusion->has_previous || elapsed <= 0 || elapsed > SPEED_FUSION_MAX_GAP)
+	{
+		fusion->has_speed = false;
+		elapsed = 0;
+	}
+
+	int32_t previous_speed = fusion->speed;
+	bool had_speed = fusion->has_speed;
+
+	/* Prediction, the speed is constant and the acceleration is noise */
+	if(fusion->has_speed)
+	{
+		fusion->variance += fixed_point_mul_div(ACCELERATION_VARIANCE, elapsed * elapsed, 1000000);
+	}
+
+	/* Wheel speed is the most reliable measurement, it is not gated */
+	if(has_wheel && fusion->has_wheel && elapsed > 0)
+	{
+		_correct(fusion, speed_fusion_wheel_speed(fusion->circumference, frame->value[E_DATA_WHEEL_REVOLUTIONS], fusion->wheel_revolutions, elapsed), WHEEL_VARIANCE, false);
+	}
+
+	if(data_frame_is_valid(frame, E_DATA_GPS_SPEED))
+	{
+		_correct(fusion, frame->value[E_DATA_GPS_SPEED], GPS_SPEED_VARIANCE, true);
+	}
+
+	if(has_position && fusion->has_position && elapsed > 0)
+	{
+		int32_t latitude[2] = {fusion->latitude, frame->value[E_DATA_LATITUDE]};
+		int32_t longitude[2] = {fusion->longitude, frame->value[E_DATA_LONGITUDE]};
+		T_geo_points_fixed points = {.latitude = latitude, .longitude = longitude, .count = 2};
+		int32_t segment = 0;
+
+		ret = geo_kernel_segment_distances_fixed(&points, &segment);
+		fail_if_negative(ret, -3, "geo_kernel_segment_distances_fixed failed, return: %d\n", ret);
+
+		_correct(fusion, (int32_t)fixed_point_mul_div(segment, 1000, elapsed), GPS_POSITION_VARIANCE, true);
+	}
+
+	/* Without measurement for too long the estimation is meaningless */
+	if(fusion->has_speed && fusion->variance > SPEED_FUSION_MAX_VARIANCE)
+	{
+		fusion->has_speed = false;
+	}
+
+	if(fusion->speed < 0)
+	{
+		fusion->speed = 0;
+	}
+
+	/* Distance is the integral of the estimated speed, trapezoidal rule */
+	if(had_speed && fusion->has_speed)
+	{
+		fusion->distance += fixed_point_mul_div((int64_t)previous_speed + fusion->speed, elapsed, 2000);
+	}
+
+	fusion->has_previous = true;
+	fusion->timestamp = frame->timestamp;
+	fusion->has_wheel = has_wheel;
+	fusion->wheel_revolutions = frame->value[E_DATA_WHEEL_REVOLUTIONS];
+	fusion->has_position = has_position;
+	fusion->latitude = frame->value[E_DATA_LATITUDE];
+	fusion->longitude = frame->value[E_DATA_LONGITUDE];
+
+	return 0;
+}
+
+/*
+ * Metric giving the fused speed and the distance
+ */
+static T_speed_fusion fusion_metric;
+
+static int _fusion_update(T_data_frame *frame)
+{
+	int ret = speed_fusion_update(&fusion_metric, frame);
+	fail_if_negative(ret, -1, "speed_fusion_update failed, return: %d\n", ret);
+
+	if(fusion_metric.has_speed)
+	{
+		frame->value[E_DATA_SPEED] = fusion_metric.speed;
+		frame->valid_mask |= data_channel_bit(E_DATA_SPEED);
+	}
+	else
+	{
+		frame->valid_mask &= ~data_channel_bit(E_DATA_SPEED);
+	}
+
+	/* mm to cm */
+	frame->value[E_DATA_DISTANCE] = (int32_t)fixed_point_mul_div(fusion_metric.distance, 1, 10);
+	frame->valid_mask |= data_channel_bit(E_DATA_DISTANCE);
+
+	return 0;
+}
+
+static void _fusion_reset(void)
+{
+	speed_fusion_reset(&fusion_metric, fusion_metric.circumference);
+}
+
+/* The filter starts again from the next measurements, only the distance is kept */
+static int _fusion_save(void *buff, int size)
+{
+	fail_if_inferior(size, (int)sizeof(fusion_metric.distance), -1, "no room for the state\n");
+
+	memcpy(buff, &fusion_metric.distance, sizeof(fusion_metric.distance));
+
+	return sizeof(fusion_metric.distance);
+}
+
+static int _fusion_restore(const void *buff, int size)
+{
+	fail_if_not_equal(size, (int)sizeof(fusion_metric.distance), -1, "invalid state size %d\n", size);
+
+	memcpy(&fusion_metric.distance, buff, sizeof(fusion_metric.distance));
+
+	return 0;
+}
+
+static const T_metric speed_fusion_metric = {
+	.name = "speed fusion",
+	.inputs = data_channel_bit(E_DATA_GPS_SPEED) | data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE)
+		| data_channel_bit(E_DATA_WHEEL_REVOLUTIONS) | data_channel_bit(E_DATA_ELAPSED_TIME),
+	.outputs = data_channel_bit(E_DATA_SPEED) | data_channel_bit(E_DATA_DISTANCE),
+	.update = &_fusion_update,
+	.reset = &_fusion_reset,
+	.save = &_fusion_save,
+	.restore = &_fusion_restore,
+	.finish = NULL,
+};
+
+int speed_fusion_init(void)
+{
+	int ret = 0;
+	int wheel_size = bike_config_get_wheel_size();
+	fail_if_negative_or_zero(wheel_size, -1, "invalid wheel size %d\n", wheel_size);
+
+	ret = speed_fusion_reset(&fusion_metric, SPEED_FUSION_CIRCUMFERENCE(wheel_size));
+	fail_if_negative(ret, -2, "speed_fusion_reset failed, return: %d\n", ret);
+
+	ret = metric_registry_register(&speed_fusion_metric);
+	fail_if_negative(ret, -3, "metric_registry_register failed, return: %d\n", ret);
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPEED_FUSION_HEADER_
+#define _SPEED_FUSION_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "data_manager.h"
+
+/* Wheel circumference in mm from the wheel_size of the bike configuration,
+ * the diameter in mm, pi is 355/113
+ */
+#define SPEED_FUSION_CIRCUMFERENCE(wheel_size) ((int32_t)(((int64_t)(wheel_size) * 355 + 56) / 113))
+
+/* Noise of the model and of the measurements, standard deviations */
+#define SPEED_FUSION_ACCELERATION_NOISE 1500 /* mm/s^2 */
+#define SPEED_FUSION_WHEEL_NOISE 150 /* mm/s */
+#define SPEED_FUSION_GPS_SPEED_NOISE 500 /* mm/s */
+#define SPEED_FUSION_GPS_POSITION_NOISE 1200 /* mm/s, speed from two consecutive positions */
+#define SPEED_FUSION_GATE 9 /* measurements further than 3 sigma are rejected */
+#define SPEED_FUSION_MAX_VARIANCE (INT64_C(3000) * 3000) /* (mm/s)^2, the speed is lost beyond */
+#define SPEED_FUSION_MAX_GAP 5000 /* ms between two updates, longer holes restart the filter */
+
+/* One dimension Kalman filter on the speed, the distance is its integral */
+typedef struct {
+	int32_t circumference; /* mm */
+	bool has_previous;
+	int64_t timestamp; /* ms, previous update */
+	bool has_wheel;
+	int32_t wheel_revolutions; /* 0.001 revolution, previous value */
+	bool has_position;
+	int32_t latitude; /* 1e-7 degree, previous value */
+	int32_t longitude;
+	bool has_speed;
+	int32_t speed; /* mm/s, estimation */
+	int64_t variance; /* (mm/s)^2, variance of the estimation */
+	int64_t distance; /* mm */
+} T_speed_fusion;
+
+int speed_fusion_reset(T_speed_fusion *fusion, int32_t circumference);
+
+/* Update the estimation with the wheel revolutions, GPS speed and GPS position
+ * of a tick, each input is used when valid in the frame. Constant time.
+ */
+int speed_fusion_update(T_speed_fusion *fusion, const T_data_frame *frame);
+
+/* Wheel speed in mm/s between two values of the revolution counter */
+int32_t speed_fusion_wheel_speed(int32_t circumference, int32_t revolutions, int32_t previous_revolutions, int64_t elapsed);
+
+/* Register the fused speed and distance metric, the circumference comes from the bike configuration */
+int speed_fusion_init(void);
+
+#endif //_SPEED_FUSION_HEADER_
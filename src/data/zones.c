@@ -0,0 +1,292 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "rider_config.h"
+#include "data_manager.h"
+#include "metric_registry.h"
+#include "metrics.h"
+#include "zones.h"
+
+#define ZONES_FILE_MAGIC "OBCZ"
+#define ZONES_FILE_VERSION 1
+
+/* Header of the zones file, followed by the histograms */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t nb_types;
+} T_zones_file_header;
+
+static const E_data_channel zones_input[E_ZONES_TYPE_NUMBER] = {
+	[E_ZONES_HEART_RATE] = E_DATA_HEART_RATE,
+	[E_ZONES_POWER]      = E_DATA_POWER,
+};
+
+static const E_data_channel zones_output[E_ZONES_TYPE_NUMBER] = {
+	[E_ZONES_HEART_RATE] = E_DATA_HEART_RATE_ZONE,
+	[E_ZONES_POWER]      = E_DATA_POWER_ZONE,
+};
+
+static struct {
+	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the histograms, read by the ui */
+	bool has_previous;
+	int64_t timestamp; /* last tick accumulated, ms */
+	T_zones_histogram histogram[E_ZONES_TYPE_NUMBER];
+} zones = {
+	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Number of bounds below or equal to the value, the unused bounds are set to
+ * INT32_MAX so the loop has a fixed length and no branch
+ */
+static inline int32_t _lookup(const int32_t bound[ZONES_MAX_BOUNDS], int32_t value)
+{
+	int32_t zone = 0;
+
+	for(int i = 0; i < ZONES_MAX_BOUNDS; i++)
+	{
+		zone += (value >= bound[i]);
+	}
+
+	return zone;
+}
+
+static int _set_bounds(T_zones_histogram *histogram, const int *bounds, int nb_bounds)
+{
+	for(int i = 1; i < nb_bounds; i++)
+	{
+		fail_if_inferior_or_equal(bounds[i], bounds[i-1], -1, "zone bounds must be increasing\n");
+	}
+
+	histogram->nb_zones = nb_bounds + 1;
+	for(int i = 0; i < ZONES_MAX_BOUNDS; i++)
+	{
+		histogram->bound[i] = (i < nb_bounds) ? bounds[i] : INT32_MAX;
+	}
+
+	return 0;
+}
+
+static int _zones_update(T_data_frame *frame)
+{
+	int64_t elapsed = frame->timestamp - zones.timestamp;
+	bool is_accumulated = zones.has_previous && elapsed <= METRICS_MAX_INTEGRATION_GAP;
+
+	pthread_mutex_lock(&zones.mutex);
+
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		T_zones_histogram *histogram = &zones.histogram[i];
+
+		if(!data_frame_is_valid(frame, zones_input[i]) || histogram->nb_zones <= 1)
+		{
+			frame->valid_mask &= ~data_channel_bit(zones_output[i]);
+			continue;
+		}
+
+		int32_t zone = _lookup(histogram->bound, frame->value[zones_input[i]]);
+		if(is_accumulated)
+		{
+			histogram->time[zone] += elapsed;
+		}
+
+		frame->value[zones_output[i]] = zone + 1;
+		frame->valid_mask |= data_channel_bit(zones_output[i]);
+	}
+
+	pthread_mutex_unlock(&zones.mutex);
+
+	zones.has_previous = true;
+	zones.timestamp = frame->timestamp;
+
+	return 0;
+}
+
+static void _zones_reset(void)
+{
+	pthread_mutex_lock(&zones.mutex);
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		memset(zones.histogram[i].time, 0, sizeof(zones.histogram[i].time));
+	}
+	pthread_mutex_unlock(&zones.mutex);
+
+	zones.has_previous = false;
+}
+
+/* Only the times are saved, the bounds come from the rider configuration */
+static int _zones_save(void *buff, int size)
+{
+	int64_t *time = buff;
+	const int count = E_ZONES_TYPE_NUMBER * ZONES_MAX_ZONES;
+	fail_if_inferior(size, count * (int)sizeof(int64_t), -1, "no room for the state\n");
+
+	pthread_mutex_lock(&zones.mutex);
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		memcpy(&time[i * ZONES_MAX_ZONES], zones.histogram[i].time, sizeof(zones.histogram[i].time));
+	}
+	pthread_mutex_unlock(&zones.mutex);
+
+	return count * sizeof(int64_t);
+}
+
+static int _zones_restore(const void *buff, int size)
+{
+	const int64_t *time = buff;
+	const int count = E_ZONES_TYPE_NUMBER * ZONES_MAX_ZONES;
+	fail_if_not_equal(size, count * (int)sizeof(int64_t), -1, "invalid state size %d\n", size);
+
+	pthread_mutex_lock(&zones.mutex);
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		memcpy(zones.histogram[i].time, &time[i * ZONES_MAX_ZONES], sizeof(zones.histogram[i].time));
+	}
+	pthread_mutex_unlock(&zones.mutex);
+
+	return 0;
+}
+
+static const T_metric zones_metric = {
+	.name = "zones",
+	.inputs = data_channel_bit(E_DATA_HEART_RATE) | data_channel_bit(E_DATA_POWER) | data_channel_bit(E_DATA_ELAPSED_TIME),
+	.outputs = data_channel_bit(E_DATA_HEART_RATE_ZONE) | data_channel_bit(E_DATA_POWER_ZONE),
+	.update = &_zones_update,
+	.reset = &_zones_reset,
+	.save = &_zones_save,
+	.restore = &_zones_restore,
+	.finish = NULL,
+};
+
+int zones_init(void)
+{
+	fail_if_true(zones.is_initialized, -1, "zones is already initialized\n");
+
+	int ret = 0;
+	int bounds[ZONES_MAX_BOUNDS];
+
+	ret = rider_config_get_hr_zones(bounds, ZONES_MAX_BOUNDS);
+	fail_if_negative(ret, -2, "rider_config_get_hr_zones failed, return: %d\n", ret);
+	ret = _set_bounds(&zones.histogram[E_ZONES_HEART_RATE], bounds, ret);
+	fail_if_negative(ret, -3, "invalid heart rate zones\n");
+
+	ret = rider_config_get_power_zones(bounds, ZONES_MAX_BOUNDS);
+	fail_if_negative(ret, -4, "rider_config_get_power_zones failed, return: %d\n", ret);
+	ret = _set_bounds(&zones.histogram[E_ZONES_POWER], bounds, ret);
+	fail_if_negative(ret, -5, "invalid power zones\n");
+
+	ret = metric_registry_register(&zones_metric);
+	fail_if_negative(ret, -6, "metric_registry_register failed, return: %d\n", ret);
+
+	_zones_reset();
+
+	zones.is_initialized = true;
+
+	return 0;
+}
+
+int zones_get_histogram(E_zones_type type, T_zones_histogram *histogram)
+{
+	fail_if_false(zones.is_initialized, -1, "zones is not initialized\n");
+	fail_if_negative(type, -2, "invalid zones type %d\n", type);
+	fail_if_superior_or_equal(type, E_ZONES_TYPE_NUMBER, -3, "invalid zones type %d\n", type);
+	fail_if_null(histogram, -4, "histogram is null\n");
+
+	pthread_mutex_lock(&zones.mutex);
+	*histogram = zones.histogram[type];
+	pthread_mutex_unlock(&zones.mutex);
+
+	return 0;
+}
+
+int zones_save(const char *path)
+{
+	fail_if_false(zones.is_initialized, -1, "zones is not initialized\n");
+	fail_if_null(path, -2, "path is null\n");
+
+	int ret = 0;
+	T_zones_histogram histogram[E_ZONES_TYPE_NUMBER];
+	T_zones_file_header header = {.magic = ZONES_FILE_MAGIC, .version = ZONES_FILE_VERSION, .nb_types = E_ZONES_TYPE_NUMBER};
+
+	pthread_mutex_lock(&zones.mutex);
+	memcpy(histogram, zones.histogram, sizeof(histogram));
+	pthread_mutex_unlock(&zones.mutex);
+
+	FILE *file = fopen(path, "wb");
+	fail_if_null(file, -3, "fopen %s failed\n", path);
+
+	if(fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(histogram, sizeof(histogram), 1, file) != 1)
+	{
+		log_error("writing %s failed\n", path);
+		ret = -4;
+	}
+
+	if(fclose(file) != 0)
+	{
+		log_error("fclose %s failed\n", path);
+		ret = -5;
+	}
+
+	return ret;
+}
+
+int zones_load(const char *path, T_zones_histogram histogram[E_ZONES_TYPE_NUMBER])
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(histogram, -2, "histogram is null\n");
+
+	int ret = 0;
+	T_zones_file_header header;
+
+	FILE *file = fopen(path, "rb");
+	fail_if_null(file, -3, "fopen %s failed\n", path);
+
+	if(fread(&header, sizeof(header), 1, file) != 1)
+	{
+		log_error("reading %s header failed\n", path);
+		ret = -4;
+		goto load_cleanup;
+	}
+
+	if(memcmp(header.magic, ZONES_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != ZONES_FILE_VERSION || header.nb_types != E_ZONES_TYPE_NUMBER)
+	{
+		log_error("%s is not a valid zones file\n", path);
+		ret = -5;
+		goto load_cleanup;
+	}
+
+	if(fread(histogram, sizeof(T_zones_histogram), E_ZONES_TYPE_NUMBER, file) != E_ZONES_TYPE_NUMBER)
+	{
+		log_error("reading %s histograms failed\n", path);
+		ret = -6;
+		goto load_cleanup;
+	}
+
+load_cleanup:
+	fclose(file);
+
+	return ret;
+}
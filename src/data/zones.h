@@ -0,0 +1,53 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ZONES_HEADER_
+#define _ZONES_HEADER_
+
+#include <stdint.h>
+#include "common_config.h"
+
+#define ZONES_MAX_BOUNDS CONFIG_MAX_ZONE_BOUNDS
+#define ZONES_MAX_ZONES (ZONES_MAX_BOUNDS + 1)
+
+typedef enum {
+	E_ZONES_HEART_RATE = 0,
+	E_ZONES_POWER,
+	E_ZONES_TYPE_NUMBER, // must be last
+} E_zones_type;
+
+/* Time spent in each zone, zone 0 being below the first bound */
+typedef struct {
+	int32_t nb_zones;
+	int32_t bound[ZONES_MAX_BOUNDS]; /* lower bound of the zones 1 to nb_zones - 1 */
+	int64_t time[ZONES_MAX_ZONES]; /* ms */
+} T_zones_histogram;
+
+/* Load the zone bounds from the rider configuration and register the zones metric,
+ * the histograms are accumulated while the zone channels have a consumer
+ */
+int zones_init(void);
+
+/* Copy the histogram accumulated since the start of the ride */
+int zones_get_histogram(E_zones_type type, T_zones_histogram *histogram);
+
+/* Write and read back all the histograms of a ride */
+int zones_save(const char *path);
+int zones_load(const char *path, T_zones_histogram histogram[E_ZONES_TYPE_NUMBER]);
+
+#endif //_ZONES_HEADER_
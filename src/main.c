@@ -21,6 +21,8 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "version.h"
 #include "ui.h"
 #include "log.h"
@@ -30,6 +32,9 @@
 #include "obc_config.h"
 #include "system.h"
 #include "locales.h"
+#include "benchmark.h"
+#include "ride_export.h"
+#include "route_store.h"
 
 static void _print_help(void)
 {
@@ -43,6 +48,12 @@ static void _print_help(void)
 	printf("  -w, --screen_w <resolution X>: Set screen horizontal resolution\n");
 	printf("  -h, --screen_h <resolution Y>: Set screen vertical resolution\n");
 	printf("  -r, --rotation <angle>: rotation angle of the screen, possible value 0, 90, 180 or 270\n");
+	printf("  -B, --benchmark: run the data path benchmarks and exit\n");
+	printf("  -e, --export <ride log>: export the ride to the --output file and exit\n");
+	printf("  -o, --output <file>: export file, the format is given by the extension .gpx, .tcx or .fit\n");
+	printf("  -f, --from <s>: export from this time since the start of the ride, .gpx and .tcx only\n");
+	printf("  -t, --to <s>: export up to this time since the start of the ride, .gpx and .tcx only\n");
+	printf("  -i, --import_route <file>: import a .gpx route in the route library and exit\n");
 }
 
 static void _print_version(void)
@@ -54,6 +65,61 @@ static void _print_version(void)
 	);
 }
 
+static int64_t _get_file_size(const char *path)
+{
+	struct stat st;
+
+	if(stat(path, &st) < 0)
+	{
+		return 0;
+	}
+
+	return st.st_size;
+}
+
+/* Headless export, the throughput is printed to benchmark the exporters */
+static int _export_ride(const char *log_path, const char *output_path, int64_t from, int64_t to)
+{
+	int ret = 0;
+	struct timespec start, end;
+
+	fail_if_null(output_path, -1, "no output file, use --output\n");
+
+	int format = ride_export_get_format(output_path);
+	fail_if_negative(format, -2, "ride_export_get_format failed, return: %d\n", format);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = ride_export(log_path, output_path, format, from, to);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fail_if_negative(ret, -3, "ride_export failed, return: %d\n", ret);
+
+	double duration = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	int64_t input_size = _get_file_size(log_path);
+	int64_t output_size = _get_file_size(output_path);
+
+	printf("%s: %lld bytes\n", log_path, (long long)input_size);
+	printf("%s: %lld bytes\n", output_path, (long long)output_size);
+	printf("time: %.3f ms, %.1f MB/s written, %.1f MB/s read\n", duration * 1e3,
+		output_size / duration / 1e6, input_size / duration / 1e6);
+
+	return 0;
+}
+
+/* Headless import, the routes screen lists the library */
+static int _import_route(const char *gpx_path)
+{
+	int ret = 0;
+	T_route_store_entry entry;
+
+	ret = route_store_import(ROUTES_FOLDER_PATH, gpx_path, &entry);
+	fail_if_negative(ret, -1, "route_store_import failed, return: %d\n", ret);
+
+	printf("%s: route %u, %d points, %d.%d km, %d m of elevation gain\n", entry.name, (unsigned int)entry.id,
+		(int)entry.nb_points, (int)(entry.distance / 1000), (int)(entry.distance / 100 % 10), (int)entry.elevation_gain);
+
+	return 0;
+}
+
 #define SIM_STRING_SIZE 64
 int main(int argc, char **argv)
 {
@@ -64,6 +130,10 @@ int main(int argc, char **argv)
 	int resolution_hor = SCREEN_HOR_SIZE;
 	int resolution_ver = SCREEN_VER_SIZE;
 	int screen_rotation = SCREEN_ROTATION;
+	char *export_file = NULL;
+	char *output_file = NULL;
+	int64_t export_from = 0;
+	int64_t export_to = RIDE_READER_END;
 
 	/* Disable getopt error output */
 	opterr = 0;
@@ -77,11 +147,17 @@ int main(int argc, char **argv)
 			{"screen_w",   required_argument, 0, 'a'},
 			{"screen_h",   required_argument, 0, 'b'},
 			{"rotation",   required_argument, 0, 'c'},
+			{"benchmark",  no_argument,       0, 'B'},
+			{"export",     required_argument, 0, 'e'},
+			{"output",     required_argument, 0, 'o'},
+			{"from",       required_argument, 0, 'f'},
+			{"to",         required_argument, 0, 't'},
+			{"import_route", required_argument, 0, 'i'},
 			{0, 0, 0, 0}
 		};
 
 		/* Parse application arguments to get the options */
-		c = getopt_long(argc, argv, "hvs:a:b:c:", long_options, NULL);
+		c = getopt_long(argc, argv, "hvs:a:b:c:Be:o:f:t:i:", long_options, NULL);
 
 		/* Detect the end of the options. */
 		if(c == -1)
@@ -116,6 +192,31 @@ int main(int argc, char **argv)
 				screen_rotation = atoi(optarg);
 				break;
 
+			case 'B':
+				/* Run the benchmarks and exit */
+				ret = benchmark_run();
+				exit(ret < 0 ? -1 : 0);
+				break;
+
+			case 'e':
+				export_file = optarg;
+				break;
+			case 'o':
+				output_file = optarg;
+				break;
+			case 'f':
+				export_from = (int64_t)atoi(optarg) * 1000;
+				break;
+			case 't':
+				export_to = (int64_t)atoi(optarg) * 1000;
+				break;
+
+			case 'i':
+				/* Import the route and exit */
+				ret = _import_route(optarg);
+				exit(ret < 0 ? -1 : 0);
+				break;
+
 			case '?':
 			default:
 				/* Option error */
@@ -125,6 +226,13 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* Export the ride without the configuration and the ui, then exit */
+	if(export_file != NULL)
+	{
+		ret = _export_ride(export_file, output_file, export_from, export_to);
+		exit(ret < 0 ? -1 : 0);
+	}
+
 	/* Init all configuration system, bike, rider and user */
 	ret = obc_config_init();
 	fail_if_negative(ret, -1, "obc_config_init failed, return: %d\n", ret);
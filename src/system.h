@@ -32,4 +32,10 @@
 #define BIKE_CONF_FILE_PATH "./config/bike.conf"
 #define USER_CONF_FILE_PATH "./config/user.conf"
 
+/* Recorded rides */
+#define RIDES_FOLDER_PATH "./rides"
+
+/* Imported routes */
+#define ROUTES_FOLDER_PATH "./routes"
+
 #endif //_SYSTEM_HEADER_
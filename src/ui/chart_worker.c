@@ -0,0 +1,313 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <lvgl.h>
+
+#include "log.h"
+#include "fixed_point.h"
+#include "ride_reader.h"
+#include "ui.h"
+#include "chart_worker.h"
+
+#define SMOOTHED_FRACTION_BITS 8 /* fractional bits of the smoothed values */
+#define WEIGHT_FRACTION_BITS 16 /* fractional bits of the smoothing weight */
+
+static struct {
+	bool is_initialized;
+	pthread_mutex_t mutex; /* protect the pending request and the generation */
+	pthread_cond_t posted; /* a request was posted */
+	pthread_t thread;
+	bool has_request;
+	T_chart_worker_request request; /* latest request not started yet */
+	uint32_t generation; /* incremented by each request and cancel, a result of an older generation is dropped */
+	T_chart_worker_result result; /* written by the worker thread only */
+} chart_worker = {
+	.is_initialized = false,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.posted = PTHREAD_COND_INITIALIZER,
+};
+
+int32_t chart_worker_to_display(E_data_channel channel, int32_t value)
+{
+	switch(channel)
+	{
+		case E_DATA_GPS_SPEED:
+		case E_DATA_SPEED:
+		case E_DATA_AVERAGE_SPEED:
+			/* mm/s to 0.1 km/h */
+			return (int32_t)(((int64_t)value * 36) / 1000);
+		case E_DATA_ALTITUDE:
+		case E_DATA_DISTANCE:
+		case E_DATA_ELEVATION_GAIN:
+		case E_DATA_CLIMB_GAIN:
+		case E_DATA_CLIMB_DISTANCE:
+			/* cm to m */
+			return value / 100;
+		default:
+			return value;
+	}
+}
+
+/* Time of the last frame, the end of the ride is found from the last entry of the index */
+static int _get_end(const T_ride_reader *reader, T_ride_reader_iterator *iterator, int64_t *end)
+{
+	T_data_frame frame;
+	int64_t start = 0;
+
+	if(reader->nb_entries > 0)
+	{
+		start = reader->index[reader->nb_entries - 1].time - reader->start_time;
+	}
+
+	int ret = ride_reader_iterate(reader, start, RIDE_READER_END, iterator);
+	fail_if_negative(ret, -1, "ride_reader_iterate failed, return: %d\n", ret);
+
+	*end = start;
+	while((ret = ride_reader_next(iterator, &frame)) > 0)
+	{
+		*end = frame.timestamp + iterator->clock_offset - reader->start_time + 1;
+	}
+	fail_if_negative(ret, -2, "ride_reader_next failed, return: %d\n", ret);
+
+	return 0;
+}
+
+/* Read the range once, each point is the mean of the smoothed values of its
+ * time bucket, in fixed point like the rest of the data path
+ */
+static int _prepare(const T_chart_worker_request *request, T_chart_worker_result *result)
+{
+	int ret = 0;
+	T_ride_reader reader;
+	T_ride_reader_iterator iterator;
+	T_data_frame frame;
+	int64_t smoothed[CHART_WORKER_MAX_SERIES];
+	bool has_smoothed[CHART_WORKER_MAX_SERIES] = {false};
+	int64_t sum[CHART_WORKER_MAX_SERIES] = {0};
+	int32_t count[CHART_WORKER_MAX_SERIES] = {0};
+	int64_t last_time = 0;
+	int bucket = 0;
+
+	ret = ride_reader_open(&reader, request->log_path, (request->index_path[0] != '\0') ? request->index_path : NULL);
+	fail_if_negative(ret, -1, "ride_reader_open failed, return: %d\n", ret);
+
+	result->nb_series = request->nb_series;
+	result->nb_points = request->nb_points;
+	result->start = request->start;
+	result->end = request->end;
+	if(result->end == RIDE_READER_END)
+	{
+		ret = _get_end(&reader, &iterator, &result->end);
+		if(ret < 0)
+		{
+			log_error("_get_end failed, return: %d\n", ret);
+			ret = -2;
+			goto prepare_cleanup;
+		}
+	}
+	if(result->end <= result->start)
+	{
+		log_error("range %lld to %lld is empty\n", (long long)result->start, (long long)result->end);
+		ret = -3;
+		goto prepare_cleanup;
+	}
+
+	for(int i = 0; i < result->nb_series; i++)
+	{
+		result->channel[i] = request->channel[i];
+		result->min[i] = INT32_MAX;
+		result->max[i] = INT32_MIN;
+		for(int j = 0; j < result->nb_points; j++)
+		{
+			result->value[i][j] = LV_CHART_POINT_NONE;
+		}
+	}
+
+	int64_t span = result->end - result->start;
+
+	ret = ride_reader_iterate(&reader, result->start, result->end, &iterator);
+	if(ret < 0)
+	{
+		log_error("ride_reader_iterate failed, return: %d\n", ret);
+		ret = -4;
+		goto prepare_cleanup;
+	}
+
+	while((ret = ride_reader_next(&iterator, &frame)) > 0)
+	{
+		int64_t time = frame.timestamp + iterator.clock_offset - reader.start_time;
+		int next = (int)(((time - result->start) * result->nb_points) / span);
+		next = (next >= result->nb_points) ? result->nb_points - 1 : next;
+
+		for(int i = 0; i < result->nb_series; i++)
+		{
+			E_data_channel channel = result->channel[i];
+
+			/* The bucket is closed before the frame of the next one is added */
+			if(next != bucket && count[i] > 0)
+			{
+				int32_t value = chart_worker_to_display(channel, (int32_t)fixed_point_mul_div(sum[i], 1, (int64_t)count[i] << SMOOTHED_FRACTION_BITS));
+				result->value[i][bucket] = value;
+				result->min[i] = (value < result->min[i]) ? value : result->min[i];
+				result->max[i] = (value > result->max[i]) ? value : result->max[i];
+				sum[i] = 0;
+				count[i] = 0;
+			}
+
+			if(!data_frame_is_valid(&frame, channel))
+			{
+				/* The smoothing starts again after a gap */
+				has_smoothed[i] = false;
+				continue;
+			}
+
+			/* Exponential moving average, the weight depends on the time since the last frame */
+			int64_t value = (int64_t)frame.value[channel] << SMOOTHED_FRACTION_BITS;
+			if(has_smoothed[i] && request->smoothing > 0)
+			{
+				int64_t dt = time - last_time;
+				int64_t weight = fixed_point_mul_div(dt, INT64_C(1) << WEIGHT_FRACTION_BITS, request->smoothing + dt);
+				smoothed[i] += fixed_point_mul_div(value - smoothed[i], weight, INT64_C(1) << WEIGHT_FRACTION_BITS);
+			}
+			else
+			{
+				smoothed[i] = value;
+			}
+			has_smoothed[i] = true;
+			sum[i] += smoothed[i];
+			count[i]++;
+		}
+		bucket = next;
+		last_time = time;
+	}
+	if(ret < 0)
+	{
+		log_error("ride_reader_next failed, return: %d\n", ret);
+		ret = -5;
+		goto prepare_cleanup;
+	}
+
+	for(int i = 0; i < result->nb_series; i++)
+	{
+		if(count[i] > 0)
+		{
+			int32_t value = chart_worker_to_display(result->channel[i], (int32_t)fixed_point_mul_div(sum[i], 1, (int64_t)count[i] << SMOOTHED_FRACTION_BITS));
+			result->value[i][bucket] = value;
+			result->min[i] = (value < result->min[i]) ? value : result->min[i];
+			result->max[i] = (value > result->max[i]) ? value : result->max[i];
+		}
+	}
+	ret = 0;
+
+prepare_cleanup:
+	ride_reader_close(&reader);
+
+	return ret;
+}
+
+static void * worker_thread_handler(void *data)
+{
+	int ret = 0;
+	T_chart_worker_request request;
+	uint32_t generation = 0;
+
+	while(1)
+	{
+		pthread_mutex_lock(&chart_worker.mutex);
+		while(!chart_worker.has_request)
+		{
+			pthread_cond_wait(&chart_worker.posted, &chart_worker.mutex);
+		}
+		request = chart_worker.request;
+		generation = chart_worker.generation;
+		chart_worker.has_request = false;
+		pthread_mutex_unlock(&chart_worker.mutex);
+
+		ret = _prepare(&request, &chart_worker.result);
+		if(ret < 0)
+		{
+			log_error("_prepare failed for %s, return: %d\n", request.log_path, ret);
+			continue;
+		}
+
+		/* The LVGL lock is only held to hand the arrays over, a request or a
+		 * cancel posted meanwhile drops the result
+		 */
+		ui_lock();
+		pthread_mutex_lock(&chart_worker.mutex);
+		bool is_current = (generation == chart_worker.generation);
+		pthread_mutex_unlock(&chart_worker.mutex);
+		if(is_current)
+		{
+			request.done(&chart_worker.result, request.user_data);
+		}
+		ui_unlock();
+	}
+
+	return NULL;
+}
+
+int chart_worker_init(void)
+{
+	fail_if_true(chart_worker.is_initialized, -1, "chart_worker is already initialized\n");
+
+	int ret = pthread_create(&chart_worker.thread, NULL, &worker_thread_handler, NULL);
+	fail_if_not_zero(ret, -2, "Create chart worker thread failed, return: %d\n", ret);
+
+	chart_worker.is_initialized = true;
+
+	return 0;
+}
+
+int chart_worker_request(const T_chart_worker_request *request)
+{
+	fail_if_false(chart_worker.is_initialized, -1, "chart_worker is not initialized\n");
+	fail_if_null(request, -2, "request is null\n");
+	fail_if_null(request->done, -3, "done callback is null\n");
+	fail_if_false((request->nb_series > 0 && request->nb_series <= CHART_WORKER_MAX_SERIES), -4,
+		"invalid number of series: %d\n", request->nb_series);
+	fail_if_false((request->nb_points > 1 && request->nb_points <= CHART_WORKER_MAX_POINTS), -5,
+		"invalid number of points: %d\n", request->nb_points);
+	fail_if_negative(request->start, -6, "invalid start: %lld\n", (long long)request->start);
+	fail_if_false((request->end > request->start), -7, "range is empty\n");
+
+	pthread_mutex_lock(&chart_worker.mutex);
+	chart_worker.request = *request;
+	chart_worker.has_request = true;
+	chart_worker.generation++;
+	pthread_cond_signal(&chart_worker.posted);
+	pthread_mutex_unlock(&chart_worker.mutex);
+
+	return 0;
+}
+
+int chart_worker_cancel(void)
+{
+	fail_if_false(chart_worker.is_initialized, -1, "chart_worker is not initialized\n");
+
+	pthread_mutex_lock(&chart_worker.mutex);
+	chart_worker.has_request = false;
+	chart_worker.generation++;
+	pthread_mutex_unlock(&chart_worker.mutex);
+
+	return 0;
+}
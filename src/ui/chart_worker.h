@@ -0,0 +1,85 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CHART_WORKER_HEADER_
+#define _CHART_WORKER_HEADER_
+
+#include <stdint.h>
+#include "data_manager.h"
+#include "ride_reader.h"
+
+/* Chart series of a recorded ride prepared in a background thread.
+ *
+ * Reading a long ride, smoothing and decimating its samples takes too long
+ * for a screen handler, which runs with the LVGL lock held. A screen posts a
+ * request, the worker reads the time range from the ride log and fills
+ * arrays ready for lv_chart, then calls the done callback with the LVGL lock
+ * held, the callback only copies the arrays into the chart.
+ *
+ * There is one request at a time: a new request replaces the pending one and
+ * the result of the request being prepared is dropped.
+ */
+
+#define CHART_WORKER_MAX_SERIES 4
+#define CHART_WORKER_MAX_POINTS 480 /* one point per pixel of the widest chart */
+#define CHART_WORKER_PATH_SIZE 128
+
+typedef struct {
+	int nb_series;
+	int nb_points;
+	int64_t start; /* ms since the start of the ride */
+	int64_t end;
+	E_data_channel channel[CHART_WORKER_MAX_SERIES];
+	int32_t min[CHART_WORKER_MAX_SERIES]; /* display unit, for the chart range */
+	int32_t max[CHART_WORKER_MAX_SERIES];
+	int32_t value[CHART_WORKER_MAX_SERIES][CHART_WORKER_MAX_POINTS]; /* LV_CHART_POINT_NONE without sample */
+} T_chart_worker_result;
+
+/* Called with the LVGL lock held, the result is only valid during the call */
+typedef void (*T_chart_worker_done)(const T_chart_worker_result *result, void *user_data);
+
+typedef struct {
+	char log_path[CHART_WORKER_PATH_SIZE];
+	char index_path[CHART_WORKER_PATH_SIZE]; /* empty to build the index without saving it */
+	int64_t start; /* ms since the start of the ride */
+	int64_t end; /* RIDE_READER_END up to the last frame */
+	int nb_points; /* evenly spaced in time */
+	int nb_series;
+	E_data_channel channel[CHART_WORKER_MAX_SERIES];
+	int32_t smoothing; /* ms, time constant of the smoothing, 0 for none */
+	T_chart_worker_done done;
+	void *user_data;
+} T_chart_worker_request;
+
+int chart_worker_init(void);
+
+/* Post a request, it replaces the one not started yet */
+int chart_worker_request(const T_chart_worker_request *request);
+
+/* Drop the pending request and the result being prepared, called with the
+ * LVGL lock held when the chart is deleted, the done callback is not called
+ * afterwards
+ */
+int chart_worker_cancel(void);
+
+/* Value of a channel in the unit shown on the charts: km/h and % with one
+ * decimal, meters, the other channels are left as is
+ */
+int32_t chart_worker_to_display(E_data_channel channel, int32_t value);
+
+#endif //_CHART_WORKER_HEADER_
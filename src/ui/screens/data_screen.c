@@ -24,14 +24,270 @@
 #include "log.h"
 #include "system.h"
 #include "data_screen.h"
+#include "data_manager.h"
+#include "ride_history.h"
+#include "chart_worker.h"
+#include "fixed_point.h"
+#include "locales.h"
+#include "styles.h"
 #include "ui.h"
 
+#define FIELD_VALUE_STR_SIZE 16
+#define FIELD_WIDTH_PCT 50
+#define FIELD_HEIGHT_PCT 25
+#define CHART_HEIGHT 120
+#define CHART_POINTS 120 /* points of the whole ride, whatever its length */
+#define CHART_PERIOD 5000 /* ms between two updates of the chart */
+
+typedef enum {
+	E_DATA_FIELD_SPEED = 0,
+	E_DATA_FIELD_HEART_RATE,
+	E_DATA_FIELD_POWER,
+	E_DATA_FIELD_CADENCE,
+	E_DATA_FIELD_ALTITUDE,
+	E_DATA_FIELD_TEMPERATURE,
+	E_DATA_FIELD_DISTANCE,
+	E_DATA_FIELD_ELEVATION_GAIN,
+	E_DATA_FIELD_CLIMB_GAIN,
+	E_DATA_FIELD_CLIMB_GRADE,
+	E_DATA_FIELD_NUMBER, // must be last
+} E_data_field_id;
+
+typedef struct {
+	/* Elements set during screen creation */
+	lv_obj_t *container;
+	lv_obj_t *name;
+	lv_obj_t *value;
+	lv_subject_t subject;
+	int subscription_id;
+
+	/* Elements set statically, DO NOT CHANGE */
+	E_data_channel channel;
+	T_fixed_point_ratio ratio; /* channel unit to display unit */
+	int decimals; /* display precision */
+	char *unit;
+} T_data_field;
+
+static struct {
+	T_data_field field_array[E_DATA_FIELD_NUMBER];
+	lv_obj_t *altitude_chart;
+	lv_chart_series_t *altitude_series;
+	lv_timer_t *chart_timer; /* null when the chart is not shown */
+} data_screen = {
+	/* ratio converts the channel unit to the display unit with its decimals */
+	.field_array[E_DATA_FIELD_SPEED]          = {.channel = E_DATA_SPEED,          .ratio = {36, 1000}, .decimals = 1, .unit = "km/h"},
+	.field_array[E_DATA_FIELD_HEART_RATE]     = {.channel = E_DATA_HEART_RATE,     .ratio = {1, 1},     .decimals = 0, .unit = "bpm"},
+	.field_array[E_DATA_FIELD_POWER]          = {.channel = E_DATA_POWER,          .ratio = {1, 1},     .decimals = 0, .unit = "W"},
+	.field_array[E_DATA_FIELD_CADENCE]        = {.channel = E_DATA_CADENCE,        .ratio = {1, 1},     .decimals = 0, .unit = "rpm"},
+	.field_array[E_DATA_FIELD_ALTITUDE]       = {.channel = E_DATA_ALTITUDE,       .ratio = {1, 100},   .decimals = 0, .unit = "m"},
+	.field_array[E_DATA_FIELD_TEMPERATURE]    = {.channel = E_DATA_TEMPERATURE,    .ratio = {1, 1},     .decimals = 1, .unit = "°C"},
+	.field_array[E_DATA_FIELD_DISTANCE]       = {.channel = E_DATA_DISTANCE,       .ratio = {1, 1000},  .decimals = 2, .unit = "km"},
+	.field_array[E_DATA_FIELD_ELEVATION_GAIN] = {.channel = E_DATA_ELEVATION_GAIN, .ratio = {1, 100},   .decimals = 0, .unit = "m"},
+	.field_array[E_DATA_FIELD_CLIMB_GAIN]     = {.channel = E_DATA_CLIMB_GAIN,     .ratio = {1, 100},   .decimals = 0, .unit = "m"},
+	.field_array[E_DATA_FIELD_CLIMB_GRADE]    = {.channel = E_DATA_CLIMB_GRADE,    .ratio = {1, 1},     .decimals = 1, .unit = "%"},
+};
+
+static const char *_get_field_name(E_data_field_id field_id)
+{
+	switch(field_id)
+	{
+		case E_DATA_FIELD_SPEED:
+			return _("Speed");
+			break;
+		case E_DATA_FIELD_HEART_RATE:
+			return _("Heart rate");
+			break;
+		case E_DATA_FIELD_POWER:
+			return _("Power");
+			break;
+		case E_DATA_FIELD_CADENCE:
+			return _("Cadence");
+			break;
+		case E_DATA_FIELD_ALTITUDE:
+			return _("Altitude");
+			break;
+		case E_DATA_FIELD_TEMPERATURE:
+			return _("Temperature");
+			break;
+		case E_DATA_FIELD_DISTANCE:
+			return _("Distance");
+			break;
+		case E_DATA_FIELD_ELEVATION_GAIN:
+			return _("Elevation gain");
+			break;
+		case E_DATA_FIELD_CLIMB_GAIN:
+			return _("Climb gain");
+			break;
+		case E_DATA_FIELD_CLIMB_GRADE:
+			return _("Climb grade");
+			break;
+		default:
+			/* No translation */
+			return "id_invalid";
+			break;
+	};
+}
+
+/* Observer called only when the subscribed value changed */
+static void _value_observer_cb(lv_observer_t *observer, lv_subject_t *subject)
+{
+	lv_obj_t *label = lv_observer_get_target(observer);
+	T_data_field *field = lv_observer_get_user_data(observer);
+	int32_t value = lv_subject_get_int(subject);
+	char str[FIELD_VALUE_STR_SIZE];
+
+	if(value == DATA_MANAGER_NO_VALUE)
+	{
+		lv_label_set_text_fmt(label, "-- %s", field->unit);
+		return;
+	}
+
+	fixed_point_format(str, sizeof(str), value, field->decimals);
+	lv_label_set_text_fmt(label, "%s %s", str, field->unit);
+}
+
+/* Altitude since the start of the ride from the history tiers, the cost does
+ * not depend on the length of the ride
+ */
+static void _chart_timer_handler(lv_timer_t *timer)
+{
+	(void)timer;
+	T_ride_history_point point[CHART_POINTS];
+	int32_t min = INT32_MAX;
+	int32_t max = INT32_MIN;
+
+	int count = ride_history_get(E_DATA_ALTITUDE, 0, INT32_MAX, point, CHART_POINTS);
+	if(count < 2)
+	{
+		return;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		point[i].value = chart_worker_to_display(E_DATA_ALTITUDE, point[i].value);
+		min = (point[i].value < min) ? point[i].value : min;
+		max = (point[i].value > max) ? point[i].value : max;
+	}
+
+	lv_obj_t *chart = data_screen.altitude_chart;
+	lv_chart_set_point_count(chart, count);
+	lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, min, (max > min) ? max : min + 1);
+	for(int i = 0; i < count; i++)
+	{
+		lv_chart_set_value_by_id(chart, data_screen.altitude_series, i, point[i].value);
+	}
+	lv_chart_refresh(chart);
+}
+
+static void _altitude_chart_deleted(lv_event_t *e)
+{
+	/* Deleted with the LVGL lock held, the timer does not fire on the freed chart */
+	if(data_screen.chart_timer != NULL)
+	{
+		lv_timer_del(data_screen.chart_timer);
+		data_screen.chart_timer = NULL;
+	}
+	data_screen.altitude_chart = NULL;
+}
+
+static void _create_altitude_chart(lv_obj_t *screen)
+{
+	lv_obj_t *chart = lv_chart_create(screen);
+	lv_obj_set_size(chart, lv_pct(100), CHART_HEIGHT);
+	lv_chart_set_type(chart, LV_CHART_TYPE_LINE);
+	lv_chart_set_point_count(chart, 0);
+	lv_chart_set_div_line_count(chart, 3, 0);
+	lv_obj_set_style_size(chart, 0, 0, LV_PART_INDICATOR);
+
+	data_screen.altitude_chart = chart;
+	data_screen.altitude_series = lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_GREEN), LV_CHART_AXIS_PRIMARY_Y);
+	lv_obj_add_event_cb(chart, _altitude_chart_deleted, LV_EVENT_DELETE, NULL);
+
+	data_screen.chart_timer = lv_timer_create(&_chart_timer_handler, CHART_PERIOD, NULL);
+	if(data_screen.chart_timer == NULL)
+	{
+		log_error("lv_timer_create chart timer failed\n");
+		return;
+	}
+	_chart_timer_handler(data_screen.chart_timer);
+}
+
 int data_screen_enter(lv_obj_t *screen)
 {
+	lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_ROW_WRAP);
+
+	for(int i = 0; i < E_DATA_FIELD_NUMBER; i++)
+	{
+		data_screen.field_array[i].subscription_id = -1;
+	}
+
+	for(int i = 0; i < E_DATA_FIELD_NUMBER; i++)
+	{
+		/* Get the pointer on the actual field data we need */
+		T_data_field *element = &data_screen.field_array[i];
+
+		/* Create the container for the name and the value */
+		element->container = lv_obj_create(screen);
+		lv_obj_set_size(element->container, lv_pct(FIELD_WIDTH_PCT), lv_pct(FIELD_HEIGHT_PCT));
+		lv_obj_add_style(element->container, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+		lv_obj_add_style(element->container, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+		styles_disable_scrollbar(element->container);
+
+		/* Create the field name */
+		element->name = lv_label_create(element->container);
+		lv_label_set_text(element->name, _get_field_name(i));
+		lv_obj_align(element->name, LV_ALIGN_TOP_MID, 0, 0);
+		lv_obj_add_style(element->name, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+		/* Create the value label, filled by the observer */
+		element->value = lv_label_create(element->container);
+		lv_obj_align(element->value, LV_ALIGN_CENTER, 0, 0);
+		lv_obj_set_style_text_font(element->value, &inter_regular_48, LV_PART_MAIN | LV_STATE_DEFAULT);
+
+		/* Link the value label to the data manager channel */
+		lv_subject_init_int(&element->subject, DATA_MANAGER_NO_VALUE);
+		lv_subject_add_observer_obj(&element->subject, &_value_observer_cb, element->value, element);
+
+		element->subscription_id = data_manager_subscribe(element->channel, element->ratio, &element->subject);
+		fail_if_negative(element->subscription_id, -1, "data_manager_subscribe failed, return: %d\n", element->subscription_id);
+	}
+
+	_create_altitude_chart(screen);
+
 	return 0;
 }
 
 int data_screen_exit(void)
 {
+	int ret = 0;
+
+	/* The chart timer was deleted with the chart, unless the chart was never created */
+	if(data_screen.chart_timer != NULL)
+	{
+		lv_timer_del(data_screen.chart_timer);
+		data_screen.chart_timer = NULL;
+	}
+
+	for(int i = 0; i < E_DATA_FIELD_NUMBER; i++)
+	{
+		T_data_field *element = &data_screen.field_array[i];
+
+		/* Field not created if the screen enter failed */
+		if(element->subscription_id < 0)
+		{
+			continue;
+		}
+
+		ret = data_manager_unsubscribe(element->subscription_id);
+		if(ret < 0)
+		{
+			log_error("data_manager_unsubscribe failed, return: %d\n", ret);
+		}
+		element->subscription_id = -1;
+
+		/* The observers were removed with the labels when the screen was cleaned */
+		lv_subject_deinit(&element->subject);
+	}
+
 	return 0;
 }
@@ -23,6 +23,7 @@
 
 #include "log.h"
 #include "system.h"
+#include "data_recorder.h"
 #include "lvgl_helper.h"
 #include "main_screen.h"
 #include "ui.h"
@@ -40,6 +41,53 @@ static void button_event_handler(lv_event_t *event)
 	ui_change_screen(next_screen);
 }
 
+static void resume_event_handler(lv_event_t *event)
+{
+	lv_obj_t *msgbox = lv_event_get_user_data(event);
+
+	if(data_recorder_resume() < 0)
+	{
+		log_error("data_recorder_resume failed\n");
+	}
+
+	lv_msgbox_close_async(msgbox);
+}
+
+static void close_ride_event_handler(lv_event_t *event)
+{
+	lv_obj_t *msgbox = lv_event_get_user_data(event);
+
+	if(data_recorder_close_interrupted_ride() < 0)
+	{
+		log_error("data_recorder_close_interrupted_ride failed\n");
+	}
+
+	lv_msgbox_close_async(msgbox);
+}
+
+/* A ride was interrupted by a power cut, ask whether to go on recording it */
+static void _offer_resume(void)
+{
+	T_ride_catalogue_entry summary;
+
+	if(data_recorder_get_interrupted_ride(&summary) != 1)
+	{
+		return;
+	}
+
+	lv_obj_t *msgbox = lv_msgbox_create(NULL);
+	lv_msgbox_add_title(msgbox, _("Interrupted ride"));
+
+	lv_obj_t *text = lv_msgbox_add_text(msgbox, "");
+	lv_label_set_text_fmt(text, "%s  %d.%d km", summary.name, (int)(summary.distance / 1000), (int)(summary.distance / 100 % 10));
+
+	lv_obj_t *button = lv_msgbox_add_footer_button(msgbox, _("Resume"));
+	lv_obj_add_event_cb(button, &resume_event_handler, LV_EVENT_CLICKED, msgbox);
+
+	button = lv_msgbox_add_footer_button(msgbox, _("Close"));
+	lv_obj_add_event_cb(button, &close_ride_event_handler, LV_EVENT_CLICKED, msgbox);
+}
+
 typedef struct {
 	/* Elements set during screen creation */
 	lv_obj_t *container;
@@ -150,6 +198,8 @@ int main_screen_enter(lv_obj_t *screen)
 	lv_obj_align_to(main_screen.button_array[E_MAIN_BUTTON_PROFILES].container, main_screen.button_array[E_MAIN_BUTTON_RESULTS].container, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 0);
 	lv_obj_align_to(main_screen.button_array[E_MAIN_BUTTON_SETTINGS].container, main_screen.button_array[E_MAIN_BUTTON_ROUTES].container, LV_ALIGN_OUT_BOTTOM_RIGHT, 0, 0);
 
+	_offer_resume();
+
 	return 0;
 }
 
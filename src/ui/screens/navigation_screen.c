@@ -15,50 +15,307 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <stdio.h>
+#include <stdint.h>
+#include <lvgl.h>
 
 #include "log.h"
 #include "lvgl_helper.h"
+#include "data_manager.h"
+#include "fixed_point.h"
+#include "route_store.h"
+#include "route_follow.h"
+#include "locales.h"
+#include "styles.h"
+#include "ui.h"
 #include "navigation_screen.h"
-#include "assets.h"
 #include "system.h"
 
+#define NAVIGATION_PROFILE_DISTANCE 500000 /* cm ahead of the rider shown by the profile */
+#define NAVIGATION_PROFILE_MAX_SAMPLES 256
+#define NAVIGATION_PROFILE_HEIGHT 240
+#define NAVIGATION_MAX_CLIMBS 3 /* upcoming climbs listed */
+#define NAVIGATION_STR_SIZE 16
+
+typedef enum {
+	E_NAVIGATION_VALUE_DISTANCE = 0,
+	E_NAVIGATION_VALUE_REMAINING,
+	E_NAVIGATION_VALUE_OFF_ROUTE,
+	E_NAVIGATION_VALUE_NUMBER, // must be last
+} E_navigation_value;
+
 static T_lv_btn back_btn;
-static lv_obj_t *fake_map_img;
 
-int navigation_screen_enter(lv_obj_t *screen)
+static struct {
+	const T_route *route; /* reference held while the screen is shown, null without route */
+	lv_obj_t *profile_chart;
+	lv_chart_series_t *profile_series;
+	const int32_t *profile_first; /* first sample shown by the chart */
+	lv_obj_t *remaining_label;
+	lv_obj_t *off_route_label;
+	lv_obj_t *climb_label[NAVIGATION_MAX_CLIMBS];
+	lv_subject_t subject[E_NAVIGATION_VALUE_NUMBER];
+	int subscription_id[E_NAVIGATION_VALUE_NUMBER];
+} navigation_screen;
+
+/* Channels of the route values, all in cm */
+static const E_data_channel value_channel[E_NAVIGATION_VALUE_NUMBER] = {
+	[E_NAVIGATION_VALUE_DISTANCE] = E_DATA_ROUTE_DISTANCE,
+	[E_NAVIGATION_VALUE_REMAINING] = E_DATA_ROUTE_REMAINING,
+	[E_NAVIGATION_VALUE_OFF_ROUTE] = E_DATA_OFF_ROUTE,
+};
+
+/* Distance in cm as km with one decimal */
+static void _format_km(char *str, int size, int32_t distance)
 {
-	int ret = 0;
+	fixed_point_format(str, size, fixed_point_rescale(distance, FIXED_POINT_RATIO(1, 10000)), 1);
+}
 
-	/* Temporary fake map */
-	fake_map_img = lv_image_create(screen);
-	lv_image_set_src(fake_map_img, IMAGE_MAP);
-	lv_obj_set_size(fake_map_img, SCREEN_HOR_SIZE, SCREEN_VER_SIZE);
-	lv_obj_align(fake_map_img, LV_ALIGN_CENTER, 0, 0);
+/* The chart draws the samples of the profile in place, no copy */
+static void _show_profile(const T_route_profile_slice *slice)
+{
+	int32_t min = slice->altitude[0];
+	int32_t max = slice->altitude[0];
 
-	/* Create the label */
-	lv_obj_t* label = lv_label_create(fake_map_img);
-	lv_label_set_text(label, "Comming soon...");
-	lv_obj_center(label);
+	for(int i = 1; i < slice->count; i++)
+	{
+		min = (slice->altitude[i] < min) ? slice->altitude[i] : min;
+		max = (slice->altitude[i] > max) ? slice->altitude[i] : max;
+	}
 
-	/* Change style of text */
-	lv_obj_set_style_text_font(label, &lv_font_montserrat_48, LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_t *chart = navigation_screen.profile_chart;
+	lv_chart_set_point_count(chart, slice->count);
+	/* The chart only reads the array, it is not updated with set_next_value */
+	lv_chart_set_ext_y_array(chart, navigation_screen.profile_series, (int32_t *)slice->altitude);
+	lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, min, (max > min) ? max : min + 1);
+	lv_chart_refresh(chart);
+}
+
+static void _show_climbs(const T_route_profile *profile, int32_t distance)
+{
+	int next = route_profile_next_climb(profile, distance);
+	char length[NAVIGATION_STR_SIZE];
+	char grade[NAVIGATION_STR_SIZE];
+	char max_grade[NAVIGATION_STR_SIZE];
+	char to_start[NAVIGATION_STR_SIZE];
+
+	for(int i = 0; i < NAVIGATION_MAX_CLIMBS; i++)
+	{
+		lv_obj_t *label = navigation_screen.climb_label[i];
+		int index = next + i;
 
+		if(index >= profile->nb_climbs)
+		{
+			lv_label_set_text(label, (i == 0) ? _("No climb left") : "");
+			continue;
+		}
 
-	/* Remove padding and border */
-	lv_obj_set_style_pad_all(fake_map_img, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
-	lv_obj_set_style_border_width(fake_map_img, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
-	lv_obj_set_style_outline_width(fake_map_img, 0, LV_PART_MAIN | LV_STATE_DEFAULT);
+		const T_route_climb *climb = &profile->climbs[index];
+		fixed_point_format(grade, sizeof(grade), climb->grade, 1);
+		fixed_point_format(max_grade, sizeof(max_grade), climb->max_grade, 1);
 
-	lv_obj_update_layout(fake_map_img);
+		if(climb->start <= distance)
+		{
+			/* Riding it, what is left up to the top */
+			int32_t top = climb->altitude + climb->gain;
+			int32_t altitude = profile->altitude[0][distance / ROUTE_PROFILE_STEP];
+			_format_km(length, sizeof(length), climb->end - distance);
+			lv_label_set_text_fmt(label, _("Climbing: %s km and %d m to the top"), length, (int)((top - altitude) / 100));
+		}
+		else
+		{
+			_format_km(to_start, sizeof(to_start), climb->start - distance);
+			_format_km(length, sizeof(length), climb->end - climb->start);
+			lv_label_set_text_fmt(label, _("In %s km: %s km at %s %% (max %s %%), %d m"), to_start, length, grade, max_grade,
+				(int)(climb->gain / 100));
+		}
+	}
+}
+
+/* The profile and the climbs follow the rider, they only change every sample of the profile */
+static void _distance_observer_cb(lv_observer_t *observer, lv_subject_t *subject)
+{
+	const T_route_profile *profile = &navigation_screen.route->profile;
+	int32_t distance = lv_subject_get_int(subject);
+	T_route_profile_slice slice;
+
+	/* Not on the route yet, the view starts at the start of the route */
+	distance = (distance == DATA_MANAGER_NO_VALUE) ? 0 : distance;
+
+	int ret = route_profile_slice(profile, distance, distance + NAVIGATION_PROFILE_DISTANCE, NAVIGATION_PROFILE_MAX_SAMPLES, &slice);
+	if(ret <= 0)
+	{
+		log_error("route_profile_slice failed, return: %d\n", ret);
+		return;
+	}
+
+	if(slice.altitude == navigation_screen.profile_first)
+	{
+		return;
+	}
+	navigation_screen.profile_first = slice.altitude;
+
+	_show_profile(&slice);
+	_show_climbs(profile, distance);
+}
+
+static void _remaining_observer_cb(lv_observer_t *observer, lv_subject_t *subject)
+{
+	lv_obj_t *label = lv_observer_get_target(observer);
+	int32_t remaining = lv_subject_get_int(subject);
+	char str[NAVIGATION_STR_SIZE];
+
+	if(remaining == DATA_MANAGER_NO_VALUE)
+	{
+		lv_label_set_text(label, _("-- km to go"));
+		return;
+	}
+
+	_format_km(str, sizeof(str), remaining);
+	lv_label_set_text_fmt(label, _("%s km to go"), str);
+}
+
+static void _off_route_observer_cb(lv_observer_t *observer, lv_subject_t *subject)
+{
+	lv_obj_t *label = lv_observer_get_target(observer);
+	int32_t off_route = lv_subject_get_int(subject);
+
+	if(off_route == DATA_MANAGER_NO_VALUE || off_route <= ROUTE_FOLLOW_OFF_ROUTE_DISTANCE)
+	{
+		lv_obj_add_flag(label, LV_OBJ_FLAG_HIDDEN);
+		return;
+	}
+
+	lv_label_set_text_fmt(label, _("Off route by %d m"), (int)(off_route / 100));
+	lv_obj_remove_flag(label, LV_OBJ_FLAG_HIDDEN);
+}
+
+static lv_obj_t *_create_title(lv_obj_t *parent, const char *text)
+{
+	lv_obj_t *title = lv_label_create(parent);
+	lv_label_set_text(title, text);
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	return title;
+}
+
+static int _create_route_view(lv_obj_t *parent)
+{
+	const T_route *route = navigation_screen.route;
+	lv_observer_cb_t observer_cb[E_NAVIGATION_VALUE_NUMBER] = {
+		[E_NAVIGATION_VALUE_DISTANCE] = &_distance_observer_cb,
+		[E_NAVIGATION_VALUE_REMAINING] = &_remaining_observer_cb,
+		[E_NAVIGATION_VALUE_OFF_ROUTE] = &_off_route_observer_cb,
+	};
+
+	_create_title(parent, route->entry.name);
+	navigation_screen.remaining_label = lv_label_create(parent);
+	navigation_screen.off_route_label = lv_label_create(parent);
+	lv_obj_set_style_text_color(navigation_screen.off_route_label, lv_palette_main(LV_PALETTE_RED), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	_create_title(parent, _("Next 5 km"));
+	lv_obj_t *chart = lv_chart_create(parent);
+	lv_obj_set_size(chart, lv_pct(100), NAVIGATION_PROFILE_HEIGHT);
+	lv_chart_set_type(chart, LV_CHART_TYPE_LINE);
+	lv_chart_set_div_line_count(chart, 3, 0);
+	lv_obj_set_style_size(chart, 0, 0, LV_PART_INDICATOR);
+	navigation_screen.profile_series = lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_GREEN), LV_CHART_AXIS_PRIMARY_Y);
+	navigation_screen.profile_chart = chart;
+
+	_create_title(parent, _("Next climbs"));
+	for(int i = 0; i < NAVIGATION_MAX_CLIMBS; i++)
+	{
+		navigation_screen.climb_label[i] = lv_label_create(parent);
+		lv_label_set_text(navigation_screen.climb_label[i], "");
+	}
+
+	/* Each value is linked to the object it updates, the observers are called at once without value */
+	lv_obj_t *target[E_NAVIGATION_VALUE_NUMBER] = {
+		[E_NAVIGATION_VALUE_DISTANCE] = chart,
+		[E_NAVIGATION_VALUE_REMAINING] = navigation_screen.remaining_label,
+		[E_NAVIGATION_VALUE_OFF_ROUTE] = navigation_screen.off_route_label,
+	};
+	for(int i = 0; i < E_NAVIGATION_VALUE_NUMBER; i++)
+	{
+		lv_subject_init_int(&navigation_screen.subject[i], DATA_MANAGER_NO_VALUE);
+		lv_subject_add_observer_obj(&navigation_screen.subject[i], observer_cb[i], target[i], NULL);
+
+		navigation_screen.subscription_id[i] = data_manager_subscribe(value_channel[i], FIXED_POINT_IDENTITY, &navigation_screen.subject[i]);
+		fail_if_negative(navigation_screen.subscription_id[i], -1, "data_manager_subscribe failed, return: %d\n",
+			navigation_screen.subscription_id[i]);
+	}
+
+	return 0;
+}
+
+int navigation_screen_enter(lv_obj_t *screen)
+{
+	int ret = 0;
+
+	for(int i = 0; i < E_NAVIGATION_VALUE_NUMBER; i++)
+	{
+		navigation_screen.subscription_id[i] = -1;
+	}
+	navigation_screen.profile_first = NULL;
+
+	/* Below the back button */
+	lv_obj_t *content = lv_obj_create(screen);
+	lv_obj_set_size(content, lv_pct(100), ui_get_resolution_ver() - BACK_BUTTON_SIZE_Y);
+	lv_obj_align(content, LV_ALIGN_BOTTOM_MID, 0, 0);
+	lv_obj_set_flex_flow(content, LV_FLEX_FLOW_COLUMN);
+	lv_obj_add_style(content, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_style(content, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	/* The route stays loaded while it is shown, even if another one is selected */
+	navigation_screen.route = route_store_acquire();
+	if(navigation_screen.route == NULL)
+	{
+		lv_obj_t *label = lv_label_create(content);
+		lv_label_set_text(label, _("No route selected"));
+	}
+	else
+	{
+		ret = _create_route_view(content);
+		fail_if_negative(ret, -1, "_create_route_view failed, return: %d\n", ret);
+	}
 
 	/* Add back button to go in main screen */
 	ret = lvgl_helper_create_button(&back_btn, screen, BACK_BUTTON_SIZE_X, BACK_BUTTON_SIZE_Y, BACK_BUTTON_ALIGN, BACK_BUTTON_POS_X, BACK_BUTTON_POS_Y, BACK_BUTTON_TEXT, &lvgl_helper_back_button_event_handler);
-	fail_if_negative(ret, -1, "lvgl_helper_create_button failed, return %d\n");
+	fail_if_negative(ret, -2, "lvgl_helper_create_button failed, return %d\n");
 
 	return 0;
 }
 
 int navigation_screen_exit(void)
 {
+	int ret = 0;
+
+	for(int i = 0; i < E_NAVIGATION_VALUE_NUMBER; i++)
+	{
+		/* Value not linked if the screen enter failed */
+		if(navigation_screen.subscription_id[i] < 0)
+		{
+			continue;
+		}
+
+		ret = data_manager_unsubscribe(navigation_screen.subscription_id[i]);
+		if(ret < 0)
+		{
+			log_error("data_manager_unsubscribe failed, return: %d\n", ret);
+		}
+		navigation_screen.subscription_id[i] = -1;
+
+		/* The observers were removed with their objects when the screen was cleaned */
+		lv_subject_deinit(&navigation_screen.subject[i]);
+	}
+
+	/* The chart no longer reads the profile */
+	if(navigation_screen.route != NULL)
+	{
+		route_store_release(navigation_screen.route);
+		navigation_screen.route = NULL;
+	}
+	navigation_screen.profile_chart = NULL;
+
 	return 0;
 }
@@ -16,14 +16,501 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <lvgl.h>
+
 #include "log.h"
+#include "data_recorder.h"
+#include "zones.h"
+#include "ride_catalogue.h"
+#include "ride_summary.h"
+#include "ride_reader.h"
+#include "locales.h"
+#include "styles.h"
+#include "ui.h"
+#include "chart_worker.h"
+#include "virtual_list.h"
 #include "results_screen.h"
 
+#define ZONE_ROW_HEIGHT 40
+#define ZONE_BAR_WIDTH_PCT 60
+#define RIDE_ROW_HEIGHT 32
+#define CHART_HEIGHT 120
+#define CHART_SMOOTHING 5000 /* ms */
+
+static struct {
+	T_ride_catalogue catalogue; /* mapped while the list is shown */
+	T_virtual_list rides;
+	E_ride_catalogue_key sort_key;
+	int *order; /* catalogue index of each row, null falls back to the most recent ride first */
+	lv_obj_t *rides_title;
+	lv_obj_t *detail; /* detail of the ride chosen in the list */
+	lv_obj_t *altitude_chart; /* null once deleted */
+	lv_chart_series_t *altitude_series;
+} results_screen;
+
+static const char *_get_zones_title(E_zones_type type)
+{
+	switch(type)
+	{
+		case E_ZONES_HEART_RATE:
+			return _("Heart rate zones");
+			break;
+		case E_ZONES_POWER:
+			return _("Power zones");
+			break;
+		default:
+			/* No translation */
+			return "id_invalid";
+			break;
+	};
+}
+
+/* One row per zone: name, bar of the share of the ride time and time spent */
+static void _create_zone_bars(lv_obj_t *screen, E_zones_type type, const T_zones_histogram *histogram)
+{
+	int64_t total = 0;
+
+	for(int i = 0; i < histogram->nb_zones; i++)
+	{
+		total += histogram->time[i];
+	}
+
+	lv_obj_t *title = lv_label_create(screen);
+	lv_label_set_text(title, _get_zones_title(type));
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	for(int i = 0; i < histogram->nb_zones; i++)
+	{
+		int64_t seconds = histogram->time[i] / 1000;
+
+		lv_obj_t *row = lv_obj_create(screen);
+		lv_obj_set_size(row, lv_pct(100), ZONE_ROW_HEIGHT);
+		lv_obj_add_style(row, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+		lv_obj_add_style(row, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+		styles_disable_scrollbar(row);
+
+		lv_obj_t *name = lv_label_create(row);
+		lv_label_set_text_fmt(name, "Z%d", i + 1);
+		lv_obj_align(name, LV_ALIGN_LEFT_MID, 0, 0);
+
+		lv_obj_t *bar = lv_bar_create(row);
+		lv_obj_set_size(bar, lv_pct(ZONE_BAR_WIDTH_PCT), ZONE_ROW_HEIGHT / 2);
+		lv_obj_align(bar, LV_ALIGN_CENTER, 0, 0);
+		lv_bar_set_range(bar, 0, 100);
+		lv_bar_set_value(bar, total > 0 ? (int32_t)(histogram->time[i] * 100 / total) : 0, LV_ANIM_OFF);
+
+		lv_obj_t *time = lv_label_create(row);
+		lv_label_set_text_fmt(time, "%d:%02d:%02d", (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+		lv_obj_align(time, LV_ALIGN_RIGHT_MID, 0, 0);
+	}
+}
+
+/* Full resolution profile prepared by the chart worker, the chart copies the values */
+static void _altitude_ready(const T_chart_worker_result *result, void *user_data)
+{
+	if(results_screen.altitude_chart == NULL || result->min[0] > result->max[0])
+	{
+		return;
+	}
+
+	lv_obj_t *chart = results_screen.altitude_chart;
+	lv_chart_set_point_count(chart, result->nb_points);
+	lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, result->min[0], (result->max[0] > result->min[0]) ? result->max[0] : result->min[0] + 1);
+	for(int i = 0; i < result->nb_points; i++)
+	{
+		lv_chart_set_value_by_id(chart, results_screen.altitude_series, i, result->value[0][i]);
+	}
+	lv_chart_refresh(chart);
+}
+
+static void _altitude_chart_deleted(lv_event_t *e)
+{
+	/* Deleted with the LVGL lock held, a result being prepared is dropped */
+	results_screen.altitude_chart = NULL;
+	chart_worker_cancel();
+}
+
+/* Altitude profile of the ride, shown at once from the points of the summary
+ * then replaced by the profile read from the ride log at the chart width
+ */
+static void _create_altitude_chart(lv_obj_t *screen, const T_ride_catalogue_entry *entry, const T_ride_summary *summary)
+{
+	int count = summary->nb_points[E_RIDE_SUMMARY_CHART_ALTITUDE];
+	const T_ride_history_point *point = summary->chart[E_RIDE_SUMMARY_CHART_ALTITUDE];
+	int32_t min = INT32_MAX;
+	int32_t max = INT32_MIN;
+	T_chart_worker_request request = {
+		.start = 0,
+		.end = RIDE_READER_END,
+		.nb_series = 1,
+		.channel = {E_DATA_ALTITUDE},
+		.smoothing = CHART_SMOOTHING,
+		.done = _altitude_ready,
+	};
+
+	if(count < 2)
+	{
+		return;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		int32_t value = chart_worker_to_display(E_DATA_ALTITUDE, point[i].value);
+		min = (value < min) ? value : min;
+		max = (value > max) ? value : max;
+	}
+
+	lv_obj_t *chart = lv_chart_create(screen);
+	lv_obj_set_size(chart, lv_pct(100), CHART_HEIGHT);
+	lv_chart_set_type(chart, LV_CHART_TYPE_LINE);
+	lv_chart_set_point_count(chart, count);
+	lv_chart_set_range(chart, LV_CHART_AXIS_PRIMARY_Y, min, (max > min) ? max : min + 1);
+	lv_chart_set_div_line_count(chart, 3, 0);
+	lv_obj_set_style_size(chart, 0, 0, LV_PART_INDICATOR);
+
+	lv_chart_series_t *series = lv_chart_add_series(chart, lv_palette_main(LV_PALETTE_GREEN), LV_CHART_AXIS_PRIMARY_Y);
+	for(int i = 0; i < count; i++)
+	{
+		lv_chart_set_next_value(chart, series, chart_worker_to_display(E_DATA_ALTITUDE, point[i].value));
+	}
+
+	results_screen.altitude_chart = chart;
+	results_screen.altitude_series = series;
+	lv_obj_add_event_cb(chart, _altitude_chart_deleted, LV_EVENT_DELETE, NULL);
+
+	request.nb_points = ui_get_resolution_hor();
+	request.nb_points = (request.nb_points > CHART_WORKER_MAX_POINTS) ? CHART_WORKER_MAX_POINTS : request.nb_points;
+	if(ride_catalogue_get_path(entry, DATA_RECORDER_LOG_EXTENSION, request.log_path, sizeof(request.log_path)) == 0
+	&& ride_catalogue_get_path(entry, RIDE_READER_INDEX_EXTENSION, request.index_path, sizeof(request.index_path)) == 0)
+	{
+		chart_worker_request(&request);
+	}
+}
+
+static void _create_power_curve(lv_obj_t *screen, const T_ride_summary *summary)
+{
+	if(summary->mean_max[0] == 0)
+	{
+		return;
+	}
+
+	lv_obj_t *title = lv_label_create(screen);
+	lv_label_set_text(title, _("Power curve"));
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	for(int i = 0; i < RIDE_SUMMARY_NB_DURATIONS && summary->mean_max[i] > 0; i++)
+	{
+		int32_t duration = summary->duration[i];
+
+		lv_obj_t *row = lv_label_create(screen);
+		if(duration < 60)
+		{
+			lv_label_set_text_fmt(row, "%d s  %d W", (int)duration, (int)summary->mean_max[i]);
+		}
+		else if(duration < 3600)
+		{
+			lv_label_set_text_fmt(row, "%d min  %d W", (int)(duration / 60), (int)summary->mean_max[i]);
+		}
+		else
+		{
+			lv_label_set_text_fmt(row, "%d h  %d W", (int)(duration / 3600), (int)summary->mean_max[i]);
+		}
+	}
+}
+
+static void _create_lap_table(lv_obj_t *screen, const T_ride_summary *summary)
+{
+	if(summary->nb_laps < 2)
+	{
+		return;
+	}
+
+	lv_obj_t *title = lv_label_create(screen);
+	lv_label_set_text(title, _("Laps"));
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	for(int i = 0; i < summary->nb_laps; i++)
+	{
+		const T_ride_summary_lap *lap = &summary->lap[i];
+		int seconds = lap->duration / 1000;
+
+		lv_obj_t *row = lv_label_create(screen);
+		lv_label_set_text_fmt(row, "%d  %d:%02d  %d.%d km  %d.%d km/h  %d m  %d W", i + 1, seconds / 60, seconds % 60,
+			(int)(lap->distance / 100000), (int)(lap->distance / 10000 % 10),
+			(int)(lap->average_speed * 36 / 10000), (int)(lap->average_speed * 36 / 1000 % 10),
+			(int)(lap->elevation_gain / 100), (int)lap->average_power);
+	}
+}
+
+static void _create_climb_table(lv_obj_t *screen, const T_ride_summary *summary)
+{
+	if(summary->nb_climbs < 1)
+	{
+		return;
+	}
+
+	lv_obj_t *title = lv_label_create(screen);
+	lv_label_set_text(title, _("Climbs"));
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	for(int i = 0; i < summary->nb_climbs; i++)
+	{
+		const T_climb *climb = &summary->climb[i];
+
+		lv_obj_t *row = lv_label_create(screen);
+		lv_label_set_text_fmt(row, "%d  %d.%d km  %d m  %d.%d %%  %d m/h", i + 1,
+			(int)(climb->distance / 100000), (int)(climb->distance / 10000 % 10), (int)(climb->gain / 100),
+			(int)(climb->grade / 10), (int)(climb->grade % 10), (int)climb->vam);
+	}
+}
+
+/* Detail of a ride of the catalogue from its sidecar, read at once, the
+ * zones file is the fallback for the rides recorded without sidecar
+ */
+static int _create_ride_detail(lv_obj_t *screen, const T_ride_catalogue_entry *entry)
+{
+	int ret = 0;
+	char path[DATA_RECORDER_PATH_SIZE];
+	T_zones_histogram histogram[E_ZONES_TYPE_NUMBER];
+
+	T_ride_summary *summary = malloc(sizeof(T_ride_summary));
+	if(summary != NULL && ride_catalogue_get_path(entry, RIDE_SUMMARY_EXTENSION, path, sizeof(path)) == 0
+	&& ride_summary_load(path, summary) == 0)
+	{
+		_create_altitude_chart(screen, entry, summary);
+		for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+		{
+			if(summary->zones[i].nb_zones > 0)
+			{
+				_create_zone_bars(screen, i, &summary->zones[i]);
+			}
+		}
+		_create_power_curve(screen, summary);
+		_create_lap_table(screen, summary);
+		_create_climb_table(screen, summary);
+
+		free(summary);
+		return 0;
+	}
+	free(summary);
+
+	ret = ride_catalogue_get_path(entry, ".zones", path, sizeof(path));
+	if(ret == 0)
+	{
+		ret = zones_load(path, histogram);
+	}
+	if(ret < 0)
+	{
+		return ret;
+	}
+
+	for(int i = 0; i < E_ZONES_TYPE_NUMBER; i++)
+	{
+		_create_zone_bars(screen, i, &histogram[i]);
+	}
+
+	return 0;
+}
+
+/* Entry shown at a row of the list, in the order of the sort key */
+static const T_ride_catalogue_entry *_get_entry(const T_ride_catalogue *catalogue, int index)
+{
+	if(results_screen.order != NULL)
+	{
+		return &catalogue->entries[results_screen.order[index]];
+	}
+
+	/* The catalogue is in recording order */
+	return &catalogue->entries[catalogue->nb_rides - 1 - index];
+}
+
+static void _bind_ride_row(lv_obj_t *row, int index, void *user_data)
+{
+	const T_ride_catalogue *catalogue = user_data;
+	const T_ride_catalogue_entry *entry = _get_entry(catalogue, index);
+	time_t start_time = (time_t)entry->start_time;
+	struct tm *tm = localtime(&start_time);
+	char date[16] = "";
+
+	if(tm != NULL)
+	{
+		strftime(date, sizeof(date), "%Y-%m-%d", tm);
+	}
+
+	lv_label_set_text_fmt(row, "%s  %d:%02d  %d.%d km  %d m  %d W", date,
+		(int)(entry->duration / 3600), (int)(entry->duration / 60 % 60),
+		(int)(entry->distance / 1000), (int)(entry->distance / 100 % 10),
+		(int)entry->elevation_gain, (int)entry->average_power);
+}
+
+/* The detail of the clicked ride replaces the one shown */
+static void _select_ride(int index, void *user_data)
+{
+	const T_ride_catalogue *catalogue = user_data;
+	const T_ride_catalogue_entry *entry = _get_entry(catalogue, index);
+
+	/* Deleting the chart cancels its pending request */
+	lv_obj_clean(results_screen.detail);
+	if(_create_ride_detail(results_screen.detail, entry) < 0)
+	{
+		lv_obj_t *label = lv_label_create(results_screen.detail);
+		lv_label_set_text(label, _("No detail for this ride"));
+	}
+	lv_obj_scroll_to_y(lv_obj_get_parent(results_screen.detail), 0, LV_ANIM_ON);
+}
+
+static const char *_get_sort_title(E_ride_catalogue_key key)
+{
+	switch(key)
+	{
+		case E_RIDE_CATALOGUE_START_TIME:
+			return _("Rides, most recent first");
+			break;
+		case E_RIDE_CATALOGUE_DURATION:
+			return _("Rides, longest first");
+			break;
+		case E_RIDE_CATALOGUE_DISTANCE:
+			return _("Rides, farthest first");
+			break;
+		case E_RIDE_CATALOGUE_ELEVATION_GAIN:
+			return _("Rides, most climbing first");
+			break;
+		case E_RIDE_CATALOGUE_AVERAGE_POWER:
+			return _("Rides, most powerful first");
+			break;
+		default:
+			return _("Rides");
+			break;
+	}
+}
+
+/* Sort the rows on key, the largest value first, the order is only built
+ * when the user asks for another key than the recording order
+ */
+static void _sort_rides(E_ride_catalogue_key key)
+{
+	int ret = 0;
+
+	if(key == E_RIDE_CATALOGUE_START_TIME)
+	{
+		free(results_screen.order);
+		results_screen.order = NULL;
+	}
+	else
+	{
+		if(results_screen.order == NULL)
+		{
+			results_screen.order = malloc(results_screen.catalogue.nb_rides * sizeof(int));
+			if(results_screen.order == NULL)
+			{
+				log_error("malloc order failed\n");
+				return;
+			}
+		}
+
+		ret = ride_catalogue_sort(&results_screen.catalogue, key, true, results_screen.order);
+		if(ret < 0)
+		{
+			log_error("ride_catalogue_sort failed, return: %d\n", ret);
+			free(results_screen.order);
+			results_screen.order = NULL;
+			key = E_RIDE_CATALOGUE_START_TIME;
+		}
+	}
+
+	results_screen.sort_key = key;
+	lv_label_set_text(results_screen.rides_title, _get_sort_title(key));
+}
+
+/* A click on the title of the list sorts the rides on the next key */
+static void _rides_title_handler(lv_event_t *e)
+{
+	(void)e;
+	int ret = 0;
+
+	_sort_rides((results_screen.sort_key + 1) % E_RIDE_CATALOGUE_KEY_NUMBER);
+
+	ret = virtual_list_set_count(&results_screen.rides, results_screen.catalogue.nb_rides);
+	if(ret < 0)
+	{
+		log_error("virtual_list_set_count failed, return: %d\n", ret);
+	}
+}
+
+/* Rows recycled on scroll, read from the catalogue only, entering the screen
+ * does not depend on the number of rides
+ */
+static void _create_ride_list(lv_obj_t *screen)
+{
+	int ret = 0;
+
+	results_screen.rides_title = lv_label_create(screen);
+	lv_label_set_text(results_screen.rides_title, _get_sort_title(results_screen.sort_key));
+	lv_obj_add_style(results_screen.rides_title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_flag(results_screen.rides_title, LV_OBJ_FLAG_CLICKABLE);
+	lv_obj_add_event_cb(results_screen.rides_title, &_rides_title_handler, LV_EVENT_CLICKED, NULL);
+
+	ret = virtual_list_create(&results_screen.rides, screen, ui_get_resolution_ver() / 2, RIDE_ROW_HEIGHT,
+		results_screen.catalogue.nb_rides, &_bind_ride_row, &results_screen.catalogue);
+	if(ret < 0)
+	{
+		log_error("virtual_list_create failed, return: %d\n", ret);
+		return;
+	}
+
+	ret = virtual_list_set_click(&results_screen.rides, &_select_ride);
+	if(ret < 0)
+	{
+		log_error("virtual_list_set_click failed, return: %d\n", ret);
+	}
+}
+
 int results_screen_enter(lv_obj_t *screen)
 {
+	int ret = 0;
+
+	lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_COLUMN);
+
+	ret = ride_catalogue_open(&results_screen.catalogue, RIDE_CATALOGUE_PATH);
+	if(ret < 0)
+	{
+		log_error("ride_catalogue_open failed, return: %d\n", ret);
+	}
+
+	if(results_screen.catalogue.nb_rides == 0)
+	{
+		lv_obj_t *label = lv_label_create(screen);
+		lv_label_set_text(label, _("No ride recorded"));
+		return 0;
+	}
+
+	/* Most recent ride first from the recording order, sorted on click only */
+	results_screen.order = NULL;
+	results_screen.sort_key = E_RIDE_CATALOGUE_START_TIME;
+
+	/* Everything is saved with the ride, no need to read the samples */
+	results_screen.detail = lv_obj_create(screen);
+	lv_obj_set_size(results_screen.detail, lv_pct(100), LV_SIZE_CONTENT);
+	lv_obj_set_flex_flow(results_screen.detail, LV_FLEX_FLOW_COLUMN);
+	lv_obj_add_style(results_screen.detail, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_style(results_screen.detail, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	_select_ride(0, &results_screen.catalogue);
+
+	_create_ride_list(screen);
+
 	return 0;
 }
+
 int results_screen_exit(void)
 {
+	/* The objects are removed with the screen, the rows no longer use the catalogue */
+	ride_catalogue_close(&results_screen.catalogue);
+	free(results_screen.order);
+	results_screen.order = NULL;
+
 	return 0;
 }
@@ -16,14 +16,84 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+#include <lvgl.h>
+
 #include "log.h"
+#include "route_store.h"
+#include "locales.h"
+#include "styles.h"
+#include "ui.h"
+#include "virtual_list.h"
 #include "routes_screen.h"
 
+#define ROUTE_ROW_HEIGHT 32
+
+static struct {
+	T_route_store_catalogue catalogue; /* mapped while the list is shown */
+	T_virtual_list routes;
+} routes_screen;
+
+/* Routes in import order, the catalogue holds everything shown */
+static void _bind_route_row(lv_obj_t *row, int index, void *user_data)
+{
+	const T_route_store_catalogue *catalogue = user_data;
+	const T_route_store_entry *entry = &catalogue->entries[index];
+
+	lv_label_set_text_fmt(row, "%s  %d.%d km  %d m", entry->name,
+		(int)(entry->distance / 1000), (int)(entry->distance / 100 % 10), (int)entry->elevation_gain);
+}
+
+/* The route is decoded at once, the navigation screen follows it */
+static void _select_route(int index, void *user_data)
+{
+	const T_route_store_catalogue *catalogue = user_data;
+
+	int ret = route_store_select(&catalogue->entries[index]);
+	if(ret < 0)
+	{
+		log_error("route_store_select failed, return: %d\n", ret);
+		return;
+	}
+
+	ui_change_screen(E_NAVIGATION_SCREEN);
+}
+
 int routes_screen_enter(lv_obj_t *screen)
 {
+	int ret = 0;
+
+	lv_obj_set_flex_flow(screen, LV_FLEX_FLOW_COLUMN);
+
+	ret = route_store_open(&routes_screen.catalogue, ROUTES_FOLDER_PATH);
+	fail_if_negative(ret, -1, "route_store_open failed, return: %d\n", ret);
+
+	if(routes_screen.catalogue.nb_routes == 0)
+	{
+		lv_obj_t *label = lv_label_create(screen);
+		lv_label_set_text(label, _("No route imported"));
+		return 0;
+	}
+
+	lv_obj_t *title = lv_label_create(screen);
+	lv_label_set_text(title, _("Routes"));
+	lv_obj_add_style(title, styles_get_font_inter_regular_18(), LV_PART_MAIN | LV_STATE_DEFAULT);
+
+	/* Rows recycled on scroll, entering the screen does not depend on the number of routes */
+	ret = virtual_list_create(&routes_screen.routes, screen, ui_get_resolution_ver() * 3 / 4, ROUTE_ROW_HEIGHT,
+		routes_screen.catalogue.nb_routes, &_bind_route_row, &routes_screen.catalogue);
+	fail_if_negative(ret, -2, "virtual_list_create failed, return: %d\n", ret);
+
+	ret = virtual_list_set_click(&routes_screen.routes, &_select_route);
+	fail_if_negative(ret, -3, "virtual_list_set_click failed, return: %d\n", ret);
+
 	return 0;
 }
+
 int routes_screen_exit(void)
 {
+	/* The objects are removed with the screen, the rows no longer use the catalogue */
+	route_store_close(&routes_screen.catalogue);
+
 	return 0;
 }
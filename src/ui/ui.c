@@ -41,10 +41,12 @@
 #include "results_screen.h"
 #include "routes_screen.h"
 #include "settings_screen.h"
+#include "chart_worker.h"
 #include "styles.h"
 #include "topbar_styles.h"
 
 #include "fifo.h"
+#include "data_manager.h"
 #include "log.h"
 #include "system.h"
 #include "locales.h"
@@ -52,6 +54,7 @@
 
 #define TOPBAR_SIZE ((ui_get_resolution_ver() / 10))
 #define TOPBAR_TIMER_DELAY (1000) //ms
+#define SUBJECTS_TIMER_DELAY (LVGL_TIMER_HANDLER_RATE) //ms
 #define SCREEN_FIFO_DEPTH 8
 #define STR_TIME_SIZE (8)
 
@@ -117,6 +120,9 @@ static struct {
 
 	/* top bar */
 	T_topbar topbar;
+
+	/* data manager subjects update */
+	lv_timer_t *subjects_timer;
 } ui = {
 	.is_initialized = false,
 	.lvgl_mutex = PTHREAD_MUTEX_INITIALIZER,
@@ -166,6 +172,18 @@ static void _topbar_timer_handler(lv_timer_t * timer)
 	lv_label_set_text_fmt(label, LV_SYMBOL_BATTERY_FULL " %s", str);
 }
 
+static void _subjects_timer_handler(lv_timer_t * timer)
+{
+	int ret = 0;
+
+	/* Push the data manager values to the screens observers */
+	ret = data_manager_update_subjects();
+	if(ret < 0)
+	{
+		log_error("data_manager_update_subjects failed, return %d\n", ret);
+	}
+}
+
 static void _topbar_back_btn_handler(lv_event_t *event)
 {
 	T_topbar_config *config = lv_event_get_user_data(event);
@@ -475,6 +493,20 @@ int ui_get_resolution_ver(void)
 	return ui.resolution_ver;
 }
 
+int ui_lock(void)
+{
+	pthread_mutex_lock(&ui.lvgl_mutex);
+
+	return 0;
+}
+
+int ui_unlock(void)
+{
+	pthread_mutex_unlock(&ui.lvgl_mutex);
+
+	return 0;
+}
+
 int ui_init(int resolution_hor, int resolution_ver, int screen_rotation)
 {
 	int ret;
@@ -484,7 +516,7 @@ int ui_init(int resolution_hor, int resolution_ver, int screen_rotation)
 	/* Init lvgl lib */
 	lv_init();
 
-	ret = fifo_create(&ui.screen_fifo, sizeof(int), SCREEN_FIFO_DEPTH);
+	ret = fifo_create(&ui.screen_fifo, SCREEN_FIFO_DEPTH, sizeof(int));
 	fail_if_negative(ret, -2, "fifo_create fail, return: %d\n", ret);
 
 	log_debug("display %dx%d, rotation: %d\n", resolution_hor, resolution_ver, screen_rotation);
@@ -537,21 +569,30 @@ int ui_init(int resolution_hor, int resolution_ver, int screen_rotation)
 	ret = styles_init();
 	fail_if_negative(ret, -4, "styles_init failed, return: %d\n", ret);
 
+	/* Create lvgl timer that update the data subjects, it lives for all the screens */
+	ui.subjects_timer = lv_timer_create(&_subjects_timer_handler, SUBJECTS_TIMER_DELAY, NULL);
+	fail_if_null(ui.subjects_timer, -5, "lv_timer_create subjects timer failed\n");
+	lv_timer_set_repeat_count(ui.subjects_timer, -1); // repeat indefinitly
+
+	/* Background preparation of the chart series of the ride views */
+	ret = chart_worker_init();
+	fail_if_negative(ret, -10, "chart_worker_init failed, return: %d\n", ret);
+
 	/* Create a thread to tell lvgl the elapsed time */
 	ret = pthread_create(&ui.tick_thread, NULL, &tick_thread_handler, NULL);
-	fail_if_negative(ret, -5, "Create lvgl tick thread failed, return: %d\n", ret);
+	fail_if_negative(ret, -6, "Create lvgl tick thread failed, return: %d\n", ret);
 
 	/* Create a thread to handle lvgl drawing */
 	ret = pthread_create(&ui.draw_thread, NULL, &draw_thread_handler, NULL);
-	fail_if_negative(ret, -6, "Create lvgl draw thread failed, return: %d\n", ret);
+	fail_if_negative(ret, -7, "Create lvgl draw thread failed, return: %d\n", ret);
 
 	/* Create a thread to handle lvgl drawing */
 	ret = pthread_create(&ui.screen_thread, NULL, &screen_thread_handler, NULL);
-	fail_if_negative(ret, -7, "Create screen manager thread failed, return: %d\n", ret);
+	fail_if_negative(ret, -8, "Create screen manager thread failed, return: %d\n", ret);
 
 	/* Display the main screen */
 	ret = _push_next_screen_in_fifo(E_MAIN_SCREEN);
-	fail_if_negative(ret, -8, "_push_next_screen_in_fifo failed, return %d\n", ret);
+	fail_if_negative(ret, -9, "_push_next_screen_in_fifo failed, return %d\n", ret);
 
 	/* Mark the ui module as initialized */
 	ui.is_initialized = true;
@@ -50,4 +50,10 @@ int ui_get_resolution_hor(void);
 int ui_get_resolution_ver(void);
 int ui_apply_default_style_to_obj(lv_obj_t *obj);
 
+/* Take the LVGL lock from another thread than the ui ones, never from the
+ * screen handlers or the LVGL callbacks that already run with it
+ */
+int ui_lock(void);
+int ui_unlock(void);
+
 #endif //_UI_HEADER_
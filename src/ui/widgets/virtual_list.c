@@ -0,0 +1,161 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <lvgl.h>
+
+#include "log.h"
+#include "styles.h"
+#include "virtual_list.h"
+
+/* Bind the rows to the items around the scroll position, a row only changes when its item does */
+static void _update_rows(T_virtual_list *list)
+{
+	int first = lv_obj_get_scroll_y(list->container) / list->row_height - VIRTUAL_LIST_MARGIN_ROWS;
+
+	if(first > list->count - list->nb_rows)
+	{
+		first = list->count - list->nb_rows;
+	}
+	if(first < 0)
+	{
+		first = 0;
+	}
+
+	for(int index = first; index < first + list->nb_rows; index++)
+	{
+		int slot = index % list->nb_rows;
+
+		if(index >= list->count)
+		{
+			lv_obj_add_flag(list->row[slot], LV_OBJ_FLAG_HIDDEN);
+			list->bound[slot] = -1;
+			continue;
+		}
+
+		if(list->bound[slot] != index)
+		{
+			lv_obj_set_y(list->row[slot], index * list->row_height);
+			list->bind(list->row[slot], index, list->user_data);
+			lv_obj_remove_flag(list->row[slot], LV_OBJ_FLAG_HIDDEN);
+			list->bound[slot] = index;
+		}
+	}
+}
+
+static void _scroll_event_handler(lv_event_t *event)
+{
+	T_virtual_list *list = lv_event_get_user_data(event);
+
+	_update_rows(list);
+}
+
+/* The row keeps its item in the bound slots, a recycled row reports its new item */
+static void _click_event_handler(lv_event_t *event)
+{
+	T_virtual_list *list = lv_event_get_user_data(event);
+	lv_obj_t *row = lv_event_get_target(event);
+
+	for(int i = 0; i < list->nb_rows; i++)
+	{
+		if(list->row[i] == row && list->bound[i] >= 0)
+		{
+			list->click(list->bound[i], list->user_data);
+			return;
+		}
+	}
+}
+
+int virtual_list_create(T_virtual_list *list, lv_obj_t *parent, int32_t height, int32_t row_height, int count,
+	T_virtual_list_bind bind, void *user_data)
+{
+	fail_if_null(list, -1, "list is null\n");
+	fail_if_null(parent, -2, "parent is null\n");
+	fail_if_null(bind, -3, "bind is null\n");
+	fail_if_negative_or_zero(row_height, -4, "invalid row height %d\n", (int)row_height);
+	fail_if_negative(count, -5, "invalid count %d\n", count);
+
+	list->row_height = row_height;
+	list->bind = bind;
+	list->click = NULL;
+	list->user_data = user_data;
+	list->count = 0;
+
+	/* The rows of the view, the one partly visible and the margins */
+	list->nb_rows = height / row_height + 1 + 2 * VIRTUAL_LIST_MARGIN_ROWS;
+	if(list->nb_rows > VIRTUAL_LIST_MAX_ROWS)
+	{
+		list->nb_rows = VIRTUAL_LIST_MAX_ROWS;
+	}
+
+	list->container = lv_obj_create(parent);
+	lv_obj_set_size(list->container, lv_pct(100), height);
+	lv_obj_add_style(list->container, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_style(list->container, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_event_cb(list->container, &_scroll_event_handler, LV_EVENT_SCROLL, list);
+
+	list->spacer = lv_obj_create(list->container);
+	lv_obj_add_style(list->spacer, styles_get_no_border_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_add_style(list->spacer, styles_get_transp_bg_style(), LV_PART_MAIN | LV_STATE_DEFAULT);
+	lv_obj_remove_flag(list->spacer, LV_OBJ_FLAG_CLICKABLE);
+
+	for(int i = 0; i < list->nb_rows; i++)
+	{
+		list->row[i] = lv_label_create(list->container);
+		lv_obj_set_size(list->row[i], lv_pct(100), row_height);
+		lv_obj_add_flag(list->row[i], LV_OBJ_FLAG_HIDDEN);
+		list->bound[i] = -1;
+	}
+
+	return virtual_list_set_count(list, count);
+}
+
+int virtual_list_set_count(T_virtual_list *list, int count)
+{
+	fail_if_null(list, -1, "list is null\n");
+	fail_if_null(list->container, -2, "list is not created\n");
+	fail_if_negative(count, -3, "invalid count %d\n", count);
+
+	list->count = count;
+	lv_obj_set_size(list->spacer, 1, (count > 0) ? count * list->row_height : 1);
+
+	/* The items may have changed under the rows */
+	for(int i = 0; i < list->nb_rows; i++)
+	{
+		list->bound[i] = -1;
+	}
+	_update_rows(list);
+
+	return 0;
+}
+
+int virtual_list_set_click(T_virtual_list *list, T_virtual_list_click click)
+{
+	fail_if_null(list, -1, "list is null\n");
+	fail_if_null(list->container, -2, "list is not created\n");
+	fail_if_null(click, -3, "click is null\n");
+
+	list->click = click;
+	for(int i = 0; i < list->nb_rows; i++)
+	{
+		lv_obj_add_flag(list->row[i], LV_OBJ_FLAG_CLICKABLE);
+		lv_obj_add_event_cb(list->row[i], &_click_event_handler, LV_EVENT_CLICKED, list);
+	}
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VIRTUAL_LIST_HEADER_
+#define _VIRTUAL_LIST_HEADER_
+
+#include <stdint.h>
+#include <lvgl.h>
+
+/* Scrollable list of fixed height rows where only the visible rows and a
+ * margin of VIRTUAL_LIST_MARGIN_ROWS on each side exist as objects. On scroll
+ * the rows leaving the view are moved and bound to the items entering it, the
+ * number of objects does not depend on the number of items.
+ */
+
+#define VIRTUAL_LIST_MAX_ROWS 32
+#define VIRTUAL_LIST_MARGIN_ROWS 2
+
+/* Fill a row, a label, with the item at index */
+typedef void (*T_virtual_list_bind)(lv_obj_t *row, int index, void *user_data);
+
+/* Called with the item of the clicked row */
+typedef void (*T_virtual_list_click)(int index, void *user_data);
+
+typedef struct {
+	lv_obj_t *container;
+	lv_obj_t *spacer; /* gives the scrollable height of all the items */
+	lv_obj_t *row[VIRTUAL_LIST_MAX_ROWS];
+	int bound[VIRTUAL_LIST_MAX_ROWS]; /* item of each row, -1 when unbound */
+	int nb_rows;
+	int count; /* items */
+	int32_t row_height;
+	T_virtual_list_bind bind;
+	T_virtual_list_click click; /* null when the rows are not clickable */
+	void *user_data;
+} T_virtual_list;
+
+/* Create the list in parent, height and row_height in pixels. The list keeps
+ * a pointer to the structure, it must live as long as the objects.
+ */
+int virtual_list_create(T_virtual_list *list, lv_obj_t *parent, int32_t height, int32_t row_height, int count,
+	T_virtual_list_bind bind, void *user_data);
+
+/* Change the number of items and bind the visible rows again */
+int virtual_list_set_count(T_virtual_list *list, int count);
+
+/* Make the rows clickable */
+int virtual_list_set_click(T_virtual_list *list, T_virtual_list_click click);
+
+#endif //_VIRTUAL_LIST_HEADER_
@@ -0,0 +1,754 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "fixed_point.h"
+#include "geo_kernel.h"
+#include "data_manager.h"
+#include "speed_fusion.h"
+#include "ride_log.h"
+#include "route_store.h"
+#include "route_index.h"
+#include "simulator.h"
+#include "benchmark.h"
+
+/* Geo kernel benchmark: 1 million points, about 5000km of track */
+#define GEO_NB_POINTS (1000000)
+#define GEO_ITERATIONS (5)
+#define GEO_START_LATITUDE (45.721535)
+#define GEO_START_LONGITUDE (5.248005)
+#define GEO_STEP_DEGREE (1e-4)
+
+/* Speed fusion benchmark: replay of a scenario with a noisy GPS going
+ * through tunnels, the file speed is the truth
+ */
+#define FUSION_SCENARIO_PATH "./simulation/scenario_1.csv"
+#define FUSION_WHEEL_SIZE (668) /* mm, 700x25c */
+#define FUSION_GPS_SPEED_NOISE (800.0) /* mm/s */
+#define FUSION_GPS_POSITION_NOISE (5.0) /* 1e-7 degree, about 0.5 m */
+#define FUSION_GPS_GLITCH_PERIOD (97) /* samples between two GPS speed outliers */
+#define FUSION_GPS_GLITCH (8000) /* mm/s */
+#define FUSION_TUNNEL_PERIOD (600) /* samples */
+#define FUSION_TUNNEL_LENGTH (60) /* samples without GPS */
+#define FUSION_MAX_SAMPLES (100000)
+
+/* Ride log codec benchmark: the 8 sensor channels of the scenario replayed
+ * back and forth up to a 10 hours ride at 1 Hz
+ */
+#define CODEC_SCENARIO_PATH FUSION_SCENARIO_PATH
+#define CODEC_NB_FRAMES (10 * 3600)
+#define CODEC_LOG_PATH "/tmp/benchmark.ride"
+
+/* Route follow benchmark: a rider at 5 m/s with a 10 Hz GPS of 5 m of noise
+ * on winding routes of 10 m segments, leaving the route for a while every
+ * few km
+ */
+#define ROUTE_SEGMENT_LENGTH (10.0) /* m */
+#define ROUTE_HEADING_STEP (0.08) /* rad, random turn between two segments */
+#define ROUTE_FIX_STEP (50) /* cm between two fixes */
+#define ROUTE_GPS_NOISE (500.0) /* cm */
+#define ROUTE_DETOUR_PERIOD (8000) /* fixes between two detours */
+#define ROUTE_DETOUR_LENGTH (600) /* fixes off route */
+#define ROUTE_DETOUR_OFFSET (20000.0) /* cm */
+#define ROUTE_NB_FIXES (100000)
+#define ROUTE_NB_LINEAR_FIXES (500) /* the reference linear scan is only timed on the first fixes */
+#define ROUTE_MAX_JUMP (5000) /* cm, a match farther along the route than this from the truth is a jump */
+
+typedef int (*T_geo_kernel_fn)(E_geo_kernel_method method, const T_geo_points *points, double *distances);
+
+static double _get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double _random_step(void)
+{
+	return ((double)rand() / RAND_MAX - 0.5) * GEO_STEP_DEGREE;
+}
+
+/* Run the kernel several times and return the best time in seconds */
+static double _time_geo_kernel(T_geo_kernel_fn kernel, E_geo_kernel_method method, const T_geo_points *points, double *distances)
+{
+	double best = -1;
+
+	for(int i = 0; i < GEO_ITERATIONS; i++)
+	{
+		double start = _get_time();
+		kernel(method, points, distances);
+		double elapsed = _get_time() - start;
+
+		if(best < 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	return best;
+}
+
+static int _benchmark_geo_kernel(void)
+{
+	int ret = 0;
+	double *latitude = malloc(GEO_NB_POINTS * sizeof(double));
+	double *longitude = malloc(GEO_NB_POINTS * sizeof(double));
+	double *reference = malloc(GEO_NB_POINTS * sizeof(double));
+	double *distances = malloc(GEO_NB_POINTS * sizeof(double));
+	int32_t *latitude_fixed = malloc(GEO_NB_POINTS * sizeof(int32_t));
+	int32_t *longitude_fixed = malloc(GEO_NB_POINTS * sizeof(int32_t));
+	int32_t *distances_fixed = malloc(GEO_NB_POINTS * sizeof(int32_t));
+
+	if(!latitude || !longitude || !reference || !distances || !latitude_fixed || !longitude_fixed || !distances_fixed)
+	{
+		log_error("malloc geo kernel arrays failed\n");
+		ret = -1;
+		goto geo_cleanup;
+	}
+
+	static const struct {
+		const char *name;
+		T_geo_kernel_fn kernel;
+		E_geo_kernel_method method;
+	} cases[] = {
+		{"haversine scalar",       &geo_kernel_segment_distances_scalar, E_GEO_KERNEL_HAVERSINE},
+		{"haversine batch",        &geo_kernel_segment_distances,        E_GEO_KERNEL_HAVERSINE},
+		{"equirectangular scalar", &geo_kernel_segment_distances_scalar, E_GEO_KERNEL_EQUIRECTANGULAR},
+		{"equirectangular simd",   &geo_kernel_segment_distances,        E_GEO_KERNEL_EQUIRECTANGULAR},
+	};
+
+	/* Random walk with steps of a few meters, seeded to be reproducible */
+	srand(1);
+	latitude[0] = GEO_START_LATITUDE;
+	longitude[0] = GEO_START_LONGITUDE;
+	for(int i = 1; i < GEO_NB_POINTS; i++)
+	{
+		latitude[i] = latitude[i-1] + _random_step();
+		longitude[i] = longitude[i-1] + _random_step();
+	}
+
+	T_geo_points points = {.latitude = latitude, .longitude = longitude, .count = GEO_NB_POINTS};
+
+	/* The exact haversine is the reference for the error column */
+	ret = geo_kernel_segment_distances_scalar(E_GEO_KERNEL_HAVERSINE, &points, reference);
+	if(ret < 0)
+	{
+		log_error("geo_kernel_segment_distances_scalar failed, return: %d\n", ret);
+		goto geo_cleanup;
+	}
+
+	printf("geo kernel, %d points:\n", GEO_NB_POINTS);
+	for(int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		double elapsed = _time_geo_kernel(cases[i].kernel, cases[i].method, &points, distances);
+		double max_error = 0;
+
+		for(int j = 0; j < GEO_NB_POINTS - 1; j++)
+		{
+			double error = fabs(distances[j] - reference[j]);
+			if(error > max_error)
+			{
+				max_error = error;
+			}
+		}
+
+		printf("  %-24s %8.1f Mpoints/s, max error %.6f m\n", cases[i].name, GEO_NB_POINTS / elapsed / 1e6, max_error);
+	}
+
+	/* Fixed point kernel of the per-sample path, the track is rounded to 1e-7 degree */
+	for(int i = 0; i < GEO_NB_POINTS; i++)
+	{
+		latitude_fixed[i] = (int32_t)lround(latitude[i] * FIXED_POINT_COORDINATE_SCALE);
+		longitude_fixed[i] = (int32_t)lround(longitude[i] * FIXED_POINT_COORDINATE_SCALE);
+	}
+
+	T_geo_points_fixed points_fixed = {.latitude = latitude_fixed, .longitude = longitude_fixed, .count = GEO_NB_POINTS};
+	double best = -1;
+	double max_error = 0;
+
+	for(int i = 0; i < GEO_ITERATIONS; i++)
+	{
+		double start = _get_time();
+		geo_kernel_segment_distances_fixed(&points_fixed, distances_fixed);
+		double elapsed = _get_time() - start;
+
+		if(best < 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	for(int j = 0; j < GEO_NB_POINTS - 1; j++)
+	{
+		double error = fabs(distances_fixed[j] / 1000.0 - reference[j]);
+		if(error > max_error)
+		{
+			max_error = error;
+		}
+	}
+
+	printf("  %-24s %8.1f Mpoints/s, max error %.6f m\n", "equirectangular fixed", GEO_NB_POINTS / best / 1e6, max_error);
+
+geo_cleanup:
+	free(latitude);
+	free(longitude);
+	free(reference);
+	free(distances);
+	free(latitude_fixed);
+	free(longitude_fixed);
+	free(distances_fixed);
+
+	return ret;
+}
+
+/* Normal noise, Box-Muller */
+static double _random_normal(double sigma)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	/* log is the logging macro, call the libm function */
+	return sigma * sqrt(-2 * (log)(u)) * cos(2 * M_PI * v);
+}
+
+/* Frames of the scenario as the sensors would give them, return the number of frames */
+static int _load_fusion_scenario(T_data_frame *frames, int32_t *truth, int max_frames)
+{
+	FILE *fd = fopen(FUSION_SCENARIO_PATH, "r");
+	fail_if_null(fd, -1, "fopen %s failed\n", FUSION_SCENARIO_PATH);
+
+	char *line = NULL;
+	size_t len = 0;
+	int count = 0;
+	int64_t wheel_distance = 0; /* um */
+	int32_t circumference = SPEED_FUSION_CIRCUMFERENCE(FUSION_WHEEL_SIZE);
+
+	srand(1);
+	while(count < max_frames && getline(&line, &len, fd) != -1)
+	{
+		int32_t value[E_SIMULATOR_COLUMN_NUMBER];
+		if(line[0] == '#' || simulator_parse_line(line, value) < 0)
+		{
+			continue;
+		}
+
+		T_data_frame *frame = &frames[count];
+		bool is_in_tunnel = (count % FUSION_TUNNEL_PERIOD) >= FUSION_TUNNEL_PERIOD - FUSION_TUNNEL_LENGTH;
+
+		truth[count] = (int32_t)fixed_point_mul_div(value[E_SIMULATOR_SPEED], 1000, 36);
+		frame->timestamp = (int64_t)count * SIMULATOR_SAMPLE_PERIOD;
+		frame->valid_mask = data_channel_bit(E_DATA_WHEEL_REVOLUTIONS);
+		if(count > 0)
+		{
+			wheel_distance += ((int64_t)truth[count-1] + truth[count]) * SIMULATOR_SAMPLE_PERIOD / 2;
+		}
+		frame->value[E_DATA_WHEEL_REVOLUTIONS] = (int32_t)(wheel_distance / circumference);
+
+		if(!is_in_tunnel)
+		{
+			int32_t glitch = (count % FUSION_GPS_GLITCH_PERIOD == 0) ? FUSION_GPS_GLITCH : 0;
+
+			frame->valid_mask |= data_channel_bit(E_DATA_GPS_SPEED) | data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE);
+			frame->value[E_DATA_GPS_SPEED] = truth[count] + glitch + (int32_t)lround(_random_normal(FUSION_GPS_SPEED_NOISE));
+			frame->value[E_DATA_LATITUDE] = value[E_SIMULATOR_LATITUDE] + (int32_t)lround(_random_normal(FUSION_GPS_POSITION_NOISE));
+			frame->value[E_DATA_LONGITUDE] = value[E_SIMULATOR_LONGITUDE] + (int32_t)lround(_random_normal(FUSION_GPS_POSITION_NOISE));
+			if(frame->value[E_DATA_GPS_SPEED] < 0)
+			{
+				frame->value[E_DATA_GPS_SPEED] = 0;
+			}
+		}
+
+		count++;
+	}
+
+	free(line);
+	fclose(fd);
+
+	return count;
+}
+
+static int _benchmark_speed_fusion(void)
+{
+	int ret = 0;
+	T_data_frame *frames = malloc(FUSION_MAX_SAMPLES * sizeof(T_data_frame));
+	int32_t *truth = malloc(FUSION_MAX_SAMPLES * sizeof(int32_t));
+
+	if(!frames || !truth)
+	{
+		log_error("malloc speed fusion arrays failed\n");
+		ret = -1;
+		goto fusion_cleanup;
+	}
+
+	int count = _load_fusion_scenario(frames, truth, FUSION_MAX_SAMPLES);
+	if(count < 2)
+	{
+		log_error("_load_fusion_scenario failed, return: %d\n", count);
+		ret = -2;
+		goto fusion_cleanup;
+	}
+
+	static const struct {
+		const char *name;
+		uint64_t mask; /* sensors given to the filter */
+	} cases[] = {
+		{"gps only",    data_channel_bit(E_DATA_GPS_SPEED) | data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE)},
+		{"wheel only",  data_channel_bit(E_DATA_WHEEL_REVOLUTIONS)},
+		{"wheel + gps", data_channel_bit(E_DATA_GPS_SPEED) | data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE) | data_channel_bit(E_DATA_WHEEL_REVOLUTIONS)},
+	};
+
+	double truth_distance = 0;
+	for(int i = 1; i < count; i++)
+	{
+		truth_distance += (truth[i-1] + truth[i]) / 2.0 * SIMULATOR_SAMPLE_PERIOD / 1e9;
+	}
+
+	printf("speed fusion, %s, %d samples, %d s tunnels every %d s:\n", FUSION_SCENARIO_PATH, count, FUSION_TUNNEL_LENGTH, FUSION_TUNNEL_PERIOD);
+	for(int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		T_speed_fusion fusion;
+		double square_error = 0;
+		int nb_errors = 0;
+		int nb_lost = 0;
+
+		speed_fusion_reset(&fusion, SPEED_FUSION_CIRCUMFERENCE(FUSION_WHEEL_SIZE));
+
+		double start = _get_time();
+		for(int i = 0; i < count; i++)
+		{
+			T_data_frame frame = frames[i];
+			frame.valid_mask &= cases[c].mask;
+
+			ret = speed_fusion_update(&fusion, &frame);
+			if(ret < 0)
+			{
+				log_error("speed_fusion_update failed, return: %d\n", ret);
+				goto fusion_cleanup;
+			}
+
+			if(fusion.has_speed)
+			{
+				double error = fusion.speed - truth[i];
+				square_error += error * error;
+				nb_errors++;
+			}
+			else
+			{
+				nb_lost++;
+			}
+		}
+		double elapsed = _get_time() - start;
+
+		printf("  %-12s speed rms error %6.3f m/s, distance %8.3f km for %8.3f km (%+.2f %%), %d samples without speed, %.0f ns/sample\n",
+			cases[c].name, nb_errors ? sqrt(square_error / nb_errors) / 1000 : 0.0, fusion.distance / 1e6, truth_distance,
+			(fusion.distance / 1e6 - truth_distance) / truth_distance * 100, nb_lost, elapsed / count * 1e9);
+	}
+
+fusion_cleanup:
+	free(frames);
+	free(truth);
+
+	return ret;
+}
+
+/* Sensor frames of the scenario as the simulator gives them, return the number of frames */
+static int _load_codec_scenario(T_data_frame *frames, int max_frames)
+{
+	FILE *fd = fopen(CODEC_SCENARIO_PATH, "r");
+	fail_if_null(fd, -1, "fopen %s failed\n", CODEC_SCENARIO_PATH);
+
+	char *line = NULL;
+	size_t len = 0;
+	int count = 0;
+
+	while(count < max_frames && getline(&line, &len, fd) != -1)
+	{
+		int32_t value[E_SIMULATOR_COLUMN_NUMBER];
+		if(line[0] == '#' || simulator_parse_line(line, value) < 0)
+		{
+			continue;
+		}
+
+		T_data_frame *frame = &frames[count];
+		memset(frame, 0, sizeof(*frame));
+		frame->valid_mask = data_channel_bit(E_DATA_LATITUDE) | data_channel_bit(E_DATA_LONGITUDE) | data_channel_bit(E_DATA_GPS_SPEED)
+			| data_channel_bit(E_DATA_ALTITUDE) | data_channel_bit(E_DATA_TEMPERATURE) | data_channel_bit(E_DATA_HEART_RATE)
+			| data_channel_bit(E_DATA_POWER) | data_channel_bit(E_DATA_CADENCE);
+		frame->value[E_DATA_LATITUDE] = value[E_SIMULATOR_LATITUDE];
+		frame->value[E_DATA_LONGITUDE] = value[E_SIMULATOR_LONGITUDE];
+		frame->value[E_DATA_GPS_SPEED] = (int32_t)fixed_point_mul_div(value[E_SIMULATOR_SPEED], 1000, 36);
+		frame->value[E_DATA_ALTITUDE] = value[E_SIMULATOR_ALTITUDE];
+		frame->value[E_DATA_TEMPERATURE] = value[E_SIMULATOR_TEMPERATURE];
+		frame->value[E_DATA_HEART_RATE] = value[E_SIMULATOR_HEART_RATE];
+		frame->value[E_DATA_POWER] = (int32_t)fixed_point_mul_div(value[E_SIMULATOR_POWER], 1, 10);
+		frame->value[E_DATA_CADENCE] = value[E_SIMULATOR_CADENCE];
+		count++;
+	}
+
+	free(line);
+	fclose(fd);
+
+	return count;
+}
+
+static int _benchmark_ride_log_codec(void)
+{
+	int ret = 0;
+	int nb_errors = 0;
+	int64_t raw_size = 0;
+	struct stat st;
+	T_ride_log_writer *writer = malloc(sizeof(T_ride_log_writer));
+	T_ride_log_reader *reader = malloc(sizeof(T_ride_log_reader));
+	T_data_frame *scenario = malloc(CODEC_NB_FRAMES * sizeof(T_data_frame));
+	T_data_frame *frames = malloc(CODEC_NB_FRAMES * sizeof(T_data_frame));
+
+	if(!writer || !reader || !scenario || !frames)
+	{
+		log_error("malloc ride log codec arrays failed\n");
+		ret = -1;
+		goto codec_cleanup;
+	}
+
+	int count = _load_codec_scenario(scenario, CODEC_NB_FRAMES);
+	if(count < 2)
+	{
+		log_error("_load_codec_scenario failed, return: %d\n", count);
+		ret = -2;
+		goto codec_cleanup;
+	}
+
+	/* Back and forth on the scenario, the track stays continuous */
+	for(int i = 0; i < CODEC_NB_FRAMES; i++)
+	{
+		int lap = i / (count - 1);
+		int index = i % (count - 1);
+
+		frames[i] = scenario[(lap % 2 == 0) ? index : count - 1 - index];
+		frames[i].timestamp = (int64_t)i * SIMULATOR_SAMPLE_PERIOD;
+		raw_size += sizeof(frames[i].timestamp) + sizeof(frames[i].valid_mask)
+			+ sizeof(frames[i].value[0]) * __builtin_popcountll(frames[i].valid_mask);
+	}
+
+	/* No flush period, the buffers are only written when full */
+	ret = ride_log_writer_open(writer, CODEC_LOG_PATH, 0, INT32_MAX, RIDE_LOG_BLOCK_SIZE, false);
+	if(ret < 0)
+	{
+		log_error("ride_log_writer_open failed, return: %d\n", ret);
+		ret = -3;
+		goto codec_cleanup;
+	}
+
+	double start = _get_time();
+	for(int i = 0; i < CODEC_NB_FRAMES && ret >= 0; i++)
+	{
+		ret = ride_log_writer_push(writer, &frames[i]);
+		if(ret == 1)
+		{
+			ret = ride_log_writer_flush(writer);
+		}
+	}
+	double encode_time = _get_time() - start;
+	if(ret < 0 || ride_log_writer_close(writer) < 0 || stat(CODEC_LOG_PATH, &st) < 0)
+	{
+		log_error("writing %s failed, return: %d\n", CODEC_LOG_PATH, ret);
+		ret = -4;
+		goto codec_cleanup;
+	}
+
+	/* Decoding the whole ride, as the charts are rebuilt */
+	ret = ride_log_reader_open(reader, CODEC_LOG_PATH);
+	if(ret < 0)
+	{
+		log_error("ride_log_reader_open failed, return: %d\n", ret);
+		ret = -5;
+		goto codec_cleanup;
+	}
+
+	int nb_read = 0;
+	T_data_frame frame;
+	start = _get_time();
+	while((ret = ride_log_reader_next(reader, &frame)) > 0)
+	{
+		if(nb_read >= CODEC_NB_FRAMES || frame.timestamp != frames[nb_read].timestamp || frame.valid_mask != frames[nb_read].valid_mask
+		|| memcmp(frame.value, frames[nb_read].value, sizeof(frame.value)) != 0)
+		{
+			nb_errors++;
+		}
+		nb_read++;
+	}
+	double decode_time = _get_time() - start;
+	ride_log_reader_close(reader);
+	if(ret < 0 || nb_read != CODEC_NB_FRAMES || nb_errors > 0)
+	{
+		log_error("%d frames read for %d, %d different, return: %d\n", nb_read, CODEC_NB_FRAMES, nb_errors, ret);
+		ret = -6;
+		goto codec_cleanup;
+	}
+
+	printf("ride log codec, %s replayed to %d frames (%d h at 1 Hz, 8 channels):\n", CODEC_SCENARIO_PATH, CODEC_NB_FRAMES, CODEC_NB_FRAMES / 3600);
+	printf("  %lld bytes raw, %lld bytes in the log with the block headers, ratio %.1f, %.2f B/frame\n",
+		(long long)raw_size, (long long)st.st_size, (double)raw_size / st.st_size, (double)st.st_size / CODEC_NB_FRAMES);
+	printf("  encode %.0f ns/frame with the writes, decode %.1f ms for the whole ride\n",
+		encode_time / CODEC_NB_FRAMES * 1e9, decode_time * 1e3);
+	ret = 0;
+
+codec_cleanup:
+	remove(CODEC_LOG_PATH);
+	free(writer);
+	free(reader);
+	free(scenario);
+	free(frames);
+
+	return ret;
+}
+
+/* Winding route starting at the geo kernel start, the distances are the ones of the route store */
+static int _build_benchmark_route(T_route *route, int nb_points)
+{
+	double latitude = GEO_START_LATITUDE;
+	double longitude = GEO_START_LONGITUDE;
+	double heading = 0;
+	int64_t total = 0;
+
+	memset(route, 0, sizeof(*route));
+	route->latitude = malloc(nb_points * sizeof(int32_t));
+	route->longitude = malloc(nb_points * sizeof(int32_t));
+	route->altitude = calloc(nb_points, sizeof(int32_t));
+	route->distance = malloc(nb_points * sizeof(int32_t));
+	fail_if_false((route->latitude && route->longitude && route->altitude && route->distance), -1, "malloc route arrays failed\n");
+
+	route->nb_points = nb_points;
+	route->entry.nb_points = nb_points;
+	for(int i = 0; i < nb_points; i++)
+	{
+		route->latitude[i] = (int32_t)lround(latitude * FIXED_POINT_COORDINATE_SCALE);
+		route->longitude[i] = (int32_t)lround(longitude * FIXED_POINT_COORDINATE_SCALE);
+
+		heading += ((double)rand() / RAND_MAX - 0.5) * 2 * ROUTE_HEADING_STEP;
+		latitude += ROUTE_SEGMENT_LENGTH * cos(heading) / GEO_KERNEL_EARTH_RADIUS_M * 180 / M_PI;
+		longitude += ROUTE_SEGMENT_LENGTH * sin(heading) / (GEO_KERNEL_EARTH_RADIUS_M * cos(latitude * M_PI / 180)) * 180 / M_PI;
+	}
+
+	T_geo_points_fixed points = {.latitude = route->latitude, .longitude = route->longitude, .count = nb_points};
+	int ret = geo_kernel_segment_distances_fixed(&points, route->distance + 1);
+	fail_if_negative(ret, -2, "geo_kernel_segment_distances_fixed failed, return: %d\n", ret);
+
+	T_route_store_box *box = &route->entry.box;
+	box->min_latitude = box->max_latitude = route->latitude[0];
+	box->min_longitude = box->max_longitude = route->longitude[0];
+	route->distance[0] = 0;
+	for(int i = 1; i < nb_points; i++)
+	{
+		total += route->distance[i];
+		route->distance[i] = (int32_t)(total / 10);
+		box->min_latitude = (route->latitude[i] < box->min_latitude) ? route->latitude[i] : box->min_latitude;
+		box->max_latitude = (route->latitude[i] > box->max_latitude) ? route->latitude[i] : box->max_latitude;
+		box->min_longitude = (route->longitude[i] < box->min_longitude) ? route->longitude[i] : box->min_longitude;
+		box->max_longitude = (route->longitude[i] > box->max_longitude) ? route->longitude[i] : box->max_longitude;
+	}
+
+	return 0;
+}
+
+/* Fixes along the route with the GPS noise and the detours, truth is the
+ * distance along the route, -1 during the detours
+ */
+static void _build_benchmark_fixes(const T_route *route, int32_t *latitude, int32_t *longitude, int32_t *truth)
+{
+	int segment = 0;
+	int32_t end = route->distance[route->nb_points - 1];
+
+	for(int i = 0; i < ROUTE_NB_FIXES; i++)
+	{
+		/* Back and forth on the route */
+		int32_t distance = (int32_t)(((int64_t)i * ROUTE_FIX_STEP) % (2 * (int64_t)end));
+		distance = (distance > end) ? 2 * end - distance : distance;
+		while(segment < route->nb_points - 2 && route->distance[segment + 1] < distance)
+		{
+			segment++;
+		}
+		while(segment > 0 && route->distance[segment] > distance)
+		{
+			segment--;
+		}
+
+		int64_t length = route->distance[segment + 1] - route->distance[segment];
+		int64_t position = distance - route->distance[segment];
+		double offset = (i % ROUTE_DETOUR_PERIOD >= ROUTE_DETOUR_PERIOD - ROUTE_DETOUR_LENGTH) ? ROUTE_DETOUR_OFFSET : 0;
+
+		/* 1e-7 degree is about 1.1 cm */
+		latitude[i] = fixed_point_lerp(route->latitude[segment], route->latitude[segment + 1], position, length > 0 ? length : 1)
+			+ (int32_t)lround((_random_normal(ROUTE_GPS_NOISE) + offset) / 1.11);
+		longitude[i] = fixed_point_lerp(route->longitude[segment], route->longitude[segment + 1], position, length > 0 ? length : 1)
+			+ (int32_t)lround(_random_normal(ROUTE_GPS_NOISE) / 1.11 / cos(GEO_START_LATITUDE * M_PI / 180));
+		truth[i] = (offset > 0) ? -1 : distance;
+	}
+}
+
+static int _benchmark_route_follow(void)
+{
+	static const int sizes[] = {3000, 30000, 300000}; /* 30, 300 and 3000 km */
+	int ret = 0;
+	T_route route = {0};
+	T_route_index index = {0};
+	T_route_index_match match;
+	T_route_index_match reference;
+	int32_t *latitude = malloc(ROUTE_NB_FIXES * sizeof(int32_t));
+	int32_t *longitude = malloc(ROUTE_NB_FIXES * sizeof(int32_t));
+	int32_t *truth = malloc(ROUTE_NB_FIXES * sizeof(int32_t));
+
+	if(!latitude || !longitude || !truth)
+	{
+		log_error("malloc route follow arrays failed\n");
+		ret = -1;
+		goto route_cleanup;
+	}
+
+	srand(1);
+	printf("route follow, %d fixes at %d cm with %.0f cm of noise, a %.0f m detour every %d fixes:\n", ROUTE_NB_FIXES, ROUTE_FIX_STEP,
+		ROUTE_GPS_NOISE, ROUTE_DETOUR_OFFSET / 100, ROUTE_DETOUR_PERIOD);
+	for(int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		if(_build_benchmark_route(&route, sizes[s]) < 0)
+		{
+			log_error("_build_benchmark_route failed\n");
+			ret = -2;
+			goto route_cleanup;
+		}
+		_build_benchmark_fixes(&route, latitude, longitude, truth);
+
+		double start = _get_time();
+		ret = route_index_build(&index, &route);
+		double build_time = _get_time() - start;
+		if(ret < 0)
+		{
+			log_error("route_index_build failed, return: %d\n", ret);
+			ret = -3;
+			goto route_cleanup;
+		}
+
+		/* The grid must give the distance of the linear scan */
+		int nb_errors = 0;
+		start = _get_time();
+		for(int i = 0; i < ROUTE_NB_LINEAR_FIXES; i++)
+		{
+			route_index_nearest_in_range(&index, latitude[i], longitude[i], 0, route.nb_points - 2, &reference);
+		}
+		double linear_time = (_get_time() - start) / ROUTE_NB_LINEAR_FIXES;
+
+		for(int i = 0; i < ROUTE_NB_LINEAR_FIXES; i++)
+		{
+			route_index_nearest_in_range(&index, latitude[i], longitude[i], 0, route.nb_points - 2, &reference);
+			route_index_nearest(&index, latitude[i], longitude[i], &match);
+			nb_errors += (match.off_route != reference.off_route);
+		}
+
+		int nb_jumps = 0;
+		start = _get_time();
+		for(int i = 0; i < ROUTE_NB_FIXES; i++)
+		{
+			route_index_nearest(&index, latitude[i], longitude[i], &match);
+			nb_jumps += (truth[i] >= 0 && abs(match.distance - truth[i]) > ROUTE_MAX_JUMP);
+		}
+		double grid_time = (_get_time() - start) / ROUTE_NB_FIXES;
+
+		int nb_follow_jumps = 0;
+		int segment = -1;
+		start = _get_time();
+		for(int i = 0; i < ROUTE_NB_FIXES; i++)
+		{
+			route_index_follow(&index, latitude[i], longitude[i], &segment, &match);
+			nb_follow_jumps += (truth[i] >= 0 && abs(match.distance - truth[i]) > ROUTE_MAX_JUMP);
+		}
+		double follow_time = (_get_time() - start) / ROUTE_NB_FIXES;
+
+		printf("  %d points, %d km, grid of %dx%d cells of %d m built in %.2f ms:\n", route.nb_points,
+			(int)(route.distance[route.nb_points - 1] / 100000), index.nb_columns, index.nb_rows, (int)(index.cell_size / 100), build_time * 1e3);
+		printf("    linear %10.0f ns/fix\n", linear_time * 1e9);
+		printf("    grid   %10.0f ns/fix, %d different from the linear scan, %d matches on route more than %d m from the truth\n",
+			grid_time * 1e9, nb_errors, nb_jumps, ROUTE_MAX_JUMP / 100);
+		printf("    follow %10.0f ns/fix, %d matches on route more than %d m from the truth\n", follow_time * 1e9, nb_follow_jumps, ROUTE_MAX_JUMP / 100);
+
+		route_index_free(&index);
+		free(route.latitude);
+		free(route.longitude);
+		free(route.altitude);
+		free(route.distance);
+		memset(&route, 0, sizeof(route));
+
+		if(nb_errors > 0)
+		{
+			log_error("the grid and the linear scan differ on %d fixes\n", nb_errors);
+			ret = -4;
+			goto route_cleanup;
+		}
+	}
+	ret = 0;
+
+route_cleanup:
+	route_index_free(&index);
+	free(route.latitude);
+	free(route.longitude);
+	free(route.altitude);
+	free(route.distance);
+	free(latitude);
+	free(longitude);
+	free(truth);
+
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(void);
+} benchmark_table[] = {
+	{"geo kernel", &_benchmark_geo_kernel},
+	{"speed fusion", &_benchmark_speed_fusion},
+	{"ride log codec", &_benchmark_ride_log_codec},
+	{"route follow", &_benchmark_route_follow},
+};
+
+int benchmark_run(void)
+{
+	int ret = 0;
+	int nb_failed = 0;
+
+	for(int i = 0; i < sizeof(benchmark_table) / sizeof(benchmark_table[0]); i++)
+	{
+		ret = benchmark_table[i].run();
+		if(ret < 0)
+		{
+			log_error("benchmark %s failed, return: %d\n", benchmark_table[i].name, ret);
+			nb_failed++;
+		}
+	}
+
+	fail_if_not_zero(nb_failed, -1, "%d benchmark(s) failed\n", nb_failed);
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CRC32_HEADER_
+#define _CRC32_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT (0xFFFFFFFFu)
+
+/* CRC-32 (IEEE 802.3, as zlib and FIT) of a buffer, crc32_update can be chained
+ * over several buffers starting from CRC32_INIT, crc32_final gives the result
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size);
+
+static inline uint32_t crc32_final(uint32_t crc)
+{
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static inline uint32_t crc32_compute(const void *data, size_t size)
+{
+	return crc32_final(crc32_update(CRC32_INIT, data, size));
+}
+
+#endif //_CRC32_HEADER_
@@ -100,7 +100,7 @@ int fifo_push(T_fifo *fifo, void *element)
 	fifo->write_index++;
 	fifo->element_count++;
 
-	if(fifo->write_index > fifo->nb_element)
+	if(fifo->write_index >= fifo->nb_element)
 	{
 		fifo->write_index = 0;
 	}
@@ -142,7 +142,7 @@ static int _pop(T_fifo *fifo, void *element)
 	fifo->read_index++;
 	fifo->element_count--;
 
-	if(fifo->read_index > fifo->nb_element)
+	if(fifo->read_index >= fifo->nb_element)
 	{
 		fifo->read_index = 0;
 	}
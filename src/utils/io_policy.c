@@ -0,0 +1,236 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+#include "utils.h"
+#include "io_policy.h"
+
+typedef struct {
+	E_io_policy_source source;
+	char path[IO_POLICY_PATH_SIZE];
+} T_deferred_sync;
+
+static struct {
+	pthread_mutex_t mutex; /* protect the deferred files and the counters */
+	bool is_window_open;
+	int nb_deferred;
+	T_deferred_sync deferred[IO_POLICY_MAX_DEFERRED];
+	T_io_policy_stats stats[E_IO_POLICY_SOURCE_NUMBER];
+} io_policy = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.is_window_open = false,
+	.nb_deferred = 0,
+};
+
+static const char *_get_source_name(E_io_policy_source source)
+{
+	switch(source)
+	{
+		case E_IO_POLICY_RIDE_LOG:
+			return "ride log";
+		case E_IO_POLICY_RIDE_FILES:
+			return "ride files";
+		case E_IO_POLICY_CONFIG:
+			return "config";
+		default:
+			return "invalid";
+	}
+}
+
+static int _sync_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	fail_if_negative(fd, -1, "open %s failed, errno: %d\n", path, errno);
+
+	int ret = fsync(fd);
+	close(fd);
+	fail_if_negative(ret, -2, "fsync %s failed, errno: %d\n", path, errno);
+
+	return 0;
+}
+
+/* Sync the deferred files, the list is emptied first so the writers never wait for the flash */
+static int _sync_deferred(void)
+{
+	int ret = 0;
+	int nb_deferred = 0;
+	T_deferred_sync deferred[IO_POLICY_MAX_DEFERRED];
+
+	pthread_mutex_lock(&io_policy.mutex);
+	nb_deferred = io_policy.nb_deferred;
+	memcpy(deferred, io_policy.deferred, nb_deferred * sizeof(deferred[0]));
+	io_policy.nb_deferred = 0;
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	for(int i = 0; i < nb_deferred; i++)
+	{
+		if(_sync_file(deferred[i].path) < 0)
+		{
+			log_error("_sync_file %s failed\n", deferred[i].path);
+			ret = -1;
+			continue;
+		}
+
+		io_policy_account(deferred[i].source, 0, 0, 1);
+	}
+
+	return ret;
+}
+
+int io_policy_open_window(void)
+{
+	pthread_mutex_lock(&io_policy.mutex);
+	io_policy.is_window_open = true;
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	return 0;
+}
+
+int io_policy_close_window(void)
+{
+	pthread_mutex_lock(&io_policy.mutex);
+	io_policy.is_window_open = false;
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	int ret = _sync_deferred();
+	fail_if_negative(ret, -1, "_sync_deferred failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int io_policy_sync(E_io_policy_source source, const char *path)
+{
+	fail_if_negative(source, -1, "invalid source %d\n", source);
+	fail_if_superior_or_equal(source, E_IO_POLICY_SOURCE_NUMBER, -2, "invalid source %d\n", source);
+	fail_if_null(path, -3, "path is null\n");
+	fail_if_superior_or_equal(strlen(path), IO_POLICY_PATH_SIZE, -4, "path %s is too long\n", path);
+
+	int ret = 0;
+	bool is_deferred = false;
+
+	pthread_mutex_lock(&io_policy.mutex);
+	if(io_policy.is_window_open)
+	{
+		/* A file written twice in the window is synced once */
+		is_deferred = true;
+		for(int i = 0; i < io_policy.nb_deferred; i++)
+		{
+			if(strcmp(io_policy.deferred[i].path, path) == 0)
+			{
+				pthread_mutex_unlock(&io_policy.mutex);
+				return 0;
+			}
+		}
+
+		if(io_policy.nb_deferred < IO_POLICY_MAX_DEFERRED)
+		{
+			io_policy.deferred[io_policy.nb_deferred].source = source;
+			safe_strncpy(io_policy.deferred[io_policy.nb_deferred].path, path, IO_POLICY_PATH_SIZE);
+			io_policy.nb_deferred++;
+		}
+		else
+		{
+			is_deferred = false;
+		}
+	}
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	if(!is_deferred)
+	{
+		ret = _sync_file(path);
+		fail_if_negative(ret, -5, "_sync_file %s failed, return: %d\n", path, ret);
+
+		io_policy_account(source, 0, 0, 1);
+	}
+
+	return 0;
+}
+
+int io_policy_flush(void)
+{
+	int ret = _sync_deferred();
+	fail_if_negative(ret, -1, "_sync_deferred failed, return: %d\n", ret);
+
+	return 0;
+}
+
+int io_policy_account(E_io_policy_source source, int64_t requested, int64_t written, int nb_syncs)
+{
+	fail_if_negative(source, -1, "invalid source %d\n", source);
+	fail_if_superior_or_equal(source, E_IO_POLICY_SOURCE_NUMBER, -2, "invalid source %d\n", source);
+
+	pthread_mutex_lock(&io_policy.mutex);
+	T_io_policy_stats *stats = &io_policy.stats[source];
+	stats->bytes_requested += requested;
+	stats->bytes_written += written;
+	stats->nb_writes += (written > 0) ? 1 : 0;
+	stats->nb_syncs += nb_syncs;
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	return 0;
+}
+
+int io_policy_get_stats(E_io_policy_source source, T_io_policy_stats *stats)
+{
+	fail_if_negative(source, -1, "invalid source %d\n", source);
+	fail_if_superior_or_equal(source, E_IO_POLICY_SOURCE_NUMBER, -2, "invalid source %d\n", source);
+	fail_if_null(stats, -3, "stats is null\n");
+
+	pthread_mutex_lock(&io_policy.mutex);
+	*stats = io_policy.stats[source];
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	return 0;
+}
+
+int io_policy_reset_stats(void)
+{
+	pthread_mutex_lock(&io_policy.mutex);
+	memset(io_policy.stats, 0, sizeof(io_policy.stats));
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	return 0;
+}
+
+int io_policy_dump(void)
+{
+	T_io_policy_stats stats[E_IO_POLICY_SOURCE_NUMBER];
+
+	pthread_mutex_lock(&io_policy.mutex);
+	memcpy(stats, io_policy.stats, sizeof(stats));
+	pthread_mutex_unlock(&io_policy.mutex);
+
+	for(int i = 0; i < E_IO_POLICY_SOURCE_NUMBER; i++)
+	{
+		/* Hundredths, no float on the write path */
+		int64_t amplification = (stats[i].bytes_requested > 0) ? stats[i].bytes_written * 100 / stats[i].bytes_requested : 0;
+
+		log_info("io %s: %lld bytes requested, %lld bytes written in %d writes and %d syncs, write amplification %lld.%02lld\n",
+			_get_source_name(i), (long long)stats[i].bytes_requested, (long long)stats[i].bytes_written, stats[i].nb_writes,
+			stats[i].nb_syncs, (long long)(amplification / 100), (long long)(amplification % 100));
+	}
+
+	return 0;
+}
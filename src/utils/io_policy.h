@@ -0,0 +1,68 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IO_POLICY_HEADER_
+#define _IO_POLICY_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IO_POLICY_MAX_DEFERRED 8 /* files waiting for the flush window */
+#define IO_POLICY_PATH_SIZE 128
+
+/* Writes to the flash, by origin */
+typedef enum {
+	E_IO_POLICY_RIDE_LOG = 0,
+	E_IO_POLICY_RIDE_FILES, /* files written at the end of the ride */
+	E_IO_POLICY_CONFIG,
+	E_IO_POLICY_SOURCE_NUMBER, // must be last
+} E_io_policy_source;
+
+typedef struct {
+	int64_t bytes_requested; /* data the writer needed to store */
+	int64_t bytes_written; /* data given to the file system, rewrites and padding included */
+	int32_t nb_writes;
+	int32_t nb_syncs;
+} T_io_policy_stats;
+
+/* Each sync wakes the flash and programs partial pages, the small files are
+ * not synced on their own while a flush window is open: their sync is
+ * deferred to the next flush of the ride log, all the dirty data of the
+ * device then goes to the flash at once.
+ */
+int io_policy_open_window(void);
+
+/* Sync the deferred files and sync the next ones immediately */
+int io_policy_close_window(void);
+
+/* The file was written, sync it now or with the next flush when the window is open */
+int io_policy_sync(E_io_policy_source source, const char *path);
+
+/* Sync the deferred files, called by the owner of the window after its own sync */
+int io_policy_flush(void);
+
+/* Count a write and the syncs it needed, in bytes */
+int io_policy_account(E_io_policy_source source, int64_t requested, int64_t written, int nb_syncs);
+
+int io_policy_get_stats(E_io_policy_source source, T_io_policy_stats *stats);
+int io_policy_reset_stats(void);
+
+/* Log the counters and the write amplification of each source */
+int io_policy_dump(void);
+
+#endif //_IO_POLICY_HEADER_
@@ -0,0 +1,198 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "record_file.h"
+
+#define RECORD_FILE_TMP_EXTENSION ".tmp"
+#define RECORD_FILE_PATH_SIZE 256
+
+/* Header of the file, followed by the records */
+typedef struct {
+	char magic[RECORD_FILE_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t nb_records;
+} T_record_file_header;
+
+static int _write_all(int fd, const void *buff, size_t size)
+{
+	const char *p = buff;
+
+	while(size > 0)
+	{
+		ssize_t ret = write(fd, p, size);
+		if(ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		fail_if_negative_or_zero(ret, -1, "write failed, errno: %d\n", errno);
+
+		p += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+/* The rename is only durable once the directory is synced */
+static int _sync_directory(const char *path)
+{
+	char directory[RECORD_FILE_PATH_SIZE];
+	const char *slash = strrchr(path, '/');
+	int length = (slash == NULL) ? 1 : (int)(slash - path);
+
+	fail_if_superior_or_equal(length, (int)sizeof(directory), -1, "path %s is too long\n", path);
+	memcpy(directory, (slash == NULL) ? "." : path, length);
+	directory[length] = '\0';
+
+	int fd = open(directory, O_RDONLY | O_DIRECTORY);
+	fail_if_negative(fd, -2, "open %s failed, errno: %d\n", directory, errno);
+
+	int ret = fsync(fd);
+	close(fd);
+	fail_if_negative(ret, -3, "fsync %s failed, errno: %d\n", directory, errno);
+
+	return 0;
+}
+
+int record_file_open(T_record_file *file, const char *path, const char *magic, uint32_t version, uint32_t record_size)
+{
+	fail_if_null(file, -1, "file is null\n");
+	fail_if_null(path, -2, "path is null\n");
+	fail_if_null(magic, -3, "magic is null\n");
+
+	int ret = 0;
+	struct stat st;
+
+	file->map = NULL;
+	file->size = 0;
+	file->nb_records = 0;
+	file->records = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0 && errno == ENOENT)
+	{
+		return 0;
+	}
+	fail_if_negative(fd, -4, "open %s failed, errno: %d\n", path, errno);
+
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(T_record_file_header))
+	{
+		log_error("%s is too short\n", path);
+		ret = -5;
+		goto open_cleanup;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		log_error("mmap %s failed, errno: %d\n", path, errno);
+		ret = -6;
+		goto open_cleanup;
+	}
+
+	const T_record_file_header *header = map;
+	if(memcmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != version || header->record_size != record_size
+	|| (size_t)st.st_size < sizeof(T_record_file_header) + (size_t)header->nb_records * record_size)
+	{
+		log_error("%s is not a valid %.4s file\n", path, magic);
+		munmap(map, st.st_size);
+		ret = -7;
+		goto open_cleanup;
+	}
+
+	file->map = map;
+	file->size = st.st_size;
+	file->nb_records = header->nb_records;
+	file->records = header + 1;
+
+open_cleanup:
+	/* The mapping stays valid without the file descriptor */
+	close(fd);
+
+	return ret;
+}
+
+int record_file_close(T_record_file *file)
+{
+	fail_if_null(file, -1, "file is null\n");
+
+	if(file->map != NULL)
+	{
+		munmap(file->map, file->size);
+	}
+
+	file->map = NULL;
+	file->size = 0;
+	file->nb_records = 0;
+	file->records = NULL;
+
+	return 0;
+}
+
+int record_file_append(const char *path, const char *magic, uint32_t version, uint32_t record_size, const T_record_file *file,
+	const void *record)
+{
+	fail_if_null(path, -1, "path is null\n");
+	fail_if_null(magic, -2, "magic is null\n");
+	fail_if_null(file, -3, "file is null\n");
+	fail_if_null(record, -4, "record is null\n");
+
+	int ret = 0;
+	char tmp_path[RECORD_FILE_PATH_SIZE];
+	T_record_file_header header = {.version = version, .record_size = record_size, .nb_records = file->nb_records + 1};
+
+	memcpy(header.magic, magic, sizeof(header.magic));
+	ret = snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, RECORD_FILE_TMP_EXTENSION);
+	fail_if_superior_or_equal(ret, (int)sizeof(tmp_path), -5, "path %s is too long\n", path);
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	fail_if_negative(fd, -6, "open %s failed, errno: %d\n", tmp_path, errno);
+
+	if(_write_all(fd, &header, sizeof(header)) < 0
+	|| _write_all(fd, file->records, (size_t)file->nb_records * record_size) < 0
+	|| _write_all(fd, record, record_size) < 0
+	|| fsync(fd) < 0)
+	{
+		log_error("writing %s failed, errno: %d\n", tmp_path, errno);
+		close(fd);
+		remove(tmp_path);
+		return -7;
+	}
+	close(fd);
+
+	if(rename(tmp_path, path) < 0)
+	{
+		log_error("rename %s failed, errno: %d\n", tmp_path, errno);
+		remove(tmp_path);
+		return -8;
+	}
+
+	ret = _sync_directory(path);
+	fail_if_negative(ret, -9, "_sync_directory failed, return: %d\n", ret);
+
+	return 0;
+}
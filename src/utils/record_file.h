@@ -0,0 +1,53 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RECORD_FILE_HEADER_
+#define _RECORD_FILE_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* File of fixed size records after a small header with a magic, a version
+ * and the size of a record, read with a single mmap. A record is added by
+ * writing the whole file next to it and renaming it over it, a power cut
+ * leaves either the old or the new file.
+ */
+
+#define RECORD_FILE_MAGIC_SIZE 4
+
+/* Records mapped read-only */
+typedef struct {
+	void *map;
+	size_t size;
+	int nb_records;
+	const void *records;
+} T_record_file;
+
+/* A missing file is opened empty, a file with another magic, version or
+ * record size is an error
+ */
+int record_file_open(T_record_file *file, const char *path, const char *magic, uint32_t version, uint32_t record_size);
+int record_file_close(T_record_file *file);
+
+/* Replace the file at path with the records of file followed by record,
+ * file is the one opened on path
+ */
+int record_file_append(const char *path, const char *magic, uint32_t version, uint32_t record_size, const T_record_file *file,
+	const void *record);
+
+#endif //_RECORD_FILE_HEADER_
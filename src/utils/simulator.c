@@ -22,10 +22,52 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <pthread.h>
-#include <errno.h>
 #include "log.h"
+#include "data_manager.h"
+#include "data.h"
+#include "data_recorder.h"
+#include "fixed_point.h"
+#include "bike_config.h"
+#include "speed_fusion.h"
 #include "simulator.h"
 
+int simulator_parse_line(const char *line, int32_t value[E_SIMULATOR_COLUMN_NUMBER])
+{
+	fail_if_null(line, -1, "line is NULL\n");
+
+	int ret = 0;
+	const char *end = line;
+
+	for(int i = 0; i < E_SIMULATOR_COLUMN_NUMBER; i++)
+	{
+		int decimals = (i == E_SIMULATOR_LATITUDE || i == E_SIMULATOR_LONGITUDE) ? FIXED_POINT_COORDINATE_DECIMALS : 0;
+
+		ret = fixed_point_parse(end, decimals, &value[i], &end);
+		fail_if_negative(ret, -2, "column %d is not a number\n", i);
+
+		/* The separator after the last column is optional */
+		if(*end == ';')
+		{
+			end++;
+		}
+		else if(i != E_SIMULATOR_COLUMN_NUMBER - 1)
+		{
+			fail(-3, "column %d is not terminated by ';'\n", i);
+		}
+	}
+
+	return 0;
+}
+
+static void _push(E_data_channel channel, int64_t timestamp, int32_t value)
+{
+	int ret = data_manager_push(channel, timestamp, value);
+	if(ret < 0)
+	{
+		log_error("data_manager_push channel %d failed, return: %d\n", channel, ret);
+	}
+}
+
 static struct {
 	bool is_initialized;
 	pthread_t simu_thread;
@@ -43,7 +85,15 @@ static void * simu_thread_handler(void *data)
     char * line = NULL;
     size_t len = 0;
     ssize_t read;
+	int ret = 0;
 	int line_counter = 0;
+	int64_t timestamp = 0;
+	int64_t wheel_distance = 0; /* um, wheel sensor simulated from the file speed */
+	int32_t speed = 0; /* mm/s */
+	int32_t previous_speed = 0;
+	bool has_previous_speed = false;
+	int32_t circumference = SPEED_FUSION_CIRCUMFERENCE(bike_config_get_wheel_size());
+	fail_if_negative_or_zero(circumference, NULL, "invalid wheel size\n");
 
 	if(access(file, F_OK) != 0)
 	{
@@ -54,6 +104,20 @@ static void * simu_thread_handler(void *data)
 	fd = fopen(file, "r");
 	fail_if_null(fd, NULL, "fopen failed\n");
 
+	/* The simulation file is one ride, or goes on with the interrupted one once the rider chose */
+	ret = data_recorder_wait_interrupted_ride();
+	if(ret < 0)
+	{
+		log_error("data_recorder_wait_interrupted_ride failed, return: %d\n", ret);
+	}
+	else if(ret == 0 && data_start_ride() < 0)
+	{
+		log_error("data_start_ride failed\n");
+	}
+
+	/* Samples are replayed in real time from now */
+	timestamp = data_manager_get_time();
+
 	while ((read = getline(&line, &len, fd)) != -1) {
 		/* Count line read in file */
 		line_counter++;
@@ -64,34 +128,52 @@ static void * simu_thread_handler(void *data)
 			continue;
 		}
 
-		/* Use sscanf to get the value for each of the following parameter */
 		/* latitude;longitude;speed;altitude;temperature;heart rate;power;cadence; */
-
-		/* Value to get from each line */
-		float latitude = 0;
-		float longitude = 0;
-		int speed = 0;
-		int altitude = 0;
-		int temperature = 0;
-		int heart_rate = 0;
-		int power = 0;
-		int cadence = 0;
-
-		/* extract the value from the string readed */
-		errno = 0;
-		int ret = sscanf(line, "%f;%f;%d;%d;%d;%d;%d;%d;", &latitude, &longitude, &speed, &altitude, &temperature, &heart_rate, &power, &cadence);
-		if (ret != 8 || errno != 0) {
+		int32_t value[E_SIMULATOR_COLUMN_NUMBER];
+		if(simulator_parse_line(line, value) < 0)
+		{
 			log_error("simulation file %s, line %d is malformed, ignoring it\n", file, line_counter);
 			continue;
 		}
 
-		/* push value to the data manager */
-		printf("Value read:%f;%f;%d;%d;%d;%d;%d;%d\n", latitude, longitude, speed, altitude,temperature, heart_rate, power, cadence);
+		log_debug("Value read:%d;%d;%d;%d;%d;%d;%d;%d\n", value[E_SIMULATOR_LATITUDE], value[E_SIMULATOR_LONGITUDE], value[E_SIMULATOR_SPEED], value[E_SIMULATOR_ALTITUDE],
+			value[E_SIMULATOR_TEMPERATURE], value[E_SIMULATOR_HEART_RATE], value[E_SIMULATOR_POWER], value[E_SIMULATOR_CADENCE]);
+
+		/* push value to the data manager, the file stores speed in 0.1 km/h,
+		 * altitude in cm, temperature in 0.1 degree and power in 0.1 W
+		 */
+		speed = (int32_t)fixed_point_mul_div(value[E_SIMULATOR_SPEED], 1000, 36);
+		_push(E_DATA_LATITUDE, timestamp, value[E_SIMULATOR_LATITUDE]);
+		_push(E_DATA_LONGITUDE, timestamp, value[E_SIMULATOR_LONGITUDE]);
+		_push(E_DATA_GPS_SPEED, timestamp, speed);
+		_push(E_DATA_ALTITUDE, timestamp, value[E_SIMULATOR_ALTITUDE]);
+		_push(E_DATA_TEMPERATURE, timestamp, value[E_SIMULATOR_TEMPERATURE]);
+		_push(E_DATA_HEART_RATE, timestamp, value[E_SIMULATOR_HEART_RATE]);
+		_push(E_DATA_POWER, timestamp, (int32_t)fixed_point_mul_div(value[E_SIMULATOR_POWER], 1, 10));
+		_push(E_DATA_CADENCE, timestamp, value[E_SIMULATOR_CADENCE]);
+
+		/* The wheel sensor counts the distance covered since the previous sample */
+		if(has_previous_speed)
+		{
+			wheel_distance += ((int64_t)previous_speed + speed) * SIMULATOR_SAMPLE_PERIOD / 2;
+		}
+		previous_speed = speed;
+		has_previous_speed = true;
+		_push(E_DATA_WHEEL_REVOLUTIONS, timestamp, (int32_t)(wheel_distance / circumference));
+
+		/* Wait for the next sample */
+		timestamp += SIMULATOR_SAMPLE_PERIOD;
+		usleep(SIMULATOR_SAMPLE_PERIOD * 1000);
 	}
 
 	/* Close the file */
 	fclose(fd);
 
+	if(data_stop_ride() < 0)
+	{
+		log_error("data_stop_ride failed\n");
+	}
+
 	/* Cleanup the line buffer if necessary */
 	if (line)
 	{
@@ -18,6 +18,29 @@
 #ifndef _SIMULATOR_HEADER_
 #define _SIMULATOR_HEADER_
 
+#include <stdint.h>
+
+/* Each line of the simulation file is one sample per sensor */
+#define SIMULATOR_SAMPLE_PERIOD 1000 /* ms */
+
+/* Columns of the simulation file */
+typedef enum {
+	E_SIMULATOR_LATITUDE = 0, /* degree */
+	E_SIMULATOR_LONGITUDE, /* degree */
+	E_SIMULATOR_SPEED, /* 0.1 km/h */
+	E_SIMULATOR_ALTITUDE, /* cm */
+	E_SIMULATOR_TEMPERATURE, /* 0.1 degree Celsius */
+	E_SIMULATOR_HEART_RATE, /* bpm */
+	E_SIMULATOR_POWER, /* 0.1 W */
+	E_SIMULATOR_CADENCE, /* rpm */
+	E_SIMULATOR_COLUMN_NUMBER, // must be last
+} E_simulator_column;
+
 int simulator_init(char *file_path);
 
+/* Parse the ';' separated columns of a line, the coordinates are read
+ * straight in 1e-7 degree, a float would lose the last decimals
+ */
+int simulator_parse_line(const char *line, int32_t value[E_SIMULATOR_COLUMN_NUMBER]);
+
 #endif //_SIMULATOR_HEADER_
@@ -0,0 +1,92 @@
+/*
+	OpenBikeComputer core application
+    Copyright (C) 2023  LAMBS Pierre-Antoine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VARINT_HEADER_
+#define _VARINT_HEADER_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* LEB128 varints, 7 bits per byte with the high bit set on all the bytes but
+ * the last, the signed values are zigzag encoded first so that the small
+ * negative values are short too
+ */
+
+#define VARINT_MAX_SIZE 10 /* 64 bits */
+
+static inline uint64_t varint_zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t varint_unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline int varint_size(uint64_t value)
+{
+	int size = 1;
+
+	while(value >= 0x80)
+	{
+		value >>= 7;
+		size++;
+	}
+
+	return size;
+}
+
+/* Return the number of bytes written, at most VARINT_MAX_SIZE */
+static inline int varint_put(uint8_t *buff, uint64_t value)
+{
+	int size = 0;
+
+	while(value >= 0x80)
+	{
+		buff[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buff[size++] = (uint8_t)value;
+
+	return size;
+}
+
+/* Read the varint at position of a buffer of size bytes and move position
+ * after it, return false when the varint is truncated or too long
+ */
+static inline bool varint_get(const uint8_t *buff, int size, int *position, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	for(int shift = 0; shift < 64 && *position < size; shift += 7)
+	{
+		uint8_t byte = buff[(*position)++];
+
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if(byte < 0x80)
+		{
+			*value = result;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif //_VARINT_HEADER_